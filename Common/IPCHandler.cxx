@@ -3,6 +3,8 @@
 #include <cstring>
 #include <iostream>
 #include <cerrno>
+#include <chrono>
+#include <climits>
 
 #ifdef WIN32
   #ifdef _WIN32_WINNT
@@ -24,8 +26,31 @@
   #include <sys/time.h>
 #endif
 
+#ifdef __linux__
+  #include <linux/futex.h>
+  #include <sys/syscall.h>
+  #include <ctime>
+#endif
+
 using namespace std;
 
+#ifdef __linux__
+// There is no glibc wrapper for futex. Listeners live in other processes, so
+// the non-private operations are used
+static long futex(int *addr, int op, int val, const struct timespec *timeout)
+{
+  return syscall(SYS_futex, addr, op, val, timeout, NULL, 0);
+}
+#endif
+
+// Time stamp used to measure the latency of the messages. The steady clock
+// is system-wide, so it can be compared between processes
+static long long GetTimeStamp()
+{
+  return chrono::duration_cast<chrono::microseconds>(
+        chrono::steady_clock::now().time_since_epoch()).count();
+}
+
 void IPCHandler::Attach(const char *path, short version, size_t message_size)
 {
   // Initialize the data pointer
@@ -170,6 +195,13 @@ bool IPCHandler::ReadIfNew(void *target_ptr)
   // Copy the message to the target pointer
   memcpy(target_ptr, m_UserData, m_MessageSize);
 
+  // Keep track of the time it took for the message to get here
+  double latency = (GetTimeStamp() - header->broadcast_time) / 1000.0;
+  m_MessagesReceived++;
+  m_TotalLatency += latency;
+  if(latency > m_MaxLatency)
+    m_MaxLatency = latency;
+
   // Success!
   return true;
 }
@@ -194,6 +226,15 @@ IPCHandler
 
     // Copy the message contents into the shared memory
     memcpy(m_UserData, message_ptr, m_MessageSize);
+    header->broadcast_time = GetTimeStamp();
+
+    // Wake up the processes that are waiting for a message
+#ifdef __linux__
+    __atomic_add_fetch(&header->notify_counter, 1, __ATOMIC_SEQ_CST);
+    futex(&header->notify_counter, FUTEX_WAKE, INT_MAX, NULL);
+#else
+    header->notify_counter++;
+#endif
 
     // Done
     return true;
@@ -202,8 +243,83 @@ IPCHandler
   return false;
 }
 
+bool IPCHandler::IsNotificationSupported() const
+{
+#ifdef __linux__
+  return m_SharedData != NULL;
+#else
+  return false;
+#endif
+}
+
+bool IPCHandler::StartListening(std::function<void()> callback)
+{
+  if(!this->IsNotificationSupported())
+    return false;
+
+  this->StopListening();
+  m_StopListening = false;
+  m_ListenerThread = std::thread(&IPCHandler::Listen, this, callback);
+  return true;
+}
+
+void IPCHandler::StopListening()
+{
+  if(!m_ListenerThread.joinable())
+    return;
+
+  m_StopListening = true;
+
+#ifdef __linux__
+  // Wake up the listener. The listeners of other processes are woken up too,
+  // but they will see that there is no new message and wait again
+  Header *header = static_cast<Header *>(m_SharedData);
+  futex(&header->notify_counter, FUTEX_WAKE, INT_MAX, NULL);
+#endif
+
+  m_ListenerThread.join();
+}
+
+void IPCHandler::Listen(std::function<void()> callback)
+{
+#ifdef __linux__
+  Header *header = static_cast<Header *>(m_SharedData);
+  int seen = __atomic_load_n(&header->notify_counter, __ATOMIC_ACQUIRE);
+  while(!m_StopListening)
+    {
+    // Wait for the counter to change. The timeout is only a safeguard
+    struct timespec timeout = { 1, 0 };
+    long rc = futex(&header->notify_counter, FUTEX_WAIT, seen, &timeout);
+    if(m_StopListening)
+      break;
+
+    int current = __atomic_load_n(&header->notify_counter, __ATOMIC_ACQUIRE);
+    if(current == seen)
+      {
+      if(rc == 0 || errno != ETIMEDOUT)
+        m_SpuriousWakeups++;
+      continue;
+      }
+
+    seen = current;
+    m_Wakeups++;
+
+    // Our own broadcasts don't need to be read
+    if(header->sender_pid != m_ProcessID)
+      callback();
+    }
+#endif
+}
+
+double IPCHandler::GetMeanLatency() const
+{
+  return m_MessagesReceived ? m_TotalLatency / m_MessagesReceived : 0.0;
+}
+
 void IPCHandler::Close()
 {
+  this->StopListening();
+
 #ifdef WIN32
   CloseHandle(m_Handle);
 #else
@@ -231,6 +347,14 @@ IPCHandler::IPCHandler()
   // Reset the shared memory
   m_SharedData = NULL;
 
+  // Reset the listener and the counters
+  m_StopListening = false;
+  m_Wakeups = 0;
+  m_SpuriousWakeups = 0;
+  m_MessagesReceived = 0;
+  m_TotalLatency = 0.0;
+  m_MaxLatency = 0.0;
+
   // Get the process ID
 #ifdef WIN32
   m_ProcessID = _getpid();
@@ -241,5 +365,5 @@ IPCHandler::IPCHandler()
 
 IPCHandler::~IPCHandler()
 {
-
+  this->StopListening();
 }
@@ -1,8 +1,11 @@
 #ifndef IPCHANDLER_H
 #define IPCHANDLER_H
 
+#include <atomic>
 #include <cstddef>
+#include <functional>
 #include <set>
+#include <thread>
 
 /**
  * Base class for IPCHandler. This class contains the definitions of the
@@ -40,6 +43,39 @@ public:
   /** Broadcast a 'message' (i.e. replace shared memory contents */
   bool Broadcast(const void *message_ptr);
 
+  /**
+   * Whether other processes can be notified when a message is broadcast, so
+   * that they don't have to poll the shared memory. Currently this is only
+   * supported on Linux, where the listeners wait on a futex that is stored in
+   * the shared memory block.
+   */
+  bool IsNotificationSupported() const;
+
+  /**
+   * Start a thread that waits for messages broadcast by other processes and
+   * calls the callback each time there is one. The callback is called from
+   * that thread, so it should only schedule a call to ReadIfNew() on the
+   * main thread. Returns false if notifications are not supported, in which
+   * case the caller should poll ReadIfNew() instead.
+   */
+  bool StartListening(std::function<void()> callback);
+
+  /** Stop the listening thread. This is also done by Close() */
+  void StopListening();
+
+  /** Number of times the listening thread was woken up by a new message */
+  unsigned long GetNumberOfWakeups() const { return m_Wakeups; }
+
+  /** Number of times the listening thread was woken up with no new message */
+  unsigned long GetNumberOfSpuriousWakeups() const { return m_SpuriousWakeups; }
+
+  /** Number of messages read by ReadIfNew() */
+  unsigned long GetNumberOfMessagesReceived() const { return m_MessagesReceived; }
+
+  /** Mean and maximum time between Broadcast() and ReadIfNew(), in ms */
+  double GetMeanLatency() const;
+  double GetMaxLatency() const { return m_MaxLatency; }
+
 protected:
 
   struct Header
@@ -47,6 +83,12 @@ protected:
     short version;
     long sender_pid;
     long message_id;
+
+    // Time of the broadcast (steady clock, in microseconds)
+    long long broadcast_time;
+
+    // Incremented by each broadcast; listeners wait on this value
+    int notify_counter;
   };
 
 
@@ -78,6 +120,18 @@ protected:
 
   // List of known process ids, with status (0 = alive, -1 = dead)
   std::set<long> m_KnownDeadPIDs;
+
+  // Listening thread and the flag used to stop it
+  std::thread m_ListenerThread;
+  std::atomic<bool> m_StopListening;
+
+  // Listening loop, executed by the thread
+  void Listen(std::function<void()> callback);
+
+  // Counters
+  std::atomic<unsigned long> m_Wakeups, m_SpuriousWakeups;
+  unsigned long m_MessagesReceived;
+  double m_TotalLatency, m_MaxLatency;
 };
 
 
@@ -279,43 +279,24 @@ bool Generic3DModel::AcceptAction()
   // Accept the current action
   if(mode == SPRAYPAINT_MODE)
     {
-    // Anything to update?
-    bool update = false;
-
-    // Merge all the spray points into the segmentation
+    // Find the spray points in image coordinates
+    std::vector<itk::Index<3> > voxels(m_SprayPoints->GetNumberOfPoints());
     for(int i = 0; i < m_SprayPoints->GetNumberOfPoints(); i++)
       {
-      // Find the point in image coordinates
       double *x = m_SprayPoints->GetPoint(i);
-
-      // Create a region around this one voxel (in the future could use other shapes)
-      SegmentationUpdateIterator::RegionType region;
-      region.SetIndex(0, static_cast<unsigned int>(x[0])); region.SetSize(0, 1);
-      region.SetIndex(1, static_cast<unsigned int>(x[1])); region.SetSize(1, 1);
-      region.SetIndex(2, static_cast<unsigned int>(x[2])); region.SetSize(2, 1);
-
-      // Treat each point as a region update
-      SegmentationUpdateIterator it(seg, region,
-                                    app->GetGlobalState()->GetDrawingColorLabel(),
-                                    app->GetGlobalState()->GetDrawOverFilter());
-
-      for(; !it.IsAtEnd(); ++it)
-        {
-        it.PaintAsForeground();
-        }
-
-      // Store the delta for this update
-      if(it.Finalize())
-        {
-        update = true;
-        seg->StoreIntermediateUndoDelta(it.RelinquishDelta());
-        }
+      for(int d = 0; d < 3; d++)
+        voxels[i][d] = static_cast<unsigned int>(x[d]);
       }
 
-    // Store the undo point
+    // Merge all the spray points into the segmentation as a single update
+    bool update = seg->PaintVoxels(voxels,
+                                   app->GetGlobalState()->GetDrawingColorLabel(),
+                                   app->GetGlobalState()->GetDrawOverFilter(),
+                                   "3D spray paint") > 0;
+
+    // Clean up after the update
     if(update)
       {
-      seg->StoreUndoPoint("3D spray paint");
       app->RecordCurrentLabelUse();
 
       // Clear the spray points
@@ -448,9 +429,13 @@ bool Generic3DModel::IntersectSegmentation(int vx, int vy, Vector3i &hit)
     RayCasterType caster;
     LabelImageHitTester tester(m_ParentUI->GetDriver()->GetColorLabelTable());
     caster.SetHitTester(tester);
-    result = caster.FindIntersection(
-          m_ParentUI->GetDriver()->GetSelectedSegmentationLayer()->GetImage(),
-          x_image, d_image, hit);
+
+    // Skip over empty bricks, unless the clear label itself can be hit
+    LabelImageWrapper *seg = m_ParentUI->GetDriver()->GetSelectedSegmentationLayer();
+    if(!tester(0))
+      caster.SetBrickOccupancy(seg->GetBrickOccupancy());
+
+    result = caster.FindIntersection(seg->GetImage(), x_image, d_image, hit);
     }
 
   return (result == 1);
@@ -330,6 +330,8 @@ void ImageIOWizardModel::OpenImage(std::string filename, ImageReadingProgressAcc
     m_LoadDelegate->UnloadCurrentImage();
 
     // Load the data from the image
+    m_GuidedIO->SetLazyTimePointThreshold(m_LoadDelegate->GetLazyTimePointThreshold());
+    m_GuidedIO->SetStreamNativeData(m_LoadDelegate->GetStreamNativeData());
 		m_GuidedIO->ReadNativeImageData(dataProgCmd);
 
     // Validate the image data
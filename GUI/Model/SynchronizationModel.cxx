@@ -29,7 +29,7 @@ struct IPCMessage
   CameraState camera;
 
   // Version of the data structure
-  enum VersionEnum { VERSION = 0x1005 };
+  enum VersionEnum { VERSION = 0x1006 };
 };
 
 
@@ -37,9 +37,13 @@ public:
    * flag depending on whether the window is active or not */
   irisGetSetMacro(CanBroadcast, bool)
 
-  /** This method should be called by UI at regular intervals to read IPC state */
+  /** This method should be called by UI at regular intervals, or when the
+      IPC handler reports a new message, to read IPC state */
   void ReadIPCState();
 
+  /** The IPC handler, used by the UI to listen for messages */
+  irisGetMacro(IPCHandler, IPCHandler *)
+
 protected:
 
   SynchronizationModel();
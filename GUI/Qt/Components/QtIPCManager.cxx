@@ -1,13 +1,21 @@
 #include "QtIPCManager.h"
 #include "SNAPEvents.h"
 #include "SynchronizationModel.h"
+#include "IPCHandler.h"
 
 
 QtIPCManager::QtIPCManager(QWidget *parent) :
   SNAPComponent(parent)
 {
-  // Start the IPC timer at 30ms intervals
-  startTimer(30);
+  m_Model = NULL;
+  m_TimerId = 0;
+}
+
+QtIPCManager::~QtIPCManager()
+{
+  // The listener calls back into this object, so it must be stopped first
+  if(m_Model)
+    m_Model->GetIPCHandler()->StopListening();
 }
 
 void QtIPCManager::SetModel(SynchronizationModel *model)
@@ -16,6 +24,19 @@ void QtIPCManager::SetModel(SynchronizationModel *model)
 
   // Listen to update events from the model
   connectITK(m_Model, ModelUpdateEvent());
+
+  // Have the IPC handler wake us up when another session broadcasts. The
+  // callback runs on the listening thread, so the state is read on the GUI
+  // thread through a queued call
+  bool listening = m_Model->GetIPCHandler()->StartListening([this]()
+    {
+    QMetaObject::invokeMethod(this, [this]() { m_Model->ReadIPCState(); },
+                              Qt::QueuedConnection);
+    });
+
+  // Otherwise, start the IPC timer at 30ms intervals
+  if(!listening && !m_TimerId)
+    m_TimerId = startTimer(30);
 }
 
 void QtIPCManager::onModelUpdate(const EventBucket &bucket)
@@ -8,15 +8,17 @@ class SynchronizationModel;
 
 /**
  * @brief This class manages IPC communications between SNAP sessions on the
- * GUI level. It uses Qt's timers to schedule checks for IPC updates, and it
- * listens to the events from the model layer in order to send IPC messages
- * out.
+ * GUI level. When the IPC handler supports notifications, it is woken up by
+ * other sessions when they broadcast; otherwise it uses Qt's timers to
+ * schedule checks for IPC updates. It listens to the events from the model
+ * layer in order to send IPC messages out.
  */
 class QtIPCManager : public SNAPComponent
 {
   Q_OBJECT
 public:
   explicit QtIPCManager(QWidget *parent = 0);
+  virtual ~QtIPCManager();
 
   void SetModel(SynchronizationModel *model);
   
@@ -33,6 +35,9 @@ protected:
 private:
 
   SynchronizationModel *m_Model;
+
+  // Id of the polling timer, or zero if notifications are used
+  int m_TimerId;
 };
 
 #endif // QTIPCMANAGER_H
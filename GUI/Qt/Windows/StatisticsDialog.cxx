@@ -47,8 +47,9 @@ void StatisticsDialog::Activate()
 
 void StatisticsDialog::FillTable()
 {
-  // Compute the segmentation statistics
-  m_Stats->Compute(m_Model->GetDriver());
+  // Get the segmentation statistics. These are updated incrementally
+  // after painting, so refreshing the table is cheap.
+  *m_Stats = m_Model->GetDriver()->GetSegmentationStatistics();
 
   // Fill out the item model
   m_ItemModel->clear();
@@ -85,6 +85,10 @@ double Window3DPicker::IntersectWithLine(
     LabelImageHitTester tester(app->GetColorLabelTable());
     finder.SetHitTester(tester);
 
+    // Skip over empty bricks, unless the clear label itself can be hit
+    if(!tester(0))
+      finder.SetBrickOccupancy(layer->GetBrickOccupancy());
+
     result = finder.FindIntersection(layer->GetImage(), x0, x1 - x0, pos);
     }
 
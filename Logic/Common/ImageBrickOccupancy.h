@@ -0,0 +1,96 @@
+#ifndef IMAGEBRICKOCCUPANCY_H
+#define IMAGEBRICKOCCUPANCY_H
+
+#include "itkSize.h"
+#include <algorithm>
+#include <vector>
+
+/**
+  A coarse grid over a 3D label image that records, for each brick of
+  8x8x8 voxels, whether the brick may contain a non-zero voxel. The flags
+  are conservative: a brick is never marked empty if it has a non-zero
+  voxel, but a brick whose voxels have been cleared stays marked until the
+  grid is rebuilt. Ray casting code uses the grid to skip empty bricks
+  instead of looking up every voxel along the ray.
+
+  Voxel coordinates are relative to the start of the image region.
+  */
+class ImageBrickOccupancy
+{
+public:
+
+  enum { BRICK_BITS = 3, BRICK_SIZE = 1 << BRICK_BITS };
+
+  ImageBrickOccupancy()
+  {
+    for(int d = 0; d < 3; d++)
+      m_Size[d] = m_BrickCount[d] = 0;
+  }
+
+  /** Allocate a grid for an image of the given size, with all bricks empty */
+  void Reset(const itk::Size<3> &size)
+  {
+    for(int d = 0; d < 3; d++)
+      {
+      m_Size[d] = size[d];
+      m_BrickCount[d] = (size[d] + BRICK_SIZE - 1) >> BRICK_BITS;
+      }
+    m_Bricks.assign(m_BrickCount[0] * m_BrickCount[1] * m_BrickCount[2], 0);
+  }
+
+  /** Mark the bricks that contain voxels [x0, x1) of line (y, z) */
+  void MarkRun(long x0, long x1, long y, long z)
+  {
+    if(x0 >= x1)
+      return;
+    unsigned char *p = &m_Bricks[this->GetBrickOffset(0, y, z)];
+    std::fill(p + (x0 >> BRICK_BITS), p + ((x1 - 1) >> BRICK_BITS) + 1, 1);
+  }
+
+  /** Whether the brick containing the voxel may have non-zero voxels */
+  bool IsOccupied(long x, long y, long z) const
+  {
+    return m_Bricks[this->GetBrickOffset(x, y, z)] != 0;
+  }
+
+  /** Build the grid from the runs of an RLE image */
+  template <class TRLEImage> void Build(const TRLEImage *image)
+  {
+    typedef typename TRLEImage::BufferType BufferType;
+    typename TRLEImage::RegionType region = image->GetBufferedRegion();
+    this->Reset(region.GetSize());
+
+    const BufferType *lines = image->GetBuffer();
+    const typename TRLEImage::RLLine *line = lines->GetBufferPointer();
+    for(long z = 0; z < m_Size[2]; z++)
+      {
+      for(long y = 0; y < m_Size[1]; y++, line++)
+        {
+        long x = 0;
+        for(size_t i = 0; i < line->size(); i++)
+          {
+          long n = (*line)[i].first;
+          if((*line)[i].second != 0)
+            this->MarkRun(x, x + n, y, z);
+          x += n;
+          }
+        }
+      }
+  }
+
+  /** Size of the image covered by the grid */
+  const long *GetSize() const { return m_Size; }
+
+protected:
+
+  size_t GetBrickOffset(long x, long y, long z) const
+  {
+    return ((z >> BRICK_BITS) * m_BrickCount[1] + (y >> BRICK_BITS)) * m_BrickCount[0]
+        + (x >> BRICK_BITS);
+  }
+
+  long m_Size[3], m_BrickCount[3];
+  std::vector<unsigned char> m_Bricks;
+};
+
+#endif // IMAGEBRICKOCCUPANCY_H
@@ -36,6 +36,7 @@
 #define __ImageRayIntersectionFinder_h_
 
 #include "SNAPCommon.h"
+#include "ImageBrickOccupancy.h"
 #include <vnl/vnl_matrix_fixed.h>
 
 /**
@@ -49,6 +50,7 @@ template <class TImage, class THitTester>
 class ImageRayIntersectionFinder
 {
 public:
+    ImageRayIntersectionFinder() : m_BrickOccupancy(NULL) {}
     virtual ~ImageRayIntersectionFinder() {}
   /** Image type */
   typedef TImage ImageType;
@@ -56,6 +58,13 @@ public:
   /** Set the hit-test functor to evaluate for hits */
   irisSetMacro(HitTester,THitTester);
 
+  /**
+   * Optionally, set a brick occupancy grid for the image. The ray then skips
+   * over empty bricks without looking at their pixels. This may only be used
+   * if the hit tester rejects zero pixels.
+   */
+  irisSetMacro(BrickOccupancy, const ImageBrickOccupancy *);
+
   /**
    * Compute the intersection (index of the first pixel in the
    * image that the ray crosses and which satisfies the THitTester's
@@ -69,6 +78,9 @@ public:
 private:
   /** The hit tester used internally */
   THitTester m_HitTester;
+
+  /** Optional occupancy grid of the image */
+  const ImageBrickOccupancy *m_BrickOccupancy;
 };
 
 #ifndef ITK_MANUAL_INSTANTIATION
@@ -45,9 +45,6 @@ ImageRayIntersectionFinder<TImage, THitTester>
   typename ImageType::SizeType size =
     image->GetLargestPossibleRegion().GetSize();
 
-  double delta[3][3] = {{0.,0.,0.},{0.,0.,0.},{0.,0.,0.}}, dratio[3]={0.,0.,0.};
-  int    signrx, signry, signrz;
-
   double rayLen = ray.two_norm();
   if(rayLen == 0)
     return -1;
@@ -55,13 +52,6 @@ ImageRayIntersectionFinder<TImage, THitTester>
 
   double rx = ray[0];double ry = ray[1];double rz = ray[2];
 
-  if (rx >=0) signrx = 1;
-  else signrx = -1;
-  if (ry >=0) signry = 1;
-  else signry = -1;
-  if (rz >=0) signrz = 1;
-  else signrz = -1;
-
   // offset everything by (.5, .5) [becuz samples are at center of voxels]
   // this offset will put borders of voxels at integer values
   // we will work with this offset grid and offset back to check samples
@@ -83,96 +73,48 @@ ImageRayIntersectionFinder<TImage, THitTester>
     }
   if (c >= 9999) return -1;
 
-  // walk along ray to find intersection with any voxel with val > 0
-  while ( (px >= 0 && px < size[0]&&
-           py >= 0 && py < size[1] &&
-           pz >= 0 && pz < size[2]) )
+  // Walk along the ray through every voxel that it crosses, in order. For
+  // each axis, tMax is the ray parameter at which the ray crosses into the
+  // next voxel along that axis, and tDelta is the length of one voxel
+  double p[3] = {px, py, pz}, r[3] = {rx, ry, rz}, tMax[3], tDelta[3];
+  int step[3];
+  for(int d = 0; d < 3; d++)
     {
-
-    // offset point by (-.5, -.5) [to account for earlier offset] and
-    // get the nearest sample voxel within unit cube around (px,py,pz)
-    //    lx = my_round(px-0.5);
-    //    ly = my_round(py-0.5);
-    //    lz = my_round(pz-0.5);
-    lIndex[0] = (int)px;
-    lIndex[1] = (int)py;
-    lIndex[2] = (int)pz;
-
-    // Get the pixel
-    typename ImageType::PixelType hitPixel = image->GetPixel(lIndex);
-
-    // Test if the pixel is a hit
-    if(m_HitTester(hitPixel))
+    lIndex[d] = (int) p[d];
+    step[d] = r[d] > 0 ? 1 : (r[d] < 0 ? -1 : 0);
+    if(step[d] != 0)
       {
-      hit[0] = lIndex[0];
-      hit[1] = lIndex[1];
-      hit[2] = lIndex[2];
-      return 1;
-      }
-
-    // BEGIN : walk along ray to border of next voxel touched by ray
-
-    // compute path to YZ-plane surface of next voxel
-    if (rx == 0)
-      { // ray is parallel to 0 axis
-      delta[0][0] = 9999;
-      }
-    else
-      {
-      delta[0][0] = (int)(px+signrx) - px;
-      }
-
-    // compute path to XZ-plane surface of next voxel
-    if (ry == 0)
-      { // ray is parallel to 1 axis
-      delta[1][0] = 9999;
+      tMax[d] = (lIndex[d] + (step[d] > 0 ? 1 : 0) - p[d]) / r[d];
+      tDelta[d] = step[d] / r[d];
       }
     else
       {
-      delta[1][1] = (int)(py+signry) - py;
-      dratio[1]   = delta[1][1]/ry;
-      delta[1][0] = dratio[1] * rx;
+      tMax[d] = tDelta[d] = 1e100;
       }
+    }
 
-    // compute path to XY-plane surface of next voxel
-    if (rz == 0)
-      { // ray is parallel to 2 axis
-      delta[2][0] = 9999;
-      }
-    else
+  while(lIndex[0] >= 0 && lIndex[0] < (long) size[0] &&
+        lIndex[1] >= 0 && lIndex[1] < (long) size[1] &&
+        lIndex[2] >= 0 && lIndex[2] < (long) size[2])
+    {
+    // Pixels are only looked up outside of empty bricks
+    if(!m_BrickOccupancy || m_BrickOccupancy->IsOccupied(lIndex[0], lIndex[1], lIndex[2]))
       {
-      delta[2][2] = (int)(pz+signrz) - pz;
-      dratio[2]   = delta[2][2]/rz;
-      delta[2][0] = dratio[2] * rx;
+      // Test if the pixel is a hit
+      if(m_HitTester(image->GetPixel(lIndex)))
+        {
+        hit[0] = lIndex[0];
+        hit[1] = lIndex[1];
+        hit[2] = lIndex[2];
+        return 1;
+        }
       }
 
-    // choose the shortest path
-    if ( fabs(delta[0][0]) <= fabs(delta[1][0]) && fabs(delta[0][0]) <= fabs(delta[2][0]) )
-      {
-      dratio[0]   = delta[0][0]/rx;
-      delta[0][1] = dratio[0] * ry;
-      delta[0][2] = dratio[0] * rz;
-      px += delta[0][0];
-      py += delta[0][1];
-      pz += delta[0][2];
-      }
-    else if ( fabs(delta[1][0]) <= fabs(delta[0][0]) && fabs(delta[1][0]) <= fabs(delta[2][0]) )
-      {
-      delta[1][2] = dratio[1] * rz;
-      px += delta[1][0];
-      py += delta[1][1];
-      pz += delta[1][2];
-      }
-    else
-      { //if (fabs(delta[2][0] <= fabs(delta[0][0] && fabs(delta[2][0] <= fabs(delta[0][0])
-      delta[2][1] = dratio[2] * ry;
-      px += delta[2][0];
-      py += delta[2][1];
-      pz += delta[2][2];
-      }
-    // END : walk along ray to border of next voxel touched by ray
+    // Step into the next voxel crossed by the ray
+    int d = tMax[0] < tMax[1] ? (tMax[0] < tMax[2] ? 0 : 2) : (tMax[1] < tMax[2] ? 1 : 2);
+    lIndex[d] += step[d];
+    tMax[d] += tDelta[d];
+    }
 
-    } // while ( (px
   return 0;
 }
-
@@ -36,38 +36,33 @@
 #include "GenericImageData.h"
 #include "IRISApplication.h"
 #include "ImageCollectionToImageFilter.h"
+#include "UndoDataManager.h"
 
 #include <iostream>
 #include <iomanip>
+#include <set>
 
 
 using namespace std;
 
 
-// TODO: improve efficiency by using filters to integrate label intensities
 void
 SegmentationStatistics
-::Compute(IRISApplication *app)
+::FindLayers(IRISApplication *app,
+             vector<ScalarImageWrapperBase *> &layers,
+             vector<string> *names) const
 {
   // Get the current image data
   GenericImageData *id = app->GetCurrentImageData();
 
-  // Get the selected segmentation layer
-  LabelImageWrapper *seg = app->GetSelectedSegmentationLayer();
-
-  // A list of image sources
-  vector<ScalarImageWrapperBase *> layers;
-
-  // Clear the list of column names
-  m_ImageStatisticsColumnNames.clear();
-
   // Find all the images available for statistics computation
   for(LayerIterator it(id, MAIN_ROLE | OVERLAY_ROLE); !it.IsAtEnd(); ++it)
     {
     ScalarImageWrapperBase *lscalar = it.GetLayerAsScalar();
     if(lscalar)
       {
-      m_ImageStatisticsColumnNames.push_back(lscalar->GetNickname());
+      if(names)
+        names->push_back(lscalar->GetNickname());
       layers.push_back(lscalar);
       }
     else
@@ -75,20 +70,47 @@ SegmentationStatistics
       VectorImageWrapperBase *lvector = it.GetLayerAsVector();
       for(int j = 0; j < lvector->GetNumberOfComponents(); j++)
         {
-        std::ostringstream oss;
-        oss << lvector->GetNickname();
-        if(lvector->GetNumberOfComponents() > 1)
-          oss << " [" << j << "]";
-        m_ImageStatisticsColumnNames.push_back(oss.str());
+        if(names)
+          {
+          std::ostringstream oss;
+          oss << lvector->GetNickname();
+          if(lvector->GetNumberOfComponents() > 1)
+            oss << " [" << j << "]";
+          names->push_back(oss.str());
+          }
         layers.push_back(lvector->GetScalarRepresentation(
               SCALAR_REP_COMPONENT, j));
         }
       }
     }
+}
+
+void
+SegmentationStatistics
+::Compute(IRISApplication *app)
+{
+  // Get the current image data
+  GenericImageData *id = app->GetCurrentImageData();
+
+  // Get the selected segmentation layer
+  LabelImageWrapper *seg = app->GetSelectedSegmentationLayer();
+
+  // Clear the list of column names and find the image layers
+  m_ImageStatisticsColumnNames.clear();
+  m_Layers.clear();
+  this->FindLayers(app, m_Layers, &m_ImageStatisticsColumnNames);
+
+  // A list of image sources
+  vector<ScalarImageWrapperBase *> &layers = m_Layers;
 
   // Get the number of gray image layers
   size_t ngray = layers.size();
 
+  // Remember the state of the layers, so that deltas can be applied later
+  m_LayerMTimes.resize(ngray);
+  for(size_t j = 0; j < ngray; j++)
+    m_LayerMTimes[j] = layers[j]->GetImageBase()->GetMTime();
+
   // Clear and initialize the statistics table
   m_Stats.clear();
 
@@ -116,7 +138,7 @@ SegmentationStatistics
       // Change the cached entry
       runLabel = label;
       cachedEntry = &m_Stats[runLabel];
-      if(cachedEntry->count == 0)
+      if(cachedEntry->sum.size() != ngray)
         cachedEntry->resize(ngray);
 
       runStart = itLabel.GetIndex();
@@ -127,14 +149,102 @@ SegmentationStatistics
   // Record the statistics from the last run
   this->RecordRunLength(ngray, layers, region, runStart, runLength, cachedEntry);
 
+  // The voxel counts are the ones maintained by the segmentation
+  for(EntryMap::iterator it = m_Stats.begin(); it != m_Stats.end(); ++it)
+    it->second.count = seg->GetNumberOfVoxelsWithLabel(it->first);
+
   // Compute the size of a voxel, in mm^3
   const double *spacing = 
     id->GetMain()->GetImageBase()->GetSpacing().GetDataPointer();
-  double volVoxel = spacing[0] * spacing[1] * spacing[2];
-  
+  m_VoxelVolume = spacing[0] * spacing[1] * spacing[2];
+
   // Compute the mean and standard deviation
-  for(EntryMap::iterator it = m_Stats.begin(); it != m_Stats.end(); ++it)
+  this->UpdateDerivedStatistics();
+}
+
+void
+SegmentationStatistics
+::ApplyDelta(LabelImageWrapper *seg, const UndoDelta<LabelType> *delta, bool reverse)
+{
+  size_t ngray = m_Layers.size();
+  vnl_vector<double> sum(ngray), sumsq(ngray);
+  std::set<LabelType> touched;
+
+  // Iterate over the region of the delta, in the same order as it was encoded
+  itk::ImageRegion<3> region = delta->GetRegion();
+  LabelImageWrapper::ConstIterator itLabel(seg->GetImage(), region);
+
+  for(UndoDelta<LabelType>::RLEReader rit(delta); !rit.IsAtEnd(); ++rit)
     {
+    size_t n = rit.GetLength();
+
+    // The change to the label values over this run
+    LabelType d = reverse ? (LabelType) (0 - rit.GetValue()) : rit.GetValue();
+    if(d == 0)
+      {
+      for(size_t j = 0; j < n; j++)
+        ++itLabel;
+      continue;
+      }
+
+    // The run may cover several labels, split it into pieces of constant label
+    size_t j = 0;
+    while(j < n)
+      {
+      LabelType newLabel = itLabel.Value();
+      LabelType oldLabel = newLabel - d;
+      itk::Index<3> runStart = itLabel.GetIndex();
+      long runLength = 0;
+      for(; j < n && itLabel.Value() == newLabel; j++, runLength++)
+        ++itLabel;
+
+      // Integrate the intensities over the piece
+      sum.fill(0.0);
+      sumsq.fill(0.0);
+      for(size_t k = 0; k < ngray; k++)
+        m_Layers[k]->GetRunLengthIntensityStatistics(
+              region, runStart, runLength,
+              sum.data_block() + k, sumsq.data_block() + k);
+
+      // Move the piece from the old label to the new label
+      Entry &eOld = m_Stats[oldLabel];
+      if(eOld.sum.size() != ngray)
+        eOld.resize(ngray);
+      eOld.sum -= sum;
+      eOld.sumsq -= sumsq;
+
+      Entry &eNew = m_Stats[newLabel];
+      if(eNew.sum.size() != ngray)
+        eNew.resize(ngray);
+      eNew.sum += sum;
+      eNew.sumsq += sumsq;
+
+      touched.insert(oldLabel);
+      touched.insert(newLabel);
+      }
+    }
+
+  // The segmentation has already counted the voxels of the delta
+  for(LabelType label : touched)
+    m_Stats[label].count = seg->GetNumberOfVoxelsWithLabel(label);
+}
+
+void
+SegmentationStatistics
+::UpdateDerivedStatistics()
+{
+  size_t ngray = m_Layers.size();
+
+  EntryMap::iterator it = m_Stats.begin();
+  while(it != m_Stats.end())
+    {
+    // Labels removed by incremental updates are dropped from the table
+    if(it->second.count == 0 && it->first != 0)
+      {
+      m_Stats.erase(it++);
+      continue;
+      }
+
     Entry &entry = it->second;
     for(size_t j = 0; j < ngray; j++)
       {
@@ -143,15 +253,32 @@ SegmentationStatistics
       double stdev = sqrt((entry.sumsq[j] - entry.sum[j] * mean) / (entry.count - 1));
 
       // Map with scale and shift
-      entry.mean[j] = layers[j]->GetNativeIntensityMapping()->MapInternalToNative(mean);
+      entry.mean[j] = m_Layers[j]->GetNativeIntensityMapping()->MapInternalToNative(mean);
 
       // Map with just shift
-      entry.stdev[j] = layers[j]->GetNativeIntensityMapping()->MapGradientMagnitudeToNative(stdev);
+      entry.stdev[j] = m_Layers[j]->GetNativeIntensityMapping()->MapGradientMagnitudeToNative(stdev);
       }
-    entry.volume_mm3 = entry.count * volVoxel;
+    entry.volume_mm3 = entry.count * m_VoxelVolume;
+    ++it;
     }
 }
 
+bool
+SegmentationStatistics
+::AreLayersCurrent(IRISApplication *app) const
+{
+  vector<ScalarImageWrapperBase *> layers;
+  this->FindLayers(app, layers, NULL);
+  if(layers != m_Layers)
+    return false;
+
+  for(size_t j = 0; j < layers.size(); j++)
+    if(layers[j]->GetImageBase()->GetMTime() != m_LayerMTimes[j])
+      return false;
+
+  return true;
+}
+
 void SegmentationStatistics
 ::RecordRunLength(size_t ngray, vector<ScalarImageWrapperBase *> &layers,
                   itk::ImageRegion<3> &region, itk::Index<3> &runStart,
@@ -165,8 +292,6 @@ void SegmentationStatistics
           cachedEntry->sum.data_block() + j,
           cachedEntry->sumsq.data_block() + j);
     }
-
-  cachedEntry->count += runLength;
 }
 
 void SegmentationStatistics
@@ -175,40 +300,13 @@ void SegmentationStatistics
   // Get selected segmentation layer
   LabelImageWrapper *liw = app->GetSelectedSegmentationLayer();
 
-  // Get the iterator from the segmentation
-  LabelImageWrapper::ConstIterator it = liw->GetImageConstIterator();
-
-  // Iterate through image and update count
-  LabelType runLabel = 0;
-  unsigned long *cachedCnt = &result[runLabel];
-  unsigned long runLength = 0;
-
-  // Start counting
-  for (; !it.IsAtEnd(); ++it, ++runLength)
-    {
-      LabelType label = it.Value();
-      if (label != runLabel)
-        {
-          // std::cout << "run length: " << runLength << endl;
-          *cachedCnt += runLength;
-
-          // Reset for new count
-          runLabel = label;
-          cachedCnt = &result[runLabel];
-          runLength = 0;
-        }
-    }
-
-  // Add last run Length
-  *cachedCnt += runLength;
-
-  // Debug
-  /*
-  for (auto cit = result.cbegin(); cit != result.cend(); ++cit)
+  // Use the label counts maintained by the segmentation
+  for(size_t label = 0; label <= itk::NumericTraits<LabelType>::max(); label++)
     {
-      std::cout << cit->first << "=>" << cit->second << std::endl;
+    size_t n = liw->GetNumberOfVoxelsWithLabel((LabelType) label);
+    if(n || label == 0)
+      result[(LabelType) label] += n;
     }
-    */
 }
 
 void 
@@ -36,6 +36,7 @@
 #define __SegmentationStatistics_h_
 
 #include "SNAPCommon.h"
+#include "itkIntTypes.h"
 #include <vector>
 #include <string>
 #include <iostream>
@@ -45,6 +46,8 @@ class GenericImageData;
 class ColorLabelTable;
 class ScalarImageWrapperBase;
 class IRISApplication;
+class LabelImageWrapper;
+template <typename TPixel> class UndoDelta;
 
 namespace itk {
   template <unsigned int VDim> class ImageRegion;
@@ -83,6 +86,26 @@ public:
 
   /* Compute statistics from a segmentation image */
   void Compute(IRISApplication *app);
+
+  /**
+   * Update the sums and counts after the voxels covered by an undo delta have
+   * been changed in the segmentation seg. The segmentation must already hold
+   * the new labels. If reverse is true, the delta has been undone rather than
+   * applied. Only voxels with a non-zero delta are sampled, so the cost does
+   * not depend on the size of the image. This must be followed by a call to
+   * UpdateDerivedStatistics() before the means and volumes are used. The
+   * image layers sampled by the last Compute() must not have been removed
+   * since, which the caller ensures by listening for layer changes. The
+   * voxel counts are not recomputed here but taken from the label counts
+   * of seg, which LabelImageWrapper updates before reporting the delta.
+   */
+  void ApplyDelta(LabelImageWrapper *seg, const UndoDelta<LabelType> *delta, bool reverse);
+
+  /* Recompute means, standard deviations and volumes from the sums and counts */
+  void UpdateDerivedStatistics();
+
+  /* Check whether the image layers used by the last Compute() are unchanged */
+  bool AreLayersCurrent(IRISApplication *app) const;
   
   /* Export to a text file using legacy format */
   void ExportLegacy(std::ostream &oss, const ColorLabelTable &clt);
@@ -90,13 +113,16 @@ public:
   /* Export to a CSV or text file */
   void Export(std::ostream &oss, const std::string &colsep, const ColorLabelTable &clt);
 
+  SegmentationStatistics() : m_VoxelVolume(0) {}
+
   const EntryMap &GetStats() const
     { return m_Stats; }
 
   const std::vector<std::string> &GetImageStatisticsColumns() const
     { return m_ImageStatisticsColumnNames; }
 
-  /* A light-weight method only compute voxel counts for each label*/
+  /* Voxel counts of the labels present in the selected segmentation, as
+     maintained by LabelImageWrapper::GetNumberOfVoxelsWithLabel() */
   void GetVoxelCount(LabelVoxelCount &result, IRISApplication *app) const;
 
 private:
@@ -106,6 +132,18 @@ private:
 
   // Column information
   std::vector<std::string> m_ImageStatisticsColumnNames;
+
+  // Image layers sampled by the last Compute(), and the times they were
+  // last modified. These are needed to apply deltas incrementally.
+  std::vector<ScalarImageWrapperBase *> m_Layers;
+  std::vector<itk::ModifiedTimeType> m_LayerMTimes;
+
+  // Volume of a voxel, in mm^3
+  double m_VoxelVolume;
+
+  void FindLayers(IRISApplication *app,
+                  std::vector<ScalarImageWrapperBase *> &layers,
+                  std::vector<std::string> *names) const;
   
   void RecordRunLength(
       size_t ngray,
@@ -53,6 +53,7 @@
 #include "Rebroadcaster.h"
 #include "LayerIterator.h"
 #include "GuidedNativeImageIO.h"
+#include "TimePointImageCache.h"
 #include "ImageAnnotationData.h"
 #include "RLERegionOfInterestImageFilter.h"
 #include "TimePointProperties.h"
@@ -133,6 +134,37 @@ GenericImageData
 
 #include "itkIdentityTransform.h"
 
+/**
+ * Wrap the voxels of a 4D image that has a single time point as a 3D image,
+ * without copying them
+ */
+template <class TImage4D, class TImage>
+static typename TImage::Pointer
+ExtractSingleTimePoint(TImage4D *image_4d)
+{
+  typename TImage::Pointer image = TImage::New();
+  typename TImage::RegionType region;
+  typename TImage::SpacingType spacing;
+  typename TImage::PointType origin;
+  typename TImage::DirectionType dir;
+  for(unsigned int i = 0; i < 3; i++)
+    {
+    region.SetIndex(i, image_4d->GetBufferedRegion().GetIndex(i));
+    region.SetSize(i, image_4d->GetBufferedRegion().GetSize(i));
+    spacing[i] = image_4d->GetSpacing()[i];
+    origin[i] = image_4d->GetOrigin()[i];
+    for(unsigned int j = 0; j < 3; j++)
+      dir(i,j) = image_4d->GetDirection()(i,j);
+    }
+
+  image->SetRegions(region);
+  image->SetSpacing(spacing);
+  image->SetOrigin(origin);
+  image->SetDirection(dir);
+  image->SetPixelContainer(image_4d->GetPixelContainer());
+  return image;
+}
+
 SmartPtr<ImageWrapperBase>
 GenericImageData::CreateAnatomicWrapper(GuidedNativeImageIO *io, ITKTransformType *transform)
 {
@@ -169,6 +201,41 @@ GenericImageData::CreateAnatomicWrapper(GuidedNativeImageIO *io, ITKTransformTyp
     out_wrapper = wrapper.GetPointer();
     }
 
+  else if(io->IsLazyTimePointMode())
+    {
+    // Only the first time point has been read, and the others will be read
+    // on demand. Lazy mode is limited to types that are cast without rescaling
+    typedef AnatomicScalarImageWrapper::Image4DType AnatomicImage4DType;
+    typedef AnatomicScalarImageWrapper::ImageType AnatomicImageType;
+    typedef TimePointImageCache<AnatomicImageType> CacheType;
+
+    CastNativeImage<AnatomicImage4DType> caster;
+    AnatomicImage4DType::Pointer image = caster(io);
+
+    // The loader reads a time point and wraps it as a 3D image
+    SmartPtr<GuidedNativeImageIO> reader = io->CreateTimePointReader();
+    SmartPtr<CacheType> cache = CacheType::New();
+    cache->SetLoader([reader](unsigned int tp)
+      {
+      CastNativeImage<AnatomicImage4DType> tp_caster;
+      AnatomicImage4DType::Pointer image_4d = tp_caster(reader, reader->ReadNativeTimePoint(tp));
+      return ExtractSingleTimePoint<AnatomicImage4DType, AnatomicImageType>(image_4d);
+      }, io->GetNumberOfNativeTimePoints());
+
+    // Create a main wrapper of fixed type.
+    SmartPtr<AnatomicScalarImageWrapper> wrapper = AnatomicScalarImageWrapper::New();
+
+    // Set properties
+    wrapper->SetDisplayGeometry(m_DisplayGeometry);
+    wrapper->SetImage4DWithTimePointCache(image, cache, refSpace, transform);
+    wrapper->SetNativeMapping(LinearInternalToNativeIntensityMapping(1.0, 0.0));
+
+    for(int i = 0; i < 3; i++)
+      wrapper->SetDisplayViewportGeometry(i, m_DisplayViewportGeometry[i]);
+
+    out_wrapper = wrapper.GetPointer();
+    }
+
   else
     {
     // Rescale the image to desired number of bits
@@ -326,23 +393,85 @@ GenericImageData
 
   // This is the uncompressed representation of the segmentation
   typedef itk::Image<LabelType, 4> UncompressedImage4DType;
+  typedef LabelImageWrapper::Image4DType LabelImage4DType;
+  LabelImage4DType::Pointer imgLabel;
 
-  // Cast the native to label type
-  CastNativeImage<UncompressedImage4DType> caster;
-  UncompressedImage4DType::Pointer imgUncompressed = caster(io);
+  if(io->IsStreamedDataMode())
+    {
+    // The voxels are still in the file. Read them a few slices at a time and
+    // encode each slab straight into the lines of the RLE image, so that the
+    // uncompressed segmentation never has to fit in memory
+    itk::ImageBase<4> *header = io->GetNativeImage();
+    itk::ImageRegion<4> largest = header->GetLargestPossibleRegion();
+    imgLabel = LabelImage4DType::New();
+    imgLabel->CopyInformation(header);
+    imgLabel->SetRegions(largest);
+    imgLabel->Allocate();
+
+    // Slabs of whole z-slices holding about 16M voxels
+    unsigned int nx = largest.GetSize(0), ny = largest.GetSize(1);
+    unsigned int nz = largest.GetSize(2), nt = largest.GetSize(3);
+    unsigned int slab_depth = (unsigned int) std::max(
+          (size_t) 1, std::min((size_t) nz, (size_t) (1 << 24) / ((size_t) nx * ny)));
+
+    LabelImage4DType::BufferType *buffer = imgLabel->GetBuffer();
+    LabelImage4DType::RLLine *lines = buffer->GetBufferPointer();
+    CastNativeImage<UncompressedImage4DType> caster;
+    for(unsigned int t = 0; t < nt; t++)
+      {
+      for(unsigned int z0 = 0; z0 < nz; z0 += slab_depth)
+        {
+        itk::ImageRegion<4> slab_region;
+        slab_region.SetIndex(2, z0);
+        slab_region.SetIndex(3, t);
+        slab_region.SetSize(0, nx);
+        slab_region.SetSize(1, ny);
+        slab_region.SetSize(2, std::min(slab_depth, nz - z0));
+        slab_region.SetSize(3, 1);
+
+        UncompressedImage4DType::Pointer slab = caster(io, io->ReadNativeRegion(slab_region));
+        const LabelType *p = slab->GetBufferPointer();
+
+        // The lines of the buffer are ordered by y, then z, then t
+        size_t n_lines = (size_t) ny * slab_region.GetSize(2);
+        LabelImage4DType::RLLine *line = lines + ((size_t) t * nz + z0) * ny;
+        for(size_t k = 0; k < n_lines; k++, line++, p += nx)
+          {
+          line->clear();
+          unsigned int x = 0;
+          while(x < nx)
+            {
+            unsigned int x_end = x + 1;
+            while(x_end < nx && p[x_end] == p[x])
+              x_end++;
+            line->push_back(LabelImage4DType::RLSegment(x_end - x, p[x]));
+            x = x_end;
+            }
+          }
+        }
+      }
 
-  //use specialized RoI filter to convert to RLEImage
-  typedef LabelImageWrapper::Image4DType LabelImage4DType;
-  typedef itk::RegionOfInterestImageFilter<UncompressedImage4DType, LabelImage4DType> inConverterType;
-  inConverterType::Pointer inConv = inConverterType::New();
-  inConv->SetInput(imgUncompressed);
-  inConv->SetRegionOfInterest(imgUncompressed->GetLargestPossibleRegion());
-  inConv->Update();
-  LabelImage4DType::Pointer imgLabel = inConv->GetOutput();
-  imgUncompressed = NULL; //deallocate intermediate image to save memory
-
-  // Disconnect from the pipeline right away
-  imgLabel->DisconnectPipeline();
+    // The lines were filled in through the buffer
+    imgLabel->Modified();
+    }
+  else
+    {
+    // Cast the native to label type
+    CastNativeImage<UncompressedImage4DType> caster;
+    UncompressedImage4DType::Pointer imgUncompressed = caster(io);
+
+    //use specialized RoI filter to convert to RLEImage
+    typedef itk::RegionOfInterestImageFilter<UncompressedImage4DType, LabelImage4DType> inConverterType;
+    inConverterType::Pointer inConv = inConverterType::New();
+    inConv->SetInput(imgUncompressed);
+    inConv->SetRegionOfInterest(imgUncompressed->GetLargestPossibleRegion());
+    inConv->Update();
+    imgLabel = inConv->GetOutput();
+    imgUncompressed = NULL; //deallocate intermediate image to save memory
+
+    // Disconnect from the pipeline right away
+    imgLabel->DisconnectPipeline();
+    }
 
   // The header of the label image is made to match that of the grey image
   imgLabel->SetOrigin(this->GetMain()->GetImage4DBase()->GetOrigin());
@@ -46,6 +46,8 @@
 #include "IRISVectorTypesToITKConversion.h"
 #include "SNAPImageData.h"
 #include "MeshManager.h"
+#include "MeshDiskCache.h"
+#include "SlicePreviewTileCacheBudget.h"
 #include "MeshExportSettings.h"
 #include "SegmentationStatistics.h"
 #include "RLEImageRegionIterator.h"
@@ -89,6 +91,8 @@
 #include "ImageMeshLayers.h"
 #include "StandaloneMeshWrapper.h"
 #include "AllPurposeProgressAccumulator.h"
+#include "itkMultiThreaderBase.h"
+#include "ImageRayIntersectionFinder.h"
 
 #include <stdio.h>
 #include <sstream>
@@ -101,6 +105,14 @@ IRISApplication
   m_SystemInterface = new SystemInterface();
   m_HistoryManager = m_SystemInterface->GetHistoryManager();
 
+  // Statistics are computed on first request
+  m_SegmentationStatistics = new SegmentationStatistics();
+  m_StatisticsSegmentation = NULL;
+  m_StatisticsTimePoint = 0;
+  m_StatisticsSegmentationMTime = 0;
+  m_StatisticsDeltaObserverTag = 0;
+  m_StatisticsDeleteObserverTag = 0;
+
   // Create a color map preset manager
   m_ColorMapPresetManager = ColorMapPresetManager::New();
   m_ColorMapPresetManager->Initialize(m_SystemInterface);
@@ -135,6 +147,14 @@ IRISApplication
   // TODO: should this also be a generic Wrapper Image Data change event?
   Rebroadcaster::RebroadcastAsSourceEvent(m_SNAPImageData, LevelSetImageChangeEvent(), this);
 
+  // Incremental statistics sample the image layers, and must be recomputed
+  // once layers are added or removed
+  typedef itk::MemberCommand<IRISApplication> LayerCommandType;
+  SmartPtr<LayerCommandType> cmdLayers = LayerCommandType::New();
+  cmdLayers->SetCallbackFunction(this, &IRISApplication::OnStatisticsLayerChange);
+  m_IRISImageData->AddObserver(LayerChangeEvent(), cmdLayers);
+  m_SNAPImageData->AddObserver(LayerChangeEvent(), cmdLayers);
+
   // Construct new global state object
   m_GlobalState = GlobalState::New();
   m_GlobalState->SetDriver(this);
@@ -160,9 +180,17 @@ IRISApplication
   m_RandomForestPreviewWrapper = RFPreprocessingPreviewWrapperType::New();
   m_LastUsedRFClassifierComponents = 0;
 
+  // The preview wrappers share the memory for their cached slices
+  m_PreviewTileCacheBudget = SlicePreviewTileCacheBudget::New();
+  m_ThresholdPreviewWrapper->SetTileCacheBudget(m_PreviewTileCacheBudget);
+  m_EdgePreviewWrapper->SetTileCacheBudget(m_PreviewTileCacheBudget);
+  m_GMMPreviewWrapper->SetTileCacheBudget(m_PreviewTileCacheBudget);
+  m_RandomForestPreviewWrapper->SetTileCacheBudget(m_PreviewTileCacheBudget);
+
   m_PreprocessingMode = PREPROCESS_NONE;
 
   // Initialize the mesh management object
+  m_MeshDiskCache = MeshDiskCache::New();
   m_MeshManager = MeshManager::New();
   m_MeshManager->Initialize(this);
 
@@ -193,6 +221,8 @@ GetImageToAnatomyRAI()
 IRISApplication
 ::~IRISApplication() 
 {
+  this->DetachStatisticsSegmentation();
+  delete m_SegmentationStatistics;
   delete m_SystemInterface;
 }
 
@@ -1042,8 +1072,7 @@ void
 IRISApplication
 ::ExportSegmentationStatistics(const char *file)
 {
-  SegmentationStatistics stats;
-  stats.Compute(this);
+  SegmentationStatistics stats = this->GetSegmentationStatistics();
 
   // Open the selected file for writing
   std::ofstream fout(file);
@@ -1065,6 +1094,106 @@ IRISApplication
   fout.close();
 }
 
+const SegmentationStatistics &
+IRISApplication
+::GetSegmentationStatistics()
+{
+  LabelImageWrapper *seg = this->GetSelectedSegmentationLayer();
+
+  // Check if the deltas seen since the last scan account for all changes
+  bool current =
+      m_StatisticsSegmentationMTime != 0
+      && seg == m_StatisticsSegmentation
+      && seg->GetTimePointIndex() == m_StatisticsTimePoint
+      && seg->GetTimePointPixelsMTime() == m_StatisticsSegmentationMTime
+      && m_SegmentationStatistics->AreLayersCurrent(this);
+
+  if(current)
+    {
+    m_SegmentationStatistics->UpdateDerivedStatistics();
+    return *m_SegmentationStatistics;
+    }
+
+  // Start tracking deltas applied to the segmentation
+  if(seg != m_StatisticsSegmentation)
+    {
+    this->DetachStatisticsSegmentation();
+
+    typedef itk::MemberCommand<IRISApplication> CommandType;
+    SmartPtr<CommandType> cmdDelta = CommandType::New();
+    cmdDelta->SetCallbackFunction(this, &IRISApplication::OnStatisticsSegmentationEvent);
+    m_StatisticsDeltaObserverTag = seg->AddObserver(SegmentationDeltaEvent(), cmdDelta);
+
+    SmartPtr<CommandType> cmdDelete = CommandType::New();
+    cmdDelete->SetCallbackFunction(this, &IRISApplication::OnStatisticsSegmentationDeleted);
+    m_StatisticsDeleteObserverTag = seg->AddObserver(itk::DeleteEvent(), cmdDelete);
+
+    m_StatisticsSegmentation = seg;
+    }
+
+  // Scan the whole image
+  m_SegmentationStatistics->Compute(this);
+  m_StatisticsTimePoint = seg->GetTimePointIndex();
+  m_StatisticsSegmentationMTime = seg->GetTimePointPixelsMTime();
+
+  return *m_SegmentationStatistics;
+}
+
+void
+IRISApplication
+::OnStatisticsSegmentationEvent(itk::Object *source, const itk::EventObject &event)
+{
+  const SegmentationDeltaEvent *devent = dynamic_cast<const SegmentationDeltaEvent *>(&event);
+  if(!devent || source != m_StatisticsSegmentation || m_StatisticsSegmentationMTime == 0)
+    return;
+
+  // A delta can only be applied on top of the voxels that the statistics
+  // describe. Otherwise the segmentation was changed in some other way.
+  if(devent->GetTimePoint() != m_StatisticsTimePoint
+     || devent->GetMTime() != m_StatisticsSegmentationMTime)
+    {
+    m_StatisticsSegmentationMTime = 0;
+    return;
+    }
+
+  if(devent->GetDelta())
+    m_SegmentationStatistics->ApplyDelta(
+          m_StatisticsSegmentation, devent->GetDelta(), devent->IsReverse());
+  else
+    m_StatisticsSegmentationMTime = devent->GetModifiedMTime();
+}
+
+void
+IRISApplication
+::OnStatisticsSegmentationDeleted(const itk::Object *source, const itk::EventObject &)
+{
+  if(source == m_StatisticsSegmentation)
+    {
+    m_StatisticsSegmentation = NULL;
+    m_StatisticsSegmentationMTime = 0;
+    }
+}
+
+void
+IRISApplication
+::OnStatisticsLayerChange(itk::Object *, const itk::EventObject &)
+{
+  m_StatisticsSegmentationMTime = 0;
+}
+
+void
+IRISApplication
+::DetachStatisticsSegmentation()
+{
+  if(m_StatisticsSegmentation)
+    {
+    m_StatisticsSegmentation->RemoveObserver(m_StatisticsDeltaObserverTag);
+    m_StatisticsSegmentation->RemoveObserver(m_StatisticsDeleteObserverTag);
+    m_StatisticsSegmentation = NULL;
+    }
+  m_StatisticsSegmentationMTime = 0;
+}
+
 
 
 void
@@ -1200,8 +1329,6 @@ IRISApplication
   return it.GetNumberOfChangedVoxels();
 }
 
-// TODO: This information should be cached at the segmentation layer level
-// by keeping track of label counts after every update operation.
 size_t
 IRISApplication
 ::GetNumberOfVoxelsWithLabel(LabelType label)
@@ -1209,20 +1336,12 @@ IRISApplication
   // Number of voxels matching current label
   size_t nvoxels = 0;
 
-  // We must iterate over all the label images
+  // Sum the label counts maintained by each of the label images
   for(LayerIterator it = this->GetCurrentImageData()->GetLayers(LABEL_ROLE);
       !it.IsAtEnd(); ++it)
     {
     LabelImageWrapper *wrapper = dynamic_cast<LabelImageWrapper *>(it.GetLayer());
-    const LabelImageType *seg = wrapper->GetImage();
-
-    // Get the number of voxels
-    for(LabelImageWrapper::ConstIterator it(seg, seg->GetBufferedRegion());
-        !it.IsAtEnd(); ++it)
-      {
-      if(it.Get() == label)
-        ++nvoxels;
-      }
+    nvoxels += wrapper->GetNumberOfVoxelsWithLabel(label);
     }
 
   return nvoxels;
@@ -1235,189 +1354,180 @@ IRISApplication
 {
   // Get the label image
   LabelImageWrapper *seg = this->GetSelectedSegmentationLayer();
-  
-  // Create the smart target iterator
-  SegmentationUpdateIterator it(
-        seg, seg->GetBufferedRegion(),
-        m_GlobalState->GetDrawingColorLabel(), m_GlobalState->GetDrawOverFilter());
+  LabelImageType *img = seg->GetModifiableImage();
+  itk::ImageRegion<3> region = seg->GetBufferedRegion();
+
+  LabelType active = m_GlobalState->GetDrawingColorLabel();
+  DrawOverFilter draw_over = m_GlobalState->GetDrawOverFilter();
 
   // Adjust the intercept by 0.5 for voxel offset
   intercept -= 0.5 * (normal[0] + normal[1] + normal[2]);
 
-  // Iterate over the image, relabeling labels on one side of the plane
-  while(!it.IsAtEnd())
+  // Same rule as SegmentationUpdateIterator::PaintAsForegroundPreserveClear()
+  auto relabel = [&](LabelType lOld) -> LabelType
     {
-    // Compute the distance to the plane
-    itk::Index<3> index = it.GetIndex();
-    double distance = 
-      index[0]*normal[0] + 
-      index[1]*normal[1] + 
-      index[2]*normal[2] - intercept;
-
-    // Check the side of the plane
-    if(distance > 0)
-      it.PaintAsForegroundPreserveClear();
+    if(lOld == 0)
+      return lOld;
 
-    // Next voxel
-    ++it;
-    }
-
-  // Finalize
-
-
-  // Store the undo point if needed
-  if(it.Finalize("3D scalpel"))
-    {
-    RecordCurrentLabelUse();
-    InvokeEvent(SegmentationChangeEvent());
-    }
+    if(draw_over.CoverageMode == PAINT_OVER_ALL ||
+       (draw_over.CoverageMode == PAINT_OVER_ONE && lOld == draw_over.DrawOverLabel) ||
+       (draw_over.CoverageMode == PAINT_OVER_VISIBLE && lOld != 0))
+      return active;
 
-  return it.GetNumberOfChangedVoxels();
-}
+    return lOld;
+    };
 
-int 
-IRISApplication
-::GetRayIntersectionWithSegmentation(const Vector3d &point, 
-                                     const Vector3d &ray, Vector3i &hit) const
-{
-  // Get the label wrapper
-  LabelImageWrapper *xLabelWrapper = this->GetSelectedSegmentationLayer();
-  assert(xLabelWrapper->IsInitialized());
+  long x0 = region.GetIndex(0), x1 = x0 + region.GetSize(0);
+  long y0 = region.GetIndex(1), y1 = y0 + region.GetSize(1);
+  long z0 = region.GetIndex(2), nz = region.GetSize(2);
+  LabelImageType::BufferType *lines = img->GetBuffer();
 
-  itk::Index<3> lIndex;
-  Vector3ui lSize = xLabelWrapper->GetSize();
+  // Split the image into slabs along z that are processed in parallel. Each
+  // slab records its changes in its own undo delta
+  typedef LabelImageWrapper::UndoManagerDelta DeltaType;
+  itk::MultiThreaderBase::Pointer mt = itk::MultiThreaderBase::New();
+  long nSlabs = std::max(1l, std::min((long) mt->GetNumberOfWorkUnits(), nz));
+  std::vector<DeltaType *> deltas(nSlabs);
+  std::vector<unsigned long> changed(nSlabs, 0);
 
-  double delta[3][3] = {{0.,0.,0.},{0.,0.,0.},{0.,0.,0.}}, dratio[3] = {0., 0., 0.};
-  int    signrx, signry, signrz;
+  // Deltas are created up front since each one takes a unique ID
+  for(long i = 0; i < nSlabs; i++)
+    deltas[i] = new DeltaType();
 
-  double rx = ray[0];
-  double ry = ray[1];
-  double rz = ray[2];
+  mt->ParallelizeArray(0, nSlabs, [&](itk::SizeValueType slab)
+    {
+    long zFirst = z0 + (nz * slab) / nSlabs, zLast = z0 + (nz * (slab + 1)) / nSlabs;
+    itk::ImageRegion<3> slabRegion = region;
+    slabRegion.SetIndex(2, zFirst);
+    slabRegion.SetSize(2, zLast - zFirst);
 
-  double rlen = rx*rx+ry*ry+rz*rz;
-  if(rlen == 0) return -1;
+    DeltaType *delta = deltas[slab];
+    delta->SetRegion(slabRegion);
 
-  double rfac = 1.0 / sqrt(rlen);
-  rx *= rfac; ry *= rfac; rz *= rfac;
+    for(long z = zFirst; z < zLast; z++)
+      {
+      for(long y = y0; y < y1; y++)
+        {
+        // Side of the plane of voxel x, computed as it has always been
+        auto inside = [&](long x)
+          { return x * normal[0] + y * normal[1] + z * normal[2] - intercept > 0; };
+
+        // The voxels on the positive side of the plane form an interval [a, b)
+        // of the line. Its end is estimated analytically and then corrected
+        // for rounding, which is possible because the side is monotonic in x
+        long a = x0, b = x1;
+        if(normal[0] == 0.0)
+          {
+          if(!inside(x0))
+            b = x0;
+          }
+        else
+          {
+          // Find the first voxel c where the side is the same as at x = inf
+          bool side = normal[0] > 0;
+          double t = (intercept - y * normal[1] - z * normal[2]) / normal[0];
+          t = std::max((double) x0, std::min((double) x1, std::floor(t)));
+          long c = (long) t;
+          while(c > x0 && inside(c - 1) == side)
+            c--;
+          while(c < x1 && inside(c) != side)
+            c++;
+
+          if(side)
+            a = c;
+          else
+            b = c;
+          }
 
-  if (rx >=0) signrx = 1; else signrx = -1;
-  if (ry >=0) signry = 1; else signry = -1;
-  if (rz >=0) signrz = 1; else signrz = -1;
+        // Relabel the interval run by run, recording the changes in the delta
+        itk::Index<2> lineIndex = {{ y, z }};
+        LabelImageType::RLLine &line = lines->GetPixel(lineIndex);
+        delta->EncodeRun(0, a - x0);
+        img->TransformLineInterval(line, a - x0, b - x0,
+                                   [&](LabelType lOld, long n) -> LabelType
+          {
+          LabelType lNew = relabel(lOld);
+          delta->EncodeRun((LabelType)(lNew - lOld), n);
+          if(lNew != lOld)
+            changed[slab] += n;
+          return lNew;
+          });
+        delta->EncodeRun(0, x1 - b);
+        }
+      }
 
-  // offset everything by (.5, .5) [becuz samples are at center of voxels]
-  // this offset will put borders of voxels at integer values
-  // we will work with this offset grid and offset back to check samples
-  // we really only need to offset "point"
-  double px = point[0]+0.5;
-  double py = point[1]+0.5;
-  double pz = point[2]+0.5;
+    delta->FinishEncoding();
+    }, nullptr);
 
-  // get the starting point within data extents
-  int c = 0;
-  while ( (px < 0 || px >= lSize[0]||
-           py < 0 || py >= lSize[1]||
-           pz < 0 || pz >= lSize[2]) && c < 10000)
+  // Only the slabs where voxels changed are kept for undo
+  unsigned long nChanged = 0;
+  std::vector<DeltaType *> changedDeltas;
+  for(long i = 0; i < nSlabs; i++)
     {
-    px += rx;
-    py += ry;
-    pz += rz;
-    c++;
+    if(changed[i] > 0)
+      {
+      nChanged += changed[i];
+      changedDeltas.push_back(deltas[i]);
+      }
+    else
+      {
+      delete deltas[i];
+      }
     }
-  if (c >= 9999) return -1;
 
-  // walk along ray to find intersection with any voxel with val > 0
-  while ( (px >= 0 && px < lSize[0]&&
-           py >= 0 && py < lSize[1] &&
-           pz >= 0 && pz < lSize[2]) )
+  // Store the undo point if needed
+  if(nChanged > 0)
     {
+    for(DeltaType *delta : changedDeltas)
+      seg->DeltaApplied(delta);
+    seg->DeltaPixelsModified();
 
-    // offset point by (-.5, -.5) [to account for earlier offset] and
-    // get the nearest sample voxel within unit cube around (px,py,pz)
-    //    lx = my_round(px-0.5);
-    //    ly = my_round(py-0.5);
-    //    lz = my_round(pz-0.5);
-    lIndex[0] = (int) px;
-    lIndex[1] = (int) py;
-    lIndex[2] = (int) pz;
+    for(DeltaType *delta : changedDeltas)
+      seg->StoreIntermediateUndoDelta(delta);
+    seg->StoreUndoPoint("3D scalpel");
 
-    LabelType hitlabel = xLabelWrapper->GetVoxel(lIndex);
+    RecordCurrentLabelUse();
+    InvokeEvent(SegmentationChangeEvent());
+    }
 
-    if (m_ColorLabelTable->IsColorLabelValid(hitlabel))
-      {
-      ColorLabel cl = m_ColorLabelTable->GetColorLabel(hitlabel);
-      if(cl.IsVisible())
-        {
-        hit[0] = lIndex[0];
-        hit[1] = lIndex[1];
-        hit[2] = lIndex[2];
-        return 1;
-        }
-      }
+  return nChanged;
+}
 
-    // BEGIN : walk along ray to border of next voxel touched by ray
+/** Hit tester for GetRayIntersectionWithSegmentation */
+class VisibleLabelHitTester
+{
+public:
+  VisibleLabelHitTester(const ColorLabelTable *table = NULL) : m_LabelTable(table) {}
 
-    // compute path to YZ-plane surface of next voxel
-    if (rx == 0)
-      { // ray is parallel to 0 axis
-      delta[0][0] = 9999;
-      }
-    else
-      {
-      delta[0][0] = (int)(px+signrx) - px;
-      }
+  int operator()(LabelType label) const
+  {
+    return m_LabelTable->IsColorLabelValid(label)
+        && m_LabelTable->GetColorLabel(label).IsVisible() ? 1 : 0;
+  }
 
-    // compute path to XZ-plane surface of next voxel
-    if (ry == 0)
-      { // ray is parallel to 1 axis
-      delta[1][0] = 9999;
-      }
-    else
-      {
-      delta[1][1] = (int)(py+signry) - py;
-      dratio[1]   = delta[1][1]/ry;
-      delta[1][0] = dratio[1] * rx;
-      }
+private:
+  const ColorLabelTable *m_LabelTable;
+};
 
-    // compute path to XY-plane surface of next voxel
-    if (rz == 0)
-      { // ray is parallel to 2 axis
-      delta[2][0] = 9999;
-      }
-    else
-      {
-      delta[2][2] = (int)(pz+signrz) - pz;
-      dratio[2]   = delta[2][2]/rz;
-      delta[2][0] = dratio[2] * rx;
-      }
+int 
+IRISApplication
+::GetRayIntersectionWithSegmentation(const Vector3d &point, 
+                                     const Vector3d &ray, Vector3i &hit) const
+{
+  // Get the label wrapper
+  LabelImageWrapper *xLabelWrapper = this->GetSelectedSegmentationLayer();
+  assert(xLabelWrapper->IsInitialized());
 
-    // choose the shortest path 
-    if ( fabs(delta[0][0]) <= fabs(delta[1][0]) && fabs(delta[0][0]) <= fabs(delta[2][0]) )
-      {
-      dratio[0]   = delta[0][0]/rx;
-      delta[0][1] = dratio[0] * ry;
-      delta[0][2] = dratio[0] * rz;
-      px += delta[0][0];
-      py += delta[0][1];
-      pz += delta[0][2];
-      }
-    else if ( fabs(delta[1][0]) <= fabs(delta[0][0]) && fabs(delta[1][0]) <= fabs(delta[2][0]) )
-      {
-      delta[1][2] = dratio[1] * rz;
-      px += delta[1][0];
-      py += delta[1][1];
-      pz += delta[1][2];
-      }
-    else
-      { //if (fabs(delta[2][0] <= fabs(delta[0][0] && fabs(delta[2][0] <= fabs(delta[0][0]) 
-      delta[2][1] = dratio[2] * ry;
-      px += delta[2][0];
-      py += delta[2][1];
-      pz += delta[2][2];
-      }
-    // END : walk along ray to border of next voxel touched by ray
+  typedef ImageRayIntersectionFinder<LabelImageType, VisibleLabelHitTester> FinderType;
+  FinderType finder;
+  VisibleLabelHitTester tester(m_ColorLabelTable);
+  finder.SetHitTester(tester);
 
-    } // while ( (px
-  return 0;
+  // Skip over empty bricks, unless the clear label itself can be hit
+  if(!tester(0))
+    finder.SetBrickOccupancy(xLabelWrapper->GetBrickOccupancy());
+
+  return finder.FindIntersection(xLabelWrapper->GetImage(), point, ray, hit);
 }
 
 void
@@ -1852,6 +1962,8 @@ IRISApplication
   del->UnloadCurrentImage();
 
   // Read the image body
+  io->SetLazyTimePointThreshold(del->GetLazyTimePointThreshold());
+  io->SetStreamNativeData(del->GetStreamNativeData());
 	io->ReadNativeImageData(dataProgCmd);
 
   // Validate the image data
@@ -63,6 +63,8 @@ class AbstractSlicePreviewFilterWrapper;
 class UnsupervisedClustering;
 class ImageWrapperBase;
 class MeshManager;
+class MeshDiskCache;
+class SlicePreviewTileCacheBudget;
 class AbstractOpenImageDelegate;
 class AbstractSaveImageDelegate;
 class IRISWarningList;
@@ -72,6 +74,7 @@ class LabelUseHistory;
 class ImageAnnotationData;
 class LabelImageWrapper;
 class ImageReadingProgressAccumulator;
+class SegmentationStatistics;
 
 template <class TPixel, class TLabel, int VDim> class RandomForestClassifier;
 template <class TPixel, class TLabel, int VDim> class RFClassificationEngine;
@@ -511,6 +514,16 @@ public:
   /** Export voxel statistis to a file */
   void ExportSegmentationStatistics(const char *file);
 
+  /**
+   * Get the label statistics (voxel counts, volumes, intensity means) for the
+   * selected segmentation layer. The first call scans the whole image. After
+   * that, the per-label sums and counts are updated from each undo delta that
+   * changes the segmentation, so repeated calls after painting are cheap. A
+   * full scan is repeated if the segmentation is changed in any other way, or
+   * if the image layers change.
+   */
+  const SegmentationStatistics &GetSegmentationStatistics();
+
   /**
    * Export the 3D mesh to a file, using settings passed in the
    * MeshExportSettings structure.
@@ -628,6 +641,9 @@ public:
   /** Get the object used to manage VTK mesh creation */
   irisGetMacro(MeshManager, MeshManager *)
 
+  /** Get the on-disk mesh cache shared by all mesh pipelines */
+  irisGetMacro(MeshDiskCache, MeshDiskCache *)
+
   /** Get the preset manager for color maps */
   irisGetMacro(ColorMapPresetManager, ColorMapPresetManager *)
 
@@ -756,6 +772,9 @@ protected:
   // Random forest preprocessing wrapper
   SmartPtr<RFPreprocessingPreviewWrapperType> m_RandomForestPreviewWrapper;
 
+  // Memory shared by the slice caches of the preview wrappers
+  SmartPtr<SlicePreviewTileCacheBudget> m_PreviewTileCacheBudget;
+
   // The EM classification object
   SmartPtr<UnsupervisedClustering> m_ClusteringEngine;
 
@@ -773,6 +792,9 @@ protected:
   // Mesh object (used to manage meshes)
   SmartPtr<MeshManager> m_MeshManager;
 
+  // Cache of segmentation meshes, stored next to the workspace
+  SmartPtr<MeshDiskCache> m_MeshDiskCache;
+
   // Color map preset manager
   SmartPtr<ColorMapPresetManager> m_ColorMapPresetManager;
 
@@ -817,6 +839,31 @@ protected:
   // -------------- Saving IRIS state during SNAP mode --------------------
   unsigned long m_SavedIRISSelectedSegmentationLayerId;
 
+  // -------------- Incremental segmentation statistics --------------------
+
+  // Statistics for the segmentation layer m_StatisticsSegmentation, valid
+  // for the voxels as of m_StatisticsSegmentationMTime (0 if invalid)
+  SegmentationStatistics *m_SegmentationStatistics;
+  LabelImageWrapper *m_StatisticsSegmentation;
+  unsigned int m_StatisticsTimePoint;
+  itk::ModifiedTimeType m_StatisticsSegmentationMTime;
+
+  // Observer tags on m_StatisticsSegmentation
+  unsigned long m_StatisticsDeltaObserverTag, m_StatisticsDeleteObserverTag;
+
+  // Called when the tracked segmentation is changed by a delta
+  void OnStatisticsSegmentationEvent(itk::Object *source, const itk::EventObject &event);
+
+  // Called when the tracked segmentation is deleted
+  void OnStatisticsSegmentationDeleted(const itk::Object *source, const itk::EventObject &event);
+
+  // Called when image layers are added or removed. The statistics refer to
+  // the layers they were computed from, so deltas can no longer be applied.
+  void OnStatisticsLayerChange(itk::Object *source, const itk::EventObject &event);
+
+  // Stop tracking changes to the segmentation
+  void DetachStatisticsSegmentation();
+
 };
 
 #endif // __IRISApplication_h_
@@ -56,6 +56,18 @@ public:
   virtual bool GetUseRegistration() const { return false; }
   virtual bool IsOverlay() const { return false; }
 
+  /**
+   * Size in bytes above which 4D images are read one time point at a time,
+   * see GuidedNativeImageIO::SetLazyTimePointThreshold(). Zero disables this.
+   */
+  virtual unsigned long GetLazyTimePointThreshold() const { return 0; }
+
+  /**
+   * Whether the delegate reads the image data itself in slabs, see
+   * GuidedNativeImageIO::SetStreamNativeData().
+   */
+  virtual bool GetStreamNativeData() const { return false; }
+
 protected:
   AbstractOpenImageDelegate() : m_MetaDataRegistry(NULL) {}
   virtual ~AbstractOpenImageDelegate() {}
@@ -80,6 +92,10 @@ public:
 
   virtual void ValidateHeader(GuidedNativeImageIO *io, IRISWarningList &wl) ITK_OVERRIDE;
 
+  /** Anatomic 4D images over 1GB are read lazily */
+  virtual unsigned long GetLazyTimePointThreshold() const ITK_OVERRIDE
+    { return 1024ul * 1024ul * 1024ul; }
+
 protected:
   LoadAnatomicImageDelegate() {}
   virtual ~LoadAnatomicImageDelegate() {}
@@ -130,6 +146,9 @@ public:
   void UnloadCurrentImage() ITK_OVERRIDE;
   ImageWrapperBase * UpdateApplicationWithImage(GuidedNativeImageIO *io) ITK_OVERRIDE;
 
+  // Segmentations are run-length encoded one slab at a time as they are read
+  virtual bool GetStreamNativeData() const ITK_OVERRIDE { return true; }
+
 protected:
   // TODO: this is probably a temporary band-aid. In some situations, we want to be
   // able to load segmentation images as the one and only segmentation layer and in
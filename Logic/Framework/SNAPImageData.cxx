@@ -45,6 +45,8 @@
 #include "itkMaximumImageFilter.h"
 #include "itkSubtractImageFilter.h"
 #include "itkUnaryFunctorImageFilter.h"
+#include "itkImageRegionConstIteratorWithIndex.h"
+#include "itkImageRegionIteratorWithIndex.h"
 
 #include "SmoothBinaryThresholdImageFilter.h"
 #include "GlobalState.h"
@@ -188,11 +190,8 @@ SNAPImageData
   // data, not an image into a needless copy of an IRIS region.
   LabelImageType::RegionType region = imgInput->GetBufferedRegion();
 
-  // Create iterators to perform the copy
-  typedef itk::ImageRegionConstIterator<LabelImageType> SourceIterator;
+  // Iterator used to fill out the bubbles
   typedef itk::ImageRegionIteratorWithIndex<FloatImageType> TargetIterator;
-  SourceIterator itSource(imgInput,region);
-  TargetIterator itTarget(imgLevelSet,region);
 
   // During the copy loop, compute the extents of the initialization
   Vector3i bbLower = region.GetSize();
@@ -201,25 +200,43 @@ SNAPImageData
   unsigned long nInitVoxels = 0;
 
   // Convert the input label image into a binary function whose 0 level set
-  // is the boundary of the current label's region
-  while(!itSource.IsAtEnd())
+  // is the boundary of the current label's region. The lines of the RLE image
+  // are walked run by run, so lines without the label cost one comparison
+  // per run and the voxels of the label are filled a run at a time. The
+  // sparse field solver builds its own narrow band from the zero crossing
+  // of this image, so only the sign of each voxel needs to be set here.
+  typedef LabelImageType::BufferType LabelBufferType;
+  typedef itk::ImageRegionConstIteratorWithIndex<LabelBufferType> LineIterator;
+  LabelBufferType *lines = imgInput->GetBuffer();
+  LineIterator itLine(lines, lines->GetBufferedRegion());
+
+  size_t nx = region.GetSize(0), ny = region.GetSize(1);
+  float *lsBuffer = imgLevelSet->GetBufferPointer();
+  for(; !itLine.IsAtEnd(); ++itLine)
     {
-    if(itSource.Value() == m_SnakeColorLabel)
-      {
-      // Expand the bounding box accordingly
-      Vector3i point = itTarget.GetIndex();
-      bbLower = vector_min(bbLower,point);
-      bbUpper = vector_max(bbUpper,point);
-      
-      // Increase the number of initialization voxels
-      nInitVoxels++;
+    const LabelImageType::RLLine &line = itLine.Value();
+    LabelBufferType::IndexType idxLine = itLine.GetIndex();
+    size_t dy = idxLine[0] - region.GetIndex(1), dz = idxLine[1] - region.GetIndex(2);
+    float *lsLine = lsBuffer + nx * (dy + ny * dz);
 
-      // Set the target value to inside
-      itTarget.Value() = INSIDE_VALUE;
+    size_t x = 0;
+    for(size_t iSeg = 0; iSeg < line.size(); x += line[iSeg++].first)
+      {
+      if(line[iSeg].second != m_SnakeColorLabel)
+        continue;
+
+      size_t len = line[iSeg].first;
+      std::fill(lsLine + x, lsLine + x + len, INSIDE_VALUE);
+      nInitVoxels += len;
+
+      // Expand the bounding box by the ends of the run
+      Vector3i first((int) (region.GetIndex(0) + x),
+                     (int) idxLine[0], (int) idxLine[1]);
+      Vector3i last = first;
+      last[0] += (int) len - 1;
+      bbLower = vector_min(bbLower, first);
+      bbUpper = vector_max(bbUpper, last);
       }
-
-    // Go to the next pixel
-    ++itTarget; ++itSource;
     }
 
   // Fill in the bubbles by computing their
@@ -543,10 +560,11 @@ void SNAPImageData::SwapLabelImageWithCompressedAlternative()
   if(m_CompressedAlternateLabelImage)
     {
     LabelImageWrapper::Iterator it_write(liw->GetModifiableImage(), liw->GetBufferedRegion());
-    for(size_t i = 0; i < m_CompressedAlternateLabelImage->GetNumberOfRLEs(); ++i)
+    for(CompressedLabelImageType::RLEReader rit(m_CompressedAlternateLabelImage);
+        !rit.IsAtEnd(); ++rit)
       {
-      LabelType value = m_CompressedAlternateLabelImage->GetRLEValue(i);
-      for(size_t j = 0; j < m_CompressedAlternateLabelImage->GetRLELength(i); ++j, ++it_write)
+      LabelType value = rit.GetValue();
+      for(size_t j = 0; j < rit.GetLength(); ++j, ++it_write)
         it_write.Set(value);
       }
     }
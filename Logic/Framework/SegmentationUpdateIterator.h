@@ -235,7 +235,8 @@ public:
     m_Delta->FinishEncoding();
     if(m_ChangedVoxels > 0)
       {
-      m_Wrapper->PixelsModified();
+      m_Wrapper->DeltaApplied(m_Delta);
+      m_Wrapper->DeltaPixelsModified();
       if(undo_string)
         m_Wrapper->StoreUndoPoint(undo_string, RelinquishDelta());
       return true;
@@ -37,6 +37,8 @@
 
 #include <vector>
 #include <list>
+#include <map>
+#include <cstdio>
 
 #include <RLEImage.h>
 
@@ -44,6 +46,12 @@
  * The Delta class represents a difference between two images used in
  * the Undo system. It only supports linear traversal of images and
  * stores differences in an RLE (run length encoding) format.
+ *
+ * To keep long editing histories in memory, the runs are stored compactly:
+ * each run is a variable-length encoded run length, followed by the
+ * variable-length encoded index of the run value in a small dictionary of
+ * the distinct values in the delta. A typical run takes 2-3 bytes. The
+ * encoded runs can also be moved to a file (spilled) and restored later.
  */
 template <typename TPixel>
 class UndoDelta
@@ -61,29 +69,96 @@ public:
 
   void Encode(const TPixel &value);
 
-  void FinishEncoding();
-
-  size_t GetNumberOfRLEs()
-  { return m_Array.size(); }
+  /** Encode a run of identical values, same as calling Encode() n times */
+  void EncodeRun(const TPixel &value, size_t n);
 
-  TPixel GetRLEValue(size_t i)
-  { return m_Array[i].second; }
+  void FinishEncoding();
 
-  size_t GetRLELength(size_t i)
-  { return m_Array[i].first; }
+  size_t GetNumberOfRLEs() const
+  { return m_NumberOfRLEs; }
 
   unsigned long GetUniqueID() const
   { return m_UniqueID; }
 
+  /**
+   * Sequential reader for the runs in the delta. The delta must not be
+   * spilled while it is being read.
+   */
+  class RLEReader
+  {
+  public:
+    RLEReader(const UndoDelta *delta);
+
+    bool IsAtEnd() const
+    { return m_Index >= m_Delta->m_NumberOfRLEs; }
+
+    RLEReader &operator ++()
+    { ++m_Index; this->Read(); return *this; }
+
+    size_t GetLength() const
+    { return m_Length; }
+
+    TPixel GetValue() const
+    { return m_Value; }
+
+  protected:
+    void Read();
+
+    const UndoDelta *m_Delta;
+    const unsigned char *m_Ptr;
+    size_t m_Index, m_Length;
+    TPixel m_Value;
+  };
+
+  /** Number of bytes of memory used by the delta */
+  size_t GetMemorySize() const;
+
+  /** Number of bytes taken up by the encoded runs, in memory or on disk */
+  size_t GetEncodedSize() const
+  { return m_IsSpilled ? m_SpillSize : m_Data.size(); }
+
+  /** Whether the encoded runs are currently held in a file */
+  bool IsSpilled() const
+  { return m_IsSpilled; }
+
+  /**
+   * Append the encoded runs to the end of a file and release their memory.
+   * Returns false if the data could not be written, in which case the delta
+   * is left in memory.
+   */
+  bool Spill(FILE *file);
+
+  /** Read the encoded runs back from the file they were spilled to */
+  void Restore(FILE *file);
+
   UndoDelta & operator = (const UndoDelta &other);
 
 protected:
-  typedef std::pair<size_t, TPixel> RLEPair;
-  typedef std::vector<RLEPair> RLEArray;
-  RLEArray m_Array;
+
+  // Append a variable-length unsigned integer to the data
+  void PushVarInt(size_t value);
+
+  // Append the current run to the data
+  void PushRun();
+
+  // Encoded runs
+  std::vector<unsigned char> m_Data;
+  size_t m_NumberOfRLEs;
+
+  // Distinct values in the delta, indexed by the runs
+  std::vector<TPixel> m_Dictionary;
+
+  // Reverse lookup into the dictionary, only used during encoding
+  std::map<TPixel, size_t> m_DictionaryLookup;
+
   size_t m_CurrentLength;
   TPixel m_LastValue;
 
+  // Location of the encoded runs when spilled to a file
+  bool m_IsSpilled;
+  long m_SpillOffset;
+  size_t m_SpillSize;
+
   // The delta is associated with an image region
   RegionType m_Region;
 
@@ -96,6 +171,11 @@ protected:
 /**
  * \class UndoDataManager
  * \brief Manages data (delta updates) for undo/redo in itk-snap
+ *
+ * The amount of memory used by the undo history is limited to a budget in
+ * bytes. When the budget is exceeded, the oldest commits are either dropped
+ * or, if a disk budget has been specified, moved to a temporary file from
+ * which they are read back when they are needed for undo or redo.
  */
 template<typename TPixel> class UndoDataManager
 {
@@ -123,13 +203,26 @@ public:
     Commit(const DList &list, const char *name);
     void DeleteDeltas();
     size_t GetNumberOfRLEs() const;
+    size_t GetMemorySize() const;
+    size_t GetEncodedSize() const;
+    bool IsSpilled() const;
+    bool Spill(FILE *file);
+    void Restore(FILE *file);
     const DList &GetDeltas() const { return m_Deltas; }
   protected:
     DList m_Deltas;
     std::string m_Name;
   };
 
-  UndoDataManager(size_t nMinCommits, size_t nMaxTotalSize);
+  /**
+   * Create an undo manager that keeps at least nMinCommits commits and
+   * limits the memory used by the commits to nMaxTotalSize bytes. Commits
+   * beyond the memory budget are spilled to a temporary file holding at
+   * most nMaxDiskSize bytes; the default of 0 disables spilling.
+   */
+  UndoDataManager(size_t nMinCommits, size_t nMaxTotalSize, size_t nMaxDiskSize = 0);
+
+  ~UndoDataManager();
 
   /** Add a delta to the staging list. The staging list must be committed */
   void AddDeltaToStaging(Delta *delta);
@@ -149,6 +242,20 @@ public:
   size_t GetNumberOfCommits()
     { return m_CommitList.size(); }
 
+  /** Bytes of memory used by the commits */
+  size_t GetTotalSize() const
+    { return m_TotalSize; }
+
+  /** Number of commits whose deltas are currently spilled to disk */
+  size_t GetNumberOfSpilledCommits() const;
+
+  /** Bytes of commit data spilled to disk */
+  size_t GetDiskSize() const
+    { return m_DiskSize; }
+
+  /** Size of the spill file, including the space left by restored commits */
+  size_t GetSpillFileSize() const;
+
 private:
 
   // Current staging list - where deltas are added
@@ -159,10 +266,28 @@ private:
   typedef typename CList::iterator CIterator;
   typedef typename CList::const_iterator CConstIterator;
 
+  // Delete a commit, updating the memory and disk usage
+  CIterator DeleteCommit(CIterator it);
+
+  // Spill or drop old commits until nIncoming more bytes fit in memory. The
+  // commit keep is neither spilled nor dropped (pass end() to allow all)
+  void EnforceMemoryBudget(size_t nIncoming, CIterator keep);
+
+  // Bring the deltas of a commit back into memory, spilling other commits
+  // if this exceeds the memory budget
+  void RestoreCommit(CIterator it);
+
+  // Rewrite the spill file when it contains too much dead space
+  void CompactSpillFile();
+
   // A list of commits
   CList m_CommitList;
   CIterator m_Position;
   size_t m_TotalSize, m_MinCommits, m_MaxTotalSize;
+
+  // Spill file and its usage
+  FILE *m_SpillFile;
+  size_t m_DiskSize, m_MaxDiskSize;
 };
 
 #endif // __UndoDataManager_h_
@@ -32,6 +32,7 @@
   PURPOSE.  See the above copyright notices for more information. 
 
 =========================================================================*/
+#include "IRISException.h"
 
 template<typename TPixel> unsigned long UndoDelta<TPixel>::m_UniqueIDCounter = 0;
 
@@ -40,9 +41,44 @@ UndoDelta<TPixel>
 ::UndoDelta()
 {
   m_CurrentLength = 0;
+  m_NumberOfRLEs = 0;
+  m_IsSpilled = false;
+  m_SpillOffset = 0;
+  m_SpillSize = 0;
   m_UniqueID = m_UniqueIDCounter++;
 }
 
+template<typename TPixel>
+void
+UndoDelta<TPixel>
+::PushVarInt(size_t value)
+{
+  while(value >= 0x80)
+    {
+    m_Data.push_back((unsigned char)(value | 0x80));
+    value >>= 7;
+    }
+  m_Data.push_back((unsigned char) value);
+}
+
+template<typename TPixel>
+void
+UndoDelta<TPixel>
+::PushRun()
+{
+  // Look up the value in the dictionary, adding it if necessary
+  typename std::map<TPixel, size_t>::iterator it = m_DictionaryLookup.find(m_LastValue);
+  if(it == m_DictionaryLookup.end())
+    {
+    it = m_DictionaryLookup.insert(std::make_pair(m_LastValue, m_Dictionary.size())).first;
+    m_Dictionary.push_back(m_LastValue);
+    }
+
+  PushVarInt(m_CurrentLength);
+  PushVarInt(it->second);
+  m_NumberOfRLEs++;
+}
+
 template<typename TPixel>
 void
 UndoDelta<TPixel>
@@ -59,19 +95,102 @@ UndoDelta<TPixel>
     }
   else
     {
-    m_Array.push_back(std::make_pair(m_CurrentLength, m_LastValue));
+    PushRun();
     m_CurrentLength = 1;
     m_LastValue = value;
     }
 }
 
+template<typename TPixel>
+void
+UndoDelta<TPixel>
+::EncodeRun(const TPixel &value, size_t n)
+{
+  if(n == 0)
+    return;
+
+  if(m_CurrentLength == 0)
+    {
+    m_LastValue = value;
+    m_CurrentLength = n;
+    }
+  else if(value == m_LastValue)
+    {
+    m_CurrentLength += n;
+    }
+  else
+    {
+    PushRun();
+    m_CurrentLength = n;
+    m_LastValue = value;
+    }
+}
+
 template<typename TPixel>
 void
 UndoDelta<TPixel>
 ::FinishEncoding()
 {
   if(m_CurrentLength > 0)
-    m_Array.push_back(std::make_pair(m_CurrentLength, m_LastValue));
+    PushRun();
+
+  // The lookup is no longer needed, and the data will not grow anymore
+  m_DictionaryLookup.clear();
+  m_Data.shrink_to_fit();
+  m_Dictionary.shrink_to_fit();
+}
+
+template<typename TPixel>
+size_t
+UndoDelta<TPixel>
+::GetMemorySize() const
+{
+  return sizeof(*this)
+      + m_Data.capacity()
+      + m_Dictionary.capacity() * sizeof(TPixel);
+}
+
+template<typename TPixel>
+bool
+UndoDelta<TPixel>
+::Spill(FILE *file)
+{
+  if(m_IsSpilled)
+    return true;
+
+  if(fseek(file, 0, SEEK_END) != 0)
+    return false;
+
+  long offset = ftell(file);
+  if(offset < 0)
+    return false;
+
+  if(m_Data.size() && fwrite(m_Data.data(), 1, m_Data.size(), file) != m_Data.size())
+    return false;
+
+  m_SpillOffset = offset;
+  m_SpillSize = m_Data.size();
+  m_IsSpilled = true;
+  std::vector<unsigned char>().swap(m_Data);
+  return true;
+}
+
+template<typename TPixel>
+void
+UndoDelta<TPixel>
+::Restore(FILE *file)
+{
+  if(!m_IsSpilled)
+    return;
+
+  m_Data.resize(m_SpillSize);
+  if(fseek(file, m_SpillOffset, SEEK_SET) != 0 ||
+     (m_SpillSize && fread(m_Data.data(), 1, m_SpillSize, file) != m_SpillSize))
+    throw IRISException("Failed to read undo data from temporary file");
+
+  m_IsSpilled = false;
+  m_SpillOffset = 0;
+  m_SpillSize = 0;
 }
 
 template<typename TPixel>
@@ -79,24 +198,96 @@ UndoDelta<TPixel> &
 UndoDelta<TPixel>
 ::operator = (const UndoDelta<TPixel> &other)
 {
-  m_Array = other.m_Array;
+  m_Data = other.m_Data;
+  m_NumberOfRLEs = other.m_NumberOfRLEs;
+  m_Dictionary = other.m_Dictionary;
+  m_DictionaryLookup = other.m_DictionaryLookup;
   m_CurrentLength = other.m_CurrentLength;
   m_LastValue = other.m_LastValue;
+  m_IsSpilled = other.m_IsSpilled;
+  m_SpillOffset = other.m_SpillOffset;
+  m_SpillSize = other.m_SpillSize;
   m_Region = other.m_Region;
   return *this;
 }
 
+template<typename TPixel>
+UndoDelta<TPixel>::RLEReader
+::RLEReader(const UndoDelta *delta)
+  : m_Delta(delta), m_Ptr(delta->m_Data.data()), m_Index(0), m_Length(0)
+{
+  assert(!delta->m_IsSpilled);
+  this->Read();
+}
+
+template<typename TPixel>
+void
+UndoDelta<TPixel>::RLEReader
+::Read()
+{
+  if(this->IsAtEnd())
+    return;
+
+  // Decode the run length and the dictionary index
+  size_t v[2];
+  for(int k = 0; k < 2; k++)
+    {
+    v[k] = 0;
+    for(int shift = 0; ; shift += 7)
+      {
+      unsigned char byte = *m_Ptr++;
+      v[k] |= (size_t)(byte & 0x7f) << shift;
+      if(!(byte & 0x80))
+        break;
+      }
+    }
+
+  m_Length = v[0];
+  m_Value = m_Delta->m_Dictionary[v[1]];
+}
+
 
 template<typename TPixel>
 UndoDataManager<TPixel>
-::UndoDataManager(size_t nMinCommits, size_t nMaxTotalSize)
+::UndoDataManager(size_t nMinCommits, size_t nMaxTotalSize, size_t nMaxDiskSize)
 {
   this->m_MinCommits = nMinCommits;
   this->m_MaxTotalSize = nMaxTotalSize;
+  this->m_MaxDiskSize = nMaxDiskSize;
   this->m_TotalSize = 0;
+  this->m_DiskSize = 0;
+  this->m_SpillFile = NULL;
   m_Position = m_CommitList.begin();
 }
 
+template<typename TPixel>
+UndoDataManager<TPixel>
+::~UndoDataManager()
+{
+  this->Clear();
+}
+
+template<typename TPixel>
+typename UndoDataManager<TPixel>::CIterator
+UndoDataManager<TPixel>
+::DeleteCommit(CIterator it)
+{
+  if(it->IsSpilled())
+    m_DiskSize -= it->GetEncodedSize();
+  m_TotalSize -= it->GetMemorySize();
+  it->DeleteDeltas();
+  it = m_CommitList.erase(it);
+
+  // Once nothing is left on disk, the temporary file can go away
+  if(m_DiskSize == 0 && m_SpillFile)
+    {
+    fclose(m_SpillFile);
+    m_SpillFile = NULL;
+    }
+
+  return it;
+}
+
 template<typename TPixel>
 void
 UndoDataManager<TPixel>
@@ -107,8 +298,7 @@ UndoDataManager<TPixel>
   while(m_Position != m_CommitList.end())
     {
     // Deallocate all the deltas in this commit
-    m_Position->DeleteDeltas();
-    m_Position = m_CommitList.erase(m_Position);
+    m_Position = DeleteCommit(m_Position);
     }
   m_TotalSize = 0;
 
@@ -125,6 +315,142 @@ UndoDataManager<TPixel>
   m_StagingList.push_back(delta);
 }
 
+template<typename TPixel>
+void
+UndoDataManager<TPixel>
+::EnforceMemoryBudget(size_t nIncoming, CIterator keep)
+{
+  CIterator it = m_CommitList.begin();
+  while(m_TotalSize + nIncoming > m_MaxTotalSize)
+    {
+    // Find the oldest commit that is still in memory, other than the one
+    // that is about to be used for undo or redo
+    while(it != m_CommitList.end() && (it->IsSpilled() || it == keep))
+      ++it;
+    if(it == m_CommitList.end())
+      break;
+
+    // Try moving the commit to disk, dropping the oldest spilled commits if
+    // there is not enough room there
+    size_t n_encoded = it->GetEncodedSize();
+    if(n_encoded <= m_MaxDiskSize)
+      {
+      while(m_DiskSize + n_encoded > m_MaxDiskSize
+            && m_CommitList.size() > m_MinCommits
+            && m_CommitList.begin()->IsSpilled())
+        DeleteCommit(m_CommitList.begin());
+
+      if(m_DiskSize + n_encoded <= m_MaxDiskSize)
+        {
+        if(!m_SpillFile)
+          m_SpillFile = tmpfile();
+
+        size_t n_mem = it->GetMemorySize();
+        if(m_SpillFile && it->Spill(m_SpillFile))
+          {
+          m_TotalSize = m_TotalSize - n_mem + it->GetMemorySize();
+          m_DiskSize += n_encoded;
+          continue;
+          }
+
+        // Spilling failed, make sure the commit is in a consistent state
+        if(m_SpillFile)
+          it->Restore(m_SpillFile);
+        }
+      }
+
+    // The commit can only be dropped if it is the oldest and enough commits remain
+    if(it != m_CommitList.begin() || m_CommitList.size() <= m_MinCommits)
+      break;
+    it = DeleteCommit(it);
+    }
+
+  CompactSpillFile();
+}
+
+template<typename TPixel>
+void
+UndoDataManager<TPixel>
+::CompactSpillFile()
+{
+  // Dead space is left in the file when spilled commits are restored or
+  // deleted. Once the file is twice as large as its content, rewrite it.
+  if(!m_SpillFile || fseek(m_SpillFile, 0, SEEK_END) != 0)
+    return;
+
+  // Small files are not worth rewriting, since every spilled delta passes
+  // through memory while the file is rewritten
+  long file_size = ftell(m_SpillFile);
+  if(file_size < 0 || (size_t) file_size <= 2 * m_DiskSize
+     || (size_t) file_size - m_DiskSize < m_MaxTotalSize)
+    return;
+
+  FILE *new_file = tmpfile();
+  if(!new_file)
+    return;
+
+  for(CIterator it = m_CommitList.begin(); it != m_CommitList.end(); ++it)
+    {
+    if(it->IsSpilled())
+      {
+      size_t n_mem = it->GetMemorySize();
+      it->Restore(m_SpillFile);
+      if(!it->Spill(new_file))
+        {
+        // Keep the commit in memory rather than losing it
+        it->Restore(new_file);
+        m_DiskSize -= it->GetEncodedSize();
+        m_TotalSize = m_TotalSize - n_mem + it->GetMemorySize();
+        }
+      }
+    }
+
+  fclose(m_SpillFile);
+  m_SpillFile = new_file;
+}
+
+template<typename TPixel>
+void
+UndoDataManager<TPixel>
+::RestoreCommit(CIterator it)
+{
+  if(it->IsSpilled() && m_SpillFile)
+    {
+    size_t n_mem = it->GetMemorySize();
+    m_DiskSize -= it->GetEncodedSize();
+    it->Restore(m_SpillFile);
+    m_TotalSize = m_TotalSize - n_mem + it->GetMemorySize();
+
+    // The restored commit may push the history over its memory budget, in
+    // which case other commits go back to disk
+    EnforceMemoryBudget(0, it);
+    }
+}
+
+template<typename TPixel>
+size_t
+UndoDataManager<TPixel>
+::GetNumberOfSpilledCommits() const
+{
+  size_t n = 0;
+  for(CConstIterator it = m_CommitList.begin(); it != m_CommitList.end(); ++it)
+    if(it->IsSpilled())
+      n++;
+  return n;
+}
+
+template<typename TPixel>
+size_t
+UndoDataManager<TPixel>
+::GetSpillFileSize() const
+{
+  if(!m_SpillFile || fseek(m_SpillFile, 0, SEEK_END) != 0)
+    return 0;
+
+  long file_size = ftell(m_SpillFile);
+  return file_size < 0 ? 0 : (size_t) file_size;
+}
+
 template<typename TPixel>
 int
 UndoDataManager<TPixel>
@@ -135,9 +461,7 @@ UndoDataManager<TPixel>
   // to the end. So that's the loop that we do
   while(m_Position != m_CommitList.end())
     {
-    m_TotalSize -= m_Position->GetNumberOfRLEs();
-    m_Position->DeleteDeltas();
-    m_Position = m_CommitList.erase(m_Position);
+    m_Position = DeleteCommit(m_Position);
     }
 
   // Create a commit that we will be adding
@@ -156,20 +480,15 @@ UndoDataManager<TPixel>
     return 0;
     }
 
-  // Check whether we need to prune from the back to keep total size under control
-  CIterator itHead = m_CommitList.begin();
-  while(m_CommitList.size() > m_MinCommits && m_TotalSize + n_new_rles > m_MaxTotalSize)
-    {
-    m_TotalSize -= itHead->GetNumberOfRLEs();
-    itHead->DeleteDeltas();
-    itHead = m_CommitList.erase(itHead);
-    }
+  // Spill or prune from the back to keep the memory size under control
+  size_t n_new_bytes = new_commit.GetMemorySize();
+  EnforceMemoryBudget(n_new_bytes, m_CommitList.end());
 
   // Now we have a well pruned list of deltas, and we can append
   // the current delta to it;
   m_CommitList.push_back(new_commit);
   m_Position = m_CommitList.end();
-  m_TotalSize += n_new_rles;
+  m_TotalSize += n_new_bytes;
 
   // Return the number of RLEs
   return n_new_rles;
@@ -194,6 +513,9 @@ UndoDataManager<TPixel>
   // Move the position one delta to the beginning
   m_Position--;
 
+  // Make sure the deltas are in memory
+  RestoreCommit(m_Position);
+
   // Return the current delta
   return *m_Position;
 }
@@ -214,6 +536,9 @@ UndoDataManager<TPixel>
   // Can't be at the beginning
   assert(IsRedoPossible());
 
+  // Make sure the deltas are in memory
+  RestoreCommit(m_Position);
+
   // Return the delta at the current position
   const Commit &commit = *m_Position;
 
@@ -263,3 +588,64 @@ UndoDataManager<TPixel>::Commit::GetNumberOfRLEs() const
     }
   return n;
 }
+
+template<typename TPixel>
+size_t
+UndoDataManager<TPixel>::Commit::GetMemorySize() const
+{
+  size_t n = 0;
+  for(DConstIterator dit = m_Deltas.begin(); dit != m_Deltas.end(); ++dit)
+    {
+    if(*dit)
+      n += (*dit)->GetMemorySize();
+    }
+  return n;
+}
+
+template<typename TPixel>
+size_t
+UndoDataManager<TPixel>::Commit::GetEncodedSize() const
+{
+  size_t n = 0;
+  for(DConstIterator dit = m_Deltas.begin(); dit != m_Deltas.end(); ++dit)
+    {
+    if(*dit)
+      n += (*dit)->GetEncodedSize();
+    }
+  return n;
+}
+
+template<typename TPixel>
+bool
+UndoDataManager<TPixel>::Commit::IsSpilled() const
+{
+  for(DConstIterator dit = m_Deltas.begin(); dit != m_Deltas.end(); ++dit)
+    {
+    if(*dit && (*dit)->IsSpilled())
+      return true;
+    }
+  return false;
+}
+
+template<typename TPixel>
+bool
+UndoDataManager<TPixel>::Commit::Spill(FILE *file)
+{
+  for(DIterator dit = m_Deltas.begin(); dit != m_Deltas.end(); ++dit)
+    {
+    if(*dit && !(*dit)->Spill(file))
+      return false;
+    }
+  return true;
+}
+
+template<typename TPixel>
+void
+UndoDataManager<TPixel>::Commit::Restore(FILE *file)
+{
+  for(DIterator dit = m_Deltas.begin(); dit != m_Deltas.end(); ++dit)
+    {
+    if(*dit)
+      (*dit)->Restore(file);
+    }
+}
@@ -1,7 +1,7 @@
 #include "DisplayMappingPolicy.h"
 #include "ImageWrapperTraits.h"
 #include "ColorLabelTable.h"
-#include "LabelToRGBAFilter.h"
+#include "RLELabelSliceToRGBAFilter.h"
 #include "IntensityCurveVTK.h"
 #include "IntensityToColorLookupTableImageFilter.h"
 #include "LookupTableIntensityMappingFilter.h"
@@ -47,7 +47,7 @@ ColorLabelTableDisplayMappingPolicy<TWrapperTraits>
   for(unsigned int i=0; i<3; i++)
     {
     m_RGBAFilter[i] = RGBAFilterType::New();
-    m_RGBAFilter[i]->SetInput(wrapper->GetSlice(i));
+    m_RGBAFilter[i]->SetSlicer(wrapper->GetSlicer(i));
     m_RGBAFilter[i]->SetColorTable(NULL);
     }
 
@@ -163,14 +163,14 @@ CachingCurveAndColorMapDisplayMappingPolicy<TWrapperTraits>
   m_LookupTableFilter->SetInput(m_Wrapper->GetImage());
 
   // Hook up the min/max filters
-  m_LookupTableFilter->SetImageMinInput(m_Wrapper->GetMinMaxFilter()->GetMinimumOutput());
-  m_LookupTableFilter->SetImageMaxInput(m_Wrapper->GetMinMaxFilter()->GetMaximumOutput());
+  m_LookupTableFilter->SetImageMinInput(m_Wrapper->GetImageMinObject());
+  m_LookupTableFilter->SetImageMaxInput(m_Wrapper->GetImageMaxObject());
 
   for(unsigned int i=0; i<3; i++)
     {
     m_IntensityFilter[i]->SetInput(m_Wrapper->GetSlice(i));
-    m_IntensityFilter[i]->SetImageMinInput(m_Wrapper->GetMinMaxFilter()->GetMinimumOutput());
-    m_IntensityFilter[i]->SetImageMaxInput(m_Wrapper->GetMinMaxFilter()->GetMaximumOutput());
+    m_IntensityFilter[i]->SetImageMinInput(m_Wrapper->GetImageMinObject());
+    m_IntensityFilter[i]->SetImageMaxInput(m_Wrapper->GetImageMaxObject());
     }
 }
 
@@ -210,8 +210,8 @@ void
 CachingCurveAndColorMapDisplayMappingPolicy<TWrapperTraits>
 ::ClearReferenceIntensityRange()
 {
-  m_LookupTableFilter->SetImageMinInput(m_Wrapper->GetMinMaxFilter()->GetMinimumOutput());
-  m_LookupTableFilter->SetImageMaxInput(m_Wrapper->GetMinMaxFilter()->GetMaximumOutput());
+  m_LookupTableFilter->SetImageMinInput(m_Wrapper->GetImageMinObject());
+  m_LookupTableFilter->SetImageMaxInput(m_Wrapper->GetImageMaxObject());
 }
 
 template<class TWrapperTraits>
@@ -9,7 +9,7 @@
 #include "MultiChannelDisplayMode.h"
 
 class ColorLabelTable;
-class LabelToRGBAFilter;
+template <class TSlicer> class RLELabelSliceToRGBAFilter;
 class IntensityCurveVTK;
 class Registry;
 class ActorMapperPool;
@@ -107,7 +107,8 @@ protected:
   ColorLabelTableDisplayMappingPolicy();
   ~ColorLabelTableDisplayMappingPolicy();
 
-  typedef LabelToRGBAFilter RGBAFilterType;
+  typedef typename WrapperType::SlicerType SlicerType;
+  typedef RLELabelSliceToRGBAFilter<SlicerType> RGBAFilterType;
   typedef SmartPtr<RGBAFilterType> RGBAFilterPointer;
 
   RGBAFilterPointer m_RGBAFilter[3];
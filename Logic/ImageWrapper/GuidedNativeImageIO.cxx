@@ -78,6 +78,10 @@
 #include <itk_zlib.h>
 #include "itkImportImageFilter.h"
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <list>
+#include <thread>
 #include "itksys/Base64.h"
 
 
@@ -310,6 +314,10 @@ GuidedNativeImageIO
   m_NativeFileName = "";
   m_NativeByteOrder = itk::ImageIOBase::OrderNotApplicable;
   m_NativeSizeInBytes = 0;
+  m_LazyTimePointThreshold = 0;
+  m_LazyTimePoints = false;
+  m_StreamNativeData = false;
+  m_StreamedData = false;
 }
 
 GuidedNativeImageIO::FileFormat 
@@ -473,6 +481,8 @@ GuidedNativeImageIO
 
   // Save the hints
   m_Hints = folder;
+  m_LazyTimePoints = false;
+  m_StreamedData = false;
 
   // Create the header corresponding to the current image type
   CreateImageIO(FileName, m_Hints, true);
@@ -727,6 +737,53 @@ void
 GuidedNativeImageIO
 ::ReadNativeImageData(itk::Command *progressCmd)
 {
+  // Large 4D images may be read one time point at a time. In that case we only
+  // read the first time point now, and hold on to the IOBase for the rest
+  m_LazyTimePoints =
+      m_LazyTimePointThreshold > 0
+      && m_NativeSizeInBytes > m_LazyTimePointThreshold
+      && this->CanReadNativeTimePoints();
+
+  if(m_LazyTimePoints)
+    {
+    SmartPtr<TrivalProgressSource> progSrc = TrivalProgressSource::New();
+    if(progressCmd)
+      progSrc->AddObserverToProgressEvents(progressCmd);
+    progSrc->StartProgress();
+    m_NativeImage = this->ReadNativeTimePoint(0);
+    progSrc->AddProgress(1.0);
+    return;
+    }
+
+  // In streamed mode the caller reads the voxels itself, so the native image
+  // only needs to describe the header
+  m_StreamedData = m_StreamNativeData && this->CanReadNativeRegions();
+  if(m_StreamedData)
+    {
+    ImageBasePointer header = itk::ImageBase<4>::New();
+    itk::ImageBase<4>::PointType org;     org.Fill(0.0);
+    itk::ImageBase<4>::SpacingType spc;   spc.Fill(1.0);
+    itk::ImageBase<4>::DirectionType dir; dir.SetIdentity();
+    itk::ImageBase<4>::SizeType dim;
+    for(unsigned int i = 0; i < m_IOBase->GetNumberOfDimensions(); i++)
+      {
+      spc[i] = m_IOBase->GetSpacing(i);
+      org[i] = m_IOBase->GetOrigin(i);
+      for(size_t j = 0; j < m_IOBase->GetNumberOfDimensions(); j++)
+        dir(j,i) = m_IOBase->GetDirection(i)[j];
+      }
+    for(unsigned int i = 0; i < 4; i++)
+      dim[i] = m_NativeDimensions[i];
+
+    header->SetSpacing(spc);
+    header->SetOrigin(org);
+    header->SetDirection(dir);
+    header->SetMetaDataDictionary(m_IOBase->GetMetaDataDictionary());
+    header->SetRegions(dim);
+    m_NativeImage = header;
+    return;
+    }
+
   // Based on the component type, read image in native mode
   DispatchBase *dispatch = this->CreateDispatch(m_IOBase->GetComponentType());
 	dispatch->ReadNative(this, m_NativeFileName.c_str(), m_Hints, progressCmd);
@@ -744,6 +801,287 @@ GuidedNativeImageIO
 	this->ReadNativeImageData(progressCmd);
 }
 
+bool
+GuidedNativeImageIO
+::CanReadNativeRegions() const
+{
+  // The IOBase must still be around, i.e., we are between reading the
+  // header and the data, or already in lazy or streamed mode
+  if(!m_IOBase)
+    return false;
+
+  // These formats are assembled from multiple files by special code
+  if(m_FileFormat == FORMAT_DICOM_DIR
+     || m_FileFormat == FORMAT_DICOM_DIR_4DCTA
+     || m_FileFormat == FORMAT_ECHO_CARTESIAN_DICOM)
+    return false;
+
+  // Only scalar images whose dimensions all map onto the native image
+  if(m_IOBase->GetNumberOfDimensions() > 4 || m_NativeComponents != 1)
+    return false;
+
+  return m_IOBase->CanStreamRead();
+}
+
+bool
+GuidedNativeImageIO
+::CanReadNativeTimePoints() const
+{
+  if(!this->CanReadNativeRegions())
+    return false;
+
+  // Only 4D images with more than one time point
+  if(m_IOBase->GetNumberOfDimensions() != 4 || m_NativeDimensions[3] < 2)
+    return false;
+
+  // Types that are rescaled to GreyType based on their range would need the
+  // whole image to compute the mapping, so they are read in full
+  switch(m_NativeType)
+    {
+    case itk::ImageIOBase::UCHAR:
+    case itk::ImageIOBase::CHAR:
+    case itk::ImageIOBase::SHORT:
+      break;
+    default:
+      return false;
+    }
+
+  return true;
+}
+
+GuidedNativeImageIO::ImageBasePointer
+GuidedNativeImageIO
+::ReadNativeTimePoint(unsigned int tp)
+{
+  itkAssertOrThrowMacro(
+        m_IOBase && tp < m_NativeDimensions[3],
+        "Time point not available in GuidedNativeImageIO::ReadNativeTimePoint")
+
+  itk::ImageRegion<4> region;
+  for(unsigned int i = 0; i < 3; i++)
+    region.SetSize(i, m_NativeDimensions[i]);
+  region.SetIndex(3, tp);
+  region.SetSize(3, 1);
+  return this->ReadNativeRegion(region);
+}
+
+GuidedNativeImageIO::ImageBasePointer
+GuidedNativeImageIO
+::ReadNativeRegion(const itk::ImageRegion<4> &region)
+{
+  itk::ImageRegion<4> largest;
+  for(unsigned int i = 0; i < 4; i++)
+    largest.SetSize(i, m_NativeDimensions[i]);
+
+  itkAssertOrThrowMacro(
+        m_IOBase && (m_LazyTimePoints || m_StreamedData) && largest.IsInside(region),
+        "Region not available in GuidedNativeImageIO::ReadNativeRegion")
+
+  DispatchBase *dispatch = this->CreateDispatch(m_NativeType);
+  ImageBasePointer image = dispatch->ReadNativeRegion(this, region);
+  delete dispatch;
+  return image;
+}
+
+SmartPtr<GuidedNativeImageIO>
+GuidedNativeImageIO
+::CreateTimePointReader() const
+{
+  itkAssertOrThrowMacro(
+        m_LazyTimePoints,
+        "Time points can only be read in lazy mode in GuidedNativeImageIO::CreateTimePointReader")
+
+  // The reader shares the IOBase, which this object will not use again since
+  // reading another header creates a new one
+  SmartPtr<GuidedNativeImageIO> reader = GuidedNativeImageIO::New();
+  reader->m_IOBase = m_IOBase;
+  reader->m_FileFormat = m_FileFormat;
+  reader->m_Hints = m_Hints;
+  reader->m_NativeType = m_NativeType;
+  reader->m_NativeComponents = m_NativeComponents;
+  reader->m_NativeSizeInBytes = m_NativeSizeInBytes;
+  reader->m_NativeTypeString = m_NativeTypeString;
+  reader->m_NativeFileName = m_NativeFileName;
+  reader->m_NativeNickname = m_NativeNickname;
+  reader->m_NativeByteOrder = m_NativeByteOrder;
+  reader->m_NativeDimensions = m_NativeDimensions;
+  reader->m_LazyTimePointThreshold = m_LazyTimePointThreshold;
+  reader->m_LazyTimePoints = true;
+  return reader;
+}
+
+template<class TScalar>
+GuidedNativeImageIO::ImageBasePointer
+GuidedNativeImageIO
+::DoReadNativeRegion(const itk::ImageRegion<4> &region)
+{
+  typedef itk::VectorImage<TScalar, 4> NativeImageType;
+  typename NativeImageType::Pointer image = NativeImageType::New();
+
+  // The IOBase is shared by all the threads that read regions
+  std::lock_guard<std::mutex> lock(m_TimePointMutex);
+
+  // Same header as in DoReadNative, except the size
+  typename NativeImageType::PointType org;     org.Fill(0.0);
+  typename NativeImageType::SpacingType spc;   spc.Fill(1.0);
+  typename NativeImageType::DirectionType dir; dir.SetIdentity();
+  unsigned int nd = m_IOBase->GetNumberOfDimensions();
+  for(unsigned int i = 0; i < nd; i++)
+    {
+    spc[i] = m_IOBase->GetSpacing(i);
+    org[i] = m_IOBase->GetOrigin(i);
+    for(size_t j = 0; j < nd; j++)
+      dir(j,i) = m_IOBase->GetDirection(i)[j];
+    }
+
+  image->SetSpacing(spc);
+  image->SetOrigin(org);
+  image->SetDirection(dir);
+  image->SetMetaDataDictionary(m_IOBase->GetMetaDataDictionary());
+
+  typename NativeImageType::IndexType index = {{0, 0, 0, 0}};
+  image->SetRegions(typename NativeImageType::RegionType(index, region.GetSize()));
+  image->SetVectorLength(1);
+  image->Allocate();
+
+  // Read the slab of the file that holds this region. Dimensions that the
+  // file does not have are dropped from the IO region
+  itk::ImageIORegion ioRegion(nd);
+  itk::ImageIORegionAdaptor<4>::Convert(region, ioRegion, index);
+  m_IOBase->SetIORegion(ioRegion);
+  m_IOBase->Read(image->GetBufferPointer());
+
+  return image.GetPointer();
+}
+
+template <typename TScalar>
+void
+GuidedNativeImageIO
+::DoReadDicomMultiComponentSeries(itk::ImageBase<3> *info, TrivalProgressSource *progress)
+{
+  typedef itk::VectorImage<TScalar, 4> NativeImageType;
+  typedef itk::Image<TScalar, 3> SliceImageType;
+  typedef itk::ImageFileReader<SliceImageType> SliceReaderType;
+
+  int n_comp = m_DICOMImagesPerIPP;
+  size_t n_files = m_DICOMFiles.size() - m_DICOMFiles.size() % n_comp;
+
+  // The native image has the geometry of the first volume and one component
+  // for each image at a given position, in the order in which they appear
+  typename NativeImageType::SizeType dim;      dim.Fill(1);
+  typename NativeImageType::PointType org;     org.Fill(0.0);
+  typename NativeImageType::SpacingType spc;   spc.Fill(1.0);
+  typename NativeImageType::DirectionType dir; dir.SetIdentity();
+  for(unsigned int i = 0; i < 3; i++)
+    {
+    dim[i] = info->GetLargestPossibleRegion().GetSize(i);
+    org[i] = info->GetOrigin()[i];
+    spc[i] = info->GetSpacing()[i];
+    for(unsigned int j = 0; j < 3; j++)
+      dir(i,j) = info->GetDirection()(i,j);
+    }
+
+  typename NativeImageType::Pointer image = NativeImageType::New();
+  image->SetOrigin(org);
+  image->SetSpacing(spc);
+  image->SetDirection(dir);
+  image->SetRegions(dim);
+  image->SetVectorLength(n_comp);
+  image->Allocate();
+
+  TScalar *buffer = image->GetBufferPointer();
+  size_t slice_pixels = dim[0] * dim[1];
+
+  // Each file is one slice of one component. The files are decoded by a pool
+  // of threads, each with its own ImageIO, and each slice is written straight
+  // into its place in the interleaved buffer of the native image
+  std::mutex mutex;
+  std::condition_variable cv;
+  size_t next = 0, n_done = 0;
+  std::exception_ptr error;
+
+  unsigned int n_threads = std::min(
+        (size_t) std::max(1u, std::thread::hardware_concurrency()), n_files);
+  std::vector<std::thread> threads;
+  for(unsigned int i = 0; i < n_threads; i++)
+    {
+    threads.emplace_back([&]()
+      {
+      itk::GDCMImageIO::Pointer io = itk::GDCMImageIO::New();
+      while(true)
+        {
+        // Take the next file from the list
+        size_t k;
+        {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(next >= n_files || error)
+          return;
+        k = next++;
+        }
+
+        std::exception_ptr k_error;
+        try
+          {
+          typename SliceReaderType::Pointer reader = SliceReaderType::New();
+          reader->SetImageIO(io);
+          reader->SetFileName(m_DICOMFiles[k]);
+          reader->Update();
+
+          SliceImageType *slice = reader->GetOutput();
+          typename SliceImageType::SizeType sz = slice->GetBufferedRegion().GetSize();
+          if(sz[0] != dim[0] || sz[1] != dim[1] || sz[2] != 1)
+            throw IRISException(
+                "Error: DICOM image size mismatch. "
+                "The image '%s' does not have the same size as the other "
+                "images in the series.", m_DICOMFiles[k].c_str());
+
+          const TScalar *src = slice->GetBufferPointer();
+          TScalar *dst = buffer + ((k / n_comp) * slice_pixels) * n_comp + k % n_comp;
+          for(size_t p = 0; p < slice_pixels; p++, dst += n_comp)
+            *dst = src[p];
+          }
+        catch(...)
+          {
+          k_error = std::current_exception();
+          }
+
+        // Report completion
+        {
+        std::lock_guard<std::mutex> lock(mutex);
+        n_done++;
+        if(k_error && !error)
+          error = k_error;
+        }
+        cv.notify_one();
+        }
+      });
+    }
+
+  // Forward progress from this thread until all the files are read
+  std::unique_lock<std::mutex> lock(mutex);
+  size_t n_reported = 0;
+  while(n_reported < n_files && !error)
+    {
+    cv.wait(lock, [&]() { return n_done > n_reported || error; });
+    size_t delta = n_done - n_reported;
+    n_reported = n_done;
+    lock.unlock();
+    progress->AddProgress(delta / (double) n_files);
+    lock.lock();
+    }
+  lock.unlock();
+
+  for(std::thread &t : threads)
+    t.join();
+
+  // Pass on any exception thrown by the readers
+  if(error)
+    std::rethrow_exception(error);
+
+  m_NativeImage = image;
+  m_NativeComponents = n_comp;
+}
+
 template <typename TScalar>
 void
 GuidedNativeImageIO
@@ -852,6 +1190,27 @@ GuidedNativeImageIO
       }
     else
       {
+      // The geometry of the volumes is that of the first one, which the
+      // series reader computes from the positions of the first and last slices
+      int n_comp = m_DICOMImagesPerIPP;
+      int n_slices = m_DICOMFiles.size() / n_comp;
+      std::vector<std::string> firstFiles;
+      for(int s = 0; s < n_slices; s++)
+        firstFiles.push_back(m_DICOMFiles[s * n_comp]);
+
+      typename SeriesReaderType::Pointer infoReader = SeriesReaderType::New();
+      infoReader->SetFileNames(firstFiles);
+      infoReader->SetImageIO(m_IOBase);
+      infoReader->UpdateOutputInformation();
+      GreyImageType *info = infoReader->GetOutput();
+
+      // Files holding more than one slice are handled by the composer below
+      if(info->GetLargestPossibleRegion().GetSize(2) == (itk::SizeValueType) n_slices)
+        {
+        this->DoReadDicomMultiComponentSeries<TScalar>(info, dcmSeriesProgSrc);
+        return;
+        }
+
       // Create a filter that will do the composing
       typedef itk::ComposeImageFilter<GreyImage4DType, NativeImageType> ComposeFilter;
       typename ComposeFilter::Pointer composer = ComposeFilter::New();
@@ -1676,8 +2035,14 @@ CastNativeImage<TOutputImage,TCastFunctor>
 ::operator()(GuidedNativeImageIO *nativeIO)
 {
   // Get the native image pointer
-  itk::ImageBase<4> *native = nativeIO->GetNativeImage();
+  return (*this)(nativeIO, nativeIO->GetNativeImage());
+}
 
+template<class TOutputImage, class TCastFunctor>
+typename CastNativeImage<TOutputImage,TCastFunctor>::OutputImageType *
+CastNativeImage<TOutputImage,TCastFunctor>
+::operator()(GuidedNativeImageIO *nativeIO, itk::ImageBase<4> *native)
+{
   // Cast image from native format to TPixel
   itk::ImageIOBase::IOComponentType itype = nativeIO->GetComponentTypeInNativeImage();
   switch(itype) 
@@ -1924,6 +2289,71 @@ const gdcm::Tag GuidedNativeImageIO::m_tagSliceThickness(0x0018, 0x0050);
 #include "gdcmDirectory.h"
 #include "gdcmImageReader.h"
 
+/**
+ * Series information extracted from a single file in a DICOM directory.
+ * Files that are not DICOM have Valid set to false.
+ */
+struct DicomFileSeriesTags
+{
+  bool Valid = false;
+  std::string SeriesId, Description, SeriesNumber;
+  int Rows = 0, Columns = 0;
+};
+
+/**
+ * Tags of the files in recently parsed DICOM directories. A file is only
+ * read again if its modification time or length has changed, so parsing a
+ * directory for the second time just requires listing it.
+ */
+class DicomDirectoryParseCache
+{
+public:
+  struct FileEntry
+  {
+    long ModifiedTime;
+    unsigned long Length;
+    DicomFileSeriesTags Tags;
+  };
+
+  typedef std::map<std::string, FileEntry> FileMap;
+
+  static DicomDirectoryParseCache &GetInstance()
+  {
+    static DicomDirectoryParseCache instance;
+    return instance;
+  }
+
+  // Get the cached files for a directory (empty if not cached)
+  FileMap Get(const std::string &dir)
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    for(auto &it : m_Directories)
+      if(it.first == dir)
+        return it.second;
+    return FileMap();
+  }
+
+  // Replace the cached files for a directory
+  void Put(const std::string &dir, FileMap &files)
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Directories.remove_if([&dir](const DirectoryEntry &e) { return e.first == dir; });
+    m_Directories.emplace_front(dir, FileMap());
+    m_Directories.front().second.swap(files);
+    while(m_Directories.size() > MAX_DIRECTORIES)
+      m_Directories.pop_back();
+  }
+
+private:
+  typedef std::pair<std::string, FileMap> DirectoryEntry;
+
+  // Most recently parsed first
+  std::list<DirectoryEntry> m_Directories;
+  std::mutex m_Mutex;
+
+  static const size_t MAX_DIRECTORIES = 16;
+};
+
 void
 GuidedNativeImageIO
 ::ParseDicomDirectory(const std::string &dir, itk::Command *progressCommand)
@@ -1952,10 +2382,6 @@ GuidedNativeImageIO
   tags_all.insert(m_tagDesc);
   tags_all.insert(m_tagSeriesInstanceUID);
 
-  //--Dev: Add to read list
-  std::set<std::string> sliceLocSet;
-  std::map<std::string, std::set<std::string>> sliceMap;
-
   // Clear the information about the last parse
   m_LastDicomParseResult.Reset();
   m_LastDicomParseResult.Directory = dir;
@@ -1966,21 +2392,21 @@ GuidedNativeImageIO
   // Load the directory - this should be quick
   dirList.Load(dir, false);
   gdcm::Directory::FilenamesType const &filenames = dirList.GetFilenames();
-  for(gdcm::Directory::FilenamesType::const_iterator it = filenames.begin();
-    it != filenames.end(); ++it)
-    {
-    // Process each filename in the directory
+
+  // Read the series tags from a single file
+  auto read_tags = [&](const std::string &fn)
+  {
+    DicomFileSeriesTags ft;
     gdcm::Reader reader;
-    reader.SetFileName(it->c_str());
+    reader.SetFileName(fn.c_str());
 
     // Try reading this file. Fail quietly.
-    bool read = false;
-    try { read = reader.ReadSelectedTags(tags_all, true); }
+    try { ft.Valid = reader.ReadSelectedTags(tags_all, true); }
     catch(...) {}
 
     // If nothing read, keep going
-    if(!read)
-      continue;
+    if(!ft.Valid)
+      return ft;
 
     // Create a string filter to get tags
     gdcm::StringFilter sf;
@@ -2018,46 +2444,148 @@ GuidedNativeImageIO
         }
       }
 
-    // The info for the current series
-    DicomDirectoryParseResult::DicomSeriesInfo &series_info
-        = m_LastDicomParseResult.SeriesMap[full_id];
+    ft.SeriesId = full_id;
+    ft.Description = sf.ToString(m_tagDesc);
+    ft.SeriesNumber = sf.ToString(m_tagSeriesNumber);
+    ft.Rows = std::atoi(sf.ToString(m_tagRows).c_str());
+    ft.Columns = std::atoi(sf.ToString(m_tagCols).c_str());
+    return ft;
+  };
+
+  // Files are read by a pool of threads, since most of the time goes into
+  // waiting for the file system (especially on network shares). Files whose
+  // modification time and length match the cache are not read at all
+  DicomDirectoryParseCache &cache = DicomDirectoryParseCache::GetInstance();
+  DicomDirectoryParseCache::FileMap cached = cache.Get(dir);
+  std::vector<DicomDirectoryParseCache::FileEntry> entries(filenames.size());
+  std::vector<char> done(filenames.size(), 0);
+
+  std::mutex mutex;
+  std::condition_variable cv;
+  size_t next = 0;
+  std::atomic<bool> abort(false);
+
+  unsigned int n_threads = std::min(
+        (size_t) std::max(8u, std::thread::hardware_concurrency()), filenames.size());
+  std::vector<std::thread> threads;
+  for(unsigned int i = 0; i < n_threads; i++)
+    {
+    threads.emplace_back([&]()
+      {
+      while(!abort)
+        {
+        // Take the next file from the list
+        size_t k;
+        {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(next >= filenames.size())
+          return;
+        k = next++;
+        }
 
-    // The registry for the current series
-    Registry &r = series_info.MetaData;
+        const std::string &fn = filenames[k];
+        DicomDirectoryParseCache::FileEntry &entry = entries[k];
+        entry.ModifiedTime = itksys::SystemTools::ModifiedTime(fn);
+        entry.Length = itksys::SystemTools::FileLength(fn);
 
-    // Have we found this ID before?
-    if(r.IsEmpty())
-      {
-      r["SeriesId"] << full_id;
+        auto itc = cached.find(fn);
+        if(itc != cached.end()
+           && itc->second.ModifiedTime == entry.ModifiedTime
+           && itc->second.Length == entry.Length)
+          entry.Tags = itc->second.Tags;
+        else
+          entry.Tags = read_tags(fn);
 
-      // Read series description
-      r["SeriesDescription"] << sf.ToString(m_tagDesc);
-      r["SeriesNumber"] << sf.ToString(m_tagSeriesNumber);
+        {
+        std::lock_guard<std::mutex> lock(mutex);
+        done[k] = 1;
+        }
+        cv.notify_one();
+        }
+      });
+    }
 
-      // Read the dimensions
-      r["Rows"] << std::atoi(sf.ToString(m_tagRows).c_str());
-      r["Columns"] << std::atoi(sf.ToString(m_tagCols).c_str());
-      r["NumberOfImages"] << 1;
-      }
-    else
+  // Merge the files into the series map in directory order, so that the
+  // result does not depend on the order in which the threads finish. This
+  // is done on the calling thread, which may be showing the partial result
+  size_t n_merged = 0;
+  try
+    {
+    std::unique_lock<std::mutex> lock(mutex);
+    while(n_merged < filenames.size())
       {
-      // Increement the number of images
-      r["NumberOfImages"] << r["NumberOfImages"][0] + 1;
-      }
+      cv.wait(lock, [&]() { return done[n_merged] != 0; });
+      size_t n_ready = n_merged;
+      while(n_ready < filenames.size() && done[n_ready])
+        n_ready++;
+      lock.unlock();
+
+      for(; n_merged < n_ready; n_merged++)
+        {
+        const DicomFileSeriesTags &ft = entries[n_merged].Tags;
+        if(!ft.Valid)
+          continue;
 
-    // Update the dimensions string
-    ostringstream oss;
-    oss << r["Rows"][0] << " x " << r["Columns"][0] << " x " << r["NumberOfImages"][0];
-    r["Dimensions"] << oss.str();
+        // The info for the current series
+        DicomDirectoryParseResult::DicomSeriesInfo &series_info
+            = m_LastDicomParseResult.SeriesMap[ft.SeriesId];
 
-    // Update the filelist
-    series_info.FileList.push_back(*it);
+        // The registry for the current series
+        Registry &r = series_info.MetaData;
 
-    // Indicate some progress
-    if(progressCommand)
-      progressCommand->Execute(this, itk::ProgressEvent());
+        // Have we found this ID before?
+        if(r.IsEmpty())
+          {
+          r["SeriesId"] << ft.SeriesId;
+
+          // Read series description
+          r["SeriesDescription"] << ft.Description;
+          r["SeriesNumber"] << ft.SeriesNumber;
+
+          // Read the dimensions
+          r["Rows"] << ft.Rows;
+          r["Columns"] << ft.Columns;
+          r["NumberOfImages"] << 1;
+          }
+        else
+          {
+          // Increement the number of images
+          r["NumberOfImages"] << r["NumberOfImages"][0] + 1;
+          }
+
+        // Update the dimensions string
+        ostringstream oss;
+        oss << r["Rows"][0] << " x " << r["Columns"][0] << " x " << r["NumberOfImages"][0];
+        r["Dimensions"] << oss.str();
+
+        // Update the filelist
+        series_info.FileList.push_back(filenames[n_merged]);
+        }
+
+      // Indicate some progress
+      if(progressCommand)
+        progressCommand->Execute(this, itk::ProgressEvent());
+
+      lock.lock();
+      }
+    }
+  catch(...)
+    {
+    abort = true;
+    for(std::thread &t : threads)
+      t.join();
+    throw;
     }
 
+  for(std::thread &t : threads)
+    t.join();
+
+  // Remember the tags of the files for the next time
+  DicomDirectoryParseCache::FileMap parsed;
+  for(size_t k = 0; k < filenames.size(); k++)
+    parsed[filenames[k]] = entries[k];
+  cache.Put(dir, parsed);
+
   // Complain if no series have been found
   if(m_LastDicomParseResult.SeriesMap.size() == 0)
     throw IRISException(
@@ -2224,6 +2752,7 @@ CastNativeImageToScalar<TPixel>
 template class RescaleNativeImageToIntegralType<itk::Image<GreyType, 4> >;
 template class RescaleNativeImageToIntegralType<itk::VectorImage<GreyType, 4> >;
 template class CastNativeImage<itk::Image<unsigned short, 4> >;
+template class CastNativeImage<itk::Image<GreyType, 4> >;
 
 // template class CastNativeImageBase<RGBType, CastToArrayFunctor<RGBType, 3> >;
 // template class CastNativeImageBase<LabelType, CastToScalarFunctor<LabelType> >;
@@ -44,6 +44,7 @@
 #include "itkEventObject.h"
 #include "gdcmTag.h"
 #include "MultiFrameDicomSeriesSorter.h"
+#include <mutex>
 
 
 namespace itk
@@ -52,6 +53,8 @@ namespace itk
   class ImageIOBase;
 }
 
+class TrivalProgressSource;
+
 
 /**
  * \class GuidedNativeImageIO
@@ -146,6 +149,75 @@ public:
 
 	void ReadNativeImageData(itk::Command *progressCmd = nullptr);
 
+  /**
+   * Size above which 4D images are read lazily, one time point at a time. When
+   * this is non-zero and the image qualifies (see CanReadNativeTimePoints()),
+   * ReadNativeImageData() only reads the first time point into the native
+   * image and keeps the IO object open, so that the other time points can be
+   * read on demand with ReadNativeTimePoint(). The default, zero, disables the
+   * lazy mode. Must be set before ReadNativeImageData() is called.
+   */
+  irisGetSetMacro(LazyTimePointThreshold, unsigned long)
+
+  /**
+   * Check whether the image whose header has been read can be read one time
+   * point at a time. This requires a scalar 4D image in a format that supports
+   * streamed reading, with a component type that casts to GreyType without a
+   * scale and shift that depend on the entire image.
+   */
+  bool CanReadNativeTimePoints() const;
+
+  /** Whether the last call to ReadNativeImageData() only read the first time point */
+  bool IsLazyTimePointMode() const
+    { return m_LazyTimePoints; }
+
+  /** Number of time points in the image whose header has been read */
+  unsigned int GetNumberOfNativeTimePoints() const
+    { return m_NativeDimensions[3]; }
+
+  /**
+   * Read a single time point in lazy 4D mode. The result is a native image,
+   * like the one returned by GetNativeImage(), with a fourth dimension of size
+   * one. This method can be called from multiple threads.
+   */
+  ImageBasePointer ReadNativeTimePoint(unsigned int tp);
+
+  /**
+   * Create a copy of this object that can read time points in lazy 4D mode.
+   * The copy is not affected if this object is later used to read another
+   * image, so it can be kept by the layer for as long as it needs the reader.
+   */
+  SmartPtr<GuidedNativeImageIO> CreateTimePointReader() const;
+
+  /**
+   * Request that ReadNativeImageData() leave the voxels in the file, so that
+   * the caller can read the image in slabs with ReadNativeRegion() and convert
+   * each slab as it arrives, rather than holding the whole native image in
+   * memory. The request is honored if CanReadNativeRegions() is true, and the
+   * image is read in full otherwise; IsStreamedDataMode() tells which of the
+   * two happened. In streamed mode the native image only carries the header
+   * (regions, spacing, origin, direction) and has no pixel buffer.
+   */
+  irisGetSetMacro(StreamNativeData, bool)
+
+  /**
+   * Check whether the image whose header has been read can be read one region
+   * at a time. This requires a scalar image with at most four dimensions in a
+   * format that supports streamed reading.
+   */
+  bool CanReadNativeRegions() const;
+
+  /** Whether the last call to ReadNativeImageData() deferred reading the voxels */
+  bool IsStreamedDataMode() const
+    { return m_StreamedData; }
+
+  /**
+   * Read a region of the image in lazy 4D or streamed mode. The result is a
+   * native image with the size of the region and a zero index, and with the
+   * origin of the whole image. This method can be called from multiple threads.
+   */
+  ImageBasePointer ReadNativeRegion(const itk::ImageRegion<4> &region);
+
   /**
    * Get the number of components in the native image read by ReadNativeImage.
    */
@@ -301,6 +373,13 @@ protected:
   /** Templated function that reads a scalar image in its native datatype */
 	template <typename TScalar> void DoReadNative(const char *fname, Registry &folder, itk::Command *ProgressCmd = nullptr);
 
+  /** Reads a DICOM series with several images per position into a multi-component image */
+  template <typename TScalar> void DoReadDicomMultiComponentSeries(
+      itk::ImageBase<3> *info, TrivalProgressSource *progress);
+
+  /** Templated function that reads a region in lazy 4D or streamed mode */
+  template <typename TScalar> ImageBasePointer DoReadNativeRegion(const itk::ImageRegion<4> &region);
+
   /** Templated function that reads a scalar image in its native datatype */
   template <typename TScalar> void DoSaveNative(const char *fname, Registry &folder);
 
@@ -322,6 +401,7 @@ protected:
 														itk::Command *progressCmd = nullptr) = 0;
 		virtual void SaveNative(GuidedNativeImageIO *self, const char *fname, Registry &folder) = 0;
     virtual std::string GetNativeMD5Hash(GuidedNativeImageIO *self) = 0;
+    virtual ImageBasePointer ReadNativeRegion(GuidedNativeImageIO *self, const itk::ImageRegion<4> &region) = 0;
     virtual ~DispatchBase() {}
   };
 
@@ -334,6 +414,8 @@ protected:
 			{ self->DoSaveNative<TScalar>(fname, folder); }
     virtual std::string GetNativeMD5Hash(GuidedNativeImageIO *self)
       { return self->DoGetNativeMD5Hash<TScalar>(); }
+    virtual ImageBasePointer ReadNativeRegion(GuidedNativeImageIO *self, const itk::ImageRegion<4> &region)
+      { return self->DoReadNativeRegion<TScalar>(region); }
   };
 
   /** 
@@ -374,6 +456,16 @@ protected:
   // Copy of the registry passed in when reading header
   Registry m_Hints;
 
+  // Lazy 4D mode: threshold, state, and a mutex that serializes the reads
+  // of individual time points (or slabs, in streamed mode) through m_IOBase
+  unsigned long m_LazyTimePointThreshold;
+  bool m_LazyTimePoints;
+  std::mutex m_TimePointMutex;
+
+  // Streamed mode: requested by the caller, and whether it is in effect
+  bool m_StreamNativeData;
+  bool m_StreamedData;
+
   // The file format
   FileFormat m_FileFormat;
 
@@ -471,6 +563,10 @@ public:
   // Constructor, takes pointer to native image
   OutputImageType *operator()(GuidedNativeImageIO *nativeIO);
 
+  // Cast a native image other than the one stored in nativeIO, such as a
+  // time point returned by GuidedNativeImageIO::ReadNativeTimePoint()
+  OutputImageType *operator()(GuidedNativeImageIO *nativeIO, itk::ImageBase<4> *native);
+
   // Set the functor
   void SetFunctor(TCastFunctor functor) 
     { m_Functor = functor; }
@@ -44,6 +44,7 @@
 #include "ImageWrapper.h"
 #include "RLEImageRegionIterator.h"
 #include "RLERegionOfInterestImageFilter.h"
+#include "RLEImageStreamingWriter.h"
 #include "itkImageSliceConstIteratorWithIndex.h"
 #include "itkNumericTraits.h"
 #include "itkRegionOfInterestImageFilter.h"
@@ -73,15 +74,31 @@
 #include "itkExtractImageFilter.h"
 #include "AffineTransformHelper.h"
 #include "InputSelectionImageFilter.h"
+#include "TimePointImageCache.h"
 #include "MetaDataAccess.h"
 
 #include <vnl/vnl_inverse.h>
 #include <iostream>
 #include <cassert>
+#include <functional>
 
 #include <itksys/SystemTools.hxx>
 
 
+/**
+ Discard the lookup structures that an image keeps over its pixel data. Only
+ the RLE image has them (the per-line segment index).
+ */
+template <class TImage>
+void DiscardImagePixelIndex(TImage *) {}
+
+template <class TPixel, unsigned int VDim, class TCounter>
+void DiscardImagePixelIndex(RLEImage<TPixel, VDim, TCounter> *image)
+{
+  image->InvalidateSegmentIndex();
+}
+
+
 template <class TPixel>
 class SimpleCastToDoubleFunctor
 {
@@ -203,6 +220,23 @@ public:
                         image_4d->GetNameOfClass());
   }
 
+  static void ConfigureTimePointHeaderFromImage4D(Image4DType *image_4d,
+                                                  ImageType *itkNotUsed(image_tp))
+  {
+    throw IRISException("ConfigureTimePointHeaderFromImage4D unsupported for class %s",
+                        image_4d->GetNameOfClass());
+  }
+
+  typedef std::function<SmartPtr<ImageType>(unsigned int)> TimePointGetter;
+
+  static SmartPtr<Image4DType> AssembleImage4D(Image4DType *image_4d,
+                                               unsigned int itkNotUsed(nt),
+                                               const TimePointGetter &itkNotUsed(getter))
+  {
+    throw IRISException("AssembleImage4D unsupported for class %s",
+                        image_4d->GetNameOfClass());
+  }
+
   static void SetSourceNativeMapping(Image4DType *image_4d, double itkNotUsed(scale), double itkNotUsed(shift))
   {
     throw IRISException("SetSourceNativeMapping unsupported for class %s",
@@ -369,6 +403,12 @@ public:
     image_4d->SetPixelContainer(image_tp->GetPixelContainer());
   }
 
+  static void ConfigureTimePointHeaderFromImage4D(Image4DType *image_4d,
+                                                  ImageType *image_tp)
+  {
+    CopyInformationFrom4DToTimePoint(image_4d, image_tp);
+  }
+
   static void UpdatePixelContainer(Image4DType *image_4d,
                                    typename Image4DType::PixelContainer *container)
   {
@@ -453,6 +493,34 @@ public:
 
     return Superclass::template DeepCopyImageRegion<Interpolator>(image,refspace,transform,interp,roi,force_resampling,progressCommand);
   }
+
+  // Copy time points into a new 4D image that has the header of image_4d. The
+  // time points are requested one at a time, so only one of them needs to be
+  // in memory in addition to the 4D image
+  static SmartPtr<Image4DType> AssembleImage4D(Image4DType *image_4d,
+                                               unsigned int nt,
+                                               const typename Superclass::TimePointGetter &getter)
+  {
+    typename Image4DType::RegionType region = image_4d->GetBufferedRegion();
+    region.SetSize(VDim, nt);
+
+    SmartPtr<Image4DType> out = Image4DType::New();
+    out->CopyInformation(image_4d);
+    out->SetMetaDataDictionary(image_4d->GetMetaDataDictionary());
+    out->SetRegions(region);
+    out->Allocate();
+
+    TPixel *dst = out->GetBufferPointer();
+    for(unsigned int i = 0; i < nt; i++)
+      {
+      SmartPtr<ImageType> tp = getter(i);
+      size_t n = tp->GetPixelContainer()->Size();
+      std::copy(tp->GetBufferPointer(), tp->GetBufferPointer() + n, dst);
+      dst += n;
+      }
+
+    return out;
+  }
 };
 
 
@@ -543,6 +611,10 @@ public:
 
   template <class TSavedImage> static void Write(TSavedImage *image, const char *fname, Registry &hints)
   {
+    // Where possible, decode the runs directly into the output file
+    if(RLEImageStreamingWriter<TSavedImage>::Write(image, fname, hints))
+      return;
+
     //use specialized RoI filter to convert to itk::Image
     typedef itk::Image<TPixel, TSavedImage::ImageDimension> UncompressedType;
     typedef itk::RegionOfInterestImageFilter<TSavedImage, UncompressedType> outConverterType;
@@ -872,11 +944,23 @@ ImageWrapper<TTraits,TBase>
   // If the source contains an image, make a copy of that image
   if (copy.IsInitialized() && copy.GetImage())
     {
-    typedef itk::RegionOfInterestImageFilter<Image4DType, Image4DType> roiType;
-    typename roiType::Pointer roi = roiType::New();
-    roi->SetInput(copy.m_Image4D);
-    roi->Update();
-    Image4DPointer newImage = roi->GetOutput();
+    Image4DPointer newImage;
+    if(copy.m_TimePointCache)
+      {
+      // In lazy 4D mode, the copy holds all of the time points in memory
+      typedef ImageWrapperPartialSpecializationTraits<ImageType, Image4DType> Specialization;
+      newImage = Specialization::AssembleImage4D(
+            copy.m_Image4D, copy.GetNumberOfTimePoints(),
+            [&copy](unsigned int tp) { return copy.GetTimePointImage(tp); });
+      }
+    else
+      {
+      typedef itk::RegionOfInterestImageFilter<Image4DType, Image4DType> roiType;
+      typename roiType::Pointer roi = roiType::New();
+      roi->SetInput(copy.m_Image4D);
+      roi->Update();
+      newImage = roi->GetOutput();
+      }
     UpdateWrappedImages(newImage);
     }
 
@@ -938,6 +1022,10 @@ ImageWrapper<TTraits,TBase>
     img->SetDirection(source->GetImageBase()->GetDirection());
     }
 
+  // In lazy 4D mode, the current time point is not one of the above
+  if(m_CurrentCachedTimePoint)
+    m_CurrentCachedTimePoint->CopyInformation(m_ImageTimePoints[m_TimePointIndex]);
+
   // Also update the transforms on the 4D image
   m_Image4D->SetSpacing(source->GetImage4DBase()->GetSpacing());
   m_Image4D->SetOrigin(source->GetImage4DBase()->GetOrigin());
@@ -1243,9 +1331,13 @@ ImageWrapper<TTraits,TBase>
 {
   // Assign the pointer to the 4D image
   m_Image4D = image_4d;
+  m_CurrentCachedTimePoint = NULL;
 
-  // The time dimension is the last dimension
-  unsigned int nt = image_4d->GetBufferedRegion().GetSize()[3];
+  // The time dimension is the last dimension. In lazy 4D mode, the 4D image
+  // only holds the first time point and the rest are read by the cache
+  unsigned int nt = m_TimePointCache
+                    ? m_TimePointCache->GetNumberOfTimePoints()
+                    : image_4d->GetBufferedRegion().GetSize()[3];
 
   // Assign these 3D volumes as inputs to a timepoint selector
   m_TimePointSelectFilter = TimePointSelectFilter::New();
@@ -1256,9 +1348,13 @@ ImageWrapper<TTraits,TBase>
     {
     ImagePointer ip = ImageType::New();
 
-    // Set the buffer pointer
+    // Set the buffer pointer. Time points that are not in the 4D image get
+    // the header only, their voxels come from the cache
     typedef ImageWrapperPartialSpecializationTraits<ImageType, Image4DType> Specialization;
-    Specialization::ConfigureTimePointImageFromImage4D(image_4d, ip.GetPointer(), i);
+    if(m_TimePointCache && i > 0)
+      Specialization::ConfigureTimePointHeaderFromImage4D(image_4d, ip.GetPointer());
+    else
+      Specialization::ConfigureTimePointImageFromImage4D(image_4d, ip.GetPointer(), i);
 
     // Append image to the array
     m_ImageTimePoints.push_back(ip);
@@ -1267,6 +1363,13 @@ ImageWrapper<TTraits,TBase>
     m_TimePointSelectFilter->AddSelectableInput(i, ip);
     }
 
+  // In lazy 4D mode, the selected time point must be read
+  if(m_TimePointCache && m_TimePointIndex > 0)
+    {
+    m_CurrentCachedTimePoint = this->GetTimePointImage(m_TimePointIndex);
+    m_TimePointSelectFilter->ReplaceSelectableInput(m_TimePointIndex, m_CurrentCachedTimePoint);
+    }
+
   // Update the selected time point in the selector
   m_TimePointSelectFilter->SetSelectedInput(m_TimePointIndex);
 
@@ -1314,6 +1417,7 @@ ImageWrapper<TTraits,TBase>
   m_DisplayGeometry = source->GetDisplayGeometry();
 
   // Call the common update method
+  m_TimePointCache = NULL;
   UpdateWrappedImages(image_4d, refSpace, tran);
 
   // Update the slice index
@@ -1335,9 +1439,14 @@ ImageWrapper<TTraits,TBase>
 {
   typedef ImageWrapperPartialSpecializationTraits<ImageType, Image4DType> Specialization;
 
-  // Allocate an empty 4D image to match the source
+  // Allocate an empty 4D image to match the source. The number of time points
+  // is taken from the wrapper, since in lazy 4D mode the source's 4D image
+  // only holds the first time point
+  typename Image4DType::SizeType size = source->GetImage4DBase()->GetBufferedRegion().GetSize();
+  size[3] = source->GetNumberOfTimePoints();
+
   Image4DPointer img_new = Image4DType::New();
-  img_new->SetRegions(source->GetImage4DBase()->GetBufferedRegion().GetSize());
+  img_new->SetRegions(size);
   img_new->SetSpacing(source->GetImage4DBase()->GetSpacing());
   img_new->SetOrigin(source->GetImage4DBase()->GetOrigin());
   img_new->SetDirection(source->GetImage4DBase()->GetDirection());
@@ -1350,6 +1459,7 @@ ImageWrapper<TTraits,TBase>
   m_DisplayGeometry = source->GetDisplayGeometry();
 
   // Call the common update method
+  m_TimePointCache = NULL;
   UpdateWrappedImages(img_new);
 
   // Update the slice index
@@ -1364,6 +1474,7 @@ void
 ImageWrapper<TTraits,TBase>
 ::SetImage4D(Image4DType *image_4d)
 {
+  m_TimePointCache = NULL;
   UpdateWrappedImages(image_4d);
 }
 
@@ -1372,9 +1483,51 @@ void
 ImageWrapper<TTraits,TBase>
 ::SetImage4D(Image4DType *image_4d, ImageBaseType *refSpace, ITKTransformType *transform)
 {
+  m_TimePointCache = NULL;
   UpdateWrappedImages(image_4d, refSpace, transform);
 }
 
+template<class TTraits, class TBase>
+void
+ImageWrapper<TTraits,TBase>
+::SetImage4DWithTimePointCache(Image4DType *image_4d, TimePointCacheType *cache,
+                               ImageBaseType *refSpace, ITKTransformType *transform)
+{
+  itkAssertOrThrowMacro(
+        image_4d->GetBufferedRegion().GetSize()[3] == 1 && cache->GetNumberOfTimePoints() > 0,
+        "The 4D image must hold one time point in ImageWrapper::SetImage4DWithTimePointCache")
+
+  m_TimePointCache = cache;
+  UpdateWrappedImages(image_4d, refSpace, transform);
+}
+
+template<class TTraits, class TBase>
+typename ImageWrapper<TTraits,TBase>::TimePointCacheType *
+ImageWrapper<TTraits,TBase>
+::GetTimePointCache() const
+{
+  return m_TimePointCache;
+}
+
+template<class TTraits, class TBase>
+typename ImageWrapper<TTraits,TBase>::ImagePointer
+ImageWrapper<TTraits,TBase>
+::GetTimePointImage(unsigned int tp) const
+{
+  // The first time point is always held by the 4D image
+  if(!m_TimePointCache || tp == 0)
+    return m_ImageTimePoints[tp];
+
+  if(tp == m_TimePointIndex && m_CurrentCachedTimePoint)
+    return m_CurrentCachedTimePoint;
+
+  // Get the voxels from the cache, and the header from the placeholder, which
+  // follows changes made to the geometry of the wrapper
+  ImagePointer image = m_TimePointCache->GetTimePoint(tp);
+  image->CopyInformation(m_ImageTimePoints[tp]);
+  return image;
+}
+
 template<class TTraits, class TBase>
 void
 ImageWrapper<TTraits,TBase>
@@ -1387,7 +1540,7 @@ ImageWrapper<TTraits,TBase>
   // Get the referenced time point
   if(time_point < 0)
     time_point = m_TimePointIndex;
-  ImageType *idest = m_ImageTimePoints[time_point];
+  ImagePointer idest = this->GetTimePointImage(time_point);
 
   itkAssertOrThrowMacro(
         idest->GetBufferedRegion() == image->GetBufferedRegion(),
@@ -1395,7 +1548,7 @@ ImageWrapper<TTraits,TBase>
 
   // Use iterators to perform update
   ConstIterator it_src(image, image->GetBufferedRegion());
-  Iterator it_dest(m_ImageTimePoints[time_point], image->GetBufferedRegion());
+  Iterator it_dest(idest, image->GetBufferedRegion());
   while(!it_src.IsAtEnd())
     {
     it_dest.Set(it_src.Get());
@@ -1403,6 +1556,10 @@ ImageWrapper<TTraits,TBase>
     ++it_dest;
     }
 
+  // In lazy 4D mode, the updated time point can no longer be read from disk
+  if(m_TimePointCache && time_point > 0)
+    m_TimePointCache->Pin(time_point, idest);
+
   // Set modification (we are not keeping track of number of updated voxels because of
   // potential added overhead
   PixelsModified();
@@ -1502,6 +1659,8 @@ ImageWrapper<TTraits,TBase>
     m_ImageBase = NULL;
     m_Image = NULL;
     }
+  m_TimePointCache = NULL;
+  m_CurrentCachedTimePoint = NULL;
   m_Initialized = false;
 
   m_Alpha = 0.5;
@@ -1529,6 +1688,10 @@ ImageWrapper<TTraits,TBase>
   // Update the pixel
   m_Image->SetPixel(index, value);
 
+  // In lazy 4D mode, the modified time point must stay in memory
+  if(m_CurrentCachedTimePoint)
+    m_TimePointCache->Pin(m_TimePointIndex, m_CurrentCachedTimePoint);
+
   // The 4D image must receive the modified event
   m_Image4D->Modified();
 }
@@ -1546,7 +1709,7 @@ ImageWrapper<TTraits,TBase>
     time_point = m_TimePointIndex;
 
   // Simply use ITK's GetPixel method
-  return m_ImageTimePoints[time_point]->GetPixel(index);
+  return this->GetTimePointImage(time_point)->GetPixel(index);
 }
 
 
@@ -1628,7 +1791,7 @@ ImageWrapper<TTraits,TBase>
       // The simple case when no interpolation is required
       for(unsigned int tp = tp_begin; tp < tp_end; tp++, arr+=nc)
         {
-        PixelType p = m_ImageTimePoints[tp]->GetPixel(index);
+        PixelType p = this->GetTimePointImage(tp)->GetPixel(index);
         Specialization::ExportToComponentArray(p, nc, arr);
         }
       }
@@ -1644,7 +1807,8 @@ ImageWrapper<TTraits,TBase>
       {
       // Use an interpolator to do the work
       // TODO: too much being initialized here for a single lookup operation!
-      InterpolateWorker iw(m_ImageTimePoints[tp]);
+      ImagePointer image_tp = this->GetTimePointImage(tp);
+      InterpolateWorker iw(image_tp);
 
       // Process the voxel, arr will be updated by the function
       iw.ProcessVoxel(cidx.GetDataPointer(), false, &arr);
@@ -1712,12 +1876,29 @@ ImageWrapper<TTraits,TBase>
   // Set the current time index
   if(index != m_TimePointIndex)
     {
+    // In lazy 4D mode, the selector gets the time point from the cache, and
+    // the previous time point is given back to the cache by restoring its
+    // placeholder. The read happens first, so that a failure leaves the
+    // wrapper unchanged
+    if(m_TimePointCache)
+      {
+      ImagePointer image = this->GetTimePointImage(index);
+      m_TimePointSelectFilter->ReplaceSelectableInput(
+            m_TimePointIndex, m_ImageTimePoints[m_TimePointIndex]);
+      m_TimePointSelectFilter->ReplaceSelectableInput(index, image);
+      m_CurrentCachedTimePoint = index > 0 ? image : NULL;
+      }
+
     m_TimePointIndex = index;
 
     // Update the image selector
     m_TimePointSelectFilter->SetSelectedInput(index);
     m_TimePointSelectFilter->Update();
     }
+
+  // Start reading the neighboring time points in the background
+  if(m_TimePointCache)
+    m_TimePointCache->Prefetch(index);
 }
 
 template<class TTraits, class TBase>
@@ -1728,7 +1909,7 @@ ImageWrapper<TTraits, TBase>::GetImageByTimePoint(unsigned int timepoint) const
         timepoint < m_ImageTimePoints.size(),
         "Requested time point out of range")
 
-  return m_ImageTimePoints[timepoint];
+  return this->GetTimePointImage(timepoint);
 }
 
 template<class TTraits, class TBase>
@@ -1828,12 +2009,28 @@ ImageWrapper<TTraits, TBase>
   // which is the output of the time point selection pipeline and thus
   // is not necessarily input to downstream filters.
   m_ImageTimePoints[m_TimePointIndex]->Modified();
+
+  // m_Image shares the pixels of the current time point, but its MTime does
+  // not change, so any index it keeps over the pixels has to be discarded
+  DiscardImagePixelIndex(m_Image);
+
+  // In lazy 4D mode, the time point read from the cache is the one that has
+  // been modified, and it can no longer be evicted
+  if(m_CurrentCachedTimePoint)
+    {
+    m_CurrentCachedTimePoint->Modified();
+    m_TimePointCache->Pin(m_TimePointIndex, m_CurrentCachedTimePoint);
+    }
   }
 
 template<class TTraits, class TBase>
 void ImageWrapper<TTraits, TBase>
 ::SetPixelContainer(typename ImageType::PixelContainer *container)
 {
+  itkAssertOrThrowMacro(
+        !m_TimePointCache,
+        "SetPixelContainer is not supported for images with a time point cache");
+
   itkAssertOrThrowMacro(
         container->Size() == m_Image4D->GetPixelContainer()->Size(),
         "Source array size does not match target array size in SetPixelContainer");
@@ -2030,8 +2227,16 @@ ImageWrapper<TTraits,TBase>
 {
   typedef ImageWrapperPartialSpecializationTraits<ImageType, Image4DType> Specialization;
 
-  // Write either in 4D or in 3D
-  if(this->GetNumberOfTimePoints() > 1)
+  // Write either in 4D or in 3D. In lazy 4D mode, the time points have to be
+  // gathered into a 4D image first
+  if(this->GetNumberOfTimePoints() > 1 && m_TimePointCache)
+    {
+    Image4DPointer image_4d = Specialization::AssembleImage4D(
+          m_Image4D, this->GetNumberOfTimePoints(),
+          [this](unsigned int tp) { return this->GetTimePointImage(tp); });
+    Specialization::Write(image_4d.GetPointer(), filename, hints);
+    }
+  else if(this->GetNumberOfTimePoints() > 1)
     Specialization::Write(m_Image4D.GetPointer(), filename, hints);
   else
     Specialization::Write(m_Image, filename, hints);
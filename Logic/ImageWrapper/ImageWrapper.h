@@ -54,6 +54,8 @@ class AdaptiveSlicingPipeline;
 
 template <class TInputImage, class TTag> class InputSelectionImageFilter;
 
+template <class TImage> class TimePointImageCache;
+
 class SNAPSegmentationROISettings;
 
 namespace itk {
@@ -105,6 +107,9 @@ public:
   typedef typename TTraits::Image4DType                            Image4DType;
   typedef SmartPtr<Image4DType>                                 Image4DPointer;
 
+  // Cache of time points read on demand (lazy 4D mode)
+  typedef TimePointImageCache<ImageType>                    TimePointCacheType;
+
   // This is the pixel type of the buffer pointer, i.e., internal representation
   typedef typename ImageType::InternalPixelType              InternalPixelType;
 
@@ -234,7 +239,11 @@ public:
   /** Return some image info independently of pixel type */
   ImageBaseType* GetImageBase() const ITK_OVERRIDE;
 
-  /** Return 4D image metadata */
+  /**
+   * Return 4D image metadata. In lazy 4D mode (see SetImage4DWithTimePointCache)
+   * the 4D image only holds the first time point, so its size along the fourth
+   * axis is one. Use GetNumberOfTimePoints() for the number of time points.
+   */
   Image4DBaseType* GetImage4DBase() const ITK_OVERRIDE { return m_Image4D; }
 
   /** Get the number of time points (how many 3D images in 4D array) */
@@ -363,9 +372,15 @@ public:
   /**
    * Return the pointer to the 4D ITK image encapsulated by this wrapper. In order to restrict
    * write operations to the image, only a const pointer is returned in the public method.
+   * The voxels of all time points are only held in memory outside of lazy 4D mode, so this
+   * throws an exception in lazy 4D mode, where the time points are read one at a time.
    */
   virtual const Image4DType *GetImage4D() const
-    { return m_Image4D; }
+    {
+    itkAssertOrThrowMacro(!m_TimePointCache,
+                          "The 4D image is not available in lazy 4D mode in ImageWrapper::GetImage4D");
+    return m_Image4D;
+    }
 
   /**
    * Get an image for modification. After making modifications, PixelsModified() should be
@@ -458,6 +473,22 @@ public:
   virtual void SetImage4D(Image4DType *image_4d,
                           ImageBaseType *refSpace, ITKTransformType *transform);
 
+  /**
+   * Set the wrapper to hold a 4D image whose time points are read from disk on
+   * demand (lazy 4D mode). The 4D image has the header of the full image, but
+   * holds the voxels of the first time point only, and its size along the
+   * fourth axis is one. GetImage4D() is not available in this mode. The other time points are
+   * requested from the cache, and the neighbors of the current time point are
+   * prefetched whenever SetTimePointIndex() is called. Intensity statistics
+   * are computed from the first time point.
+   */
+  virtual void SetImage4DWithTimePointCache(
+      Image4DType *image_4d, TimePointCacheType *cache,
+      ImageBaseType *refSpace = NULL, ITKTransformType *transform = NULL);
+
+  /** The cache supplying the time points in lazy 4D mode, or NULL */
+  TimePointCacheType *GetTimePointCache() const;
+
   /**
    * Update a single timepoint in the image with the supplied image. If time point
    * is not specified, the current time point will be updated.
@@ -683,10 +714,22 @@ protected:
   Image4DPointer m_Image4D;
 
   /**
-   * Array of 3D image pointers referencing the 3D volumes in the 4D image
+   * Array of 3D image pointers referencing the 3D volumes in the 4D image. In
+   * lazy 4D mode, only the first of these references voxels, the others just
+   * carry the header of their time point.
    */
   std::vector<ImagePointer> m_ImageTimePoints;
 
+  /** In lazy 4D mode, the source of the time points, and the current one */
+  SmartPtr<TimePointCacheType> m_TimePointCache;
+  ImagePointer m_CurrentCachedTimePoint;
+
+  /**
+   * Get the image holding the voxels of a time point. This is the same as
+   * m_ImageTimePoints[tp], except in lazy 4D mode
+   */
+  ImagePointer GetTimePointImage(unsigned int tp) const;
+
   /** This image selector is used to pull out the current time point */
   typedef InputSelectionImageFilter<ImageType, unsigned int> TimePointSelectFilter;
   typedef SmartPtr<TimePointSelectFilter> TimePointSelectPointer;
@@ -38,6 +38,12 @@ public:
    */
   void AddSelectableInput(TagType tag, InputImageType *input);
 
+  /**
+   * Replace the input associated with an existing tag. If the tag is the
+   * selected one, the new input becomes the input of the filter
+   */
+  void ReplaceSelectableInput(TagType tag, InputImageType *input);
+
   /**
    * Remove all selectable inputs
    */
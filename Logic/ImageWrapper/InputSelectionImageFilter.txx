@@ -29,6 +29,19 @@ InputSelectionImageFilter<TInputImage,TTag>
   m_TagMap[tag] = input;
 }
 
+template<class TInputImage, typename TTag>
+void
+InputSelectionImageFilter<TInputImage,TTag>
+::ReplaceSelectableInput(TagType tag, InputImageType *input)
+{
+  m_TagMap[tag] = input;
+  if(m_SelectedInput == tag)
+    {
+    this->SetInput(input);
+    this->Modified();
+    }
+}
+
 template<class TInputImage, typename TTag>
 void
 InputSelectionImageFilter<TInputImage,TTag>
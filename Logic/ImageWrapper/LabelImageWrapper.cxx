@@ -43,9 +43,12 @@
 #include "LabelImageWrapper.h"
 #include "UndoDataManager.h"
 #include "Rebroadcaster.h"
+#include <algorithm>
 
 LabelImageWrapper::LabelImageWrapper()
 {
+  m_BrickOccupancyTimePoint = 0;
+  m_BrickOccupancyMTime = 0;
 }
 
 LabelImageWrapper::~LabelImageWrapper()
@@ -65,10 +68,27 @@ void LabelImageWrapper::UpdateWrappedImages(
   for(auto p : m_TimePointUndoManagers)
     delete p;
 
-  // Set up new undo managers
-  m_TimePointUndoManagers.resize(this->GetNumberOfTimePoints());
+  // Set up new undo managers. The memory budget of each time point is the
+  // size of the 200000 uncompressed runs that the undo history used to be
+  // limited to. Older history is moved to a temporary file, and the 256MB
+  // disk budget is shared by all the time points.
+  size_t nt = this->GetNumberOfTimePoints();
+  size_t mem_budget = 200000 * sizeof(std::pair<size_t, LabelType>);
+  size_t disk_budget = std::max(mem_budget, (size_t) (256 * 1024 * 1024) / nt);
+  m_TimePointUndoManagers.resize(nt);
   for(auto &p : m_TimePointUndoManagers)
-    p = new UndoManagerType(4, 200000);
+    p = new UndoManagerType(4, mem_budget, disk_budget);
+
+  // Random access to the labels (the cursor, the oblique slicer) finds
+  // voxels with the per-line segment index instead of walking the lines
+  this->m_Image->SetUseSegmentIndex(true);
+  for(auto &img : this->m_ImageTimePoints)
+    img->SetUseSegmentIndex(true);
+
+  // Label counts will be computed when first needed
+  m_TimePointLabelCounts.clear();
+  m_TimePointLabelCounts.resize(this->GetNumberOfTimePoints());
+  m_BrickOccupancyMTime = 0;
 
   // Modified event on the image is rebroadcast as the WrapperImageChangeEvent
   Rebroadcaster::Rebroadcast(image_4d, itk::ModifiedEvent(), this, WrapperImageChangeEvent());
@@ -135,10 +155,10 @@ void LabelImageWrapper::Undo()
     IteratorType lit(m_Image, delta->GetRegion());
 
     // Iterate over the rles in the delta
-    for(size_t i = 0; i < delta->GetNumberOfRLEs(); i++)
+    for(UndoManagerDelta::RLEReader rit(delta); !rit.IsAtEnd(); ++rit)
       {
-      size_t n = delta->GetRLELength(i);
-      LabelType d = delta->GetRLEValue(i);
+      size_t n = rit.GetLength();
+      LabelType d = rit.GetValue();
       for(size_t j = 0; j < n; j++)
         {
         if(d != 0)
@@ -146,10 +166,13 @@ void LabelImageWrapper::Undo()
         ++lit;
         }
       }
+
+    // Report the change to observers
+    this->DeltaApplied(delta, true);
     }
 
   // Set modified flags
-  this->PixelsModified();
+  this->DeltaPixelsModified();
 }
 
 bool LabelImageWrapper::IsRedoPossible()
@@ -179,10 +202,10 @@ void LabelImageWrapper::Redo()
     IteratorType lit(m_Image, delta->GetRegion());
 
     // Iterate over the rles in the delta
-    for(size_t i = 0; i < delta->GetNumberOfRLEs(); i++)
+    for(UndoManagerDelta::RLEReader rit(delta); !rit.IsAtEnd(); ++rit)
       {
-      size_t n = delta->GetRLELength(i);
-      LabelType d = delta->GetRLEValue(i);
+      size_t n = rit.GetLength();
+      LabelType d = rit.GetValue();
       for(size_t j = 0; j < n; j++)
         {
         if(d != 0)
@@ -190,10 +213,13 @@ void LabelImageWrapper::Redo()
         ++lit;
         }
       }
+
+    // Report the change to observers
+    this->DeltaApplied(delta, false);
     }
 
   // Set modified flags
-  this->PixelsModified();
+  this->DeltaPixelsModified();
 }
 
 const
@@ -204,6 +230,242 @@ LabelImageWrapper
   return m_TimePointUndoManagers[m_TimePointIndex];
 }
 
+itk::ModifiedTimeType
+LabelImageWrapper::GetTimePointPixelsMTime() const
+{
+  return m_ImageTimePoints[m_TimePointIndex]->GetMTime();
+}
+
+void LabelImageWrapper::DeltaApplied(const UndoManagerDelta *delta, bool reverse)
+{
+  // Keep the label counts up to date, if they are current
+  LabelCounts &lc = m_TimePointLabelCounts[m_TimePointIndex];
+  if(lc.PixelsMTime == this->GetTimePointPixelsMTime())
+    this->UpdateLabelCounts(delta, reverse);
+  else
+    lc.PixelsMTime = 0;
+
+  // Same for the brick occupancy
+  if(m_BrickOccupancyTimePoint == m_TimePointIndex
+     && m_BrickOccupancyMTime == this->GetTimePointPixelsMTime())
+    this->UpdateBrickOccupancy(delta);
+
+  SegmentationDeltaEvent event(delta, reverse, m_TimePointIndex,
+                               this->GetTimePointPixelsMTime());
+  this->InvokeEvent(event);
+}
+
+void LabelImageWrapper::DeltaPixelsModified()
+{
+  itk::ModifiedTimeType mtime = this->GetTimePointPixelsMTime();
+  this->PixelsModified();
+
+  // The label counts have been updated for all the deltas
+  LabelCounts &lc = m_TimePointLabelCounts[m_TimePointIndex];
+  if(lc.PixelsMTime && lc.PixelsMTime == mtime)
+    lc.PixelsMTime = this->GetTimePointPixelsMTime();
+
+  if(m_BrickOccupancyTimePoint == m_TimePointIndex
+     && m_BrickOccupancyMTime && m_BrickOccupancyMTime == mtime)
+    m_BrickOccupancyMTime = this->GetTimePointPixelsMTime();
+
+  SegmentationDeltaEvent event(NULL, false, m_TimePointIndex,
+                               mtime, this->GetTimePointPixelsMTime());
+  this->InvokeEvent(event);
+}
+
+void LabelImageWrapper::UpdateLabelCounts(const UndoManagerDelta *delta, bool reverse)
+{
+  std::vector<size_t> &count = m_TimePointLabelCounts[m_TimePointIndex].Count;
+
+  // The delta stores the difference between the new and old label of each
+  // voxel, so the old label is recovered from the current one
+  ConstIterator itLabel(m_Image, delta->GetRegion());
+  for(UndoManagerDelta::RLEReader rit(delta); !rit.IsAtEnd(); ++rit)
+    {
+    size_t n = rit.GetLength();
+    LabelType d = reverse ? (LabelType)(0 - rit.GetValue()) : rit.GetValue();
+    for(size_t j = 0; j < n; j++, ++itLabel)
+      {
+      if(d != 0)
+        {
+        LabelType newLabel = itLabel.Get();
+        count[newLabel]++;
+        count[(LabelType)(newLabel - d)]--;
+        }
+      }
+    }
+}
+
+size_t LabelImageWrapper::GetNumberOfVoxelsWithLabel(LabelType label)
+{
+  LabelCounts &lc = m_TimePointLabelCounts[m_TimePointIndex];
+  itk::ModifiedTimeType mtime = this->GetTimePointPixelsMTime();
+
+  // Recompute the counts from the runs of the image
+  if(lc.PixelsMTime != mtime)
+    {
+    lc.Count.assign(static_cast<size_t>(itk::NumericTraits<LabelType>::max()) + 1, 0);
+
+    typedef ImageType::BufferType BufferType;
+    BufferType *lines = m_Image->GetBuffer();
+    itk::ImageRegionConstIterator<BufferType> itLine(lines, lines->GetBufferedRegion());
+    for(; !itLine.IsAtEnd(); ++itLine)
+      {
+      const ImageType::RLLine &line = itLine.Value();
+      for(size_t iSeg = 0; iSeg < line.size(); iSeg++)
+        lc.Count[line[iSeg].second] += line[iSeg].first;
+      }
+
+    lc.PixelsMTime = mtime;
+    }
+
+  return lc.Count[label];
+}
+
+void LabelImageWrapper::UpdateBrickOccupancy(const UndoManagerDelta *delta)
+{
+  // Bricks may be marked even if their voxels were cleared, which is fine
+  // since the occupancy is conservative
+  const itk::ImageRegion<3> &region = delta->GetRegion();
+  size_t nx = region.GetSize(0), ny = region.GetSize(1), pos = 0;
+  for(UndoManagerDelta::RLEReader rit(delta); !rit.IsAtEnd(); ++rit)
+    {
+    size_t n = rit.GetLength();
+    if(rit.GetValue() != 0)
+      {
+      // Split the run into pieces along the lines of the region
+      for(size_t p = pos; p < pos + n; )
+        {
+        size_t x = p % nx, y = (p / nx) % ny, z = p / (nx * ny);
+        size_t len = std::min(nx - x, pos + n - p);
+        m_BrickOccupancy.MarkRun(region.GetIndex(0) + x, region.GetIndex(0) + x + len,
+                                 region.GetIndex(1) + y, region.GetIndex(2) + z);
+        p += len;
+        }
+      }
+    pos += n;
+    }
+}
+
+const ImageBrickOccupancy *LabelImageWrapper::GetBrickOccupancy()
+{
+  itk::ModifiedTimeType mtime = this->GetTimePointPixelsMTime();
+  if(m_BrickOccupancyTimePoint != m_TimePointIndex || m_BrickOccupancyMTime != mtime)
+    {
+    m_BrickOccupancy.Build(m_Image);
+    m_BrickOccupancyTimePoint = m_TimePointIndex;
+    m_BrickOccupancyMTime = mtime;
+    }
+
+  return &m_BrickOccupancy;
+}
+
+unsigned long
+LabelImageWrapper::PaintVoxels(std::vector<itk::Index<3> > &voxels,
+                               LabelType label, const DrawOverFilter &draw_over,
+                               const char *undo_string)
+{
+  typedef itk::Index<3> IndexType;
+  itk::ImageRegion<3> region = this->GetBufferedRegion();
+
+  // Drop the voxels outside of the image, sort the rest by line and remove
+  // duplicates
+  voxels.erase(std::remove_if(voxels.begin(), voxels.end(),
+                              [&](const IndexType &idx) { return !region.IsInside(idx); }),
+               voxels.end());
+  std::sort(voxels.begin(), voxels.end(),
+            [](const IndexType &a, const IndexType &b)
+    {
+    if(a[2] != b[2]) return a[2] < b[2];
+    if(a[1] != b[1]) return a[1] < b[1];
+    return a[0] < b[0];
+    });
+  voxels.erase(std::unique(voxels.begin(), voxels.end()), voxels.end());
+  if(voxels.empty())
+    return 0;
+
+  // The delta covers the bounding box of the voxels
+  IndexType lower = voxels.front(), upper = voxels.front();
+  for(const IndexType &idx : voxels)
+    for(int d = 0; d < 3; d++)
+      {
+      lower[d] = std::min(lower[d], idx[d]);
+      upper[d] = std::max(upper[d], idx[d]);
+      }
+
+  itk::ImageRegion<3> bbox;
+  bbox.SetIndex(lower);
+  bbox.SetUpperIndex(upper);
+
+  UndoManagerDelta *delta = new UndoManagerDelta();
+  delta->SetRegion(bbox);
+
+  // Apply the changes one line at a time. The delta is zero between voxels
+  typedef ImageType::IndexValueType IndexValueType;
+  ImageType::BufferType *lines = m_Image->GetBuffer();
+  std::vector<IndexValueType> x;
+  size_t pos = 0, nChanged = 0;
+  for(size_t i = 0; i < voxels.size(); )
+    {
+    // Voxels in the same line
+    size_t j = i;
+    for(x.clear(); j < voxels.size() && voxels[j][1] == voxels[i][1]
+        && voxels[j][2] == voxels[i][2]; j++)
+      x.push_back(voxels[j][0] - region.GetIndex(0));
+
+    // Position of the first voxel in the delta
+    size_t offset = ((voxels[i][2] - lower[2]) * bbox.GetSize(1)
+                     + (voxels[i][1] - lower[1])) * bbox.GetSize(0)
+                     + (voxels[i][0] - lower[0]);
+    delta->EncodeRun(0, offset - pos);
+    pos = offset;
+
+    itk::Index<2> lineIndex = {{ voxels[i][1], voxels[i][2] }};
+    size_t k = 0;
+    m_Image->TransformLinePixels(lines->GetPixel(lineIndex), x.data(), x.size(),
+                                 [&](LabelType lOld) -> LabelType
+      {
+      // Zero delta from the previous voxel of the line
+      if(k > 0)
+        delta->EncodeRun(0, x[k] - x[k-1] - 1);
+      k++;
+
+      LabelType lNew = lOld;
+      if(draw_over.CoverageMode == PAINT_OVER_ALL ||
+         (draw_over.CoverageMode == PAINT_OVER_ONE && lOld == draw_over.DrawOverLabel) ||
+         (draw_over.CoverageMode == PAINT_OVER_VISIBLE && lOld != 0))
+        lNew = label;
+
+      delta->EncodeRun((LabelType)(lNew - lOld), 1);
+      if(lNew != lOld)
+        nChanged++;
+      return lNew;
+      });
+
+    pos += x.back() - x.front() + 1;
+    i = j;
+    }
+
+  delta->EncodeRun(0, bbox.GetNumberOfPixels() - pos);
+  delta->FinishEncoding();
+
+  // Report the changes and store the undo point
+  if(nChanged > 0)
+    {
+    this->DeltaApplied(delta);
+    this->DeltaPixelsModified();
+    if(undo_string)
+      {
+      this->StoreUndoPoint(undo_string, delta);
+      delta = NULL;
+      }
+    }
+
+  delete delta;
+  return nChanged;
+}
+
 LabelImageWrapper::UndoManagerDelta *
 LabelImageWrapper::CompressImage() const
 {
@@ -3,11 +3,78 @@
 
 #include "ImageWrapperTraits.h"
 #include "ScalarImageWrapper.h"
+#include "ImageBrickOccupancy.h"
+#include "itkEventObject.h"
 
 template <typename TPixel> class UndoDataManager;
 template <typename TPixel> class UndoDelta;
 class SegmentationUpdateIterator;
 
+/**
+ * Event fired by LabelImageWrapper when the voxels covered by an undo delta
+ * have been changed, either by a SegmentationUpdateIterator or by undo/redo.
+ * Observers can use it to keep quantities derived from the segmentation up to
+ * date without rescanning the image.
+ *
+ * The event is fired once per delta, right after its voxels are changed and
+ * before PixelsModified() is called. At that point GetMTime() is the modified
+ * time that the voxels had before the change. Once all deltas have been
+ * applied, a final event with a NULL delta is fired after PixelsModified(),
+ * with GetMTime() as before and GetModifiedMTime() the new modified time.
+ * The delta is only valid during the callback.
+ */
+class SegmentationDeltaEvent : public itk::UserEvent
+{
+public:
+  typedef SegmentationDeltaEvent Self;
+  typedef itk::UserEvent Superclass;
+  typedef UndoDelta<LabelType> DeltaType;
+
+  SegmentationDeltaEvent(const DeltaType *delta = NULL, bool reverse = false,
+                         unsigned int time_point = 0,
+                         itk::ModifiedTimeType mtime = 0,
+                         itk::ModifiedTimeType modified_mtime = 0)
+    : m_Delta(delta), m_Reverse(reverse), m_TimePoint(time_point),
+      m_MTime(mtime), m_ModifiedMTime(modified_mtime) {}
+
+  SegmentationDeltaEvent(const Self &s)
+    : Superclass(s), m_Delta(s.m_Delta), m_Reverse(s.m_Reverse),
+      m_TimePoint(s.m_TimePoint), m_MTime(s.m_MTime),
+      m_ModifiedMTime(s.m_ModifiedMTime) {}
+
+  virtual const char *GetEventName() const ITK_OVERRIDE
+    { return "SegmentationDeltaEvent"; }
+
+  virtual bool CheckEvent(const itk::EventObject *e) const ITK_OVERRIDE
+    { return dynamic_cast<const Self *>(e) != NULL; }
+
+  virtual itk::EventObject *MakeObject() const ITK_OVERRIDE
+    { return new Self(*this); }
+
+  /** The delta that was applied, or NULL for the final event */
+  const DeltaType *GetDelta() const { return m_Delta; }
+
+  /** Whether the delta was undone rather than applied */
+  bool IsReverse() const { return m_Reverse; }
+
+  /** The time point of the segmentation that was changed */
+  unsigned int GetTimePoint() const { return m_TimePoint; }
+
+  /** Modified time of the voxels before the change */
+  itk::ModifiedTimeType GetMTime() const { return m_MTime; }
+
+  /** Modified time of the voxels after the change (final event only) */
+  itk::ModifiedTimeType GetModifiedMTime() const { return m_ModifiedMTime; }
+
+private:
+  void operator=(const Self &);
+
+  const DeltaType *m_Delta;
+  bool m_Reverse;
+  unsigned int m_TimePoint;
+  itk::ModifiedTimeType m_MTime, m_ModifiedMTime;
+};
+
 class LabelImageWrapper : public ScalarImageWrapper<LabelImageWrapperTraits>
 {
 public:
@@ -77,12 +144,62 @@ public:
   /** Get the undo manager */
   const UndoManagerType *GetUndoManager() const;
 
+  /**
+   * Modified time of the voxels in the current time point. This changes each
+   * time PixelsModified() is called.
+   */
+  itk::ModifiedTimeType GetTimePointPixelsMTime() const;
+
+  /**
+   * Called after the voxels covered by a delta have been changed, before
+   * PixelsModified(). Fires a SegmentationDeltaEvent for the delta.
+   */
+  void DeltaApplied(const UndoManagerDelta *delta, bool reverse = false);
+
+  /**
+   * Called instead of PixelsModified() once all the changes to the voxels
+   * have been reported with DeltaApplied(). Fires the final
+   * SegmentationDeltaEvent.
+   */
+  void DeltaPixelsModified();
+
+  /**
+   * Paint a set of voxels with a label, using the same rules as
+   * SegmentationUpdateIterator::PaintLabel(). The voxels are sorted and
+   * grouped by image line, so that each line is rebuilt once, and the changes
+   * are recorded in a single delta over their bounding box. Voxels outside of
+   * the image are ignored. Like SegmentationUpdateIterator::Finalize(), this
+   * reports the changes to observers and stores an undo point if a
+   * description is given. Returns the number of voxels that were changed.
+   */
+  unsigned long PaintVoxels(std::vector<itk::Index<3> > &voxels,
+                            LabelType label, const DrawOverFilter &draw_over,
+                            const char *undo_string = NULL);
+
   /** This is not used by the undo system itself, but uses the undo code to
    * store the contents of the image as an undo delta object, which can then
    * be stored in memory compactly. The caller is responsible for deleting the
    * array created in this call. */
   UndoManagerDelta *CompressImage() const;
 
+  /**
+   * Number of voxels with the given label in the current time point. The
+   * counts of all labels are computed from the runs of the image when first
+   * needed, and then kept up to date as deltas are reported by DeltaApplied().
+   * Any other change to the voxels causes the counts to be recomputed. These
+   * are also the counts reported by SegmentationStatistics.
+   */
+  size_t GetNumberOfVoxelsWithLabel(LabelType label);
+
+  /**
+   * Coarse grid of the bricks of the current time point that may contain
+   * non-zero voxels, used to speed up ray casting. The grid is computed from
+   * the runs of the image when first needed, and bricks touched by deltas
+   * reported with DeltaApplied() are marked as occupied. Any other change
+   * to the voxels causes the grid to be recomputed.
+   */
+  const ImageBrickOccupancy *GetBrickOccupancy();
+
 protected:
 
   LabelImageWrapper();
@@ -93,6 +210,30 @@ protected:
   // undo steps with little cost in performance or memory. We currently associate each time
   // point with its own undo manager
   std::vector<UndoManagerType *> m_TimePointUndoManagers;
+
+  // Voxel counts for each label, and the modified time of the voxels that
+  // they correspond to (zero if they have not been computed)
+  struct LabelCounts
+  {
+    std::vector<size_t> Count;
+    itk::ModifiedTimeType PixelsMTime;
+    LabelCounts() : PixelsMTime(0) {}
+  };
+
+  // We keep separate label counts for each time point
+  std::vector<LabelCounts> m_TimePointLabelCounts;
+
+  // Update the label counts of the current time point for an applied delta
+  void UpdateLabelCounts(const UndoManagerDelta *delta, bool reverse);
+
+  // Brick occupancy of one of the time points, and the modified time of the
+  // voxels that it corresponds to (zero if it has not been computed)
+  ImageBrickOccupancy m_BrickOccupancy;
+  unsigned int m_BrickOccupancyTimePoint;
+  itk::ModifiedTimeType m_BrickOccupancyMTime;
+
+  // Mark the bricks touched by an applied delta as occupied
+  void UpdateBrickOccupancy(const UndoManagerDelta *delta);
 };
 
 #endif // LABELIMAGEWRAPPER_H
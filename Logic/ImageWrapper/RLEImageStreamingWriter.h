@@ -0,0 +1,45 @@
+#ifndef RLEIMAGESTREAMINGWRITER_H
+#define RLEIMAGESTREAMINGWRITER_H
+
+#include "SNAPCommon.h"
+
+class Registry;
+
+/**
+ * Writes an RLEImage to disk without creating an uncompressed copy of the
+ * image. The run-length encoded lines are decoded one scanline at a time,
+ * straight into the output file and, for .nii.gz files, into the gzip
+ * compressor, so the memory needed to save a segmentation stays close to
+ * the size of its RLE representation.
+ *
+ * This is supported for single-file NIfTI images (.nii and .nii.gz), the
+ * default format for segmentations, with integer or floating point pixels
+ * and an orthonormal direction matrix. The header is written following the
+ * same conventions as itk::NiftiImageIO (RAS physical space, qform and sform
+ * both set to scanner coordinates). Write() returns false for images and
+ * formats that it does not support, in which case the caller should fall
+ * back to itk::ImageFileWriter.
+ */
+template <class TImage>
+class RLEImageStreamingWriter
+{
+public:
+  typedef TImage ImageType;
+  typedef typename ImageType::PixelType PixelType;
+
+  /** Check if the image can be written to this file with this writer */
+  static bool CanWrite(const ImageType *image, const char *fname, Registry &hints);
+
+  /** Write the image, if supported. Throws an IRISException on IO errors */
+  static bool Write(const ImageType *image, const char *fname, Registry &hints);
+
+protected:
+  // NIfTI datatype code for the pixel type, or 0 if not supported
+  static short GetNiftiDataType();
+};
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "RLEImageStreamingWriter.txx"
+#endif
+
+#endif // RLEIMAGESTREAMINGWRITER_H
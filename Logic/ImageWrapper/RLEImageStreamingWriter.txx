@@ -0,0 +1,243 @@
+#include "RLEImageStreamingWriter.h"
+#include "GuidedNativeImageIO.h"
+#include "IRISException.h"
+#include "Registry.h"
+#include "itkImageRegionConstIterator.h"
+#include "itksys/SystemTools.hxx"
+#include "nifti1.h"
+#include "vnl/algo/vnl_determinant.h"
+#include "vnl/algo/vnl_svd.h"
+#include <itk_zlib.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <type_traits>
+
+template <class TImage>
+short
+RLEImageStreamingWriter<TImage>
+::GetNiftiDataType()
+{
+  typedef PixelType T;
+  if(std::is_floating_point<T>::value)
+    return sizeof(T) == 4 ? NIFTI_TYPE_FLOAT32 : sizeof(T) == 8 ? NIFTI_TYPE_FLOAT64 : 0;
+  if(!std::is_integral<T>::value)
+    return 0;
+
+  bool sgn = std::is_signed<T>::value;
+  switch(sizeof(T))
+    {
+    case 1: return sgn ? NIFTI_TYPE_INT8 : NIFTI_TYPE_UINT8;
+    case 2: return sgn ? NIFTI_TYPE_INT16 : NIFTI_TYPE_UINT16;
+    case 4: return sgn ? NIFTI_TYPE_INT32 : NIFTI_TYPE_UINT32;
+    case 8: return sgn ? NIFTI_TYPE_INT64 : NIFTI_TYPE_UINT64;
+    default: return 0;
+    }
+}
+
+template <class TImage>
+bool
+RLEImageStreamingWriter<TImage>
+::CanWrite(const ImageType *image, const char *fname, Registry &hints)
+{
+  if(ImageType::ImageDimension < 3 || ImageType::ImageDimension > 4)
+    return false;
+
+  if(GetNiftiDataType() == 0)
+    return false;
+
+  // Only single-file NIfTI is written by this class
+  GuidedNativeImageIO::FileFormat fmt = GuidedNativeImageIO::GetFileFormat(hints);
+  if(fmt != GuidedNativeImageIO::FORMAT_NIFTI && fmt != GuidedNativeImageIO::FORMAT_COUNT)
+    return false;
+
+  std::string fn = itksys::SystemTools::LowerCase(fname);
+  bool is_nii = itksys::SystemTools::StringEndsWith(fn, ".nii")
+                || itksys::SystemTools::StringEndsWith(fn, ".nii.gz");
+  if(!is_nii)
+    return false;
+
+  // The quaternion representation requires an orthonormal direction matrix
+  vnl_matrix<double> dir = image->GetDirection().GetVnlMatrix().extract(3, 3);
+  vnl_matrix<double> err = dir.transpose() * dir;
+  for(unsigned int i = 0; i < 3; i++)
+    err(i,i) -= 1.0;
+  return err.absolute_value_max() < 1e-4;
+}
+
+template <class TImage>
+bool
+RLEImageStreamingWriter<TImage>
+::Write(const ImageType *image, const char *fname, Registry &hints)
+{
+  if(!CanWrite(image, fname, hints))
+    return false;
+
+  const unsigned int VDim = ImageType::ImageDimension;
+  typename ImageType::SizeType size = image->GetLargestPossibleRegion().GetSize();
+  typename ImageType::SpacingType spacing = image->GetSpacing();
+  typename ImageType::PointType origin = image->GetOrigin();
+
+  // Fill out the header
+  nifti_1_header hdr;
+  memset(&hdr, 0, sizeof(hdr));
+  hdr.sizeof_hdr = sizeof(nifti_1_header);
+  hdr.regular = 'r';
+  hdr.dim[0] = VDim;
+  for(unsigned int i = 0; i < 7; i++)
+    {
+    hdr.dim[i+1] = i < VDim ? size[i] : 1;
+    hdr.pixdim[i+1] = i < VDim ? spacing[i] : 1.0f;
+    }
+  hdr.datatype = GetNiftiDataType();
+  hdr.bitpix = 8 * sizeof(PixelType);
+  hdr.vox_offset = 352;
+  hdr.scl_slope = 1.0f;
+  hdr.scl_inter = 0.0f;
+  hdr.xyzt_units = NIFTI_UNITS_MM | NIFTI_UNITS_SEC;
+  hdr.qform_code = NIFTI_XFORM_SCANNER_ANAT;
+  hdr.sform_code = NIFTI_XFORM_SCANNER_ANAT;
+  strcpy(hdr.magic, "n+1");
+
+  // ITK uses LPS physical coordinates and NIfTI uses RAS
+  vnl_matrix_fixed<double, 3, 3> R;
+  double origin_ras[3];
+  for(unsigned int i = 0; i < 3; i++)
+    {
+    double flip = i < 2 ? -1.0 : 1.0;
+    for(unsigned int j = 0; j < 3; j++)
+      R(i,j) = flip * image->GetDirection()(i,j);
+    origin_ras[i] = flip * origin[i];
+    }
+
+  // The sform is the full voxel to RAS matrix
+  float *srow[] = { hdr.srow_x, hdr.srow_y, hdr.srow_z };
+  for(unsigned int i = 0; i < 3; i++)
+    {
+    for(unsigned int j = 0; j < 3; j++)
+      srow[i][j] = R(i,j) * spacing[j];
+    srow[i][3] = origin_ras[i];
+    }
+
+  // The qform stores a proper rotation, with the handedness in qfac. The
+  // matrix is orthogonalized first, since directions read from files often
+  // carry single precision round-off
+  vnl_svd<double> svd(R.as_matrix());
+  vnl_matrix<double> Q = svd.U() * svd.V().transpose();
+  double qfac = vnl_determinant(Q) < 0.0 ? -1.0 : 1.0;
+  if(qfac < 0)
+    for(unsigned int i = 0; i < 3; i++)
+      Q(i,2) = -Q(i,2);
+
+  // Quaternion of the rotation, same method as nifti_mat44_to_quatern
+  double a = Q(0,0) + Q(1,1) + Q(2,2) + 1.0, b, c, d;
+  if(a > 0.5)
+    {
+    a = 0.5 * std::sqrt(a);
+    b = 0.25 * (Q(2,1) - Q(1,2)) / a;
+    c = 0.25 * (Q(0,2) - Q(2,0)) / a;
+    d = 0.25 * (Q(1,0) - Q(0,1)) / a;
+    }
+  else
+    {
+    double xd = 1.0 + Q(0,0) - (Q(1,1) + Q(2,2));
+    double yd = 1.0 + Q(1,1) - (Q(0,0) + Q(2,2));
+    double zd = 1.0 + Q(2,2) - (Q(0,0) + Q(1,1));
+    if(xd > 1.0)
+      {
+      b = 0.5 * std::sqrt(xd);
+      c = 0.25 * (Q(0,1) + Q(1,0)) / b;
+      d = 0.25 * (Q(0,2) + Q(2,0)) / b;
+      a = 0.25 * (Q(2,1) - Q(1,2)) / b;
+      }
+    else if(yd > 1.0)
+      {
+      c = 0.5 * std::sqrt(yd);
+      b = 0.25 * (Q(0,1) + Q(1,0)) / c;
+      d = 0.25 * (Q(1,2) + Q(2,1)) / c;
+      a = 0.25 * (Q(0,2) - Q(2,0)) / c;
+      }
+    else
+      {
+      d = 0.5 * std::sqrt(zd);
+      b = 0.25 * (Q(0,2) + Q(2,0)) / d;
+      c = 0.25 * (Q(1,2) + Q(2,1)) / d;
+      a = 0.25 * (Q(1,0) - Q(0,1)) / d;
+      }
+    if(a < 0.0)
+      {
+      b = -b; c = -c; d = -d;
+      }
+    }
+
+  hdr.quatern_b = b;
+  hdr.quatern_c = c;
+  hdr.quatern_d = d;
+  hdr.qoffset_x = origin_ras[0];
+  hdr.qoffset_y = origin_ras[1];
+  hdr.qoffset_z = origin_ras[2];
+  hdr.pixdim[0] = qfac;
+
+  // Open the output; zlib is used for .nii.gz, plain stdio otherwise
+  bool compress = itksys::SystemTools::StringEndsWith(
+        itksys::SystemTools::LowerCase(fname), ".gz");
+  gzFile gz = NULL;
+  FILE *fp = NULL;
+  if(compress)
+    gz = gzopen(fname, "wb");
+  else
+    fp = fopen(fname, "wb");
+  if(!gz && !fp)
+    throw IRISException("Error: Unable to open file '%s' for writing.", fname);
+
+  auto write = [&](const void *data, size_t n) -> bool
+  {
+    return compress
+        ? gzwrite(gz, data, (unsigned int) n) == (int) n
+        : fwrite(data, 1, n, fp) == n;
+  };
+
+  // Header, followed by an empty extension flag
+  char extension[4] = {0, 0, 0, 0};
+  bool ok = write(&hdr, sizeof(hdr)) && write(extension, 4);
+
+  // Decode the lines in file order (x fastest, then the buffer dimensions)
+  // into a chunk that is flushed when full
+  typedef typename ImageType::BufferType BufferType;
+  typedef typename ImageType::RLLine RLLine;
+  const BufferType *buffer = image->GetBuffer();
+  itk::ImageRegionConstIterator<BufferType> it(buffer, buffer->GetBufferedRegion());
+
+  size_t line_length = size[0];
+  size_t lines_per_chunk = std::max((size_t) 1, (size_t) (1 << 20) / (line_length * sizeof(PixelType)));
+  std::vector<PixelType> chunk(lines_per_chunk * line_length);
+  size_t n_lines = 0;
+
+  for(; ok && !it.IsAtEnd(); ++it)
+    {
+    const RLLine &line = it.Value();
+    PixelType *p = chunk.data() + n_lines * line_length;
+    for(size_t s = 0; s < line.size(); s++)
+      {
+      std::fill(p, p + line[s].first, line[s].second);
+      p += line[s].first;
+      }
+
+    if(++n_lines == lines_per_chunk)
+      {
+      ok = write(chunk.data(), n_lines * line_length * sizeof(PixelType));
+      n_lines = 0;
+      }
+    }
+
+  if(ok && n_lines)
+    ok = write(chunk.data(), n_lines * line_length * sizeof(PixelType));
+
+  ok = (compress ? gzclose(gz) == Z_OK : fclose(fp) == 0) && ok;
+  if(!ok)
+    throw IRISException("Error: Failed to write image data to file '%s'.", fname);
+
+  return true;
+}
@@ -18,6 +18,9 @@ public:
 
   void Initialize(double vmin, double vmax, size_t nBins);
   void AddSample(double v);
+
+  /** Add a value that occurs multiple times */
+  void AddSample(double v, unsigned long count);
   double GetBinMin(size_t iBin) const;
   double GetBinMax(size_t iBin) const;
   double GetBinCenter(size_t iBin) const;
@@ -85,6 +88,24 @@ inline void ScalarImageHistogram::AddSample(double v)
   m_TotalSamples++;
 }
 
+inline void ScalarImageHistogram::AddSample(double v, unsigned long count)
+{
+  int index = (int) (m_Scale * (v - m_FirstBinStart));
+
+  if(index < 0)
+    index = 0;
+  else if(index >= m_BinCount)
+    index = m_BinCount - 1;
+
+  unsigned long k = (m_Bins[index] += count);
+
+  // Update total, max frequency
+  if(m_MaxFrequency < k)
+    m_MaxFrequency = k;
+
+  m_TotalSamples += count;
+}
+
 
 
 #endif // SCALARIMAGEHISTOGRAM_H
@@ -32,7 +32,6 @@
 #include "AdaptiveSlicingPipeline.h"
 #include "SNAPSegmentationROISettings.h"
 #include "itkCommand.h"
-#include "itkMinimumMaximumImageFilter.h"
 #include "itkVectorImageToImageAdaptor.h"
 #include "itkCastImageFilter.h"
 #include "IRISException.h"
@@ -51,7 +50,6 @@ template<class TTraits, class TBase>
 ScalarImageWrapper<TTraits,TBase>
 ::ScalarImageWrapper()
 {
-  m_MinMaxFilter = MinMaxFilter::New();
   m_HistogramFilter = HistogramFilterType::New();
 }
 
@@ -77,13 +75,10 @@ ScalarImageWrapper<TTraits,TBase>
   // Call the parent
   Superclass::UpdateWrappedImages(image_4d, referenceSpace, transform);
 
-  // Update the max-min pipeline once we have one setup
-  m_MinMaxFilter->SetInput(image_4d);
-
-  // Update the histogram mini-pipeline
+  // Update the histogram mini-pipeline. The histogram filter also computes
+  // the range of the image, in the same pass as the histogram when the pixel
+  // type allows it
   m_HistogramFilter->SetInput(image_4d);
-  m_HistogramFilter->SetRangeInputs(m_MinMaxFilter->GetMinimumOutput(),
-                                    m_MinMaxFilter->GetMaximumOutput());
 
   // Set the number of bins to default
   m_HistogramFilter->SetNumberOfBins(DEFAULT_HISTOGRAM_BINS);
@@ -114,22 +109,22 @@ ScalarImageWrapper<TTraits,TBase>
 
   // Check if the image has been updated since the last time that
   // the min/max has been computed
-  m_MinMaxFilter->Update();
-  m_ImageScaleFactor = 1.0 / (m_MinMaxFilter->GetMaximum() - m_MinMaxFilter->GetMinimum());
+  const_cast<ComponentTypeObject *>(this->GetImageMaxObject())->Update();
+  m_ImageScaleFactor = 1.0 / (this->GetImageMaxObject()->Get() - this->GetImageMinObject()->Get());
 }
 
 template<class TTraits, class TBase>
 const typename ScalarImageWrapper<TTraits, TBase>::ComponentTypeObject *
 ScalarImageWrapper<TTraits, TBase>::GetImageMinObject() const
 {
-  return m_MinMaxFilter->GetMinimumOutput();
+  return m_HistogramFilter->GetMinimumOutput();
 }
 
 template<class TTraits, class TBase>
 const typename ScalarImageWrapper<TTraits, TBase>::ComponentTypeObject *
 ScalarImageWrapper<TTraits, TBase>::GetImageMaxObject() const
 {
-  return m_MinMaxFilter->GetMaximumOutput();
+  return m_HistogramFilter->GetMaximumOutput();
 }
 
 template<class TTraits, class TBase>
@@ -143,7 +138,7 @@ ScalarImageWrapper<TTraits,TBase>
   // wrappers that wrap around ImageAdapter objects.
   //
   // I hope this does not cause too much trouble...
-  return m_MinMaxFilter->GetMaximum() - m_MinMaxFilter->GetMinimum();
+  return this->GetImageMaxObject()->Get() - this->GetImageMinObject()->Get();
 }
 
 template<class TTraits, class TBase>
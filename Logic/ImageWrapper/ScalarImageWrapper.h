@@ -41,7 +41,6 @@
 // Forward references
 template<class TIn> class ThreadedHistogramImageFilter;
 namespace itk {
-  template<class TIn> class MinimumMaximumImageFilter;
   template<class TInputImage> class VTKImageExport;
   template<class TOut> class ImageSource;
 }
@@ -109,9 +108,6 @@ public:
   typedef typename Superclass::DisplaySliceType               DisplaySliceType;
   typedef typename Superclass::DisplayPixelType               DisplayPixelType;
 
-  // MinMax calculator type (works on the 4D image)
-  typedef itk::MinimumMaximumImageFilter<Image4DType>             MinMaxFilter;
-
   // Histogram filter (works on the 4D image)
   typedef ThreadedHistogramImageFilter<Image4DType>        HistogramFilterType;
 
@@ -142,9 +138,6 @@ public:
    */
   virtual ScalarImageWrapperBase *GetDefaultScalarRepresentation() ITK_OVERRIDE { return this; }
 
-  /** Access the min/max filter */
-  irisGetMacro(MinMaxFilter, MinMaxFilter *)
-
   /**
    * Get the scaling factor used to convert between intensities stored
    * in this image and the 'true' image intensities
@@ -272,13 +265,9 @@ protected:
   /** Destructor */
   virtual ~ScalarImageWrapper();
 
-  /** 
-   * The min-max filter used to compute the range of the image on demand.
-   */
-  SmartPtr<MinMaxFilter> m_MinMaxFilter;
-
   /**
-   * The filter used for histogram computation
+   * The filter used for histogram computation. It also computes the range
+   * of the image on demand
    */
   SmartPtr<HistogramFilterType> m_HistogramFilter;
 
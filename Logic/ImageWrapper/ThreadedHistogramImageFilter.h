@@ -6,13 +6,30 @@
 #include <itkNumericTraits.h>
 #include <ScalarImageHistogram.h>
 
+#include <limits>
+#include <vector>
+
 /**
  * This ITK-style filter computes the histogram of an ITK scalar image. It
- * uses threading for faster histogram computation. It also is meant to be
- * used with the itk::MinimumMaximumImageFilter to avoid an extra pass for
- * determining the range of the histogram. The histogram in this filter is
- * constructed from equal size bins between the input min and max, and the
- * number of bins is a power of two.
+ * uses threading for faster histogram computation. The histogram in this
+ * filter is constructed from equal size bins between the image min and max.
+ *
+ * The range of the histogram can be supplied by the itk::MinimumMaximumImageFilter
+ * through SetRangeInputs(). Otherwise, the filter computes the range itself
+ * and makes it available through GetMinimumOutput() and GetMaximumOutput().
+ * The range outputs are only modified when their values change, and they do
+ * not depend on the number of bins or the intensity transform, so pipelines
+ * that use the range are not updated when the histogram is rebinned.
+ *
+ * For integral types of up to 16 bits, the number of voxels with each value
+ * is counted in a single pass over the image, from which the range and the
+ * histogram are obtained. For other types, the range is computed in a pass
+ * before the histogram. The counts or the range are kept, so that changing
+ * the number of bins or the intensity transform does not require another
+ * pass to get them unless the image has been modified.
+ *
+ * Each work unit accumulates into its own buffers, which are merged once all
+ * of the work units have finished.
  */
 template <class TInputImage>
 class ThreadedHistogramImageFilter :
@@ -56,6 +73,41 @@ public:
   /** Type of DataObjects used for scalar outputs */
   typedef itk::SimpleDataObjectDecorator< PixelType > PixelObjectType;
 
+  /**
+   * Type of the range outputs. Data objects are marked as modified each time
+   * their source executes, but these are only marked as modified when their
+   * value changes.
+   */
+  class RangeObjectType : public PixelObjectType
+  {
+  public:
+    typedef RangeObjectType                 Self;
+    typedef PixelObjectType                 Superclass;
+    typedef itk::SmartPointer< Self >       Pointer;
+    typedef itk::SmartPointer< const Self > ConstPointer;
+
+    itkNewMacro(Self)
+    itkTypeMacro(RangeObjectType, SimpleDataObjectDecorator)
+
+    virtual void DataHasBeenGenerated() ITK_OVERRIDE
+    {
+      m_Generating = true;
+      Superclass::DataHasBeenGenerated();
+      m_Generating = false;
+    }
+
+    virtual void Modified() const ITK_OVERRIDE
+    {
+      if(!m_Generating)
+        Superclass::Modified();
+    }
+
+  protected:
+    RangeObjectType() : m_Generating(false) {}
+
+    bool m_Generating;
+  };
+
   /**
    * Set the range inputs. These are in the format returned by the min/max
    * image filter. These are inputs to the filter, so will be updated through
@@ -64,6 +116,19 @@ public:
    */
   void SetRangeInputs(const PixelObjectType *inMin, const PixelObjectType *inMax);
 
+  /** Minimum and maximum of the image, or the range inputs if they are set */
+  PixelObjectType *GetMinimumOutput();
+  PixelObjectType *GetMaximumOutput();
+  PixelType GetMinimum() const { return m_MinimumOutput->Get(); }
+  PixelType GetMaximum() const { return m_MaximumOutput->Get(); }
+
+  /**
+   * Whether the range of the image can be computed in the same pass as the
+   * histogram, which is the case for integral types of up to 16 bits
+   */
+  static constexpr bool CanComputeRangeInSinglePass =
+      std::numeric_limits<PixelType>::is_integer && sizeof(PixelType) <= 2;
+
   /**
    * Set the desired number of bins for the histogram.
    */
@@ -81,6 +146,13 @@ public:
    */
   HistogramType *GetHistogramOutput() const { return m_OutputHistogram; }
 
+  /**
+   * The number of bins and the intensity transform do not modify the filter,
+   * so that they do not affect the range outputs. Instead, the pipeline time
+   * of the other outputs is brought up to the time that they were changed.
+   */
+  virtual void UpdateOutputInformation() ITK_OVERRIDE;
+
 protected:
 
   ThreadedHistogramImageFilter();
@@ -100,6 +172,18 @@ protected:
   // Override since the filter produces all of its output
   void EnlargeOutputRequestedRegion(itk::DataObject *data) ITK_OVERRIDE;
 
+  // Split the input region into pieces for the work units
+  std::vector<RegionType> SplitInputRegion();
+
+  // Count the voxels with each value of the pixel type
+  void ComputeValueCounts(const std::vector<RegionType> &pieces);
+
+  // Compute the range of the image
+  void ComputeRange(const std::vector<RegionType> &pieces, PixelType &pxmin, PixelType &pxmax);
+
+  // Compute the histogram for a known range
+  void ComputeHistogram(const std::vector<RegionType> &pieces, PixelType pxmin, PixelType pxmax);
+
 private:
 
   ThreadedHistogramImageFilter(const Self &); //purposely not implemented
@@ -114,11 +198,22 @@ private:
   // Intensity transform
   double m_TransformScale, m_TransformShift;
 
-  // Per-thread histograms
-  std::vector< HistogramPointer > m_ThreadHistogram;
+  // Time at which the number of bins or the transform were last changed
+  itk::TimeStamp m_HistogramParametersMTime;
+
+  // Number of voxels with each value, for types that allow it, or the range
+  // of the image otherwise, and the image and time for which they were
+  // computed
+  std::vector<unsigned long> m_ValueCounts;
+  PixelType m_ImageMin, m_ImageMax;
+  const TInputImage *m_ScannedImage;
+  itk::ModifiedTimeType m_ScannedMTime;
 
   // The output histogram
   HistogramPointer m_OutputHistogram;
+
+  // The range outputs
+  SmartPtr<RangeObjectType> m_MinimumOutput, m_MaximumOutput;
 };
 
 #ifndef ITK_MANUAL_INSTANTIATION
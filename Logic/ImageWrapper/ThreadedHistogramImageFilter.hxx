@@ -4,18 +4,34 @@
 #include "ThreadedHistogramImageFilter.h"
 #include <itkProgressReporter.h>
 #include <itkImageRegionConstIterator.h>
+#include <itkImageRegionSplitterSlowDimension.h>
+
+#include <algorithm>
 
 template <class TInputImage>
 ThreadedHistogramImageFilter<TInputImage>
 ::ThreadedHistogramImageFilter()
 {
-  this->SetNumberOfRequiredInputs(3);
-  this->SetNumberOfRequiredOutputs(2);
+  // The range inputs are optional
+  this->SetNumberOfRequiredInputs(1);
+  this->SetNumberOfRequiredOutputs(4);
 
   // Allocate the output histogram
   m_OutputHistogram = ScalarImageHistogram::New();
   this->SetNthOutput(1, m_OutputHistogram);
 
+  // Allocate the range outputs
+  m_MinimumOutput = RangeObjectType::New();
+  m_MaximumOutput = RangeObjectType::New();
+  m_MinimumOutput->Set(itk::NumericTraits<PixelType>::Zero);
+  m_MaximumOutput->Set(itk::NumericTraits<PixelType>::Zero);
+  this->SetNthOutput(2, m_MinimumOutput);
+  this->SetNthOutput(3, m_MaximumOutput);
+
+  m_ImageMin = m_ImageMax = itk::NumericTraits<PixelType>::Zero;
+  m_ScannedImage = NULL;
+  m_ScannedMTime = 0;
+
   m_Bins = 0;
   m_TransformScale = 1.0;
   m_TransformShift = 0.0;
@@ -32,6 +48,22 @@ ThreadedHistogramImageFilter<TInputImage>
   this->SetNthInput(2, m_InputMax);
 }
 
+template <class TInputImage>
+typename ThreadedHistogramImageFilter<TInputImage>::PixelObjectType *
+ThreadedHistogramImageFilter<TInputImage>
+::GetMinimumOutput()
+{
+  return m_MinimumOutput;
+}
+
+template <class TInputImage>
+typename ThreadedHistogramImageFilter<TInputImage>::PixelObjectType *
+ThreadedHistogramImageFilter<TInputImage>
+::GetMaximumOutput()
+{
+  return m_MaximumOutput;
+}
+
 template <class TInputImage>
 void
 ThreadedHistogramImageFilter<TInputImage>
@@ -40,7 +72,7 @@ ThreadedHistogramImageFilter<TInputImage>
   if(m_Bins != nBins)
     {
     m_Bins = nBins;
-    this->Modified();
+    m_HistogramParametersMTime.Modified();
     }
 }
 
@@ -53,7 +85,25 @@ ThreadedHistogramImageFilter<TInputImage>
     {
     m_TransformScale = scale;
     m_TransformShift = shift;
-    this->Modified();
+    m_HistogramParametersMTime.Modified();
+    }
+}
+
+template <class TInputImage>
+void
+ThreadedHistogramImageFilter<TInputImage>
+::UpdateOutputInformation()
+{
+  Superclass::UpdateOutputInformation();
+
+  // The histogram and the image passed through depend on the number of bins
+  // and the transform, but the range outputs don't
+  itk::ModifiedTimeType t = m_HistogramParametersMTime.GetMTime();
+  itk::DataObject *outputs[] = { this->GetPrimaryOutput(), m_OutputHistogram };
+  for(itk::DataObject *output : outputs)
+    {
+    if(output->GetPipelineMTime() < t)
+      output->SetPipelineMTime(t);
     }
 }
 
@@ -94,45 +144,197 @@ ThreadedHistogramImageFilter<TInputImage>
   // Nothing to be done for the histogram output
 }
 
+template< class TInputImage >
+std::vector<typename ThreadedHistogramImageFilter<TInputImage>::RegionType>
+ThreadedHistogramImageFilter<TInputImage>
+::SplitInputRegion()
+{
+  RegionType region = this->GetInput()->GetBufferedRegion();
+
+  typedef itk::ImageRegionSplitterSlowDimension SplitterType;
+  SplitterType::Pointer splitter = SplitterType::New();
+  unsigned int n_pieces = splitter->GetNumberOfSplits(region, this->GetNumberOfWorkUnits());
+
+  std::vector<RegionType> pieces(n_pieces, region);
+  for(unsigned int i = 0; i < n_pieces; i++)
+    splitter->GetSplit(i, n_pieces, pieces[i]);
+
+  return pieces;
+}
+
 template< class TInputImage >
 void
 ThreadedHistogramImageFilter<TInputImage>
-::GenerateData()
+::ComputeValueCounts(const std::vector<RegionType> &pieces)
 {
-  this->AllocateOutputs();
+  // The counts are indexed by the offset of the value from the smallest value
+  // of the pixel type. This method is only called for types of up to 16 bits
+  const long vmin = (long) itk::NumericTraits<PixelType>::NonpositiveMin();
+  const size_t n_values = (size_t) 1 << (8 * std::min(sizeof(PixelType), (size_t) 2));
+
+  // Each piece gets its own counts
+  std::vector< std::vector<unsigned long> > piece_counts(pieces.size());
+  this->GetMultiThreader()->ParallelizeArray(
+        0, pieces.size(),
+        [this, &pieces, &piece_counts, vmin, n_values](itk::SizeValueType i)
+    {
+    std::vector<unsigned long> &counts = piece_counts[i];
+    counts.resize(n_values, 0);
+    for(itk::ImageRegionConstIterator< TInputImage > it(this->GetInput(), pieces[i]);
+        !it.IsAtEnd(); ++it)
+      {
+      ++counts[(long) it.Get() - vmin];
+      }
+    }, nullptr);
 
-  // Get the range of the histogram
-  PixelType pxmin = m_InputMin->Get();
-  PixelType pxmax = m_InputMax->Get();
+  // Merge the counts
+  m_ValueCounts.assign(n_values, 0);
+  for(const std::vector<unsigned long> &counts : piece_counts)
+    for(size_t k = 0; k < n_values; k++)
+      m_ValueCounts[k] += counts[k];
 
-  // Initialize the output
-  m_OutputHistogram->Initialize(pxmin, pxmax, m_Bins);
+  m_ScannedImage = this->GetInput();
+  m_ScannedMTime = this->GetInput()->GetMTime();
+}
 
-  // A mutex to control updating the output histogram
-  std::mutex histo_mutex;
+template< class TInputImage >
+void
+ThreadedHistogramImageFilter<TInputImage>
+::ComputeRange(const std::vector<RegionType> &pieces, PixelType &pxmin, PixelType &pxmax)
+{
+  std::vector<PixelType> piece_min(pieces.size(), itk::NumericTraits<PixelType>::max());
+  std::vector<PixelType> piece_max(pieces.size(), itk::NumericTraits<PixelType>::NonpositiveMin());
 
-  // Parrallel block
-  itk::MultiThreaderBase::Pointer mt = itk::MultiThreaderBase::New();
-  mt->ParallelizeImageRegion<Self::OutputImageDimension>(
-        this->GetOutput()->GetBufferedRegion(),
-        [this, pxmin, pxmax, &histo_mutex](const RegionType &region)
+  this->GetMultiThreader()->ParallelizeArray(
+        0, pieces.size(),
+        [this, &pieces, &piece_min, &piece_max](itk::SizeValueType i)
     {
-    // Create a thread-local histogram
-    HistogramType::Pointer local_hist = HistogramType::New();
-    local_hist->Initialize(pxmin, pxmax, m_Bins);
+    PixelType local_min = piece_min[i], local_max = piece_max[i];
+    for(itk::ImageRegionConstIterator< TInputImage > it(this->GetInput(), pieces[i]);
+        !it.IsAtEnd(); ++it)
+      {
+      PixelType v = it.Get();
+      if(v < local_min)
+        local_min = v;
+      if(v > local_max)
+        local_max = v;
+      }
+    piece_min[i] = local_min;
+    piece_max[i] = local_max;
+    }, nullptr);
 
-    // Compute the histogram
-    for(itk::ImageRegionConstIterator< TInputImage > it(this->GetInput(), region);
+  pxmin = itk::NumericTraits<PixelType>::max();
+  pxmax = itk::NumericTraits<PixelType>::NonpositiveMin();
+  for(unsigned int i = 0; i < pieces.size(); i++)
+    {
+    pxmin = std::min(pxmin, piece_min[i]);
+    pxmax = std::max(pxmax, piece_max[i]);
+    }
+
+  // Empty image
+  if(pxmin > pxmax)
+    pxmin = pxmax = itk::NumericTraits<PixelType>::Zero;
+}
+
+template< class TInputImage >
+void
+ThreadedHistogramImageFilter<TInputImage>
+::ComputeHistogram(const std::vector<RegionType> &pieces, PixelType pxmin, PixelType pxmax)
+{
+  // Each piece gets its own histogram
+  std::vector<HistogramPointer> piece_hist(pieces.size());
+  this->GetMultiThreader()->ParallelizeArray(
+        0, pieces.size(),
+        [this, &pieces, &piece_hist, pxmin, pxmax](itk::SizeValueType i)
+    {
+    HistogramPointer local_hist = HistogramType::New();
+    local_hist->Initialize(pxmin, pxmax, m_Bins);
+    for(itk::ImageRegionConstIterator< TInputImage > it(this->GetInput(), pieces[i]);
         !it.IsAtEnd(); ++it)
       {
       local_hist->AddSample(it.Get());
       }
-
-    // In a reentrant block, update the main histogram
-    std::lock_guard<std::mutex> guard(histo_mutex);
-    m_OutputHistogram->AddCompatibleHistogram(local_hist);
+    piece_hist[i] = local_hist;
     }, nullptr);
 
+  // Merge the histograms
+  for(HistogramPointer &hist : piece_hist)
+    m_OutputHistogram->AddCompatibleHistogram(hist);
+}
+
+template< class TInputImage >
+void
+ThreadedHistogramImageFilter<TInputImage>
+::GenerateData()
+{
+  this->AllocateOutputs();
+
+  const TInputImage *input = this->GetInput();
+  std::vector<RegionType> pieces = this->SplitInputRegion();
+
+  PixelType pxmin, pxmax;
+  if(CanComputeRangeInSinglePass)
+    {
+    // Count the values, unless this has been done for the current image
+    if(m_ScannedImage != input || m_ScannedMTime != input->GetMTime())
+      this->ComputeValueCounts(pieces);
+
+    // The smallest and largest values present
+    const long vmin = (long) itk::NumericTraits<PixelType>::NonpositiveMin();
+    long kmin = 0, kmax = (long) m_ValueCounts.size() - 1;
+    while(kmin < kmax && m_ValueCounts[kmin] == 0)
+      kmin++;
+    while(kmax > kmin && m_ValueCounts[kmax] == 0)
+      kmax--;
+
+    // The range of the histogram comes from the inputs if they are set, and
+    // otherwise from the values present
+    if(m_InputMin && m_InputMax)
+      {
+      pxmin = m_InputMin->Get();
+      pxmax = m_InputMax->Get();
+      }
+    else
+      {
+      pxmin = m_ValueCounts[kmin] ? (PixelType) (kmin + vmin) : itk::NumericTraits<PixelType>::Zero;
+      pxmax = m_ValueCounts[kmin] ? (PixelType) (kmax + vmin) : itk::NumericTraits<PixelType>::Zero;
+      }
+
+    // Fill the histogram from the counts
+    m_OutputHistogram->Initialize(pxmin, pxmax, m_Bins);
+    for(long k = kmin; k <= kmax; k++)
+      if(m_ValueCounts[k])
+        m_OutputHistogram->AddSample((double) (k + vmin), m_ValueCounts[k]);
+    }
+  else
+    {
+    // Get the range from the inputs, or compute it unless this has been done
+    // for the current image, and then the histogram
+    if(m_InputMin && m_InputMax)
+      {
+      pxmin = m_InputMin->Get();
+      pxmax = m_InputMax->Get();
+      }
+    else
+      {
+      if(m_ScannedImage != input || m_ScannedMTime != input->GetMTime())
+        {
+        this->ComputeRange(pieces, m_ImageMin, m_ImageMax);
+        m_ScannedImage = input;
+        m_ScannedMTime = input->GetMTime();
+        }
+      pxmin = m_ImageMin;
+      pxmax = m_ImageMax;
+      }
+
+    m_OutputHistogram->Initialize(pxmin, pxmax, m_Bins);
+    this->ComputeHistogram(pieces, pxmin, pxmax);
+    }
+
+  // Store the range
+  m_MinimumOutput->Set(pxmin);
+  m_MaximumOutput->Set(pxmax);
+
   // Apply the transform to the histogram
   m_OutputHistogram->ApplyIntensityTransform(m_TransformScale, m_TransformShift);
 }
@@ -0,0 +1,165 @@
+#ifndef TIMEPOINTIMAGECACHE_H
+#define TIMEPOINTIMAGECACHE_H
+
+#include "SNAPCommon.h"
+#include "itkObject.h"
+#include "itkObjectFactory.h"
+
+#include <condition_variable>
+#include <functional>
+#include <list>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+
+/**
+ * This class holds a bounded set of decoded time points of a 4D image that
+ * is read from disk on demand (lazy 4D mode of ImageWrapper). The time points
+ * are produced by a loader function, typically one that reads a single
+ * volume with GuidedNativeImageIO::ReadNativeTimePoint() and casts it to the
+ * wrapper's image type.
+ *
+ * The cache keeps at most MaximumNumberOfFrames time points and at most
+ * MemoryBudget bytes of pixel data, evicting the least recently used time
+ * points first. Time points that have been edited can be pinned, in which
+ * case they are never evicted. The time point requested last is also never
+ * evicted, even if it alone exceeds the budget.
+ *
+ * Prefetch() schedules the neighbors of a time point for loading on a
+ * background thread, so that stepping through time points does not have to
+ * wait for the disk. A new call to Prefetch() replaces the pending requests
+ * of the previous call.
+ */
+template <class TImage>
+class TimePointImageCache : public itk::Object
+{
+public:
+  irisITKObjectMacro(TimePointImageCache, itk::Object)
+
+  typedef TImage ImageType;
+  typedef typename ImageType::Pointer ImagePointer;
+  typedef std::function<ImagePointer(unsigned int)> LoaderType;
+
+  /**
+   * Set the function that reads a time point from disk. The loader is called
+   * both from the caller's thread and from the prefetch thread, so it must be
+   * safe to call concurrently. This clears the cache.
+   */
+  void SetLoader(LoaderType loader, unsigned int n_time_points);
+
+  /** Number of time points in the 4D image */
+  irisGetMacro(NumberOfTimePoints, unsigned int)
+
+  /** Maximum number of time points held in memory */
+  void SetMaximumNumberOfFrames(unsigned int n);
+  unsigned int GetMaximumNumberOfFrames() const;
+
+  /** Maximum number of bytes of pixel data held in memory */
+  void SetMemoryBudget(unsigned long bytes);
+  unsigned long GetMemoryBudget() const;
+
+  /** Number of neighbors on each side scheduled by Prefetch() */
+  void SetPrefetchRadius(unsigned int radius);
+  unsigned int GetPrefetchRadius() const;
+
+  /**
+   * Get a time point, reading it from disk if it is not in the cache. If the
+   * time point is being read by the prefetch thread, this waits for it.
+   */
+  ImagePointer GetTimePoint(unsigned int tp);
+
+  /** Check if a time point is currently held in memory */
+  bool Contains(unsigned int tp) const;
+
+  /** Schedule the neighbors of a time point for loading in the background */
+  void Prefetch(unsigned int tp);
+
+  /**
+   * Pin a time point so that it is never evicted. This is used for time points
+   * whose voxels have been modified and that therefore can't be read again.
+   * The image is the modified time point, which replaces the one in the cache,
+   * if any, since the latter may have been evicted and read again.
+   */
+  void Pin(unsigned int tp, ImageType *image);
+
+  /** Check if any of the time points have been pinned */
+  bool HasPinnedTimePoints() const;
+
+  /** Drop all time points and pending prefetch requests */
+  void Clear();
+
+  /** Number of frames and bytes currently held in memory */
+  unsigned int GetNumberOfCachedFrames() const;
+  unsigned long GetCachedBytes() const;
+
+  /** Statistics: requests served from memory, requests that had to wait
+      for a read, and frames read by the prefetch thread */
+  unsigned long GetNumberOfHits() const;
+  unsigned long GetNumberOfMisses() const;
+  unsigned long GetNumberOfPrefetchedFrames() const;
+
+protected:
+  TimePointImageCache();
+  virtual ~TimePointImageCache();
+
+  struct Entry
+  {
+    ImagePointer Image;
+    unsigned long Bytes;
+    bool Pinned;
+    typename std::list<unsigned int>::iterator LRUPos;
+  };
+
+  // The following methods must be called with the lock held
+  void ClearFrames();
+  void InsertFrame(unsigned int tp, ImagePointer image, bool pinned = false);
+  void EvictFrames();
+  bool IsEvictable(unsigned int tp, bool allow_window) const;
+  bool HasRoomForPrefetch() const;
+
+  // Body of the prefetch thread
+  void PrefetchThreadMain();
+
+  static unsigned long GetImageBytes(ImageType *image);
+
+  LoaderType m_Loader;
+  unsigned int m_NumberOfTimePoints;
+
+  unsigned int m_MaximumNumberOfFrames;
+  unsigned long m_MemoryBudget;
+  unsigned int m_PrefetchRadius;
+
+  // Frames in memory and their order of use, most recent first
+  std::map<unsigned int, Entry> m_Frames;
+  std::list<unsigned int> m_LRU;
+  unsigned long m_CachedBytes;
+
+  // The most recently requested time point, never evicted
+  int m_LastRequested;
+
+  // Pending prefetch requests, in order of priority, and the time points
+  // that are currently being read by any thread
+  std::list<unsigned int> m_PrefetchQueue;
+  std::set<unsigned int> m_InFlight;
+
+  // The time point passed to the last Prefetch() call and its neighbors.
+  // Prefetching never evicts frames from this window
+  std::set<unsigned int> m_PrefetchWindow;
+
+  unsigned long m_Hits, m_Misses, m_Prefetched;
+
+  // Incremented by Clear(), so that reads started before are discarded
+  unsigned long m_Generation;
+
+  mutable std::mutex m_Mutex;
+  std::condition_variable m_QueueCondition, m_LoadCondition;
+  std::thread m_PrefetchThread;
+  bool m_StopPrefetch;
+};
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "TimePointImageCache.txx"
+#endif
+
+#endif // TIMEPOINTIMAGECACHE_H
@@ -0,0 +1,462 @@
+#ifndef TIMEPOINTIMAGECACHE_TXX
+#define TIMEPOINTIMAGECACHE_TXX
+
+#include "TimePointImageCache.h"
+#include "itkMacro.h"
+
+#include <algorithm>
+
+template <class TImage>
+TimePointImageCache<TImage>
+::TimePointImageCache()
+{
+  m_NumberOfTimePoints = 0;
+  m_MaximumNumberOfFrames = 16;
+  m_MemoryBudget = 512ul * 1024ul * 1024ul;
+  m_PrefetchRadius = 2;
+  m_CachedBytes = 0;
+  m_LastRequested = -1;
+  m_Hits = m_Misses = m_Prefetched = 0;
+  m_Generation = 0;
+  m_StopPrefetch = false;
+}
+
+template <class TImage>
+TimePointImageCache<TImage>
+::~TimePointImageCache()
+{
+  // Stop the prefetch thread. If it is in the middle of a read, we wait for
+  // the read to finish
+  {
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  m_StopPrefetch = true;
+  m_PrefetchQueue.clear();
+  }
+  m_QueueCondition.notify_all();
+
+  if(m_PrefetchThread.joinable())
+    m_PrefetchThread.join();
+}
+
+template <class TImage>
+void
+TimePointImageCache<TImage>
+::SetLoader(LoaderType loader, unsigned int n_time_points)
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  m_Loader = loader;
+  m_NumberOfTimePoints = n_time_points;
+  this->ClearFrames();
+}
+
+template <class TImage>
+void
+TimePointImageCache<TImage>
+::SetMaximumNumberOfFrames(unsigned int n)
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  m_MaximumNumberOfFrames = std::max(n, 1u);
+  this->EvictFrames();
+}
+
+template <class TImage>
+unsigned int
+TimePointImageCache<TImage>
+::GetMaximumNumberOfFrames() const
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  return m_MaximumNumberOfFrames;
+}
+
+template <class TImage>
+void
+TimePointImageCache<TImage>
+::SetMemoryBudget(unsigned long bytes)
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  m_MemoryBudget = bytes;
+  this->EvictFrames();
+}
+
+template <class TImage>
+unsigned long
+TimePointImageCache<TImage>
+::GetMemoryBudget() const
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  return m_MemoryBudget;
+}
+
+template <class TImage>
+void
+TimePointImageCache<TImage>
+::SetPrefetchRadius(unsigned int radius)
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  m_PrefetchRadius = radius;
+}
+
+template <class TImage>
+unsigned int
+TimePointImageCache<TImage>
+::GetPrefetchRadius() const
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  return m_PrefetchRadius;
+}
+
+template <class TImage>
+typename TimePointImageCache<TImage>::ImagePointer
+TimePointImageCache<TImage>
+::GetTimePoint(unsigned int tp)
+{
+  itkAssertOrThrowMacro(
+        tp < m_NumberOfTimePoints,
+        "Time point out of range in TimePointImageCache::GetTimePoint")
+
+  std::unique_lock<std::mutex> lock(m_Mutex);
+  m_LastRequested = tp;
+
+  // The time point may already be in memory
+  typename std::map<unsigned int, Entry>::iterator it = m_Frames.find(tp);
+  if(it != m_Frames.end())
+    {
+    m_Hits++;
+    m_LRU.splice(m_LRU.begin(), m_LRU, it->second.LRUPos);
+    return it->second.Image;
+    }
+
+  m_Misses++;
+  m_PrefetchQueue.remove(tp);
+
+  // If the prefetch thread is reading this time point, wait for it
+  if(m_InFlight.count(tp))
+    {
+    m_LoadCondition.wait(lock, [this, tp]() { return m_InFlight.count(tp) == 0; });
+    it = m_Frames.find(tp);
+    if(it != m_Frames.end())
+      {
+      m_LRU.splice(m_LRU.begin(), m_LRU, it->second.LRUPos);
+      return it->second.Image;
+      }
+    }
+
+  // Read the time point in this thread, without holding the lock
+  m_InFlight.insert(tp);
+  unsigned long generation = m_Generation;
+  LoaderType loader = m_Loader;
+  lock.unlock();
+
+  ImagePointer image;
+  try
+    {
+    image = loader(tp);
+    }
+  catch(...)
+    {
+    lock.lock();
+    m_InFlight.erase(tp);
+    m_LoadCondition.notify_all();
+    throw;
+    }
+
+  lock.lock();
+  m_InFlight.erase(tp);
+  if(generation == m_Generation)
+    this->InsertFrame(tp, image);
+  m_LoadCondition.notify_all();
+
+  return image;
+}
+
+template <class TImage>
+bool
+TimePointImageCache<TImage>
+::Contains(unsigned int tp) const
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  return m_Frames.find(tp) != m_Frames.end();
+}
+
+template <class TImage>
+void
+TimePointImageCache<TImage>
+::Prefetch(unsigned int tp)
+{
+  {
+  std::lock_guard<std::mutex> lock(m_Mutex);
+
+  // Requests from the previous call are stale
+  m_PrefetchQueue.clear();
+  m_PrefetchWindow.clear();
+  m_PrefetchWindow.insert(tp);
+
+  // There is no point in prefetching more neighbors than fit in the cache
+  unsigned int radius = std::min(m_PrefetchRadius, (m_MaximumNumberOfFrames - 1) / 2);
+
+  // Closest neighbors first, and the next time point before the previous one
+  // since playback moves forward
+  for(unsigned int d = 1; d <= radius; d++)
+    {
+    if(tp + d < m_NumberOfTimePoints)
+      m_PrefetchWindow.insert(tp + d);
+    if(tp >= d)
+      m_PrefetchWindow.insert(tp - d);
+
+    if(tp + d < m_NumberOfTimePoints && !m_Frames.count(tp + d) && !m_InFlight.count(tp + d))
+      m_PrefetchQueue.push_back(tp + d);
+    if(tp >= d && !m_Frames.count(tp - d) && !m_InFlight.count(tp - d))
+      m_PrefetchQueue.push_back(tp - d);
+    }
+
+  if(m_PrefetchQueue.empty())
+    return;
+
+  // Start the prefetch thread the first time it is needed
+  if(!m_PrefetchThread.joinable())
+    m_PrefetchThread = std::thread(&Self::PrefetchThreadMain, this);
+  }
+
+  m_QueueCondition.notify_one();
+}
+
+template <class TImage>
+void
+TimePointImageCache<TImage>
+::Pin(unsigned int tp, ImageType *image)
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  typename std::map<unsigned int, Entry>::iterator it = m_Frames.find(tp);
+  if(it != m_Frames.end() && it->second.Image == image)
+    it->second.Pinned = true;
+  else
+    this->InsertFrame(tp, image, true);
+}
+
+template <class TImage>
+bool
+TimePointImageCache<TImage>
+::HasPinnedTimePoints() const
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  for(const auto &it : m_Frames)
+    if(it.second.Pinned)
+      return true;
+  return false;
+}
+
+template <class TImage>
+void
+TimePointImageCache<TImage>
+::Clear()
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  this->ClearFrames();
+}
+
+template <class TImage>
+unsigned int
+TimePointImageCache<TImage>
+::GetNumberOfCachedFrames() const
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  return m_Frames.size();
+}
+
+template <class TImage>
+unsigned long
+TimePointImageCache<TImage>
+::GetCachedBytes() const
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  return m_CachedBytes;
+}
+
+template <class TImage>
+unsigned long
+TimePointImageCache<TImage>
+::GetNumberOfHits() const
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  return m_Hits;
+}
+
+template <class TImage>
+unsigned long
+TimePointImageCache<TImage>
+::GetNumberOfMisses() const
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  return m_Misses;
+}
+
+template <class TImage>
+unsigned long
+TimePointImageCache<TImage>
+::GetNumberOfPrefetchedFrames() const
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  return m_Prefetched;
+}
+
+template <class TImage>
+void
+TimePointImageCache<TImage>
+::ClearFrames()
+{
+  m_Frames.clear();
+  m_LRU.clear();
+  m_CachedBytes = 0;
+  m_PrefetchQueue.clear();
+  m_PrefetchWindow.clear();
+  m_LastRequested = -1;
+  m_Generation++;
+}
+
+template <class TImage>
+void
+TimePointImageCache<TImage>
+::InsertFrame(unsigned int tp, ImagePointer image, bool pinned)
+{
+  typename std::map<unsigned int, Entry>::iterator it = m_Frames.find(tp);
+  if(it != m_Frames.end())
+    {
+    m_CachedBytes -= it->second.Bytes;
+    m_LRU.erase(it->second.LRUPos);
+    m_Frames.erase(it);
+    }
+
+  m_LRU.push_front(tp);
+
+  Entry &entry = m_Frames[tp];
+  entry.Image = image;
+  entry.Bytes = GetImageBytes(image);
+  entry.Pinned = pinned;
+  entry.LRUPos = m_LRU.begin();
+  m_CachedBytes += entry.Bytes;
+
+  this->EvictFrames();
+}
+
+template <class TImage>
+bool
+TimePointImageCache<TImage>
+::IsEvictable(unsigned int tp, bool allow_window) const
+{
+  typename std::map<unsigned int, Entry>::const_iterator it = m_Frames.find(tp);
+  return !it->second.Pinned
+      && (int) tp != m_LastRequested
+      && (allow_window || !m_PrefetchWindow.count(tp));
+}
+
+template <class TImage>
+void
+TimePointImageCache<TImage>
+::EvictFrames()
+{
+  // Frames outside of the prefetch window go first, oldest first
+  for(int pass = 0; pass < 2; pass++)
+    {
+    typename std::list<unsigned int>::iterator it = m_LRU.end();
+    while(it != m_LRU.begin()
+          && (m_Frames.size() > m_MaximumNumberOfFrames || m_CachedBytes > m_MemoryBudget))
+      {
+      --it;
+      if(this->IsEvictable(*it, pass > 0))
+        {
+        typename std::map<unsigned int, Entry>::iterator itf = m_Frames.find(*it);
+        m_CachedBytes -= itf->second.Bytes;
+        m_Frames.erase(itf);
+        it = m_LRU.erase(it);
+        }
+      }
+    }
+}
+
+template <class TImage>
+bool
+TimePointImageCache<TImage>
+::HasRoomForPrefetch() const
+{
+  if(m_Frames.empty())
+    return true;
+
+  // Prefetching must not push out frames of the current window, so only
+  // count the memory of frames that are outside of it
+  unsigned long frame_bytes = m_Frames.begin()->second.Bytes;
+  unsigned long kept_bytes = 0;
+  unsigned int kept_frames = 0;
+  for(const auto &it : m_Frames)
+    {
+    if(!this->IsEvictable(it.first, false))
+      {
+      kept_bytes += it.second.Bytes;
+      kept_frames++;
+      }
+    }
+
+  return kept_frames + 1 <= m_MaximumNumberOfFrames
+      && kept_bytes + frame_bytes <= m_MemoryBudget;
+}
+
+template <class TImage>
+void
+TimePointImageCache<TImage>
+::PrefetchThreadMain()
+{
+  std::unique_lock<std::mutex> lock(m_Mutex);
+  while(true)
+    {
+    m_QueueCondition.wait(lock, [this]() { return m_StopPrefetch || !m_PrefetchQueue.empty(); });
+    if(m_StopPrefetch)
+      return;
+
+    unsigned int tp = m_PrefetchQueue.front();
+    m_PrefetchQueue.pop_front();
+    if(m_Frames.count(tp) || m_InFlight.count(tp))
+      continue;
+
+    // Stop when the budget is full, the remaining requests are further away
+    if(!this->HasRoomForPrefetch())
+      {
+      m_PrefetchQueue.clear();
+      continue;
+      }
+
+    m_InFlight.insert(tp);
+    unsigned long generation = m_Generation;
+    LoaderType loader = m_Loader;
+    lock.unlock();
+
+    // Errors are not reported here. If the time point is needed, the read
+    // is repeated by GetTimePoint(), which passes the exception on
+    ImagePointer image;
+    try
+      {
+      image = loader(tp);
+      }
+    catch(...)
+      {
+      image = nullptr;
+      }
+
+    lock.lock();
+    m_InFlight.erase(tp);
+    if(image && generation == m_Generation)
+      {
+      this->InsertFrame(tp, image);
+      m_Prefetched++;
+      }
+    m_LoadCondition.notify_all();
+    }
+}
+
+template <class TImage>
+unsigned long
+TimePointImageCache<TImage>
+::GetImageBytes(ImageType *image)
+{
+  return image->GetPixelContainer()->Size() * sizeof(typename ImageType::InternalPixelType);
+}
+
+#endif // TIMEPOINTIMAGECACHE_TXX
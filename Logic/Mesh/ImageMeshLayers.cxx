@@ -7,10 +7,10 @@
 #include "StandaloneMeshWrapper.h"
 #include "SegmentationMeshWrapper.h"
 #include "LevelSetMeshWrapper.h"
+#include "MeshDiskCache.h"
 
 ImageMeshLayers::ImageMeshLayers()
 {
-
 }
 
 void
@@ -157,6 +157,10 @@ ImageMeshLayers
     // Get the active segmentation image layer id
     auto segImg = app->GetSelectedSegmentationLayer();
 
+    // The mesh cache follows the workspace, if one is open
+    app->GetMeshDiskCache()->SetDirectory(MeshDiskCache::GetDirectoryForProject(
+                                    app->GetGlobalState()->GetProjectFilename()));
+
     if (m_ImageToMeshMap.count(segImg->GetUniqueId()))
       {
       // If the layer already exist, update the layer
@@ -278,6 +282,7 @@ AddSegmentationMeshLayer(LabelImageWrapper* segImg)
   // Create a new segmentation mesh wrapper
   auto segMesh = SegmentationMeshWrapper::New();
   segMesh->Initialize(segImg, app->GetGlobalState()->GetMeshOptions());
+  segMesh->SetDiskCache(app->GetMeshDiskCache());
 
   // Add to layer map and segmentation mesh map
   AddLayer(segMesh);
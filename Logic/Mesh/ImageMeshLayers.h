@@ -13,6 +13,7 @@ class GenericImageData;
 class LabelImageWrapper;
 class SegmentationMeshWrapper;
 class LevelSetMeshWrapper;
+class MeshDiskCache;
 
 /**
  * \class ImageMeshLayers
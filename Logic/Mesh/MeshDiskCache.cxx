@@ -0,0 +1,318 @@
+#include "MeshDiskCache.h"
+#include "MeshOptions.h"
+#include "Registry.h"
+#include "itkImageBase.h"
+#include "itksys/Directory.hxx"
+#include "itksys/MD5.h"
+#include "itksys/SystemTools.hxx"
+
+#include <vtkNew.h>
+#include <vtkPolyData.h>
+#include <vtkPolyDataReader.h>
+#include <vtkPolyDataWriter.h>
+
+#include <algorithm>
+#include <sstream>
+#include <tuple>
+
+using itksys::SystemTools;
+using itksys::Directory;
+
+// Extension of the cached mesh files
+static const char *MESH_CACHE_EXTENSION = ".vtk";
+
+static std::string ComputeStringMD5(const std::string &text)
+{
+  char hex_code[33];
+  hex_code[32] = 0;
+  itksysMD5 *md5 = itksysMD5_New();
+  itksysMD5_Initialize(md5);
+  itksysMD5_Append(md5, (unsigned char *) text.c_str(), text.size());
+  itksysMD5_FinalizeHex(md5, hex_code);
+  itksysMD5_Delete(md5);
+  return std::string(hex_code);
+}
+
+MeshDiskCache::MeshDiskCache()
+{
+  m_MaximumSize = 512ul * 1024ul * 1024ul;
+  m_DiskUsage = -1;
+  m_NumberOfHits = 0;
+  m_NumberOfMisses = 0;
+  m_Writing = false;
+  m_StopWriter = false;
+}
+
+MeshDiskCache::~MeshDiskCache()
+{
+  // The writer thread finishes the queue before it exits
+  {
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  m_StopWriter = true;
+  }
+  m_QueueCondition.notify_all();
+  if(m_WriterThread.joinable())
+    m_WriterThread.join();
+}
+
+void
+MeshDiskCache::SetDirectory(const std::string &dir)
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  if(m_Directory != dir)
+    {
+    m_Directory = dir;
+    m_DiskUsage = -1;
+    this->Modified();
+    }
+}
+
+std::string
+MeshDiskCache::GetDirectoryForProject(const std::string &project_file)
+{
+  if(project_file.empty())
+    return std::string();
+
+  return SystemTools::GetParentDirectory(project_file) + "/"
+      + SystemTools::GetFilenameWithoutLastExtension(project_file) + ".meshcache";
+}
+
+std::string
+MeshDiskCache::ComputeImageKey(const itk::ImageBase<3> *image)
+{
+  std::ostringstream oss;
+  oss.precision(12);
+  oss << image->GetLargestPossibleRegion().GetSize() << " "
+      << image->GetOrigin() << " "
+      << image->GetSpacing() << " "
+      << image->GetDirection().GetVnlMatrix();
+  return ComputeStringMD5(oss.str());
+}
+
+std::string
+MeshDiskCache::ComputeOptionsKey(const MeshOptions *options)
+{
+  Registry folder;
+  options->WriteToRegistry(folder);
+
+  std::ostringstream oss;
+  folder.Print(oss);
+  return ComputeStringMD5(oss.str());
+}
+
+std::string
+MeshDiskCache::ComputeMeshKey(
+    const std::string &image_key, const std::string &options_key,
+    LabelType label, const std::string &label_digest)
+{
+  std::ostringstream oss;
+  oss << image_key << " " << options_key << " " << label << " " << label_digest;
+  return ComputeStringMD5(oss.str());
+}
+
+std::string
+MeshDiskCache::GetMeshFileName(const std::string &dir, const std::string &key)
+{
+  return dir + "/" + key + MESH_CACHE_EXTENSION;
+}
+
+vtkSmartPointer<vtkPolyData>
+MeshDiskCache::Load(const std::string &key)
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  if(!IsEnabled())
+    return nullptr;
+
+  // The mesh may still be waiting to be written
+  for(const PendingMesh &pm : m_Queue)
+    {
+    if(pm.Key == key && pm.Directory == m_Directory)
+      {
+      vtkSmartPointer<vtkPolyData> mesh = vtkSmartPointer<vtkPolyData>::New();
+      mesh->ShallowCopy(pm.Mesh);
+      m_NumberOfHits++;
+      return mesh;
+      }
+    }
+
+  std::string fn = GetMeshFileName(m_Directory, key);
+  if(!SystemTools::FileExists(fn, true))
+    {
+    m_NumberOfMisses++;
+    return nullptr;
+    }
+
+  vtkNew<vtkPolyDataReader> reader;
+  reader->SetFileName(fn.c_str());
+  reader->Update();
+
+  // A file that can't be read (e.g., left over by a crash) is discarded
+  if(reader->GetErrorCode() || !reader->GetOutput()
+     || reader->GetOutput()->GetNumberOfPoints() == 0)
+    {
+    SystemTools::RemoveFile(fn);
+    m_DiskUsage = -1;
+    m_NumberOfMisses++;
+    return nullptr;
+    }
+
+  // Mark the file as recently used
+  SystemTools::Touch(fn, false);
+
+  vtkSmartPointer<vtkPolyData> mesh = vtkSmartPointer<vtkPolyData>::New();
+  mesh->ShallowCopy(reader->GetOutput());
+  m_NumberOfHits++;
+  return mesh;
+}
+
+void
+MeshDiskCache::Store(const std::string &key, vtkPolyData *mesh)
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  if(!IsEnabled() || !mesh || mesh->GetNumberOfPoints() == 0)
+    return;
+
+  // The writer gets its own mesh object, sharing the point and cell data
+  PendingMesh pm;
+  pm.Directory = m_Directory;
+  pm.Key = key;
+  pm.Mesh = vtkSmartPointer<vtkPolyData>::New();
+  pm.Mesh->ShallowCopy(mesh);
+  m_Queue.push_back(pm);
+
+  // Start the writer thread the first time it is needed
+  if(!m_WriterThread.joinable())
+    m_WriterThread = std::thread(&MeshDiskCache::WriterThreadMain, this);
+  m_QueueCondition.notify_all();
+}
+
+void
+MeshDiskCache::Flush()
+{
+  std::unique_lock<std::mutex> lock(m_Mutex);
+  m_IdleCondition.wait(lock, [this]() { return m_Queue.empty() && !m_Writing; });
+}
+
+void
+MeshDiskCache::WriterThreadMain()
+{
+  std::unique_lock<std::mutex> lock(m_Mutex);
+  while(true)
+    {
+    m_QueueCondition.wait(lock, [this]() { return m_StopWriter || !m_Queue.empty(); });
+    if(m_Queue.empty())
+      return;
+
+    PendingMesh pm = m_Queue.front();
+    m_Writing = true;
+    lock.unlock();
+
+    this->WriteMesh(pm);
+
+    lock.lock();
+    m_Queue.pop_front();
+    m_Writing = false;
+    m_IdleCondition.notify_all();
+    }
+}
+
+void
+MeshDiskCache::WriteMesh(const PendingMesh &pm)
+{
+  if(!SystemTools::FileIsDirectory(pm.Directory)
+     && !SystemTools::MakeDirectory(pm.Directory))
+    return;
+
+  // Write to a temporary file first, so that a partially written mesh is
+  // never picked up by Load()
+  std::string fn = GetMeshFileName(pm.Directory, pm.Key);
+  std::string fn_tmp = fn + ".tmp";
+
+  vtkNew<vtkPolyDataWriter> writer;
+  writer->SetInputData(pm.Mesh);
+  writer->SetFileName(fn_tmp.c_str());
+  writer->SetFileTypeToBinary();
+  if(!writer->Write() || !SystemTools::RenameFile(fn_tmp, fn))
+    {
+    SystemTools::RemoveFile(fn_tmp);
+    return;
+    }
+
+  // Only the usage of the current directory is tracked
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  if(pm.Directory != m_Directory)
+    return;
+
+  // A directory that has not been scanned yet already includes the new file
+  if(m_DiskUsage < 0)
+    UpdateDiskUsage();
+  else
+    m_DiskUsage += SystemTools::FileLength(fn);
+
+  if(m_DiskUsage > (long) m_MaximumSize)
+    EvictFiles();
+}
+
+unsigned long
+MeshDiskCache::GetDiskUsage()
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  if(!IsEnabled())
+    return 0;
+
+  UpdateDiskUsage();
+  return (unsigned long) m_DiskUsage;
+}
+
+void
+MeshDiskCache::UpdateDiskUsage()
+{
+  if(m_DiskUsage >= 0)
+    return;
+
+  m_DiskUsage = 0;
+  Directory dir;
+  if(!dir.Load(m_Directory))
+    return;
+
+  for(unsigned long i = 0; i < dir.GetNumberOfFiles(); i++)
+    {
+    std::string fn = dir.GetFile(i);
+    if(SystemTools::GetFilenameLastExtension(fn) == MESH_CACHE_EXTENSION)
+      m_DiskUsage += SystemTools::FileLength(m_Directory + "/" + fn);
+    }
+}
+
+void
+MeshDiskCache::EvictFiles()
+{
+  Directory dir;
+  if(!dir.Load(m_Directory))
+    return;
+
+  // List the cached files, least recently used first
+  typedef std::tuple<long, unsigned long, std::string> FileEntry;
+  std::vector<FileEntry> files;
+  long total = 0;
+  for(unsigned long i = 0; i < dir.GetNumberOfFiles(); i++)
+    {
+    std::string fn = dir.GetFile(i);
+    if(SystemTools::GetFilenameLastExtension(fn) != MESH_CACHE_EXTENSION)
+      continue;
+
+    std::string path = m_Directory + "/" + fn;
+    unsigned long size = SystemTools::FileLength(path);
+    files.push_back(FileEntry(SystemTools::ModifiedTime(path), size, path));
+    total += size;
+    }
+  std::sort(files.begin(), files.end());
+
+  // Delete files until under the limit, keeping the most recent one
+  for(size_t i = 0; i + 1 < files.size() && total > (long) m_MaximumSize; i++)
+    {
+    if(SystemTools::RemoveFile(std::get<2>(files[i])))
+      total -= std::get<1>(files[i]);
+    }
+
+  m_DiskUsage = total;
+}
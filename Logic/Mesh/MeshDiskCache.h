@@ -0,0 +1,132 @@
+#ifndef MESHDISKCACHE_H
+#define MESHDISKCACHE_H
+
+#include "SNAPCommon.h"
+#include "itkObject.h"
+#include "itkObjectFactory.h"
+#include "vtkSmartPointer.h"
+
+#include <condition_variable>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+
+class vtkPolyData;
+class MeshOptions;
+
+namespace itk {
+  template <unsigned int VImageDimension> class ImageBase;
+}
+
+/**
+ * \class MeshDiskCache
+ * \brief A directory of label meshes that persists across sessions.
+ *
+ * MultiLabelMeshPipeline computes an MD5 digest of the runs of every label
+ * whose mesh it needs, which identifies the voxels from which the mesh is
+ * extracted. Combined with the geometry of the image and the mesh options,
+ * this identifies the mesh itself, so a mesh computed once can be read back
+ * instead of running marching cubes again when the workspace is reopened or
+ * when the user returns to a time point whose pipeline has been dropped from
+ * memory.
+ *
+ * Each mesh is stored as a binary VTK legacy file named by the MD5 of its
+ * key. Meshes are written by a background thread, so that storing them does
+ * not delay the caller. When the total size of the directory exceeds
+ * MaximumSize, the least recently used files (by modification time, which is
+ * refreshed when a file is read) are deleted. The cache is disabled while the
+ * directory is empty. A single cache is shared by the whole application.
+ */
+class MeshDiskCache : public itk::Object
+{
+public:
+  irisITKObjectMacro(MeshDiskCache, itk::Object)
+
+  /** Set the cache directory. An empty string disables the cache. The
+      directory is created when the first mesh is stored */
+  void SetDirectory(const std::string &dir);
+  irisGetMacro(Directory, std::string)
+
+  /** Is the cache enabled */
+  bool IsEnabled() const { return m_Directory.size() > 0; }
+
+  /** Maximum total size of the cached files, in bytes */
+  irisGetSetMacro(MaximumSize, unsigned long)
+
+  /** The cache directory used for a workspace file: the workspace path with
+      the extension replaced by '.meshcache', or empty if there is no workspace */
+  static std::string GetDirectoryForProject(const std::string &project_file);
+
+  /** Hash of the image geometry (size, origin, spacing, direction) */
+  static std::string ComputeImageKey(const itk::ImageBase<3> *image);
+
+  /** Hash of the serialized mesh options */
+  static std::string ComputeOptionsKey(const MeshOptions *options);
+
+  /** Key of the mesh for a single label, given the digest of its voxels */
+  static std::string ComputeMeshKey(
+      const std::string &image_key, const std::string &options_key,
+      LabelType label, const std::string &label_digest);
+
+  /** Read a mesh from the cache. Returns nullptr if the mesh is not cached */
+  vtkSmartPointer<vtkPolyData> Load(const std::string &key);
+
+  /** Queue a mesh to be written to the cache, evicting old meshes if needed.
+      The mesh must not be modified afterwards */
+  void Store(const std::string &key, vtkPolyData *mesh);
+
+  /** Wait until the queued meshes have been written */
+  void Flush();
+
+  /** Total size of the cached files, in bytes */
+  unsigned long GetDiskUsage();
+
+  /** Statistics: meshes found in the cache, meshes not found */
+  irisGetMacro(NumberOfHits, unsigned long)
+  irisGetMacro(NumberOfMisses, unsigned long)
+
+protected:
+  MeshDiskCache();
+  virtual ~MeshDiskCache();
+
+  // Path of the file holding the mesh with a given key
+  static std::string GetMeshFileName(const std::string &dir, const std::string &key);
+
+  // A mesh waiting to be written, with the directory it belongs to
+  struct PendingMesh
+  {
+    std::string Directory, Key;
+    vtkSmartPointer<vtkPolyData> Mesh;
+  };
+
+  // Write a queued mesh. Called by the writer thread without the lock
+  void WriteMesh(const PendingMesh &pm);
+
+  // Body of the writer thread
+  void WriterThreadMain();
+
+  // Scan the directory if needed and delete files until under the limit.
+  // Must be called with the lock held
+  void UpdateDiskUsage();
+  void EvictFiles();
+
+  std::string m_Directory;
+  unsigned long m_MaximumSize;
+
+  // Total size of the files in the directory, or -1 if it has not been
+  // scanned since the directory was set
+  long m_DiskUsage;
+
+  unsigned long m_NumberOfHits, m_NumberOfMisses;
+
+  // Meshes waiting to be written, and whether one is being written
+  std::list<PendingMesh> m_Queue;
+  bool m_Writing, m_StopWriter;
+
+  std::mutex m_Mutex;
+  std::condition_variable m_QueueCondition, m_IdleCondition;
+  std::thread m_WriterThread;
+};
+
+#endif // MESHDISKCACHE_H
@@ -52,6 +52,7 @@
 #include "SNAPImageData.h"
 #include "AllPurposeProgressAccumulator.h"
 #include "MeshOptions.h"
+#include "MeshDiskCache.h"
 
 // ITK includes
 #include "itkRegionOfInterestImageFilter.h"
@@ -115,6 +116,9 @@ MeshManager
     {
       if(create_if_missing)
         {
+        // Meshes are only built here for export, one time point at a time,
+        // so no pipelines are generated in the background. Playback goes
+        // through the pipeline table of SegmentationMeshWrapper
         pipelineTable = MultiLabelMeshPipelineTable::New();
         wrapper->SetUserData("MeshPipelineTable", pipelineTable);
         }
@@ -187,8 +191,18 @@ MeshManager
       // Pass the options to the pipeline
     pipeline->SetMeshOptions(m_GlobalState->GetMeshOptions());
 
+    // Reuse meshes saved with the workspace
+    MeshDiskCache *cache = m_Driver->GetMeshDiskCache();
+    cache->SetDirectory(
+          MeshDiskCache::GetDirectoryForProject(m_GlobalState->GetProjectFilename()));
+    pipeline->SetDiskCache(cache);
+
     // Update the meshes
     pipeline->UpdateMeshes(command);
+
+    // Trim the pipeline table to its memory limit
+    static_cast<MultiLabelMeshPipelineTable *>(
+          wrapper->GetUserData("MeshPipelineTable"))->SetCurrentTimePoint(timepoint);
     }
 
   // Fire a modified event as well
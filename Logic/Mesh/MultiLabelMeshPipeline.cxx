@@ -44,13 +44,78 @@
 #include "IRISVectorTypesToITKConversion.h"
 #include "VTKMeshPipeline.h"
 #include "MeshOptions.h"
+#include "MeshDiskCache.h"
 #include "vtkUnsignedShortArray.h"
 
 // ITK includes
 #include "itkBinaryThresholdImageFilter.h"
+#include "itkMultiThreaderBase.h"
+
+#include <algorithm>
+#include <memory>
+#include <thread>
+#include <condition_variable>
 
 using namespace std;
 
+/**
+ * A copy of the ROI -> threshold -> VTK pipeline owned by a single worker
+ * thread. The input image is wrapped in a lightweight image object that
+ * shares the RLE line buffer with the pipeline input, so that the ITK
+ * pipeline update of one worker never touches the state of another.
+ */
+class MultiLabelMeshPipeline::MeshWorker
+{
+public:
+  MeshWorker(const InputImageType *image, MeshOptions *options)
+  {
+    // Shallow copy of the input image, sharing the pixel container
+    m_Input = InputImageType::New();
+    m_Input->CopyInformation(image);
+    m_Input->SetBufferedRegion(image->GetBufferedRegion());
+    m_Input->SetRequestedRegion(image->GetBufferedRegion());
+    m_Input->SetPixelContainer(
+          const_cast<InputImageType *>(image)->GetPixelContainer());
+
+    // Filters run single-threaded, the parallelism is across labels
+    m_ROIFilter = ROIFilter::New();
+    m_ROIFilter->SetInput(m_Input);
+    m_ROIFilter->SetNumberOfWorkUnits(1);
+    m_ROIFilter->ReleaseDataFlagOn();
+
+    m_ThresholdFilter = ThresholdFilter::New();
+    m_ThresholdFilter->SetInput(m_ROIFilter->GetOutput());
+    m_ThresholdFilter->SetNumberOfWorkUnits(1);
+    m_ThresholdFilter->ReleaseDataFlagOn();
+    m_ThresholdFilter->SetInsideValue(1.0f);
+    m_ThresholdFilter->SetOutsideValue(-1.0f);
+
+    m_VTKPipeline.SetImage(m_ThresholdFilter->GetOutput());
+    m_VTKPipeline.SetMeshOptions(options);
+  }
+
+  void ComputeMesh(LabelType label,
+                   const InputImageType::RegionType &region,
+                   vtkPolyData *mesh, std::mutex *vtk_mutex)
+  {
+    m_ROIFilter->SetRegionOfInterest(region);
+    m_ROIFilter->Update();
+
+    m_ThresholdFilter->SetLowerThreshold(label);
+    m_ThresholdFilter->SetUpperThreshold(label);
+    m_ThresholdFilter->UpdateLargestPossibleRegion();
+
+    m_VTKPipeline.SetImage(m_ThresholdFilter->GetOutput());
+    m_VTKPipeline.ComputeMesh(mesh, vtk_mutex);
+  }
+
+private:
+  InputImagePointer m_Input;
+  ROIFilterPointer m_ROIFilter;
+  ThresholdFilterPointer m_ThresholdFilter;
+  VTKMeshPipeline m_VTKPipeline;
+};
+
 MultiLabelMeshPipeline
 ::MultiLabelMeshPipeline()
 {
@@ -73,6 +138,9 @@ MultiLabelMeshPipeline
   // Set the initial mesh options
   m_MeshOptions = MeshOptions::New();
   m_VTKPipeline->SetMeshOptions(m_MeshOptions);
+
+  // Use the default number of threads
+  m_NumberOfThreads = 0;
 }
 
 MultiLabelMeshPipeline
@@ -81,6 +149,13 @@ MultiLabelMeshPipeline
   delete m_VTKPipeline;
 }
 
+void
+MultiLabelMeshPipeline
+::SetDiskCache(MeshDiskCache *cache)
+{
+  m_DiskCache = cache;
+}
+
 void
 MultiLabelMeshPipeline
 ::SetMeshOptions(const MeshOptions *options)
@@ -260,10 +335,12 @@ void MultiLabelMeshPipeline::UpdateMeshes(itk::Command *progressCommand)
 
   // Deal with progress accumulation
   SmartPtr<AllPurposeProgressAccumulator> progress = AllPurposeProgressAccumulator::New();
-  progress->AddObserver(itk::ProgressEvent(), progressCommand);
+  if(progressCommand)
+    progress->AddObserver(itk::ProgressEvent(), progressCommand);
 
   // Next we check which meshes are new or updated and mark them as needing to
   // be recomputed
+  std::vector<LabelType> dirty;
   for(MeshInfoMap::const_iterator it = meshmap.begin(); it != meshmap.end(); ++it)
     {
     // Get the cached mesh info for this label
@@ -278,48 +355,72 @@ void MultiLabelMeshPipeline::UpdateMeshes(itk::Command *progressCommand)
       info.BoundingBox[0] = it->second.BoundingBox[0];
       info.BoundingBox[1] = it->second.BoundingBox[1];
       info.Mesh = NULL;
+      }
 
-      //auto src = m_VTKPipeline->GetProgressAccumulator();
+    if(info.Mesh == NULL)
+      dirty.push_back(it->first);
+    }
+
+  // Read the meshes that have been computed before from the disk cache
+  std::map<LabelType, std::string> cache_keys;
+  if(m_DiskCache && m_DiskCache->IsEnabled() && dirty.size())
+    {
+    std::string image_key = MeshDiskCache::ComputeImageKey(m_InputImage);
+    std::string options_key = MeshDiskCache::ComputeOptionsKey(m_MeshOptions);
 
-      // Capture progress from this mesh
-      progress->RegisterSource(m_VTKPipeline->GetProgressAccumulator(), info.Count);
+    std::vector<LabelType> not_cached;
+    for(LabelType label : dirty)
+      {
+      MeshInfo &mi = m_MeshInfo[label];
+      std::string key = MeshDiskCache::ComputeMeshKey(
+            image_key, options_key, label, ComputeLabelDigest(label, mi));
+      mi.Mesh = m_DiskCache->Load(key);
+      if(mi.Mesh == NULL)
+        {
+        cache_keys[label] = key;
+        not_cached.push_back(label);
+        }
       }
+    dirty = not_cached;
     }
 
-  // Now compute the meshes
-  for(MeshInfoMap::iterator it = m_MeshInfo.begin(); it != m_MeshInfo.end(); it++)
+  // Determine how many threads to use
+  unsigned int n_threads = m_NumberOfThreads > 0
+      ? m_NumberOfThreads
+      : itk::MultiThreaderBase::GetGlobalDefaultNumberOfThreads();
+  n_threads = std::min(n_threads, (unsigned int) dirty.size());
+
+  if(n_threads > 1)
     {
-    if(it->second.Mesh == NULL)
+    ComputeMeshesParallel(dirty, n_threads, progress);
+    }
+  else
+    {
+    // Capture progress from each mesh
+    for(LabelType label : dirty)
+      progress->RegisterSource(m_VTKPipeline->GetProgressAccumulator(),
+                               m_MeshInfo[label].Count);
+
+    // Now compute the meshes
+    for(LabelType label : dirty)
       {
       // Create the mesh
-      MeshInfo &mi = it->second;
+      MeshInfo &mi = m_MeshInfo[label];
       mi.Mesh = vtkSmartPointer<vtkPolyData>::New();
 
-      // TODO: make this more elegant
-      InputImageType::RegionType bbWiderRegion;
-      for(int d = 0; d < 3; d++)
-        {
-        unsigned long len =
-            (unsigned long) (1 + mi.BoundingBox[1][d] - mi.BoundingBox[0][d]);
-        bbWiderRegion.SetIndex(d, mi.BoundingBox[0][d]);
-        bbWiderRegion.SetSize(d, len);
-        }
-      bbWiderRegion.PadByRadius(5);
-      bbWiderRegion.Crop(m_InputImage->GetLargestPossibleRegion());
-
       // Pass the region to the ROI filter and propagate the filter
       m_ROIFilter->SetInput(m_InputImage);
-      m_ROIFilter->SetRegionOfInterest(bbWiderRegion);
+      m_ROIFilter->SetRegionOfInterest(GetMeshRegion(mi));
       m_ROIFilter->Update();
 
       // Set the parameters for the thresholding filter
-      m_ThrehsoldFilter->SetLowerThreshold(it->first);
-      m_ThrehsoldFilter->SetUpperThreshold(it->first);
+      m_ThrehsoldFilter->SetLowerThreshold(label);
+      m_ThrehsoldFilter->SetUpperThreshold(label);
       m_ThrehsoldFilter->UpdateLargestPossibleRegion();
 
       // Graft the polydata to the last filter in the pipeline
       m_VTKPipeline->SetImage(m_ThrehsoldFilter->GetOutput());
-      m_VTKPipeline->ComputeMesh(it->second.Mesh);
+      m_VTKPipeline->ComputeMesh(mi.Mesh);
 
       // Update progress
       progress->StartNextRun(m_VTKPipeline->GetProgressAccumulator());
@@ -329,18 +430,190 @@ void MultiLabelMeshPipeline::UpdateMeshes(itk::Command *progressCommand)
   // Clean up the progress
   progress->UnregisterAllSources();
 
+  // Save the new meshes for later sessions
+  for(auto &it : cache_keys)
+    m_DiskCache->Store(it.second, m_MeshInfo[it.first].Mesh);
+
   // Set the modified flag, so we can use the pipeline's MTime
   this->Modified();
 }
 
+std::string
+MultiLabelMeshPipeline
+::ComputeLabelDigest(LabelType label, const MeshInfo &mi) const
+{
+  itksysMD5 *md5 = itksysMD5_New();
+  itksysMD5_Initialize(md5);
+
+  long header[7] = { (long) mi.Count,
+                     mi.BoundingBox[0][0], mi.BoundingBox[0][1], mi.BoundingBox[0][2],
+                     mi.BoundingBox[1][0], mi.BoundingBox[1][1], mi.BoundingBox[1][2] };
+  itksysMD5_Append(md5, (unsigned char *) header, sizeof(header));
+
+  // Append every run of the label within its bounding box, in the same
+  // coordinates as UpdateMeshes(): x from the start of the line
+  const InputImageType::BufferType *buffer = m_InputImage->GetBuffer();
+  InputImageType::BufferType::IndexType idx;
+  for(long z = mi.BoundingBox[0][2]; z <= mi.BoundingBox[1][2]; z++)
+    {
+    for(long y = mi.BoundingBox[0][1]; y <= mi.BoundingBox[1][1]; y++)
+      {
+      idx[0] = y; idx[1] = z;
+      const InputImageType::RLLine &line = buffer->GetPixel(idx);
+      long x = 0;
+      for(size_t s = 0; s < line.size(); s++)
+        {
+        if(line[s].second == label)
+          {
+          long run[4] = { x, (long) line[s].first, y, z };
+          itksysMD5_Append(md5, (unsigned char *) run, sizeof(run));
+          }
+        x += line[s].first;
+        }
+      }
+    }
+
+  char hex_code[33];
+  hex_code[32] = 0;
+  itksysMD5_FinalizeHex(md5, hex_code);
+  itksysMD5_Delete(md5);
+  return std::string(hex_code);
+}
+
+MultiLabelMeshPipeline::InputImageType::RegionType
+MultiLabelMeshPipeline
+::GetMeshRegion(const MeshInfo &mi) const
+{
+  // TODO: make this more elegant
+  InputImageType::RegionType bbWiderRegion;
+  for(int d = 0; d < 3; d++)
+    {
+    unsigned long len =
+        (unsigned long) (1 + mi.BoundingBox[1][d] - mi.BoundingBox[0][d]);
+    bbWiderRegion.SetIndex(d, mi.BoundingBox[0][d]);
+    bbWiderRegion.SetSize(d, len);
+    }
+  bbWiderRegion.PadByRadius(5);
+  bbWiderRegion.Crop(m_InputImage->GetLargestPossibleRegion());
+  return bbWiderRegion;
+}
+
+void
+MultiLabelMeshPipeline
+::ComputeMeshesParallel(const std::vector<LabelType> &labels,
+                        unsigned int n_threads,
+                        AllPurposeProgressAccumulator *progress)
+{
+  // Allocate the output meshes and regions up front, so that the workers
+  // never modify the mesh info map
+  std::vector<MeshInfo *> infos;
+  std::vector<InputImageType::RegionType> regions;
+  double total_voxels = 0.0;
+  for(LabelType label : labels)
+    {
+    MeshInfo &mi = m_MeshInfo[label];
+    mi.Mesh = vtkSmartPointer<vtkPolyData>::New();
+    infos.push_back(&mi);
+    regions.push_back(GetMeshRegion(mi));
+    total_voxels += mi.Count;
+    }
+
+  // Create a pipeline for each worker
+  std::vector<std::unique_ptr<MeshWorker> > workers;
+  for(unsigned int i = 0; i < n_threads; i++)
+    workers.emplace_back(new MeshWorker(m_InputImage, m_MeshOptions));
+
+  // Progress is reported as the fraction of voxels whose meshes are done. The
+  // workers only update the counters; the observers are invoked from this
+  // thread so that they see the same behavior as in the serial mode
+  void *progress_src = progress->RegisterGenericSource(1, 1.0f);
+  std::mutex mutex, vtk_mutex;
+  std::condition_variable cv;
+  size_t next = 0, n_done = 0;
+  double done_voxels = 0.0;
+  std::exception_ptr error;
+
+  std::vector<std::thread> threads;
+  for(unsigned int i = 0; i < n_threads; i++)
+    {
+    MeshWorker *worker = workers[i].get();
+    threads.emplace_back([&, worker]()
+      {
+      while(true)
+        {
+        // Take the next label from the queue
+        size_t k;
+        {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(next >= labels.size())
+          return;
+        k = next++;
+        }
+
+        std::exception_ptr k_error;
+        try
+          {
+          worker->ComputeMesh(labels[k], regions[k], infos[k]->Mesh, &vtk_mutex);
+          }
+        catch(...)
+          {
+          k_error = std::current_exception();
+          }
+
+        // Report completion
+        {
+        std::lock_guard<std::mutex> lock(mutex);
+        n_done++;
+        done_voxels += infos[k]->Count;
+        if(k_error && !error)
+          error = k_error;
+        }
+        cv.notify_one();
+        }
+      });
+    }
+
+  // Forward progress until all the labels are done
+  std::unique_lock<std::mutex> lock(mutex);
+  size_t n_reported = 0;
+  while(n_reported < labels.size())
+    {
+    cv.wait(lock, [&]() { return n_done > n_reported; });
+    n_reported = n_done;
+    double p = total_voxels > 0 ? done_voxels / total_voxels : 1.0;
+    lock.unlock();
+    AllPurposeProgressAccumulator::GenericProgressCallback(
+          progress_src, n_reported < labels.size() ? p : 1.0);
+    lock.lock();
+    }
+  lock.unlock();
+
+  for(std::thread &t : threads)
+    t.join();
+
+  // Pass on any exception thrown by the workers
+  if(error)
+    std::rethrow_exception(error);
+}
+
 void 
 MultiLabelMeshPipeline
 ::SetImage(const InputImageType *image)
 {
   if(m_InputImage != image)
     {
+    // Meshes are identified by the checksums of their labels, so they remain
+    // valid for another image with the same geometry, such as a copy made
+    // for background regeneration
+    bool same_geometry = m_InputImage && image
+        && m_InputImage->GetLargestPossibleRegion() == image->GetLargestPossibleRegion()
+        && m_InputImage->GetOrigin() == image->GetOrigin()
+        && m_InputImage->GetSpacing() == image->GetSpacing()
+        && m_InputImage->GetDirection() == image->GetDirection();
+
     m_InputImage = image;
-    m_MeshInfo.clear();
+    if(!same_geometry)
+      m_MeshInfo.clear();
     }
 }
 
@@ -365,38 +638,338 @@ std::map<LabelType, vtkSmartPointer<vtkPolyData> > MultiLabelMeshPipeline::GetMe
   return meshes;
 }
 
+MultiLabelMeshPipelineTable::MultiLabelMeshPipelineTable()
+{
+  m_MemoryLimit = 1000;
+  m_MemoryUsage = 0;
+  m_UseCounter = 0;
+  m_CurrentTimePoint = 0;
+  m_Direction = 1;
+  m_NumberOfTimePoints = 0;
+  m_PrefetchCount = 2;
+  m_Hits = m_Misses = m_Evictions = m_Prefetched = 0;
+  m_StopPrefetch = false;
+}
+
+MultiLabelMeshPipelineTable::~MultiLabelMeshPipelineTable()
+{
+  // Stop the background thread, waiting for the mesh it is working on
+  {
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  m_StopPrefetch = true;
+  m_PrefetchQueue.clear();
+  }
+  m_QueueCondition.notify_all();
+  if(m_PrefetchThread.joinable())
+    m_PrefetchThread.join();
+}
+
 SmartPtr<MultiLabelMeshPipeline>
 MultiLabelMeshPipelineTable::GetPipeline(unsigned int timepoint)
 {
-  return m_table[timepoint];
+  std::unique_lock<std::mutex> lock(m_Mutex);
+
+  // If the pipeline is being generated in the background, wait for it
+  m_DoneCondition.wait(lock, [&]() { return !m_InFlight.count(timepoint); });
+
+  auto it = m_table.find(timepoint);
+  if(it == m_table.end())
+    {
+    // A pipeline waiting in the queue is updated by the caller instead
+    auto qit = std::find_if(
+          m_PrefetchQueue.begin(), m_PrefetchQueue.end(),
+          [timepoint](const std::pair<unsigned int, SmartPtr<MultiLabelMeshPipeline> > &p)
+    { return p.first == timepoint; });
+    if(qit == m_PrefetchQueue.end())
+      return nullptr;
+
+    it = m_table.insert(std::make_pair(timepoint, Entry())).first;
+    it->second.Pipeline = qit->second;
+    m_PrefetchQueue.erase(qit);
+    }
+
+  it->second.LastUse = ++m_UseCounter;
+  m_Hits++;
+  return it->second.Pipeline;
+}
+
+bool
+MultiLabelMeshPipelineTable::Contains(unsigned int timepoint) const
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  return m_table.count(timepoint) > 0;
+}
+
+SmartPtr<MultiLabelMeshPipeline>
+MultiLabelMeshPipelineTable::CreateDetachedPipeline(
+    const MultiLabelMeshPipeline::InputImageType *image,
+    const MeshOptions *options, MeshDiskCache *cache)
+{
+  typedef MultiLabelMeshPipeline::InputImageType ImageType;
+  typedef itk::RegionOfInterestImageFilter<ImageType, ImageType> CopyFilter;
+
+  // Copy the runs of the image
+  SmartPtr<CopyFilter> copier = CopyFilter::New();
+  copier->SetInput(image);
+  copier->SetRegionOfInterest(image->GetLargestPossibleRegion());
+  copier->Update();
+  SmartPtr<ImageType> copy = copier->GetOutput();
+  copy->DisconnectPipeline();
+
+  SmartPtr<MultiLabelMeshPipeline> pipeline = MultiLabelMeshPipeline::New();
+  pipeline->SetImage(copy);
+  pipeline->SetMeshOptions(options);
+  pipeline->SetDiskCache(cache);
+  return pipeline;
 }
 
 void
 MultiLabelMeshPipelineTable::SetPipeline(unsigned int timepoint, SmartPtr<MultiLabelMeshPipeline> pipeline)
 {
-  m_table[timepoint] = pipeline;
-  uint32_t size = GetPipelineMemorySize(pipeline);
-  m_MemoryUsage += size;
+  std::unique_lock<std::mutex> lock(m_Mutex);
+  m_DoneCondition.wait(lock, [&]() { return !m_InFlight.count(timepoint); });
+
+  // The pipeline replaces any pending background request for this time point
+  m_PrefetchQueue.remove_if(
+        [timepoint](const std::pair<unsigned int, SmartPtr<MultiLabelMeshPipeline> > &p)
+  { return p.first == timepoint; });
+
+  Entry &entry = m_table[timepoint];
+  entry.Pipeline = pipeline;
+  entry.LastUse = ++m_UseCounter;
+  m_Misses++;
+
+  this->Trim();
+}
+
+void
+MultiLabelMeshPipelineTable::SetCurrentTimePoint(unsigned int timepoint)
+{
+  std::unique_lock<std::mutex> lock(m_Mutex);
+
+  // Keep track of the direction of playback
+  if(timepoint > m_CurrentTimePoint)
+    m_Direction = 1;
+  else if(timepoint < m_CurrentTimePoint)
+    m_Direction = -1;
+  m_CurrentTimePoint = timepoint;
+
+  // Evict pipelines that don't fit into the memory limit
+  this->Trim();
+
+  // Requests for the previous time point are no longer relevant
+  m_PrefetchQueue.clear();
+  if(!m_Factory || !m_PrefetchCount
+     || m_MemoryUsage >= (unsigned long) m_MemoryLimit * 1024)
+    return;
+
+  // Time points ahead in the direction of playback, nearest first
+  std::vector<unsigned int> targets;
+  for(unsigned int k = 1; k <= m_PrefetchCount; k++)
+    {
+    long tp = (long) timepoint + m_Direction * (long) k;
+    if(tp < 0 || tp >= (long) m_NumberOfTimePoints)
+      break;
+    if(!m_table.count(tp) && !m_InFlight.count(tp))
+      targets.push_back((unsigned int) tp);
+    }
+
+  if(targets.empty())
+    return;
+
+  // The factory accesses the image data, so it is called from this thread
+  PipelineFactory factory = m_Factory;
+  lock.unlock();
+  std::vector<SmartPtr<MultiLabelMeshPipeline> > pipelines;
+  for(unsigned int tp : targets)
+    pipelines.push_back(factory(tp));
+  lock.lock();
+
+  for(unsigned int i = 0; i < targets.size(); i++)
+    if(pipelines[i])
+      m_PrefetchQueue.push_back(std::make_pair(targets[i], pipelines[i]));
+
+  // Start the background thread the first time it is needed
+  if(!m_PrefetchThread.joinable())
+    m_PrefetchThread = std::thread(&MultiLabelMeshPipelineTable::PrefetchThreadMain, this);
+  m_QueueCondition.notify_all();
+}
+
+void
+MultiLabelMeshPipelineTable::SetPipelineFactory(PipelineFactory factory, unsigned int n_timepoints)
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  m_Factory = factory;
+  m_NumberOfTimePoints = n_timepoints;
+  m_PrefetchQueue.clear();
+}
+
+void
+MultiLabelMeshPipelineTable::SetMemoryLimit(unsigned int mb)
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  m_MemoryLimit = mb;
+}
+
+unsigned int
+MultiLabelMeshPipelineTable::GetMemoryLimit() const
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  return m_MemoryLimit;
+}
+
+void
+MultiLabelMeshPipelineTable::SetPrefetchCount(unsigned int n)
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  m_PrefetchCount = n;
+}
+
+unsigned int
+MultiLabelMeshPipelineTable::GetPrefetchCount() const
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  return m_PrefetchCount;
+}
+
+unsigned long
+MultiLabelMeshPipelineTable::GetNumberOfHits() const
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  return m_Hits;
+}
+
+unsigned long
+MultiLabelMeshPipelineTable::GetNumberOfMisses() const
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  return m_Misses;
+}
+
+unsigned long
+MultiLabelMeshPipelineTable::GetNumberOfEvictions() const
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  return m_Evictions;
+}
+
+unsigned long
+MultiLabelMeshPipelineTable::GetNumberOfPrefetchedPipelines() const
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  return m_Prefetched;
+}
+
+unsigned long
+MultiLabelMeshPipelineTable::GetMemoryUsage() const
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  return m_MemoryUsage;
+}
 
-  // Remove item from the front of the table if memory usage exceeds threshold
-  // -- but will keep item if it's the only item in the table
-  // -- because we still want to render single huge mesh
-  if (m_MemoryUsage > m_MemoryLimit && m_table.size() > 1)
+void
+MultiLabelMeshPipelineTable::Trim()
+{
+  // The meshes change size as they are updated, so measure them again
+  m_MemoryUsage = 0;
+  for(auto &it : m_table)
+    m_MemoryUsage += GetPipelineMemorySizeKB(it.second.Pipeline);
+
+  unsigned long limit = (unsigned long) m_MemoryLimit * 1024;
+  if(m_MemoryUsage <= limit)
+    return;
+
+  // Order the candidates by distance from the current time point, furthest
+  // first, and then by last use. The current time point is always kept
+  // because we still want to render a single huge mesh
+  std::vector<std::pair<unsigned int, const Entry *> > candidates;
+  for(auto &it : m_table)
+    if(it.first != m_CurrentTimePoint)
+      candidates.push_back(std::make_pair(it.first, &it.second));
+
+  unsigned int tp_current = m_CurrentTimePoint;
+  std::sort(candidates.begin(), candidates.end(),
+            [tp_current](const std::pair<unsigned int, const Entry *> &a,
+                         const std::pair<unsigned int, const Entry *> &b)
+  {
+    unsigned int da = a.first > tp_current ? a.first - tp_current : tp_current - a.first;
+    unsigned int db = b.first > tp_current ? b.first - tp_current : tp_current - b.first;
+    if(da != db)
+      return da > db;
+    return a.second->LastUse < b.second->LastUse;
+  });
+
+  for(auto &c : candidates)
     {
-      //printf("[table trimming] usage = %u MB\n", m_MemoryUsage);
-      m_MemoryUsage -= GetPipelineMemorySize(m_table.begin()->second);
-      m_table.erase(m_table.begin());
+    if(m_MemoryUsage <= limit)
+      break;
+    m_MemoryUsage -= GetPipelineMemorySizeKB(c.second->Pipeline);
+    m_table.erase(c.first);
+    m_Evictions++;
+    }
+}
+
+void
+MultiLabelMeshPipelineTable::PrefetchThreadMain()
+{
+  std::unique_lock<std::mutex> lock(m_Mutex);
+  while(true)
+    {
+    m_QueueCondition.wait(lock, [this]() { return m_StopPrefetch || !m_PrefetchQueue.empty(); });
+    if(m_StopPrefetch)
+      return;
+
+    unsigned int tp = m_PrefetchQueue.front().first;
+    SmartPtr<MultiLabelMeshPipeline> pipeline = m_PrefetchQueue.front().second;
+    m_PrefetchQueue.pop_front();
+    if(m_table.count(tp))
+      continue;
+
+    m_InFlight.insert(tp);
+    lock.unlock();
+
+    // Errors are not reported here. If the time point is visited, the meshes
+    // are computed again in the foreground, which passes the exception on
+    bool success = true;
+    try
+      {
+      pipeline->UpdateMeshes(nullptr);
+      }
+    catch(...)
+      {
+      success = false;
+      }
+
+    // The result is dropped if the table has since filled up
+    lock.lock();
+    m_InFlight.erase(tp);
+    if(success && !m_table.count(tp)
+       && m_MemoryUsage < (unsigned long) m_MemoryLimit * 1024)
+      {
+      Entry &entry = m_table[tp];
+      entry.Pipeline = pipeline;
+      entry.LastUse = 0;
+      m_Prefetched++;
+      }
+    m_DoneCondition.notify_all();
     }
 }
 
 uint32_t
 MultiLabelMeshPipelineTable::GetPipelineMemorySize(SmartPtr<MultiLabelMeshPipeline> pipeline)
+{
+  return (uint32_t) (GetPipelineMemorySizeKB(pipeline) / 1024);
+}
+
+unsigned long
+MultiLabelMeshPipelineTable::GetPipelineMemorySizeKB(MultiLabelMeshPipeline *pipeline)
 {
   std::map<LabelType, vtkSmartPointer<vtkPolyData>> collection = pipeline->GetMeshCollection();
-  uint32_t sum = 0;
+  unsigned long sum = 0;
   for (auto pair : collection)
     {
-      sum += (pair.second->GetActualMemorySize())/1024;
+      if (pair.second)
+        sum += pair.second->GetActualMemorySize();
     }
   return sum;
 }
@@ -409,7 +982,7 @@ MultiLabelMeshPipelineTable::printMeshSize()
     unsigned int timepoint = pit->first;
     cout << "Timepoint: " << timepoint << "------------------------" << endl;
     double totalSize = 0;
-    SmartPtr<MultiLabelMeshPipeline> pipeline = pit->second;
+    SmartPtr<MultiLabelMeshPipeline> pipeline = pit->second.Pipeline;
     auto meshTable = pipeline->GetMeshCollection();
     for (auto mit = meshTable.cbegin(); mit != meshTable.cend(); ++mit)
       {
@@ -45,6 +45,13 @@
 #include "RLERegionOfInterestImageFilter.h"
 #include "RLEImageScanlineIterator.h"
 
+#include <condition_variable>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <set>
+#include <thread>
+
 
 // Forward reference to itk classes
 namespace itk {
@@ -56,6 +63,7 @@ namespace itk {
 
 // Forward references
 class MeshOptions;
+class MeshDiskCache;
 class VTKMeshPipeline;
 class vtkPolyData;
 class AllPurposeProgressAccumulator;
@@ -129,9 +137,25 @@ public:
    * the color label is not present in the image */
   bool ComputeMesh(LabelType label, vtkPolyData *outData);
 
-  /** Update the meshes */
+  /** Update the meshes. The progress command may be null */
   void UpdateMeshes(itk::Command *progressCommand);
 
+  /**
+   * Number of worker threads used by UpdateMeshes(). When more than one
+   * label needs to be recomputed, each worker gets its own ROI, threshold and
+   * VTK mesh pipeline and labels are processed concurrently. A value of 1
+   * disables the parallel mode, and 0 (default) uses the global ITK default
+   * number of threads.
+   */
+  irisGetSetMacro(NumberOfThreads, unsigned int)
+
+  /**
+   * Set an on-disk cache of meshes. UpdateMeshes() reads the meshes of labels
+   * that need to be recomputed from the cache when possible, and writes the
+   * meshes it computes to the cache.
+   */
+  void SetDiskCache(MeshDiskCache *cache);
+
   /** Get the collection of computed meshes */
   std::map<LabelType, vtkSmartPointer<vtkPolyData> > GetMeshCollection();
 
@@ -184,6 +208,28 @@ private:
   // The VTK pipeline
   VTKMeshPipeline *           m_VTKPipeline;
 
+  // Number of threads for mesh computation
+  unsigned int m_NumberOfThreads;
+
+  // Optional persistent mesh cache
+  SmartPtr<MeshDiskCache> m_DiskCache;
+
+  // A self-contained ROI/threshold/VTK chain used by each parallel worker
+  class MeshWorker;
+
+  // Compute the region from which the mesh for a label is extracted
+  InputImageType::RegionType GetMeshRegion(const MeshInfo &mi) const;
+
+  // MD5 of the runs of a label, which identifies its mesh in the disk cache.
+  // The checksum in MeshInfo only detects changes between updates, and is
+  // too weak to tell apart the meshes of different sessions
+  std::string ComputeLabelDigest(LabelType label, const MeshInfo &mi) const;
+
+  // Compute the meshes for the listed labels concurrently
+  void ComputeMeshesParallel(const std::vector<LabelType> &labels,
+                             unsigned int n_threads,
+                             AllPurposeProgressAccumulator *progress);
+
   // Helper routine for the update command
   void UpdateMeshInfoHelper(
       MeshInfo *current_meshinfo,
@@ -194,42 +240,138 @@ private:
 
 // issue #29: Now storing one pipeline for each timepoint of 4D image
 // 3D image pipeline will always be stored at timepoint 0
+//
+// The table holds at most MemoryLimit megabytes of meshes. When the limit is
+// exceeded, the pipelines of the time points furthest from the current time
+// point are dropped first, and among equally distant ones, the least recently
+// used. If a pipeline factory is set, the table also regenerates the meshes
+// of the time points that are likely to be visited next during playback on a
+// background thread, so that stepping through the frames does not have to
+// wait for marching cubes.
 class MultiLabelMeshPipelineTable : public itk::Object
 {
 public:
   irisITKObjectMacro(MultiLabelMeshPipelineTable, itk::Object)
 
-  typedef std::map<unsigned int, SmartPtr<MultiLabelMeshPipeline>> MeshPipelineTableType;
-
+  /**
+   * A function that creates a pipeline for a time point, with its image and
+   * options set but without calling UpdateMeshes(). It is called on the
+   * thread that calls SetCurrentTimePoint()
+   */
+  typedef std::function<SmartPtr<MultiLabelMeshPipeline>(unsigned int)> PipelineFactory;
 
   // only for debugging purpose
   // -- fast scrolling through frames when print for each frame may cause crash
   void printMeshSize();
 
-  // Get a pipeline from timepoint. If timepoint does not exist, return nullptr
+  // Get a pipeline from timepoint. If timepoint does not exist, return nullptr.
+  // If the pipeline is being generated in the background, this waits for it,
+  // and if it is still queued, it is taken out of the queue and returned
   SmartPtr<MultiLabelMeshPipeline> GetPipeline(unsigned int timepoint);
 
   // Set pipeline for a timepoint. If timepoint exists, overwrite existing pipeline
   void SetPipeline(unsigned int timepoint, SmartPtr<MultiLabelMeshPipeline> pipeline);
 
+  // Set the time point being viewed. Call this after the meshes of that time
+  // point have been updated: the table is trimmed to the memory limit and the
+  // next time points in the direction of travel are scheduled for background
+  // regeneration
+  void SetCurrentTimePoint(unsigned int timepoint);
+
+  // Set the function used to create pipelines for background regeneration,
+  // and the number of time points in the image
+  void SetPipelineFactory(PipelineFactory factory, unsigned int n_timepoints);
+
+  // Create a pipeline that can be handed to the background thread. The
+  // pipeline gets its own copy of the image, so that the segmentation can be
+  // edited while the meshes are generated. The copy is replaced by the live
+  // image when the time point is visited, and labels that have not changed
+  // keep their meshes. Must be called on the thread that owns the image
+  static SmartPtr<MultiLabelMeshPipeline> CreateDetachedPipeline(
+      const MultiLabelMeshPipeline::InputImageType *image,
+      const MeshOptions *options, MeshDiskCache *cache);
+
+  // Whether the table holds a pipeline for the time point. Unlike
+  // GetPipeline(), this does not wait for background work
+  bool Contains(unsigned int timepoint) const;
+
+  // Memory usage limit in MB
+  void SetMemoryLimit(unsigned int mb);
+  unsigned int GetMemoryLimit() const;
+
+  // Number of time points ahead of the current one that are regenerated in
+  // the background. Zero disables background regeneration
+  void SetPrefetchCount(unsigned int n);
+  unsigned int GetPrefetchCount() const;
+
+  // Statistics: lookups that found a pipeline, pipelines that had to be
+  // created, pipelines evicted, and pipelines generated in the background
+  unsigned long GetNumberOfHits() const;
+  unsigned long GetNumberOfMisses() const;
+  unsigned long GetNumberOfEvictions() const;
+  unsigned long GetNumberOfPrefetchedPipelines() const;
+
+  // Memory used by the meshes in the table as of the last trim, in KB
+  unsigned long GetMemoryUsage() const;
+
   // Get memory size of a pipeline in MB
   static uint32_t  GetPipelineMemorySize(SmartPtr<MultiLabelMeshPipeline> pipeline);
 
 protected:
-  MultiLabelMeshPipelineTable() {};
-  ~MultiLabelMeshPipelineTable() {};
+  MultiLabelMeshPipelineTable();
+  ~MultiLabelMeshPipelineTable();
   //MultiLabelMeshPipelineTable(const MultiLabelMeshPipelineTable& other) = delete;
   //MultiLabelMeshPipelineTable& operator=(const MultiLabelMeshPipelineTable& other) = delete;
 
 private:
+  struct Entry
+  {
+    SmartPtr<MultiLabelMeshPipeline> Pipeline;
+    unsigned long LastUse;
+  };
+
+  typedef std::map<unsigned int, Entry> MeshPipelineTableType;
+
+  // Get memory size of a pipeline in KB
+  static unsigned long GetPipelineMemorySizeKB(MultiLabelMeshPipeline *pipeline);
+
+  // Drop pipelines until the memory usage is under the limit. Must be called
+  // with the lock held, from the thread that updates the meshes
+  void Trim();
+
+  // Body of the background regeneration thread
+  void PrefetchThreadMain();
+
   // Memory usage limit in MB
-  static constexpr uint32_t m_MemoryLimit = 1000;
+  unsigned int m_MemoryLimit;
 
-  // Total current memory used by the table
-  uint32_t m_MemoryUsage = 0;
+  // Total current memory used by the table, in KB
+  unsigned long m_MemoryUsage;
 
   MeshPipelineTableType m_table;
 
+  // Use counter, for LRU ordering
+  unsigned long m_UseCounter;
+
+  // Current time point and direction of travel (+1 or -1)
+  unsigned int m_CurrentTimePoint;
+  int m_Direction;
+
+  PipelineFactory m_Factory;
+  unsigned int m_NumberOfTimePoints;
+  unsigned int m_PrefetchCount;
+
+  // Pipelines waiting to be updated in the background, and time points
+  // being updated
+  std::list<std::pair<unsigned int, SmartPtr<MultiLabelMeshPipeline> > > m_PrefetchQueue;
+  std::set<unsigned int> m_InFlight;
+
+  unsigned long m_Hits, m_Misses, m_Evictions, m_Prefetched;
+
+  mutable std::mutex m_Mutex;
+  std::condition_variable m_QueueCondition, m_DoneCondition;
+  std::thread m_PrefetchThread;
+  bool m_StopPrefetch;
 };
 
 #endif
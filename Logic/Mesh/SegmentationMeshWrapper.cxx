@@ -23,6 +23,13 @@ GetPipeline()
   return m_Pipeline;
 }
 
+void
+SegmentationMeshAssembly::
+SetPipeline(MultiLabelMeshPipeline *pipeline)
+{
+  m_Pipeline = pipeline;
+}
+
 void
 SegmentationMeshAssembly::
 UpdateMeshAssembly(itk::Command *progress, ImagePointer img, MeshOptions *options)
@@ -90,6 +97,16 @@ SegmentationMeshWrapper::Initialize(LabelImageWrapper *segImg, MeshOptions *mesh
   m_DisplayMapping->SetMesh(this);
   m_DisplayMapping->SetColorLabelTable(segImg->GetDisplayMapping()->GetLabelColorTable());
 
+  // Pipelines for the frames ahead of the cursor get a copy of their time
+  // point, and are updated on the table's background thread
+  m_PipelineTable = MultiLabelMeshPipelineTable::New();
+  m_PipelineTable->SetPipelineFactory(
+        [this](unsigned int tp)
+    {
+    return MultiLabelMeshPipelineTable::CreateDetachedPipeline(
+          m_ImagePointer->GetImageByTimePoint(tp), m_MeshOptions, m_DiskCache);
+    }, segImg->GetNumberOfTimePoints());
+
   m_Initialized = true;
 }
 
@@ -146,8 +163,30 @@ SegmentationMeshWrapper::UpdateMeshes(itk::Command *progressCmd, unsigned int ti
       static_cast<SegmentationMeshAssembly*>(m_MeshAssemblyMap[timepoint].GetPointer());
 
 
+  // Reuse the pipeline of the time point, which may have been generated in
+  // the background
+  SmartPtr<MultiLabelMeshPipeline> pipeline = m_PipelineTable->GetPipeline(timepoint);
+  if(!pipeline)
+    {
+    pipeline = MultiLabelMeshPipeline::New();
+    m_PipelineTable->SetPipeline(timepoint, pipeline);
+    }
+  assembly->SetPipeline(pipeline);
+
   auto img = m_ImagePointer->GetImageByTimePoint(timepoint);
+  pipeline->SetDiskCache(m_DiskCache);
   assembly->UpdateMeshAssembly(progressCmd, img, m_MeshOptions);
+
+  // Trim the table, schedule the next frames, and release the meshes of the
+  // time points whose pipelines were evicted
+  m_PipelineTable->SetCurrentTimePoint(timepoint);
+  for(auto it = m_MeshAssemblyMap.begin(); it != m_MeshAssemblyMap.end();)
+    {
+    if(it->first != timepoint && !m_PipelineTable->Contains(it->first))
+      it = m_MeshAssemblyMap.erase(it);
+    else
+      ++it;
+    }
 }
 
 void
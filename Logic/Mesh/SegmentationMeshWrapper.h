@@ -6,6 +6,7 @@
 #include "MultiLabelMeshPipeline.h"
 #include "MeshOptions.h"
 #include "LabelImageWrapper.h"
+#include "MeshDiskCache.h"
 
 
 class SegmentationMeshAssembly : public MeshAssembly
@@ -17,6 +18,9 @@ public:
 
   MultiLabelMeshPipeline *GetPipeline();
 
+  /** Set the pipeline that generates the meshes of the assembly */
+  void SetPipeline(MultiLabelMeshPipeline *pipeline);
+
   void UpdateMeshAssembly(itk::Command *progress, ImagePointer img, MeshOptions *options);
 protected:
   SegmentationMeshAssembly();
@@ -71,6 +75,10 @@ public:
 
   unsigned long GetAssemblyMTime(unsigned int tp);
 
+  /** Set the on-disk cache used by the mesh pipelines of all time points */
+  void SetDiskCache(MeshDiskCache *cache)
+  { m_DiskCache = cache; }
+
 protected:
   SegmentationMeshWrapper();
   virtual ~SegmentationMeshWrapper() = default;
@@ -81,6 +89,12 @@ protected:
 
   SmartPtr<MeshOptions> m_MeshOptions;
 
+  SmartPtr<MeshDiskCache> m_DiskCache;
+
+  // Mesh pipelines of the time points, bounded in memory. During playback,
+  // the table also generates the meshes of the next frames in the background
+  SmartPtr<MultiLabelMeshPipelineTable> m_PipelineTable;
+
 	const char* m_NicknamePrefix = "Mesh-";
 };
 
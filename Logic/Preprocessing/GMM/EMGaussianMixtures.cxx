@@ -1,22 +1,38 @@
 #include "EMGaussianMixtures.h"
+#include "itkMultiThreaderBase.h"
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 #include <ctime>
 
 EMGaussianMixtures::EMGaussianMixtures(double **x, int dataSize, int dataDim, int numOfClass)
   :m_x(x), m_numOfData(dataSize), m_dimOfGaussian(dataDim), m_numOfGaussian(numOfClass), m_setPriorFlag(0), m_numOfIteration(0), m_fail(0)
 {
-  m_latent = new double*[dataSize];
+  // The latent variables and log pdf values are stored by class, so that
+  // the loops over the samples access contiguous memory
+  m_latent = new double*[numOfClass];
   m_probs = new double[dataSize*numOfClass];
-  for (int i = 0; i < dataSize; i++)
+  for (int j = 0; j < numOfClass; j++)
     {
-    m_latent[i] = &m_probs[i*numOfClass];
+    m_latent[j] = &m_probs[j*dataSize];
     }
-  m_log_pdf = new double*[dataSize];
+  m_log_pdf = new double*[numOfClass];
   m_probs2 = new double[dataSize*numOfClass];
+  for (int j = 0; j < numOfClass; j++)
+    {
+    m_log_pdf[j] = &m_probs2[j*dataSize];
+    }
+
+  // Copy the samples into the buffer stored by dimension
+  m_data.resize((size_t) dataSize * dataDim);
   for (int i = 0; i < dataSize; i++)
     {
-    m_log_pdf[i] = &m_probs2[i*numOfClass];
+    for (int k = 0; k < dataDim; k++)
+      {
+      m_data[(size_t) k * dataSize + i] = x[i][k];
+      }
     }
+
   m_tmp1 = new double[numOfClass];
   m_tmp2 = new double[dataDim];
   m_tmp3 = new double[dataDim*dataDim];
@@ -28,7 +44,7 @@ EMGaussianMixtures::EMGaussianMixtures(double **x, int dataSize, int dataDim, in
 
   m_maxIteration = 30;
   m_precision = 1.0e-7;
-  m_logLikelihood = std::numeric_limits<double>::infinity();
+  m_logLikelihood = -std::numeric_limits<double>::infinity();
 }
 
 EMGaussianMixtures::~EMGaussianMixtures()
@@ -48,7 +64,7 @@ void EMGaussianMixtures::Reset(void)
 {
   m_numOfIteration = 0;
   m_fail = 0;
-  m_logLikelihood = std::numeric_limits<double>::infinity();
+  m_logLikelihood = -std::numeric_limits<double>::infinity();
   for (int i = 0; i < m_numOfData*m_numOfGaussian; i++)
     {
     m_probs[i] = 0;
@@ -104,22 +120,32 @@ int EMGaussianMixtures::GetMaxIteration(void)
 
 double ** EMGaussianMixtures::Update(void)
 {
-  double currentLogLikelihood = 0;
   m_numOfIteration = 0;
   m_fail = 0;
-  while ((fabs(m_logLikelihood - currentLogLikelihood) > m_precision) && (m_numOfIteration < m_maxIteration))
+  m_logLikelihood = -std::numeric_limits<double>::infinity();
+  while (m_numOfIteration < m_maxIteration)
     {
-    if (m_logLikelihood < currentLogLikelihood)
+    ++m_numOfIteration;
+    EvaluatePDF();
+    double currentLogLikelihood = EvaluateLogLikelihood();
+
+    // A likelihood that is not finite can't be compared to the previous one
+    if (!std::isfinite(currentLogLikelihood))
+      {
+      m_fail = 1;
+      std::cout << "!!!!!! Log Likelihood is not finite, EM fails" << std::endl;
+      break;
+      }
+
+    if (currentLogLikelihood < m_logLikelihood)
       {
       m_fail = 1;
-      std::cout << "!!!!!! Log Likelihood increase, EM fails" << std::endl;
+      std::cout << "!!!!!! Log Likelihood decrease, EM fails" << std::endl;
       std::cout << "old=" <<m_logLikelihood << std::endl << "new=" << currentLogLikelihood << std::endl;
-      // break;
       }
-    ++m_numOfIteration;
+    bool converged = fabs(currentLogLikelihood - m_logLikelihood) <= m_precision;
     m_logLikelihood = currentLogLikelihood;
-    EvaluatePDF();
-    currentLogLikelihood = EvaluateLogLikelihood();
+
     UpdateLatent();
     UpdateMean();
     UpdateCovariance();
@@ -133,6 +159,9 @@ double ** EMGaussianMixtures::Update(void)
     std::cout << "log likelihood:" << std::endl << m_logLikelihood << std::endl;
     PrintParameters();
     //getchar();
+
+    if (converged)
+      break;
     }
   return m_latent;
 }
@@ -149,10 +178,10 @@ double ** EMGaussianMixtures::UpdateOnce(void)
   double currentLogLikelihood = EvaluateLogLikelihood();
   end = clock();
   std::cout << "evaluate likelihood spending " << (end-start)/1000 << std::endl;
-  if (m_logLikelihood < currentLogLikelihood)
+  if (currentLogLikelihood < m_logLikelihood)
     {
     m_fail = 1;
-    std::cout << "!!!!!! Log Likelihood increase, EM fails" << std::endl;
+    std::cout << "!!!!!! Log Likelihood decrease, EM fails" << std::endl;
     std::cout << "old=" <<m_logLikelihood << std::endl << "new=" << currentLogLikelihood << std::endl;
     }
   if (fabs(m_logLikelihood - currentLogLikelihood) <= m_precision)
@@ -194,15 +223,39 @@ double ** EMGaussianMixtures::UpdateOnce(void)
   return m_latent;
 }
 
+int EMGaussianMixtures::GetNumberOfBlocks() const
+{
+  return (m_numOfData + BLOCK_SIZE - 1) / BLOCK_SIZE;
+}
+
+void EMGaussianMixtures::GetBlockRange(int block, int &first, int &n) const
+{
+  first = block * BLOCK_SIZE;
+  n = std::min((int) BLOCK_SIZE, m_numOfData - first);
+}
+
 void EMGaussianMixtures::EvaluatePDF(void)
 {
-  for (int i = 0; i < m_numOfData; i++)
+  // The Gaussians are only read by the threads
+  std::vector<const Gaussian *> gauss(m_numOfGaussian);
+  for (int j = 0; j < m_numOfGaussian; j++)
     {
+    gauss[j] = m_gmm->GetGaussian(j);
+    }
+
+  itk::MultiThreaderBase::Pointer mt = itk::MultiThreaderBase::New();
+  mt->ParallelizeArray(0, GetNumberOfBlocks(), [&](itk::SizeValueType block)
+    {
+    int first, n;
+    GetBlockRange(block, first, n);
+    std::vector<double> zscratch(n);
     for (int j = 0; j < m_numOfGaussian; j++)
       {
-      m_log_pdf[i][j] = m_gmm->EvaluateLogPDF(j, m_x[i]);
+      gauss[j]->EvaluateLogPDF(m_data.data() + first, m_numOfData, n,
+                               m_log_pdf[j] + first, zscratch.data());
       }
-    }
+    }, nullptr);
+
   if (m_setPriorFlag == 0)
     {
     for (int j = 0; j < m_numOfGaussian; j++)
@@ -266,161 +319,183 @@ double EMGaussianMixtures::ComputePosterior(int nGauss, double *log_pdf, double
 
 void EMGaussianMixtures::UpdateLatent(void)
 {
-  double sum = 0;
   for (int i = 0; i < m_numOfGaussian; i++)
     {
     m_sum[i] = 0;
     }
 
+  // The update with a prior is not used
+  if (m_setPriorFlag != 0)
+    return;
+
   // Compute log of the weights and store in logw
   vnl_vector<double> logw(m_numOfGaussian);
   for(int i = 0; i < m_numOfGaussian; i++)
     logw(i) = log(m_weight[i]);
-  
-  if (m_setPriorFlag == 0)
-    {
-    for (int i = 0; i < m_numOfData; i++)
-      {
-      for (int j = 0; j < m_numOfGaussian; j++)
-        {
-        m_latent[i][j] = ComputePosterior(m_numOfGaussian, m_log_pdf[i], m_weight, logw.data_block(), j);
-        m_sum[j] += m_latent[i][j];
-        }
 
+  // Each block computes its posteriors and their sums for each class
+  int nb = GetNumberOfBlocks(), ng = m_numOfGaussian;
+  m_blockSums.assign((size_t) nb * ng, 0.0);
 
-      /*
-      sum = 0;
-      for (int j = 0; j < m_numOfGaussian; j++)
-        {
-        m_tmp1[j] = m_weight[j] * m_pdf[i][j];
-        sum += m_tmp1[j];
-        }
-      if(sum == 0)
-        {
-        for (int j = 0; j < m_numOfGaussian; j++)
-          {
-          m_latent[i][j] = 1.0 / m_numOfGaussian;
-          m_sum[j] += m_latent[i][j];
-          }
-        }
-      else
-        {
-        for (int j = 0; j < m_numOfGaussian; j++)
-          {
-          m_latent[i][j] = m_tmp1[j] / sum;
-          m_sum[j] += m_latent[i][j];
-          }
-        }
-        */
-      }
-    }
-  else
+  itk::MultiThreaderBase::Pointer mt = itk::MultiThreaderBase::New();
+  mt->ParallelizeArray(0, nb, [&](itk::SizeValueType block)
     {
-    /**= THIS IS NOT USED
-    for (int i = 0; i < m_numOfData; i++)
+    int first, n;
+    GetBlockRange(block, first, n);
+    std::vector<double> log_pdf(ng);
+    double *bsum = m_blockSums.data() + block * ng;
+    for (int i = first; i < first + n; i++)
       {
-      sum = 0;
-      for (int j = 0; j < m_numOfGaussian; j++)
-        {
-        m_tmp1[j] = m_prior[i][j] * m_pdf[i][j];
-        sum += m_tmp1[j];
-        }
-      for (int j = 0; j < m_numOfGaussian; j++)
+      for (int j = 0; j < ng; j++)
+        log_pdf[j] = m_log_pdf[j][i];
+
+      for (int j = 0; j < ng; j++)
         {
-        m_latent[i][j] = m_tmp1[j] / sum;
-        m_sum[j] += m_latent[i][j];
+        double post = ComputePosterior(ng, log_pdf.data(), m_weight, logw.data_block(), j);
+        m_latent[j][i] = post;
+        bsum[j] += post;
         }
       }
-      */
-    }
+    }, nullptr);
+
+  for (int b = 0; b < nb; b++)
+    for (int j = 0; j < ng; j++)
+      m_sum[j] += m_blockSums[b * ng + j];
 }
 
 void EMGaussianMixtures::UpdateMean(void)
 {
-  for (int i = 0; i < m_numOfGaussian; i++)
+  // Each block computes the latent-weighted sums of the samples for each class
+  int nb = GetNumberOfBlocks(), ng = m_numOfGaussian, nd = m_dimOfGaussian;
+  m_blockSums.assign((size_t) nb * ng * nd, 0.0);
+
+  itk::MultiThreaderBase::Pointer mt = itk::MultiThreaderBase::New();
+  mt->ParallelizeArray(0, nb, [&](itk::SizeValueType block)
     {
-    for (int j = 0; j < m_dimOfGaussian; j++)
-      {
-      m_tmp2[j] = 0;
-      }
-    
-    for (int j = 0; j < m_numOfData; j++)
+    int first, n;
+    GetBlockRange(block, first, n);
+    double *bsum = m_blockSums.data() + block * ng * nd;
+    for (int j = 0; j < ng; j++)
       {
-      for (int k = 0; k < m_dimOfGaussian; k++)
+      const double *w = m_latent[j] + first;
+      for (int k = 0; k < nd; k++)
         {
-        m_tmp2[k] += m_latent[j][i] * m_x[j][k];
+        const double *xk = m_data.data() + (size_t) k * m_numOfData + first;
+        double sum = 0;
+        for (int s = 0; s < n; s++)
+          sum += w[s] * xk[s];
+        bsum[j * nd + k] = sum;
         }
       }
+    }, nullptr);
+
+  for (int i = 0; i < ng; i++)
+    {
+    for (int k = 0; k < nd; k++)
+      {
+      m_tmp2[k] = 0;
+      for (int b = 0; b < nb; b++)
+        m_tmp2[k] += m_blockSums[(b * ng + i) * nd + k];
+      }
 
     // This can lead to a possible divide by zero situation. In case the sum
     // of latent variables for class i is zero, we set the mean of that class
     // to infinity
     if(m_sum[i] > 0)
       {
-      for (int j = 0; j < m_dimOfGaussian; j++)
+      for (int j = 0; j < nd; j++)
         {
         m_tmp2[j] = m_tmp2[j] / m_sum[i];
         }
       }
     else
       {
-      for (int j = 0; j < m_dimOfGaussian; j++)
+      for (int j = 0; j < nd; j++)
         {
         m_tmp2[j] = - std::numeric_limits<double>::infinity();
         }
       }
 
-
-    m_gmm->SetMean(i, VectorType(m_tmp2, m_dimOfGaussian));
+    m_gmm->SetMean(i, VectorType(m_tmp2, nd));
     }
 }
 
 void EMGaussianMixtures::UpdateCovariance(void)
 {
-  for (int i = 0; i < m_numOfGaussian; i++)
+  // Each block computes the latent-weighted sums of the outer products of the
+  // mean-subtracted samples for each class. Only the upper triangle is summed
+  int nb = GetNumberOfBlocks(), ng = m_numOfGaussian, nd = m_dimOfGaussian;
+  m_blockSums.assign((size_t) nb * ng * nd * nd, 0.0);
+
+  std::vector<VectorType> means(ng);
+  for (int i = 0; i < ng; i++)
+    means[i] = m_gmm->GetMean(i);
+
+  itk::MultiThreaderBase::Pointer mt = itk::MultiThreaderBase::New();
+  mt->ParallelizeArray(0, nb, [&](itk::SizeValueType block)
     {
-    const VectorType &current_mean = m_gmm->GetMean(i);
-    
-    for (int j = 0; j < m_dimOfGaussian; j++)
+    int first, n;
+    GetBlockRange(block, first, n);
+    std::vector<double> dx((size_t) nd * n), wdx(n);
+    for (int j = 0; j < ng; j++)
       {
-      for (int k = 0; k < m_dimOfGaussian; k++)
+      double *bsum = m_blockSums.data() + (block * ng + j) * nd * nd;
+      const double *w = m_latent[j] + first;
+      for (int k = 0; k < nd; k++)
         {
-        m_tmp3[j*m_dimOfGaussian+k] = 0;
+        const double *xk = m_data.data() + (size_t) k * m_numOfData + first;
+        double *dxk = dx.data() + (size_t) k * n;
+        for (int s = 0; s < n; s++)
+          dxk[s] = xk[s] - means[j][k];
         }
-      }
-    
-    for (int j = 0; j < m_numOfData; j++)
-      {
-      for (int k = 0; k < m_dimOfGaussian; k++)
-        {
-        m_tmp2[k] = m_x[j][k] - current_mean[k];
-        }
-      for (int k = 0; k < m_dimOfGaussian; k++)
+
+      for (int k = 0; k < nd; k++)
         {
-        for (int l = 0; l < m_dimOfGaussian; l++)
+        const double *dxk = dx.data() + (size_t) k * n;
+        for (int s = 0; s < n; s++)
+          wdx[s] = w[s] * dxk[s];
+
+        for (int l = k; l < nd; l++)
           {
-          m_tmp3[k*m_dimOfGaussian+l] += m_tmp2[k] * m_tmp2[l] * m_latent[j][i];
+          const double *dxl = dx.data() + (size_t) l * n;
+          double sum = 0;
+          for (int s = 0; s < n; s++)
+            sum += wdx[s] * dxl[s];
+          bsum[k * nd + l] = sum;
           }
         }
       }
+    }, nullptr);
+
+  for (int i = 0; i < ng; i++)
+    {
+    for (int k = 0; k < nd; k++)
+      {
+      for (int l = k; l < nd; l++)
+        {
+        double sum = 0;
+        for (int b = 0; b < nb; b++)
+          sum += m_blockSums[((b * ng + i) * nd + k) * nd + l];
+        m_tmp3[k * nd + l] = m_tmp3[l * nd + k] = sum;
+        }
+      }
 
     if(m_sum[i] > 0)
       {
-      for (int j = 0; j < m_dimOfGaussian*m_dimOfGaussian; j++)
+      for (int j = 0; j < nd * nd; j++)
         {
         m_tmp3[j] = m_tmp3[j] / m_sum[i];
         }
       }
     else
       {
-      for (int j = 0; j < m_dimOfGaussian*m_dimOfGaussian; j++)
+      for (int j = 0; j < nd * nd; j++)
         {
         m_tmp3[j] = 0.0;
         }
       }
 
-
-    m_gmm->SetCovariance(i, MatrixType(m_tmp3, m_dimOfGaussian, m_dimOfGaussian));
+    m_gmm->SetCovariance(i, MatrixType(m_tmp3, nd, nd));
     }
 }
 
@@ -434,35 +509,58 @@ void EMGaussianMixtures::UpdateWeight(void)
 
 double EMGaussianMixtures::EvaluateLogLikelihood(void)
 {
-  double tmp1 = 0;
-  double tmp2 = 0;
-  if (m_setPriorFlag == 0)
+  // Delta functions are left out of the likelihood
+  std::vector<bool> isDelta(m_numOfGaussian);
+  for (int j = 0; j < m_numOfGaussian; j++)
     {
-    for (int i = 0; i < m_numOfData; i++)
-      {
-      tmp1 = 0;
-      for (int j = 0; j < m_numOfGaussian; j++)
-        {
-        if(!m_gmm->GetGaussian(j)->isDeltaFunction())
-          tmp1 += m_weight[j] * exp(m_log_pdf[i][j]);
-        }
-      tmp2 += log(tmp1);
-      }
+    isDelta[j] = m_gmm->GetGaussian(j)->isDeltaFunction();
     }
-  else
+
+  int nb = GetNumberOfBlocks(), ng = m_numOfGaussian;
+  m_blockSums.assign(nb, 0.0);
+
+  itk::MultiThreaderBase::Pointer mt = itk::MultiThreaderBase::New();
+  mt->ParallelizeArray(0, nb, [&](itk::SizeValueType block)
     {
-    for (int i = 0; i < m_numOfData; i++)
+    int first, n;
+    GetBlockRange(block, first, n);
+    std::vector<double> a(ng);
+    double sum = 0;
+    for (int i = first; i < first + n; i++)
       {
-      tmp1 = 0;
-      for (int j = 0; j < m_numOfGaussian; j++)
+      // As in ComputePosterior, the log of Sum_j[ w[j] * N(x_i; m_j, Sigma_j) ]
+      // is computed from a_j = log(w[j]) + log(N(x_i; m_j, Sigma_j)) as
+      //   a_max + log(Sum_j[ exp(a_j - a_max) ])
+      // so that it stays finite when all of the densities underflow
+      double amax = -std::numeric_limits<double>::infinity();
+      for (int j = 0; j < ng; j++)
+        {
+        double w = m_setPriorFlag ? m_prior[i][j] : m_weight[j];
+        a[j] = (!isDelta[j] && w > 0) ? log(w) + m_log_pdf[j][i]
+                                      : -std::numeric_limits<double>::infinity();
+        amax = std::max(amax, a[j]);
+        }
+
+      if (amax == -std::numeric_limits<double>::infinity())
         {
-        if(!m_gmm->GetGaussian(j)->isDeltaFunction())
-          tmp1 += m_prior[i][j] * exp(m_log_pdf[i][j]);
+        sum += amax;
+        continue;
         }
-      tmp2 += log(tmp1);
+
+      double p = 0;
+      for (int j = 0; j < ng; j++)
+        {
+        p += exp(a[j] - amax);
+        }
+      sum += amax + log(p);
       }
-    }
-  return tmp1;
+    m_blockSums[block] = sum;
+    }, nullptr);
+
+  double loglik = 0;
+  for (int b = 0; b < nb; b++)
+    loglik += m_blockSums[b];
+  return loglik;
 }
 
 void EMGaussianMixtures::PrintParameters(void)
@@ -3,7 +3,15 @@
 
 #include "GaussianMixtureModel.h"
 #include "SNAPCommon.h"
+#include <vector>
 
+/**
+ * Expectation-maximization for Gaussian mixture models. The samples passed to
+ * the constructor are copied into a buffer stored by dimension, and the E and
+ * M steps are computed in parallel over fixed blocks of samples. The partial
+ * sums of the blocks are added up in block order, so the result does not
+ * depend on the number of threads.
+ */
 class EMGaussianMixtures
 {
 public:
@@ -29,6 +37,7 @@ public:
   
   int GetMaxIteration(void);
 
+  // These return the posterior probabilities, indexed [class][sample]
   double ** Update(void);
   double ** UpdateOnce(void);
   double EvaluateLogLikelihood(void);
@@ -42,7 +51,20 @@ private:
   void UpdateMean(void);
   void UpdateCovariance(void);
   void UpdateWeight(void);
-  
+
+  // Number of samples in each block that is processed by a single thread
+  static const int BLOCK_SIZE = 4096;
+
+  // Number of blocks and the range of samples in a block
+  int GetNumberOfBlocks() const;
+  void GetBlockRange(int block, int &first, int &n) const;
+
+  // Samples stored by dimension: component k of sample i is m_data[k*N + i]
+  std::vector<double> m_data;
+
+  // Partial sums computed for each block
+  std::vector<double> m_blockSums;
+
   double **m_latent;
   double **m_log_pdf;
   double **m_prior;
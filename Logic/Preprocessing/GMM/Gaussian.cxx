@@ -95,6 +95,48 @@ double Gaussian::EvaluateLogPDF(VectorType &x, VectorType &xscratch)
   return 0.5 * logz;
 }
 
+void Gaussian::EvaluateLogPDF(
+    const double *x, long stride, int n, double *logp, double *zscratch) const
+{
+  // Same computation as above, but with the loop over the samples innermost,
+  // so that each step is a simple loop over contiguous arrays
+  for(int s = 0; s < n; s++)
+    logp[s] = 0.0;
+
+  for(int i = 0; i < m_dimension; i++)
+    {
+    // Projection of the mean-subtracted samples on the i-th eigenvector
+    for(int s = 0; s < n; s++)
+      zscratch[s] = 0.0;
+
+    for(int j = 0; j < m_dimension; j++)
+      {
+      double v = m_Vt(i,j), mu = m_mean_vector[j];
+      const double *xj = x + j * stride;
+      for(int s = 0; s < n; s++)
+        zscratch[s] += v * (xj[s] - mu);
+      }
+
+    if(m_Lambda[i] == 0)
+      {
+      // Zero variance: p(x) = 0 unless z[i] == 0, in which case p(z[i]) = 1
+      for(int s = 0; s < n; s++)
+        if(zscratch[s] != 0)
+          logp[s] = -std::numeric_limits<double>::infinity();
+      }
+    else
+      {
+      double nf = m_DiagNormFac[i], inv_lambda = 1.0 / m_Lambda[i];
+      for(int s = 0; s < n; s++)
+        logp[s] -= nf + zscratch[s] * zscratch[s] * inv_lambda;
+      }
+    }
+
+  // Final value needs to be divided by two
+  for(int s = 0; s < n; s++)
+    logp[s] *= 0.5;
+}
+
 double Gaussian::EvaluatePDF(double *x)
 {
   // We got to exponentiate somewhere, so might as well do it here
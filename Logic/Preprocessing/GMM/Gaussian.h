@@ -26,6 +26,13 @@ public:
   // Evaluate log PDF with user-provided scratch buffer
   double EvaluateLogPDF(VectorType &x, VectorType &xscratch);
 
+  // Evaluate log PDF for n samples stored by dimension, i.e., component d of
+  // sample i is x[d * stride + i]. The result is written to logp[0..n-1] and
+  // zscratch must hold n values. This method does not modify the Gaussian and
+  // may be called from several threads at once
+  void EvaluateLogPDF(const double *x, long stride, int n,
+                      double *logp, double *zscratch) const;
+
   void PrintParameters();
 
   // Tests whether the Gaussian is a delta function (i.e., has zero total variance)
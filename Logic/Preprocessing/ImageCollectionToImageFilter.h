@@ -176,6 +176,23 @@ public:
     return *(dataPtr);
   }
 
+  /** Offset in the buffer of a voxel, for use with NeighborValueAt() */
+  OffsetValueType ComputeOffset(const IndexType &index) const
+  {
+    return m_DummyImage->ComputeOffset(index);
+  }
+
+  /**
+   * Get a component in the neighborhood of the voxel at a given offset. This
+   * does not move the iterator, so it can be called from several threads
+   */
+  const InternalPixelType &NeighborValueAt(
+      OffsetValueType offset, unsigned int comp, unsigned int nbr_idx) const
+  {
+    offset += m_NeighborhoodOffsetTable[nbr_idx];
+    return *(m_Start[comp] + offset * m_OffsetScaling[comp]);
+  }
+
 protected:
 
   // Collection of scalar images
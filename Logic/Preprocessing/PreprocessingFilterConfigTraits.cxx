@@ -35,6 +35,7 @@
 
 #include "PreprocessingFilterConfigTraits.h"
 #include "SlicePreviewFilterWrapper.h"
+#include "SlicePreviewTileCache.h"
 #include "GMMClassifyImageFilter.h"
 #include "GMMClassifyImageFilter.txx"
 #include "RandomForestClassifyImageFilter.h"
@@ -75,6 +76,22 @@ SmoothBinaryThresholdFilterConfigTraits
   // Parameters are associated with the layer, so there is nothing to do here
 }
 
+std::size_t
+SmoothBinaryThresholdFilterConfigTraits
+::GetParameterHash(FilterType *filter)
+{
+  // The thresholds are modified in place by the GUI, so they are hashed by value
+  ThresholdSettings *ts = filter->GetParameters();
+  if(!ts)
+    return 0;
+
+  std::size_t hash = std::hash<int>()(ts->GetThresholdMode());
+  SlicePreviewHashCombine(hash, std::hash<float>()(ts->GetLowerThreshold()));
+  SlicePreviewHashCombine(hash, std::hash<float>()(ts->GetUpperThreshold()));
+  SlicePreviewHashCombine(hash, std::hash<float>()(ts->GetSmoothness()));
+  return hash;
+}
+
 void SmoothBinaryThresholdFilterConfigTraits::SetActiveScalarLayer(
     ScalarImageWrapperBase *layer, SmoothBinaryThresholdFilterConfigTraits::FilterType *filter, int channel)
 {
@@ -134,6 +151,20 @@ EdgePreprocessingFilterConfigTraits
   filter->SetParameters(p);
 }
 
+std::size_t
+EdgePreprocessingFilterConfigTraits
+::GetParameterHash(FilterType *filter)
+{
+  EdgePreprocessingSettings *eps = filter->GetParameters();
+  if(!eps)
+    return 0;
+
+  std::size_t hash = std::hash<float>()(eps->GetGaussianBlurScale());
+  SlicePreviewHashCombine(hash, std::hash<float>()(eps->GetRemappingSteepness()));
+  SlicePreviewHashCombine(hash, std::hash<float>()(eps->GetRemappingExponent()));
+  return hash;
+}
+
 
 
 void
@@ -66,6 +66,7 @@ public:
   static void AttachInputs(SNAPImageData *sid, FilterType *filter, int channel);
   static void DetachInputs(FilterType *filter);
   static void SetParameters(ParameterType *p, FilterType *filter, int channel);
+  static std::size_t GetParameterHash(FilterType *filter);
   static bool GetDefaultPreviewMode() { return true; }
 
   // This filter always has preview ready
@@ -91,6 +92,7 @@ public:
   static void AttachInputs(SNAPImageData *sid, FilterType *filter, int channel);
   static void DetachInputs(FilterType *filter);
   static void SetParameters(ParameterType *p, FilterType *filter, int channel);
+  static std::size_t GetParameterHash(FilterType *filter);
   static bool GetDefaultPreviewMode() { return true; }
 
   // This filter always has preview ready
@@ -120,6 +122,10 @@ public:
   static void AttachInputs(SNAPImageData *sid, FilterType *filter, int channel);
   static void DetachInputs(FilterType *filter);
   static void SetParameters(ParameterType *p, FilterType *filter, int channel);
+
+  // The mixture model is not a pipeline input; the filter is marked as
+  // modified when it changes
+  static std::size_t GetParameterHash(FilterType *filter) { return 0; }
   static bool GetDefaultPreviewMode() { return true; }
 
   // This filter always has preview ready
@@ -150,6 +156,10 @@ public:
   static void AttachInputs(SNAPImageData *sid, FilterType *filter, int channel);
   static void DetachInputs(FilterType *filter);
   static void SetParameters(ParameterType *p, FilterType *filter, int channel);
+
+  // The classifier is not a pipeline input; the filter is marked as modified
+  // when it is retrained
+  static std::size_t GetParameterHash(FilterType *filter) { return 0; }
   static bool GetDefaultPreviewMode() { return true; }
 
   // This filter always has preview ready
@@ -5,11 +5,176 @@
 #include "ImageWrapper.h"
 #include "ImageCollectionToImageFilter.h"
 #include "RLEImageRegionIterator.h"
+#include "itkImageRegionConstIteratorWithIndex.h"
+#include "itkMultiThreaderBase.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <random>
 
 // Includes from the random forest library
 #include "Library/classification.h"
 #include "Library/data.h"
 
+// Maximum number of labeled voxels from which the training sample is drawn
+static const unsigned long MAX_SAMPLES = 100000;
+
+// Call f(idx, a, b, label) for the span [a,b) of each run of a non-zero
+// label within the region, with idx holding the y and z of the run's line
+template <class TFunction>
+static void
+ForEachLabeledRun(const LabelImageWrapper::ImageType *imgSeg,
+                  const itk::ImageRegion<3> &region, TFunction f)
+{
+  typedef LabelImageWrapper::ImageType LabelImageType;
+  typedef LabelImageType::BufferType LabelBufferType;
+
+  long x0 = region.GetIndex(0), x1 = x0 + region.GetSize(0);
+  LabelBufferType *lines = imgSeg->GetBuffer();
+  itk::ImageRegionConstIteratorWithIndex<LabelBufferType> itLine(
+        lines, LabelImageType::truncateRegion(region));
+  for(; !itLine.IsAtEnd(); ++itLine)
+    {
+    const LabelImageType::RLLine &line = itLine.Value();
+    itk::Index<3> idx = {{ 0, itLine.GetIndex()[0], itLine.GetIndex()[1] }};
+
+    long x = imgSeg->GetBufferedRegion().GetIndex(0);
+    for(size_t iSeg = 0; iSeg < line.size() && x < x1; x += line[iSeg++].first)
+      {
+      // Clip the run to the region
+      long a = std::max(x, x0), b = std::min(x + (long) line[iSeg].first, x1);
+      if(line[iSeg].second && a < b)
+        f(idx, a, b, line[iSeg].second);
+      }
+    }
+}
+
+// Uniform random sample of fixed size from the voxels of one label, using
+// reservoir sampling with geometric skips (Li's algorithm L): once the
+// reservoir is full, the position of the next voxel to take is drawn
+// directly, so the runs in between cost nothing
+class LabelReservoir
+{
+public:
+  typedef std::pair<itk::Index<3>, LabelType> SampleVoxel;
+
+  LabelReservoir(unsigned long capacity, std::mt19937 *rng)
+    : m_Capacity(capacity), m_RNG(rng), m_Pick(0, capacity ? capacity - 1 : 0),
+      m_W(0.0), m_Seen(0), m_Next(0)
+  {
+    if(capacity)
+      {
+      m_Sample.reserve(capacity);
+      m_W = std::exp(LogU() / capacity);
+      m_Next = capacity + Skip();
+      }
+  }
+
+  // Offer the voxels [a,b) of the line idx, all with the given label
+  void AddRun(itk::Index<3> idx, long a, long b, LabelType label)
+  {
+    if(!m_Capacity)
+      return;
+
+    // Fill the reservoir first
+    for(; a < b && m_Sample.size() < m_Capacity; a++, m_Seen++)
+      {
+      idx[0] = a;
+      m_Sample.push_back(SampleVoxel(idx, label));
+      }
+
+    // Replace random entries at the skip positions that fall in this run
+    unsigned long nEnd = m_Seen + (b - a);
+    while(m_Next < nEnd)
+      {
+      idx[0] = a + (m_Next - m_Seen);
+      m_Sample[m_Pick(*m_RNG)] = SampleVoxel(idx, label);
+      m_W *= std::exp(LogU() / m_Capacity);
+      m_Next += 1 + Skip();
+      }
+    m_Seen = nEnd;
+  }
+
+  const std::vector<SampleVoxel> &GetSample() const { return m_Sample; }
+
+protected:
+  double LogU() { return std::log(1.0 - m_Unif(*m_RNG)); }
+  unsigned long Skip()
+    { return (unsigned long) std::min(std::floor(LogU() / std::log(1.0 - m_W)), 1.0e15); }
+
+  unsigned long m_Capacity;
+  std::mt19937 *m_RNG;
+  std::uniform_real_distribution<double> m_Unif;
+  std::uniform_int_distribution<unsigned long> m_Pick;
+  std::vector<SampleVoxel> m_Sample;
+  double m_W;
+  unsigned long m_Seen, m_Next;
+};
+
+template <class TPixel, class TLabel, int VDim>
+std::vector<typename RFClassificationEngine<TPixel,TLabel,VDim>::SampleVoxel>
+RFClassificationEngine<TPixel,TLabel,VDim>
+::SampleLabeledVoxels(const LabelImageType *imgSeg,
+                      const itk::ImageRegion<3> &region, unsigned long maxSamples)
+{
+  // Count the voxels of each label. This only visits the runs
+  std::map<LabelType, unsigned long> counts;
+  unsigned long nTotal = 0;
+  ForEachLabeledRun(imgSeg, region,
+                    [&](const itk::Index<3> &, long a, long b, LabelType label)
+    {
+    counts[label] += b - a;
+    nTotal += b - a;
+    });
+
+  // Split the sample between the labels. Every label is guaranteed an equal
+  // share of half of the sample (or all of its voxels, if it has fewer), and
+  // the rest is split in proportion to the remaining voxels. Otherwise, a
+  // label drawn by the user with a few strokes would be all but absent from
+  // a sample dominated by a large structure
+  std::map<LabelType, unsigned long> quota;
+  if(nTotal <= maxSamples)
+    {
+    quota = counts;
+    }
+  else
+    {
+    unsigned long minShare = maxSamples / (2 * counts.size());
+    unsigned long nGuaranteed = 0, nRest = 0;
+    for(auto &it : counts)
+      {
+      quota[it.first] = std::min(it.second, minShare);
+      nGuaranteed += quota[it.first];
+      nRest += it.second - quota[it.first];
+      }
+
+    double frac = nRest ? (maxSamples - nGuaranteed) / (double) nRest : 0.0;
+    for(auto &it : counts)
+      quota[it.first] += (unsigned long) ((it.second - quota[it.first]) * frac);
+    }
+
+  // Draw a uniform sample of each label. The generator is seeded with a
+  // constant so that training on the same data is repeatable
+  std::mt19937 rng(12345);
+  std::map<LabelType, LabelReservoir> reservoirs;
+  for(auto &it : quota)
+    reservoirs.emplace(it.first, LabelReservoir(it.second, &rng));
+
+  ForEachLabeledRun(imgSeg, region,
+                    [&](const itk::Index<3> &idx, long a, long b, LabelType label)
+    {
+    reservoirs.find(label)->second.AddRun(idx, a, b, label);
+    });
+
+  std::vector<SampleVoxel> sample;
+  sample.reserve(std::min(nTotal, maxSamples));
+  for(auto &it : reservoirs)
+    sample.insert(sample.end(), it.second.GetSample().begin(), it.second.GetSample().end());
+
+  return sample;
+}
+
 template <class TPixel, class TLabel, int VDim>
 RFClassificationEngine<TPixel,TLabel,VDim>::RFClassificationEngine()
 {
@@ -69,18 +234,16 @@ void RFClassificationEngine<TPixel,TLabel,VDim>:: TrainClassifier()
   // TODO: this is defaulting to the first image - is this correct?
   LabelImageWrapper *wrpSeg = m_DataSource->GetFirstSegmentationLayer();
   const LabelImageWrapper::ImageType *imgSeg = wrpSeg->GetImage();
-  typedef itk::ImageRegionConstIteratorWithIndex<LabelImageWrapper::ImageType> LabelIter;
 
   // Shrink the buffered region by radius because we can't handle BCs
   itk::ImageRegion<3> reg = imgSeg->GetBufferedRegion();
   reg.ShrinkByRadius(m_PatchRadius);
 
-  // We need to iterate throught the label image once to determine the
-  // number of samples to allocate.
-  unsigned long nSamples = 0;
-  for(LabelIter lit(imgSeg, reg); !lit.IsAtEnd(); ++lit)
-    if(lit.Value())
-      nSamples++;
+  // Find the labeled voxels by walking the runs of the segmentation, and keep
+  // a random sample of at most MAX_SAMPLES of them, stratified by label. The
+  // forest then subsamples about 10000 of these for each tree (see below)
+  std::vector<SampleVoxel> voxels = SampleLabeledVoxels(imgSeg, reg, MAX_SAMPLES);
+  unsigned long nSamples = voxels.size();
 
   // Create an iterator for going over all the anatomical image data
   CollectionIter cit(reg);
@@ -105,31 +268,29 @@ void RFClassificationEngine<TPixel,TLabel,VDim>:: TrainClassifier()
   // Create a new sample
   m_Sample = new SampleType(nSamples, nColumns);
 
-  // Now fill out the samples
-  int iSample = 0;
-  for(LabelIter lit(imgSeg, reg); !lit.IsAtEnd(); ++lit, ++cit)
+  // Now fill out the samples. Each row only depends on its voxel, so the rows
+  // are filled in parallel
+  itk::MultiThreaderBase::Pointer mt = itk::MultiThreaderBase::New();
+  mt->ParallelizeArray(0, nSamples, [&](itk::SizeValueType iSample)
     {
-    LabelType label = lit.Value();
-    if(label)
-      {
-      // Fill in the data
-      std::vector<GreyType> &column = m_Sample->data[iSample];
-      int k = 0;
-      for(int i = 0; i < nComp; i++)
-        for(int j = 0; j < nPatch; j++)
-          column[k++] = cit.NeighborValue(i,j);
-
-      // Add the coordinate features if used
-      if(m_UseCoordinateFeatures)
-        for(int d = 0; d < 3; d++)
-          column[k++] = lit.GetIndex()[d];
-
-      // Fill in the label
-      m_Sample->label[iSample] = label;
-
-      ++iSample;
-      }
-    }
+    const SampleVoxel &voxel = voxels[iSample];
+    typename CollectionIter::OffsetValueType offset = cit.ComputeOffset(voxel.first);
+
+    // Fill in the data
+    std::vector<GreyType> &column = m_Sample->data[iSample];
+    int k = 0;
+    for(int i = 0; i < nComp; i++)
+      for(int j = 0; j < nPatch; j++)
+        column[k++] = cit.NeighborValueAt(offset, i, j);
+
+    // Add the coordinate features if used
+    if(m_UseCoordinateFeatures)
+      for(int d = 0; d < 3; d++)
+        column[k++] = voxel.first[d];
+
+    // Fill in the label
+    m_Sample->label[iSample] = voxel.second;
+    }, nullptr);
 
   // Check that the sample has at least two distinct labels
   bool isValidSample = false;
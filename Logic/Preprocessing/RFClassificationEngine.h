@@ -5,6 +5,9 @@
 #include <itkObjectFactory.h>
 #include "SNAPCommon.h"
 #include <itkSize.h>
+#include <itkImageRegion.h>
+#include "RLEImage.h"
+#include <vector>
 
 template <class TPixel, class TLabel, int VDim> class RandomForestClassifier;
 template <class TData, class TLabel> class MLData;
@@ -62,6 +65,20 @@ public:
   /** Get the number of components passed to the classifier */
   int GetNumberOfComponents() const;
 
+  // A labeled voxel selected for the training sample
+  typedef std::pair<itk::Index<3>, LabelType> SampleVoxel;
+  typedef RLEImage<LabelType> LabelImageType;
+
+  /**
+   * Draw a random sample of at most maxSamples non-zero voxels of the
+   * segmentation within a region. The sample is stratified by label: each
+   * label is sampled uniformly, and gets at least an equal share of half of
+   * the sample, or all of its voxels if it has fewer.
+   */
+  static std::vector<SampleVoxel> SampleLabeledVoxels(
+      const LabelImageType *imgSeg, const itk::ImageRegion<3> &region,
+      unsigned long maxSamples);
+
 
 protected:
 
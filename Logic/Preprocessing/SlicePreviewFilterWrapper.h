@@ -15,6 +15,9 @@ namespace itk {
   template<class TIn, class TOut> class StreamingImageFilter;
 }
 
+template <class TFilterConfigTraits> class SlicePreviewTileCache;
+class SlicePreviewTileCacheBudget;
+
 class SNAPImageData;
 
 /**
@@ -85,6 +88,11 @@ protected:
 
         This sets the parameters of the filter
 
+    static std::size_t GetParameterHash(FilterType *filter)
+
+        This hashes the parameters that the filter gets as data objects, i.e.,
+        the ones that don't affect the filter's own modified time
+
 
   What does this filter do? It creates an assembly consisting
   of three slice preview filters, and one whole-volume filter. The four
@@ -105,6 +113,12 @@ protected:
   the parameters of the preview filters have not been changed since the last
   time the whole speed volume was generated, the preview filters are deemed
   to be up to date, and no preprocessing operations take place.
+
+  The slices computed by the preview filters are kept in a cache (see
+  SlicePreviewTileCache), so a slice that has already been computed with the
+  same parameters is not computed again. The caches are emptied when the
+  preview mode is turned off, and their memory is accounted for by a budget
+  that can be shared with other wrappers.
   */
 template<class TFilterConfigTraits>
 class SlicePreviewFilterWrapper : public AbstractSlicePreviewFilterWrapper
@@ -161,6 +175,9 @@ public:
   /** Compute the output volume (corresponds to the 'Apply' operation) */
   void ComputeOutputVolume(itk::Command *progress) ITK_OVERRIDE;
 
+  /** Set the memory budget of the slice caches */
+  void SetTileCacheBudget(SlicePreviewTileCacheBudget *budget);
+
 protected:
 
   SlicePreviewFilterWrapper();
@@ -180,6 +197,12 @@ protected:
   // So we can loop over all four filters
   FilterType *GetNthFilter(int);
 
+  // Caches of the slices computed by the preview filters
+  typedef SlicePreviewTileCache<TFilterConfigTraits> TileCacheType;
+  SmartPtr<TileCacheType> m_TileCache[3];
+
+  void ClearTileCaches();
+
   // Active scalar layer (for layers that support this functionality)
   ScalarImageWrapperBase *m_ActiveScalarLayer;
 
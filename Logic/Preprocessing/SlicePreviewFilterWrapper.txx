@@ -2,6 +2,7 @@
 #define SlicePreviewFilterWrapper_txx
 
 #include "SlicePreviewFilterWrapper.h"
+#include "SlicePreviewTileCache.h"
 
 #include "SmoothBinaryThresholdImageFilter.h"
 #include "EdgePreprocessingImageFilter.h"
@@ -21,8 +22,16 @@ SlicePreviewFilterWrapper<TFilterConfigTraits>
   m_VolumeFilter = FilterType::New();
   m_VolumeFilter->ReleaseDataFlagOn();
 
+  // Allocate the preview filters and the caches for their slices, which
+  // share a memory budget
+  SmartPtr<SlicePreviewTileCacheBudget> budget = SlicePreviewTileCacheBudget::New();
   for(int i = 0; i < 3; i++)
+    {
     m_PreviewFilter[i] = FilterType::New();
+    m_TileCache[i] = TileCacheType::New();
+    m_TileCache[i]->SetFilter(m_PreviewFilter[i]);
+    m_TileCache[i]->SetBudget(budget);
+    }
 
   // Allocate the streamer and attach to the volume filter
   m_VolumeStreamer = Streamer::New();
@@ -47,6 +56,10 @@ SlicePreviewFilterWrapper<TFilterConfigTraits>
   for(int i = 0; i < 4; i++)
     Traits::SetParameters(param, this->GetNthFilter(i), i);
 
+  // The parameters passed here are new or retrained models, so the slices
+  // computed with the old ones will not be used again
+  this->ClearTileCaches();
+
   // After updates to the parameters/filters update the pipeline readiness
   // status in the output wrapper
   this->UpdateOutputPipelineReadyStatus();
@@ -77,6 +90,8 @@ SlicePreviewFilterWrapper<TFilterConfigTraits>
     if(m_ActiveScalarLayer)
       Traits::SetActiveScalarLayer(m_ActiveScalarLayer, this->GetNthFilter(i), i);
     }
+
+  this->ClearTileCaches();
 }
 
 template <class TFilterConfigTraits>
@@ -89,6 +104,10 @@ SlicePreviewFilterWrapper<TFilterConfigTraits>
     m_PreviewMode = mode;
     this->Modified();
     this->UpdatePipeline();
+
+    // The cached slices are not kept when there is nothing to preview
+    if(!m_PreviewMode)
+      this->ClearTileCaches();
     }
 }
 
@@ -127,6 +146,7 @@ SlicePreviewFilterWrapper<TFilterConfigTraits>
     Traits::DetachInputs(this->GetNthFilter(i));
     }
 
+  this->ClearTileCaches();
   m_ActiveScalarLayer = NULL;
 }
 
@@ -139,9 +159,9 @@ SlicePreviewFilterWrapper<TFilterConfigTraits>
     {
     if(m_PreviewMode)
       {
-      // Attach the pipeline filters
+      // Attach the pipeline filters, through the slice caches
       m_OutputWrapper->AttachPreviewPipeline(
-            m_PreviewFilter[0], m_PreviewFilter[1], m_PreviewFilter[2]);
+            m_TileCache[0], m_TileCache[1], m_TileCache[2]);
 
       this->UpdateOutputPipelineReadyStatus();
       }
@@ -202,7 +222,26 @@ SlicePreviewFilterWrapper<TFilterConfigTraits>
   m_ActiveScalarLayer = layer;
   for(int i = 0; i < 4; i++)
     Traits::SetActiveScalarLayer(m_ActiveScalarLayer, this->GetNthFilter(i), i);
+  this->ClearTileCaches();
   this->Modified();
 }
 
+template <class TFilterConfigTraits>
+void
+SlicePreviewFilterWrapper<TFilterConfigTraits>
+::SetTileCacheBudget(SlicePreviewTileCacheBudget *budget)
+{
+  for(int i = 0; i < 3; i++)
+    m_TileCache[i]->SetBudget(budget);
+}
+
+template <class TFilterConfigTraits>
+void
+SlicePreviewFilterWrapper<TFilterConfigTraits>
+::ClearTileCaches()
+{
+  for(int i = 0; i < 3; i++)
+    m_TileCache[i]->ClearCache();
+}
+
 #endif // SlicePreviewFilterWrapper_txx
\ No newline at end of file
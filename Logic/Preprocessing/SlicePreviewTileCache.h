@@ -0,0 +1,128 @@
+#ifndef SLICEPREVIEWTILECACHE_H
+#define SLICEPREVIEWTILECACHE_H
+
+#include "SNAPCommon.h"
+#include "itkImageSource.h"
+#include "SlicePreviewTileCacheBudget.h"
+#include <list>
+#include <map>
+#include <vector>
+
+/**
+  This filter sits between one of the preview filters of the
+  SlicePreviewFilterWrapper and the slicer that displays its output. It keeps
+  the slices computed by the preview filter, keyed by a hash of the filter's
+  parameters and inputs and by the region of the slice. When the slicer asks
+  for a slice that has been computed before with the same parameters (e.g.,
+  the user moves the cursor back to a slice, or drags a threshold slider back
+  and forth), the slice is copied from the cache and the preview filter does
+  not execute.
+
+  The preview filter is not a pipeline input of this filter, since that would
+  cause it to re-execute whenever its parameters change. Instead, this filter
+  checks the pipeline time of the preview filter in UpdateOutputInformation()
+  and updates the preview filter itself, one slice at a time, on a cache miss.
+
+  The parameter hash is computed by Traits::GetParameterHash(), which should
+  cover the parameters that are passed to the filter as data objects (and
+  thus don't affect its own modified time). The modified time of the filter
+  and the modified times of its image inputs are added to the hash here.
+
+  The memory taken by the cached slices is accounted for by a
+  SlicePreviewTileCacheBudget, which may be shared with other caches. When
+  the budget is exceeded, the least recently used slices among all of its
+  caches are discarded.
+  */
+template <class TFilterConfigTraits>
+class SlicePreviewTileCache
+    : public itk::ImageSource<typename TFilterConfigTraits::FilterType::OutputImageType>,
+      public SlicePreviewTileCacheBudget::Client
+{
+public:
+
+  typedef typename TFilterConfigTraits::FilterType                FilterType;
+  typedef typename FilterType::OutputImageType               OutputImageType;
+  typedef typename OutputImageType::PixelType                      PixelType;
+  typedef typename OutputImageType::RegionType                    RegionType;
+
+  typedef SlicePreviewTileCache<TFilterConfigTraits>                    Self;
+  typedef itk::ImageSource<OutputImageType>                       Superclass;
+  typedef SmartPtr<Self>                                             Pointer;
+  typedef SmartPtr<const Self>                                  ConstPointer;
+
+  itkTypeMacro(SlicePreviewTileCache, itk::ImageSource)
+
+  itkNewMacro(Self)
+
+  /** Set the preview filter whose slices are cached */
+  void SetFilter(FilterType *filter);
+
+  /** Set the memory budget. By default, each cache has a budget of its own */
+  void SetBudget(SlicePreviewTileCacheBudget *budget);
+  irisGetMacro(Budget, SlicePreviewTileCacheBudget *)
+
+  /** Total size of the slices in this cache, in bytes */
+  irisGetMacro(MemoryUsed, unsigned long)
+
+  /** Discard all cached slices */
+  void ClearCache();
+
+  /** Statistics: slices found in the cache, slices computed */
+  irisGetMacro(NumberOfHits, unsigned long)
+  irisGetMacro(NumberOfMisses, unsigned long)
+
+  /** Check if the preview filter has changed before the pipeline update */
+  virtual void UpdateOutputInformation() ITK_OVERRIDE;
+
+  /** Budget client interface */
+  virtual unsigned long GetOldestTileTime() const ITK_OVERRIDE;
+  virtual unsigned long DiscardOldestTile() ITK_OVERRIDE;
+
+protected:
+
+  SlicePreviewTileCache();
+  ~SlicePreviewTileCache();
+
+  virtual void GenerateOutputInformation() ITK_OVERRIDE;
+  virtual void GenerateData() ITK_OVERRIDE;
+
+  // Hash of the parameters and inputs of the preview filter
+  std::size_t ComputeParameterHash();
+
+  // Key of a cached slice: the parameter hash and the region
+  struct TileKey
+  {
+    std::size_t hash;
+    long index[3], size[3];
+    bool operator < (const TileKey &other) const;
+  };
+
+  // Slices in order of use, with the time of their last use
+  typedef std::list<std::pair<TileKey, unsigned long> > LRUList;
+
+  struct Tile
+  {
+    std::vector<PixelType> data;
+    typename LRUList::iterator lru;
+  };
+
+  typedef std::map<TileKey, Tile> TileMap;
+
+  SmartPtr<FilterType> m_Filter;
+  itk::ModifiedTimeType m_FilterPipelineMTime;
+
+  // Cached slices and their order of use, most recent first
+  TileMap m_Tiles;
+  LRUList m_LRU;
+  unsigned long m_MemoryUsed;
+
+  SmartPtr<SlicePreviewTileCacheBudget> m_Budget;
+
+  unsigned long m_NumberOfHits, m_NumberOfMisses;
+};
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "SlicePreviewTileCache.txx"
+#endif
+
+#endif // SLICEPREVIEWTILECACHE_H
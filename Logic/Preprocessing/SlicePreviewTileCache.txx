@@ -0,0 +1,229 @@
+#ifndef SlicePreviewTileCache_txx
+#define SlicePreviewTileCache_txx
+
+#include "SlicePreviewTileCache.h"
+#include "itkImageRegionConstIterator.h"
+#include "itkImageRegionIterator.h"
+#include <functional>
+
+// Mix a value into a hash (same as boost::hash_combine)
+inline void SlicePreviewHashCombine(std::size_t &seed, std::size_t value)
+{
+  seed ^= value + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+}
+
+template <class TFilterConfigTraits>
+SlicePreviewTileCache<TFilterConfigTraits>
+::SlicePreviewTileCache()
+{
+  m_FilterPipelineMTime = 0;
+  m_MemoryUsed = 0;
+  m_NumberOfHits = 0;
+  m_NumberOfMisses = 0;
+
+  m_Budget = SlicePreviewTileCacheBudget::New();
+  m_Budget->AddClient(this);
+}
+
+template <class TFilterConfigTraits>
+SlicePreviewTileCache<TFilterConfigTraits>
+::~SlicePreviewTileCache()
+{
+  this->ClearCache();
+  m_Budget->RemoveClient(this);
+}
+
+template <class TFilterConfigTraits>
+void
+SlicePreviewTileCache<TFilterConfigTraits>
+::SetBudget(SlicePreviewTileCacheBudget *budget)
+{
+  if(m_Budget != budget)
+    {
+    this->ClearCache();
+    m_Budget->RemoveClient(this);
+    m_Budget = budget;
+    m_Budget->AddClient(this);
+    }
+}
+
+template <class TFilterConfigTraits>
+bool
+SlicePreviewTileCache<TFilterConfigTraits>::TileKey
+::operator < (const TileKey &other) const
+{
+  if(hash != other.hash)
+    return hash < other.hash;
+  for(int d = 0; d < 3; d++)
+    {
+    if(index[d] != other.index[d])
+      return index[d] < other.index[d];
+    if(size[d] != other.size[d])
+      return size[d] < other.size[d];
+    }
+  return false;
+}
+
+template <class TFilterConfigTraits>
+void
+SlicePreviewTileCache<TFilterConfigTraits>
+::SetFilter(FilterType *filter)
+{
+  if(m_Filter != filter)
+    {
+    m_Filter = filter;
+    this->ClearCache();
+    this->Modified();
+    }
+}
+
+template <class TFilterConfigTraits>
+void
+SlicePreviewTileCache<TFilterConfigTraits>
+::ClearCache()
+{
+  m_Tiles.clear();
+  m_LRU.clear();
+  m_Budget->ReleaseMemory(m_MemoryUsed);
+  m_MemoryUsed = 0;
+}
+
+template <class TFilterConfigTraits>
+unsigned long
+SlicePreviewTileCache<TFilterConfigTraits>
+::GetOldestTileTime() const
+{
+  return m_LRU.size() ? m_LRU.back().second : 0;
+}
+
+template <class TFilterConfigTraits>
+unsigned long
+SlicePreviewTileCache<TFilterConfigTraits>
+::DiscardOldestTile()
+{
+  if(m_LRU.empty())
+    return 0;
+
+  typename TileMap::iterator itOld = m_Tiles.find(m_LRU.back().first);
+  unsigned long bytes = itOld->second.data.size() * sizeof(PixelType);
+  m_MemoryUsed -= bytes;
+  m_Tiles.erase(itOld);
+  m_LRU.pop_back();
+  return bytes;
+}
+
+template <class TFilterConfigTraits>
+void
+SlicePreviewTileCache<TFilterConfigTraits>
+::UpdateOutputInformation()
+{
+  // Bring the preview filter's pipeline up to date. If anything upstream of
+  // it has changed, our output is out of date as well
+  if(m_Filter)
+    {
+    m_Filter->UpdateOutputInformation();
+    itk::ModifiedTimeType t = m_Filter->GetOutput()->GetPipelineMTime();
+    if(t != m_FilterPipelineMTime)
+      {
+      m_FilterPipelineMTime = t;
+      this->Modified();
+      }
+    }
+
+  Superclass::UpdateOutputInformation();
+}
+
+template <class TFilterConfigTraits>
+void
+SlicePreviewTileCache<TFilterConfigTraits>
+::GenerateOutputInformation()
+{
+  if(m_Filter)
+    this->GetOutput()->CopyInformation(m_Filter->GetOutput());
+}
+
+template <class TFilterConfigTraits>
+std::size_t
+SlicePreviewTileCache<TFilterConfigTraits>
+::ComputeParameterHash()
+{
+  std::size_t hash = TFilterConfigTraits::GetParameterHash(m_Filter);
+  SlicePreviewHashCombine(hash, m_Filter->GetMTime());
+
+  // The image inputs are identified by their address and modified time
+  itk::ProcessObject::DataObjectPointerArray inputs = m_Filter->GetInputs();
+  for(unsigned int i = 0; i < inputs.size(); i++)
+    {
+    const itk::ImageBase<3> *image =
+        dynamic_cast<const itk::ImageBase<3> *>(inputs[i].GetPointer());
+    if(image)
+      {
+      SlicePreviewHashCombine(hash, std::hash<const void *>()(image));
+      SlicePreviewHashCombine(hash, image->GetMTime());
+      }
+    }
+
+  return hash;
+}
+
+template <class TFilterConfigTraits>
+void
+SlicePreviewTileCache<TFilterConfigTraits>
+::GenerateData()
+{
+  OutputImageType *output = this->GetOutput();
+  this->AllocateOutputs();
+
+  RegionType region = output->GetRequestedRegion();
+  typedef itk::ImageRegionIterator<OutputImageType> OutputIterator;
+
+  // Look up the slice
+  TileKey key;
+  key.hash = this->ComputeParameterHash();
+  for(int d = 0; d < 3; d++)
+    {
+    key.index[d] = region.GetIndex(d);
+    key.size[d] = region.GetSize(d);
+    }
+
+  typename TileMap::iterator it = m_Tiles.find(key);
+  if(it != m_Tiles.end())
+    {
+    // Copy the slice from the cache and mark it as recently used
+    m_NumberOfHits++;
+    const PixelType *p = it->second.data.data();
+    for(OutputIterator itOut(output, region); !itOut.IsAtEnd(); ++itOut, ++p)
+      itOut.Set(*p);
+
+    m_LRU.splice(m_LRU.begin(), m_LRU, it->second.lru);
+    it->second.lru->second = m_Budget->GetNextUseTime();
+    return;
+    }
+
+  // Have the preview filter compute the slice
+  m_NumberOfMisses++;
+  m_Filter->GetOutput()->SetRequestedRegion(region);
+  m_Filter->GetOutput()->Update();
+
+  // Copy the slice to the output and to the cache
+  Tile &tile = m_Tiles[key];
+  tile.data.resize(region.GetNumberOfPixels());
+  PixelType *p = tile.data.data();
+  itk::ImageRegionConstIterator<OutputImageType> itIn(m_Filter->GetOutput(), region);
+  for(OutputIterator itOut(output, region); !itOut.IsAtEnd(); ++itOut, ++itIn, ++p)
+    {
+    *p = itIn.Get();
+    itOut.Set(*p);
+    }
+
+  m_LRU.push_front(std::make_pair(key, m_Budget->GetNextUseTime()));
+  tile.lru = m_LRU.begin();
+
+  // Discard the least recently used slices of all the caches that share the
+  // budget, keeping the current one
+  unsigned long bytes = tile.data.size() * sizeof(PixelType);
+  m_MemoryUsed += bytes;
+  m_Budget->AddMemory(bytes);
+}
+
+#endif // SlicePreviewTileCache_txx
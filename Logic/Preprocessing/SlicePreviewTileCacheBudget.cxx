@@ -0,0 +1,65 @@
+#include "SlicePreviewTileCacheBudget.h"
+#include <algorithm>
+
+SlicePreviewTileCacheBudget::SlicePreviewTileCacheBudget()
+{
+  m_MaximumMemory = 64ul * 1024ul * 1024ul;
+  m_MemoryUsed = 0;
+  m_UseTime = 0;
+}
+
+void SlicePreviewTileCacheBudget::SetMaximumMemory(unsigned long bytes)
+{
+  if(m_MaximumMemory != bytes)
+    {
+    m_MaximumMemory = bytes;
+    this->Enforce();
+    this->Modified();
+    }
+}
+
+void SlicePreviewTileCacheBudget::AddClient(Client *client)
+{
+  if(std::find(m_Clients.begin(), m_Clients.end(), client) == m_Clients.end())
+    m_Clients.push_back(client);
+}
+
+void SlicePreviewTileCacheBudget::RemoveClient(Client *client)
+{
+  m_Clients.erase(std::remove(m_Clients.begin(), m_Clients.end(), client), m_Clients.end());
+}
+
+void SlicePreviewTileCacheBudget::AddMemory(unsigned long bytes)
+{
+  m_MemoryUsed += bytes;
+  this->Enforce();
+}
+
+void SlicePreviewTileCacheBudget::ReleaseMemory(unsigned long bytes)
+{
+  m_MemoryUsed -= std::min(bytes, m_MemoryUsed);
+}
+
+void SlicePreviewTileCacheBudget::Enforce()
+{
+  while(m_MemoryUsed > m_MaximumMemory)
+    {
+    // Find the cache holding the least recently used slice
+    Client *oldest = NULL;
+    unsigned long t_oldest = 0;
+    for(Client *client : m_Clients)
+      {
+      unsigned long t = client->GetOldestTileTime();
+      if(t > 0 && (!oldest || t < t_oldest))
+        {
+        oldest = client;
+        t_oldest = t;
+        }
+      }
+
+    if(!oldest || t_oldest == m_UseTime)
+      break;
+
+    this->ReleaseMemory(oldest->DiscardOldestTile());
+    }
+}
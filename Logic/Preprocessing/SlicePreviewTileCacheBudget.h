@@ -0,0 +1,73 @@
+#ifndef SLICEPREVIEWTILECACHEBUDGET_H
+#define SLICEPREVIEWTILECACHEBUDGET_H
+
+#include "SNAPCommon.h"
+#include "itkObject.h"
+#include "itkObjectFactory.h"
+#include <vector>
+
+/**
+ * \class SlicePreviewTileCacheBudget
+ * \brief The memory shared by the slice caches of the preview filters.
+ *
+ * Each SlicePreviewTileCache reports the memory taken by its slices to a
+ * budget, and stamps every slice with the time of its last use, obtained
+ * from the budget. When the total exceeds MaximumMemory, the budget discards
+ * the least recently used slice among all of its caches, so that the caches
+ * of the filter being previewed can use the memory held by the caches of the
+ * filters that are not. A single budget is shared by all of the preview
+ * wrappers of the application.
+ */
+class SlicePreviewTileCacheBudget : public itk::Object
+{
+public:
+  irisITKObjectMacro(SlicePreviewTileCacheBudget, itk::Object)
+
+  /** The interface of a cache that uses the budget */
+  class Client
+  {
+  public:
+    virtual ~Client() {}
+
+    /** Time of use of the least recently used slice, 0 if there are none */
+    virtual unsigned long GetOldestTileTime() const = 0;
+
+    /** Discard the least recently used slice and return its size */
+    virtual unsigned long DiscardOldestTile() = 0;
+  };
+
+  /** Maximum total size of the cached slices, in bytes */
+  void SetMaximumMemory(unsigned long bytes);
+  irisGetMacro(MaximumMemory, unsigned long)
+
+  /** Total size of the cached slices, in bytes */
+  irisGetMacro(MemoryUsed, unsigned long)
+
+  /** Add or remove a cache. A cache must release its memory before it is
+      removed */
+  void AddClient(Client *client);
+  void RemoveClient(Client *client);
+
+  /** Get a time stamp for a slice that has just been used */
+  unsigned long GetNextUseTime() { return ++m_UseTime; }
+
+  /** Account for a slice that has been added to a cache, discarding the
+      least recently used slices if the budget is exceeded */
+  void AddMemory(unsigned long bytes);
+
+  /** Account for slices that a cache has discarded */
+  void ReleaseMemory(unsigned long bytes);
+
+protected:
+  SlicePreviewTileCacheBudget();
+  virtual ~SlicePreviewTileCacheBudget() {}
+
+  // Discard slices until the budget is met. The most recently used slice is
+  // kept even if it alone exceeds the budget
+  void Enforce();
+
+  std::vector<Client *> m_Clients;
+  unsigned long m_MaximumMemory, m_MemoryUsed, m_UseTime;
+};
+
+#endif // SLICEPREVIEWTILECACHEBUDGET_H
@@ -3,6 +3,8 @@
 
 #include <utility> //std::pair
 #include <vector>
+#include <atomic>
+#include <mutex>
 #include <itkImageBase.h>
 #include <itkImage.h>
 
@@ -107,6 +109,7 @@ public:
         Superclass::Initialize();
         m_OnTheFlyCleanup = true;
         myBuffer = BufferType::New();
+        InvalidateSegmentIndex();
     }
 
     /** Fill the image buffer with a value.  Be sure to call Allocate()
@@ -144,6 +147,22 @@ public:
     * This method is used by iterators directly. */
     int SetPixel(RLLine & line, IndexValueType & segmentRemainder, IndexValueType & realIndex, const TPixel & value);
 
+    /** Replaces the values of pixels [x0, x1) of a line (relative to the start
+    * of the buffered region) by calling f(value, length) for each segment, or
+    * part of a segment, in that interval, in order, and using the value it
+    * returns. Segments are split and merged as needed, so the cost depends on
+    * the number of segments rather than on the number of pixels. Different
+    * lines may be changed from different threads at the same time. */
+    template <typename TFunction>
+    void TransformLineInterval(RLLine & line, IndexValueType x0, IndexValueType x1, TFunction f);
+
+    /** Replaces the values of the pixels x[0], ..., x[n-1] of a line (relative
+    * to the start of the buffered region, sorted and without duplicates) by
+    * f(value), rebuilding the line once. Different lines may be changed from
+    * different threads at the same time. */
+    template <typename TFunction>
+    void TransformLinePixels(RLLine & line, const IndexValueType * x, size_t n, TFunction f);
+
     /** \brief Get a pixel. SLOW! Better use iterators for pixel access. */
     const TPixel & GetPixel(const IndexType & index) const;
 
@@ -163,6 +182,27 @@ public:
         return this->GetPixel(index);
     }
 
+    /** Should GetPixel() and SetPixel() use the per-line segment index?
+    * The index keeps the cumulative segment lengths of every line, so the
+    * segment containing a pixel is found by binary search instead of a
+    * linear walk from the start of the line. It is built lazily on first
+    * access, and rebuilt after CleanUp(), FillBuffer() or Modified().
+    * Once a line is changed through SetPixel(), image iterators or the
+    * TransformLine...() methods, all lines are walked linearly until the
+    * next rebuild. Code that writes RLLine-s directly through GetBuffer()
+    * must call Modified() or InvalidateSegmentIndex() afterwards.
+    *
+    * Several threads may read pixels of an unmodified image at once, the
+    * first of them builds the index. Reading pixels while another thread
+    * writes to the image is not supported. */
+    void SetUseSegmentIndex(bool value);
+
+    /** Is the per-line segment index used? */
+    bool GetUseSegmentIndex() const { return m_UseSegmentIndex; }
+
+    /** Discard the segment index. It will be rebuilt on next access. */
+    void InvalidateSegmentIndex() const { m_SegmentIndexMTime = 0; }
+
     virtual unsigned int GetNumberOfComponentsPerPixel() const ITK_OVERRIDE
     {
         // use the GetLength() method which works with variable length arrays,
@@ -218,6 +258,7 @@ public:
     void SetPixelContainer(PixelContainer *container)
     {
       myBuffer->SetPixelContainer(container);
+      InvalidateSegmentIndex();
     }
 
     /** Get pixel container */
@@ -231,6 +272,9 @@ protected:
     RLEImage() : itk::ImageBase < VImageDimension >()
     {
         m_OnTheFlyCleanup = true;
+        m_UseSegmentIndex = false;
+        m_SegmentIndexMTime = 0;
+        m_SegmentIndexStale = false;
         myBuffer = BufferType::New();
     }
     void PrintSelf(std::ostream & os, itk::Indent indent) const ITK_OVERRIDE;
@@ -250,9 +294,46 @@ protected:
     /** Merges adjacent segments with duplicate values in a single line. */
     void CleanUpLine(RLLine & line) const;
 
+    /** Finds the segment of the line containing pixel x (relative to the
+    * start of the buffered region). Returns the position of the segment in
+    * the line and sets segmentEnd to one past the last pixel of the segment. */
+    IndexValueType FindSegment(const RLLine & line, IndexValueType x, IndexValueType & segmentEnd) const;
+
+    /** Stops the segment index from being used until it is rebuilt. Called
+    * before a line is changed, it does not lock, so that different lines
+    * can be changed from different threads. */
+    void MarkSegmentIndexStale() const
+    {
+        if (m_UseSegmentIndex)
+            m_SegmentIndexStale = true;
+    }
+
+    /** Rebuilds the segment index if the image has been modified. Returns
+    * false if the index is stale and the lines must be walked instead. */
+    bool UpdateSegmentIndex() const;
+
 private:
     bool m_OnTheFlyCleanup; //should same-valued segments be merged on the fly
 
+    bool m_UseSegmentIndex; //should the per-line segment index be used
+
+    /** Cumulative segment lengths of all lines, stored line after line */
+    mutable std::vector<CounterType> m_SegmentEnds;
+
+    /** Position of the first entry of each line in m_SegmentEnds */
+    mutable std::vector<SizeValueType> m_SegmentLineStart;
+
+    /** MTime of the image when the index was built, 0 if not built. It is
+    * stored after the index, so a reader that sees the current MTime here
+    * also sees the complete index. */
+    mutable std::atomic<itk::ModifiedTimeType> m_SegmentIndexMTime;
+
+    /** Set when a line has changed since the index was built */
+    mutable std::atomic<bool> m_SegmentIndexStale;
+
+    /** Guards lazy (re)building of the index from const methods */
+    mutable std::mutex m_SegmentIndexMutex;
+
     RLEImage(const Self &);          //purposely not implemented
     void operator=(const Self &); //purposely not implemented
 
@@ -3,6 +3,8 @@
 
 #include "RLEImage.h"
 #include "itkImageRegionConstIterator.h"
+#include "itkImageRegionIterator.h"
+#include <algorithm>
 
 template< typename TPixel, unsigned int VImageDimension, typename CounterType >
 inline typename RLEImage<TPixel, VImageDimension, CounterType>::BufferType::IndexType
@@ -56,6 +58,7 @@ void RLEImage<TPixel, VImageDimension, CounterType>::Allocate(bool initialize)
         line[0] = segment;
         myBuffer->FillBuffer(line);
     }
+    InvalidateSegmentIndex();
 }
 
 template< typename TPixel, unsigned int VImageDimension, typename CounterType >
@@ -66,6 +69,7 @@ void RLEImage<TPixel, VImageDimension, CounterType>
     RLLine line(1);
     line[0] = segment;
     myBuffer->FillBuffer(line);
+    InvalidateSegmentIndex();
 }
 
 template< typename TPixel, unsigned int VImageDimension, typename CounterType >
@@ -86,13 +90,102 @@ void RLEImage<TPixel, VImageDimension, CounterType>::CleanUpLine(RLLine & line)
 template< typename TPixel, unsigned int VImageDimension, typename CounterType >
 void RLEImage<TPixel, VImageDimension, CounterType>::CleanUp() const
 {
-    assert(!myBuffer.empty());
     if (this->GetLargestPossibleRegion().GetSize(0) == 0)
         return;
-#pragma omp parallel for
-    for (CounterType z = 0; z < myBuffer.size(); z++)
-        for (CounterType y = 0; y < myBuffer[0].size(); y++)
-            CleanUpLine(myBuffer[z][y]);
+    itk::ImageRegionIterator<BufferType> it(myBuffer, myBuffer->GetBufferedRegion());
+    for (; !it.IsAtEnd(); ++it)
+        CleanUpLine(it.Value());
+    InvalidateSegmentIndex();
+}
+
+template< typename TPixel, unsigned int VImageDimension, typename CounterType >
+void RLEImage<TPixel, VImageDimension, CounterType>::SetUseSegmentIndex(bool value)
+{
+    if (value == m_UseSegmentIndex)
+        return;
+    m_UseSegmentIndex = value;
+
+    // Release the memory held by the index, it is rebuilt on next access
+    std::lock_guard<std::mutex> lock(m_SegmentIndexMutex);
+    m_SegmentEnds = std::vector<CounterType>();
+    m_SegmentLineStart = std::vector<SizeValueType>();
+    InvalidateSegmentIndex();
+}
+
+template< typename TPixel, unsigned int VImageDimension, typename CounterType >
+bool RLEImage<TPixel, VImageDimension, CounterType>::UpdateSegmentIndex() const
+{
+    itk::ModifiedTimeType mtime = this->GetMTime();
+    if (m_SegmentIndexMTime == mtime)
+        return !m_SegmentIndexStale;
+
+    // Several threads may be reading pixels at once, only one builds the index
+    std::lock_guard<std::mutex> lock(m_SegmentIndexMutex);
+    if (m_SegmentIndexMTime == mtime)
+        return !m_SegmentIndexStale;
+
+    const RLLine *lines = myBuffer->GetBufferPointer();
+    SizeValueType nLines = lines ? myBuffer->GetBufferedRegion().GetNumberOfPixels() : 0;
+
+    m_SegmentLineStart.resize(nLines);
+    SizeValueType total = 0;
+    for (SizeValueType i = 0; i < nLines; i++)
+    {
+        m_SegmentLineStart[i] = total;
+        total += lines[i].size();
+    }
+
+    m_SegmentEnds.resize(total);
+    CounterType *ends = m_SegmentEnds.data();
+    for (SizeValueType i = 0; i < nLines; i++)
+    {
+        CounterType t = 0;
+        for (const RLSegment &seg : lines[i])
+        {
+            t += seg.first;
+            *ends++ = t;
+        }
+    }
+
+    m_SegmentIndexStale = false;
+    m_SegmentIndexMTime = mtime;
+    return true;
+}
+
+template< typename TPixel, unsigned int VImageDimension, typename CounterType >
+typename RLEImage<TPixel, VImageDimension, CounterType>::IndexValueType
+RLEImage<TPixel, VImageDimension, CounterType>::
+FindSegment(const RLLine & line, IndexValueType x, IndexValueType & segmentEnd) const
+{
+    if (m_UseSegmentIndex && UpdateSegmentIndex())
+    {
+        std::ptrdiff_t offset = &line - myBuffer->GetBufferPointer();
+        if (offset >= 0 && offset < (std::ptrdiff_t) m_SegmentLineStart.size())
+        {
+            //binary search for the first segment that ends past x
+            const CounterType *first = m_SegmentEnds.data() + m_SegmentLineStart[offset];
+            const CounterType *last = first + line.size();
+            const CounterType *it = std::upper_bound(first, last, CounterType(x));
+            if (it != last)
+            {
+                segmentEnd = *it;
+                return it - first;
+            }
+            throw itk::ExceptionObject(__FILE__, __LINE__, "Reached past the end of Run-Length line!", __FUNCTION__);
+        }
+    }
+
+    IndexValueType t = 0;
+    for (IndexValueType s = 0; s < line.size(); s++)
+    {
+        t += line[s].first;
+        if (t > x)
+        {
+            segmentEnd = t;
+            return s;
+        }
+    }
+    throw itk::ExceptionObject(__FILE__, __LINE__, "Reached past the end of Run-Length line!", __FUNCTION__);
 }
 
 template< typename TPixel, unsigned int VImageDimension, typename CounterType >
@@ -105,7 +198,11 @@ SetPixel(RLLine & line, IndexValueType & segmentRemainder, IndexValueType & real
         "BufferedRegion must contain complete run-length lines!");
     if (line[realIndex].second == value) //already correct value
         return 0;
-    else if (line[realIndex].first == 1) //single pixel segment
+
+    //the segments of this line are about to change
+    MarkSegmentIndexStale();
+
+    if (line[realIndex].first == 1) //single pixel segment
     {
         line[realIndex].second = value;
         if (m_OnTheFlyCleanup)//now see if we can merge it into adjacent segments
@@ -185,28 +282,112 @@ SetPixel(RLLine & line, IndexValueType & segmentRemainder, IndexValueType & real
 }
 
 template< typename TPixel, unsigned int VImageDimension, typename CounterType >
+template< typename TFunction >
 void RLEImage<TPixel, VImageDimension, CounterType>::
-SetPixel(const IndexType & index, const TPixel & value)
+TransformLineInterval(RLLine & line, IndexValueType x0, IndexValueType x1, TFunction f)
 {
     //complete Run-Length Lines have to be buffered
     itkAssertOrThrowMacro(this->GetBufferedRegion().GetSize(0)
         == this->GetLargestPossibleRegion().GetSize(0),
         "BufferedRegion must contain complete run-length lines!");
-    IndexValueType bri0 = this->GetBufferedRegion().GetIndex(0);
-    typename BufferType::IndexType bi = truncateIndex(index);
-    RLLine & line = myBuffer->GetPixel(bi);
-    IndexValueType t = 0;
-    for (IndexValueType x = 0; x < line.size(); x++)
+    if (x0 >= x1)
+        return;
+
+    //the segments of this line are about to change
+    MarkSegmentIndexStale();
+
+    //append a segment to the output line, merging it into the last one
+    RLLine out;
+    out.reserve(line.size() + 2);
+    auto append = [&out](IndexValueType count, const TPixel & value)
+    {
+        if (count <= 0)
+            return;
+        if (!out.empty() && out.back().second == value)
+            out.back().first += CounterType(count);
+        else
+            out.push_back(RLSegment(CounterType(count), value));
+    };
+
+    IndexValueType x = 0;
+    for (const RLSegment &seg : line)
     {
-        t += line[x].first;
-        if (t > index[0] - bri0)
+        IndexValueType a = x, b = x + seg.first;
+        x = b;
+        if (b <= x0 || a >= x1) //segment is outside of the interval
         {
-            t -= index[0] - bri0; //we need to supply a reference
-            SetPixel(line, t, x, value);
+            append(b - a, seg.second);
+            continue;
+        }
+
+        IndexValueType a1 = std::max(a, x0), b1 = std::min(b, x1);
+        append(a1 - a, seg.second);
+        append(b1 - a1, f(seg.second, b1 - a1));
+        append(b - b1, seg.second);
+    }
+    out.swap(line);
+}
+
+template< typename TPixel, unsigned int VImageDimension, typename CounterType >
+template< typename TFunction >
+void RLEImage<TPixel, VImageDimension, CounterType>::
+TransformLinePixels(RLLine & line, const IndexValueType * px, size_t n, TFunction f)
+{
+    //complete Run-Length Lines have to be buffered
+    itkAssertOrThrowMacro(this->GetBufferedRegion().GetSize(0)
+        == this->GetLargestPossibleRegion().GetSize(0),
+        "BufferedRegion must contain complete run-length lines!");
+    if (n == 0)
+        return;
+
+    //the segments of this line are about to change
+    MarkSegmentIndexStale();
+
+    //append a segment to the output line, merging it into the last one
+    RLLine out;
+    out.reserve(line.size() + 2 * n);
+    auto append = [&out](IndexValueType count, const TPixel & value)
+    {
+        if (count <= 0)
             return;
+        if (!out.empty() && out.back().second == value)
+            out.back().first += CounterType(count);
+        else
+            out.push_back(RLSegment(CounterType(count), value));
+    };
+
+    IndexValueType x = 0;
+    size_t k = 0;
+    for (const RLSegment &seg : line)
+    {
+        IndexValueType a = x, b = x + seg.first;
+        x = b;
+        for (; k < n && px[k] < b; k++)
+        {
+            append(px[k] - a, seg.second);
+            append(1, f(seg.second));
+            a = px[k] + 1;
         }
+        append(b - a, seg.second);
     }
-    throw itk::ExceptionObject(__FILE__, __LINE__, "Reached past the end of Run-Length line!", __FUNCTION__);
+    out.swap(line);
+}
+
+template< typename TPixel, unsigned int VImageDimension, typename CounterType >
+void RLEImage<TPixel, VImageDimension, CounterType>::
+SetPixel(const IndexType & index, const TPixel & value)
+{
+    //complete Run-Length Lines have to be buffered
+    itkAssertOrThrowMacro(this->GetBufferedRegion().GetSize(0)
+        == this->GetLargestPossibleRegion().GetSize(0),
+        "BufferedRegion must contain complete run-length lines!");
+    IndexValueType bri0 = this->GetBufferedRegion().GetIndex(0);
+    typename BufferType::IndexType bi = truncateIndex(index);
+    RLLine & line = myBuffer->GetPixel(bi);
+    IndexValueType t;
+    IndexValueType x = FindSegment(line, index[0] - bri0, t);
+    t -= index[0] - bri0; //we need to supply a reference
+    SetPixel(line, t, x, value);
 }
 
 template< typename TPixel, unsigned int VImageDimension, typename CounterType >
@@ -219,15 +400,9 @@ GetPixel(const IndexType & index) const
         "BufferedRegion must contain complete run-length lines!");
     IndexValueType bri0 = this->GetBufferedRegion().GetIndex(0);
     typename BufferType::IndexType bi = truncateIndex(index);
-    RLLine & line = myBuffer->GetPixel(bi);
-    IndexValueType t = 0;
-    for (IndexValueType x = 0; x < line.size(); x++)
-    {
-        t += line[x].first;
-        if (t > index[0] - bri0)
-            return line[x].second;
-    }
-    throw itk::ExceptionObject(__FILE__, __LINE__, "Reached past the end of Run-Length line!", __FUNCTION__);
+    const RLLine & line = myBuffer->GetPixel(bi);
+    IndexValueType segmentEnd;
+    return line[FindSegment(line, index[0] - bri0, segmentEnd)].second;
 }
 
 template< typename TPixel, unsigned int VImageDimension, typename CounterType >
@@ -29,6 +29,20 @@
 
 #include "itkVectorImage.h"
 #include "itkNumericTraits.h"
+#include <algorithm>
+
+// Select the widest instruction set available to the compiler for the
+// trilinear kernels below. There is no runtime dispatch: the kernel is fixed
+// by the compiler flags and the floating point type of the interpolator.
+#if defined(__AVX__)
+#define FAST_LINEAR_INTERPOLATOR_USE_AVX
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FAST_LINEAR_INTERPOLATOR_USE_SSE2
+#endif
+#if defined(FAST_LINEAR_INTERPOLATOR_USE_AVX) || defined(FAST_LINEAR_INTERPOLATOR_USE_SSE2)
+#include <immintrin.h>
+#endif
 
 template <class TFloat, class TInputComponentType>
 struct FastLinearInterpolatorOutputTraits
@@ -68,6 +82,154 @@ struct FastWarpCompositeImageFilterInputImageTraits< itk::VectorImage<TPixel, VD
 };
 
 
+/**
+ * Trilinear interpolation kernel that evaluates Lanes independent samples at
+ * once. The corner values are passed in c, grouped by corner in the order
+ * 000, 100, 010, 110, 001, 101, 011, 111, with Lanes values per corner. The
+ * order of operations is the same as in FastLinearInterpolator::Interpolate,
+ * so all kernels produce the same values as the scalar code.
+ *
+ * This generic version is used when no vector instructions are available for
+ * TFloat. Specializations for float and double follow.
+ */
+template <class TFloat>
+struct FastTrilinearKernel
+{
+  enum { Lanes = 4 };
+
+  static const char *GetName() { return "scalar"; }
+
+  static inline void Evaluate(const TFloat *fx, const TFloat *fy, const TFloat *fz,
+                              const TFloat *c, TFloat *out)
+  {
+    for(int l = 0; l < Lanes; l++)
+      {
+      TFloat dx00 = c[l]           + (c[Lanes + l]   - c[l])           * fx[l];
+      TFloat dx10 = c[2 * Lanes + l] + (c[3 * Lanes + l] - c[2 * Lanes + l]) * fx[l];
+      TFloat dx01 = c[4 * Lanes + l] + (c[5 * Lanes + l] - c[4 * Lanes + l]) * fx[l];
+      TFloat dx11 = c[6 * Lanes + l] + (c[7 * Lanes + l] - c[6 * Lanes + l]) * fx[l];
+      TFloat dxy0 = dx00 + (dx10 - dx00) * fy[l];
+      TFloat dxy1 = dx01 + (dx11 - dx01) * fy[l];
+      out[l] = dxy0 + (dxy1 - dxy0) * fz[l];
+      }
+  }
+};
+
+#if defined(FAST_LINEAR_INTERPOLATOR_USE_AVX)
+
+template <>
+struct FastTrilinearKernel<double>
+{
+  enum { Lanes = 4 };
+
+  static const char *GetName() { return "AVX"; }
+
+  static inline __m256d lerp(__m256d a, __m256d l, __m256d h)
+  {
+    return _mm256_add_pd(l, _mm256_mul_pd(_mm256_sub_pd(h, l), a));
+  }
+
+  static inline void Evaluate(const double *fx, const double *fy, const double *fz,
+                              const double *c, double *out)
+  {
+    __m256d vfx = _mm256_loadu_pd(fx), vfy = _mm256_loadu_pd(fy), vfz = _mm256_loadu_pd(fz);
+    __m256d dx00 = lerp(vfx, _mm256_loadu_pd(c),      _mm256_loadu_pd(c + 4));
+    __m256d dx10 = lerp(vfx, _mm256_loadu_pd(c + 8),  _mm256_loadu_pd(c + 12));
+    __m256d dx01 = lerp(vfx, _mm256_loadu_pd(c + 16), _mm256_loadu_pd(c + 20));
+    __m256d dx11 = lerp(vfx, _mm256_loadu_pd(c + 24), _mm256_loadu_pd(c + 28));
+    __m256d dxy0 = lerp(vfy, dx00, dx10);
+    __m256d dxy1 = lerp(vfy, dx01, dx11);
+    _mm256_storeu_pd(out, lerp(vfz, dxy0, dxy1));
+  }
+};
+
+template <>
+struct FastTrilinearKernel<float>
+{
+  enum { Lanes = 8 };
+
+  static const char *GetName() { return "AVX"; }
+
+  static inline __m256 lerp(__m256 a, __m256 l, __m256 h)
+  {
+    return _mm256_add_ps(l, _mm256_mul_ps(_mm256_sub_ps(h, l), a));
+  }
+
+  static inline void Evaluate(const float *fx, const float *fy, const float *fz,
+                              const float *c, float *out)
+  {
+    __m256 vfx = _mm256_loadu_ps(fx), vfy = _mm256_loadu_ps(fy), vfz = _mm256_loadu_ps(fz);
+    __m256 dx00 = lerp(vfx, _mm256_loadu_ps(c),      _mm256_loadu_ps(c + 8));
+    __m256 dx10 = lerp(vfx, _mm256_loadu_ps(c + 16), _mm256_loadu_ps(c + 24));
+    __m256 dx01 = lerp(vfx, _mm256_loadu_ps(c + 32), _mm256_loadu_ps(c + 40));
+    __m256 dx11 = lerp(vfx, _mm256_loadu_ps(c + 48), _mm256_loadu_ps(c + 56));
+    __m256 dxy0 = lerp(vfy, dx00, dx10);
+    __m256 dxy1 = lerp(vfy, dx01, dx11);
+    _mm256_storeu_ps(out, lerp(vfz, dxy0, dxy1));
+  }
+};
+
+#elif defined(FAST_LINEAR_INTERPOLATOR_USE_SSE2)
+
+template <>
+struct FastTrilinearKernel<double>
+{
+  enum { Lanes = 4 };
+
+  static const char *GetName() { return "SSE2"; }
+
+  static inline __m128d lerp(__m128d a, __m128d l, __m128d h)
+  {
+    return _mm_add_pd(l, _mm_mul_pd(_mm_sub_pd(h, l), a));
+  }
+
+  static inline void Evaluate(const double *fx, const double *fy, const double *fz,
+                              const double *c, double *out)
+  {
+    // Two samples per register, so the four lanes are processed in two halves
+    for(int h = 0; h < Lanes; h += 2)
+      {
+      __m128d vfx = _mm_loadu_pd(fx + h), vfy = _mm_loadu_pd(fy + h), vfz = _mm_loadu_pd(fz + h);
+      __m128d dx00 = lerp(vfx, _mm_loadu_pd(c + h),      _mm_loadu_pd(c + 4 + h));
+      __m128d dx10 = lerp(vfx, _mm_loadu_pd(c + 8 + h),  _mm_loadu_pd(c + 12 + h));
+      __m128d dx01 = lerp(vfx, _mm_loadu_pd(c + 16 + h), _mm_loadu_pd(c + 20 + h));
+      __m128d dx11 = lerp(vfx, _mm_loadu_pd(c + 24 + h), _mm_loadu_pd(c + 28 + h));
+      __m128d dxy0 = lerp(vfy, dx00, dx10);
+      __m128d dxy1 = lerp(vfy, dx01, dx11);
+      _mm_storeu_pd(out + h, lerp(vfz, dxy0, dxy1));
+      }
+  }
+};
+
+template <>
+struct FastTrilinearKernel<float>
+{
+  enum { Lanes = 4 };
+
+  static const char *GetName() { return "SSE2"; }
+
+  static inline __m128 lerp(__m128 a, __m128 l, __m128 h)
+  {
+    return _mm_add_ps(l, _mm_mul_ps(_mm_sub_ps(h, l), a));
+  }
+
+  static inline void Evaluate(const float *fx, const float *fy, const float *fz,
+                              const float *c, float *out)
+  {
+    __m128 vfx = _mm_loadu_ps(fx), vfy = _mm_loadu_ps(fy), vfz = _mm_loadu_ps(fz);
+    __m128 dx00 = lerp(vfx, _mm_loadu_ps(c),      _mm_loadu_ps(c + 4));
+    __m128 dx10 = lerp(vfx, _mm_loadu_ps(c + 8),  _mm_loadu_ps(c + 12));
+    __m128 dx01 = lerp(vfx, _mm_loadu_ps(c + 16), _mm_loadu_ps(c + 20));
+    __m128 dx11 = lerp(vfx, _mm_loadu_ps(c + 24), _mm_loadu_ps(c + 28));
+    __m128 dxy0 = lerp(vfy, dx00, dx10);
+    __m128 dxy1 = lerp(vfy, dx01, dx11);
+    _mm_storeu_ps(out, lerp(vfz, dxy0, dxy1));
+  }
+};
+
+#endif
+
+
 /**
  * Base class for the fast linear interpolators
  */
@@ -188,6 +350,10 @@ public:
   InOut InterpolateNearestNeighbor(RealType *cix, OutputComponentType *out)
     { return Superclass::INSIDE; }
 
+  void InterpolateLine(const RealType *cix, const RealType *step, int n,
+                       OutputComponentType *out, InOut *status)
+    { for(int i = 0; i < n; i++) status[i] = Superclass::INSIDE; }
+
   TFloat GetMask() { return 0.0; }
 
   TFloat GetMaskAndGradient(RealType *mask_gradient) { return 0.0; }
@@ -218,6 +384,9 @@ public:
   typedef typename Superclass::InOut                         InOut;
   typedef itk::ImageBase<3>                                  ImageBaseType;
 
+  /** Vectorized kernel, selected by the output component type */
+  typedef FastTrilinearKernel<OutputComponentType>           Kernel;
+
   FastLinearInterpolator(ImageType *image) : Superclass(image)
   {
     xsize = image->GetLargestPossibleRegion().GetSize()[0];
@@ -365,8 +534,38 @@ public:
 
     if(this->status != Superclass::OUTSIDE)
       {
-      // Loop over the components
-      for(int iComp = 0; iComp < this->nSampled; iComp++,
+      int iComp = 0;
+
+      // Interpolate blocks of components together using the vector kernel
+      if(this->nSampled >= Kernel::Lanes)
+        {
+        const int L = Kernel::Lanes;
+        OutputComponentType vfx[L], vfy[L], vfz[L], corners[8 * L];
+        std::fill(vfx, vfx + L, fx);
+        std::fill(vfy, vfy + L, fy);
+        std::fill(vfz, vfz + L, fz);
+
+        for(; iComp + L <= this->nSampled; iComp += L, out += L,
+            d000 += L, d001 += L, d010 += L, d011 += L,
+            d100 += L, d101 += L, d110 += L, d111 += L)
+          {
+          for(int l = 0; l < L; l++)
+            {
+            corners[l]         = d000[l];
+            corners[L + l]     = d100[l];
+            corners[2 * L + l] = d010[l];
+            corners[3 * L + l] = d110[l];
+            corners[4 * L + l] = d001[l];
+            corners[5 * L + l] = d101[l];
+            corners[6 * L + l] = d011[l];
+            corners[7 * L + l] = d111[l];
+            }
+          Kernel::Evaluate(vfx, vfy, vfz, corners, out);
+          }
+        }
+
+      // Loop over the remaining components
+      for(; iComp < this->nSampled; iComp++,
           d000++, d001++, d010++, d011++,
           d100++, d101++, d110++, d111++)
         {
@@ -384,6 +583,86 @@ public:
     return this->status;
   }
 
+  /**
+   * Interpolate at n points along a line, starting at cix and advancing by step.
+   * The nSampled values for each point are placed in out, and the status of each
+   * point in status (nothing is written to out for OUTSIDE points). Points are
+   * taken Kernel::Lanes at a time, and if the interpolating cubes of all of them
+   * are inside the image, they are evaluated together with the vector kernel.
+   * Other points go through Interpolate(). The sample positions are accumulated
+   * by repeated addition of step, same as a caller stepping along the line.
+   */
+  void InterpolateLine(const RealType *cix, const RealType *step, int n,
+                       OutputComponentType *out, InOut *status)
+  {
+    const int L = Kernel::Lanes;
+    const int xstride = this->nComp * xsize, zstride = this->nComp * xsize * ysize;
+
+    RealType p[3] = { cix[0], cix[1], cix[2] }, lp[L][3];
+    OutputComponentType lfx[L], lfy[L], lfz[L], corners[8 * L], res[L];
+    const InputComponentType *lptr[L];
+
+    for(int i = 0; i < n; i += L)
+      {
+      int nb = std::min(L, n - i);
+      bool inside = (nb == L);
+
+      // Compute the sample positions and check if all cubes are inside
+      for(int l = 0; l < nb; l++)
+        {
+        for(int d = 0; d < 3; d++)
+          {
+          lp[l][d] = p[d];
+          p[d] += step[d];
+          }
+
+        if(inside)
+          {
+          int x = (int) floor(lp[l][0]), y = (int) floor(lp[l][1]), z = (int) floor(lp[l][2]);
+          if(x >= 0 && x + 1 < xsize && y >= 0 && y + 1 < ysize && z >= 0 && z + 1 < zsize)
+            {
+            lfx[l] = lp[l][0] - x;
+            lfy[l] = lp[l][1] - y;
+            lfz[l] = lp[l][2] - z;
+            lptr[l] = dens(x, y, z);
+            }
+          else inside = false;
+          }
+        }
+
+      OutputComponentType *out_block = out + i * this->nSampled;
+      if(inside)
+        {
+        for(int iComp = 0; iComp < this->nSampled; iComp++)
+          {
+          for(int l = 0; l < L; l++)
+            {
+            const InputComponentType *dp = lptr[l] + iComp;
+            corners[l]         = dp[0];
+            corners[L + l]     = dp[this->nComp];
+            corners[2 * L + l] = dp[xstride];
+            corners[3 * L + l] = dp[xstride + this->nComp];
+            corners[4 * L + l] = dp[zstride];
+            corners[5 * L + l] = dp[zstride + this->nComp];
+            corners[6 * L + l] = dp[zstride + xstride];
+            corners[7 * L + l] = dp[zstride + xstride + this->nComp];
+            }
+          Kernel::Evaluate(lfx, lfy, lfz, corners, res);
+          for(int l = 0; l < L; l++)
+            out_block[l * this->nSampled + iComp] = res[l];
+          }
+
+        for(int l = 0; l < L; l++)
+          status[i + l] = Superclass::INSIDE;
+        }
+      else
+        {
+        for(int l = 0; l < nb; l++)
+          status[i + l] = this->Interpolate(lp[l], out_block + l * this->nSampled);
+        }
+      }
+  }
+
   InOut InterpolateNearestNeighbor(RealType *cix, OutputComponentType *out)
   {
     x0 = (int) floor(cix[0] + 0.5);
@@ -726,6 +1005,22 @@ public:
     return this->status;
   }
 
+  /**
+   * Interpolate at n points along a line, starting at cix and advancing by step.
+   * See the 3D version; in 2D this simply calls Interpolate() for each point.
+   */
+  void InterpolateLine(const RealType *cix, const RealType *step, int n,
+                       OutputComponentType *out, InOut *status)
+  {
+    RealType p[2] = { cix[0], cix[1] };
+    for(int i = 0; i < n; i++, out += this->nSampled)
+      {
+      status[i] = this->Interpolate(p, out);
+      p[0] += step[0];
+      p[1] += step[1];
+      }
+  }
+
   InOut InterpolateNearestNeighbor(RealType *cix, OutputComponentType *out)
   {
     x0 = (int) floor(cix[0] + 0.5);
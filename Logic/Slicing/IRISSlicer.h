@@ -362,6 +362,20 @@ private:
   // Whether the main input should always be bypassed
   bool m_BypassMainInput;
 
+  // Position of the segment last used in a line: its index in the line
+  // and the x coordinate of its first pixel
+  struct LineCursor
+  {
+    unsigned int Segment;
+    long Start;
+  };
+
+  // Per-line cursors used when slicing along x, and the image (and its
+  // modification time) for which they were computed
+  std::vector<LineCursor> m_LineCursors;
+  const InputImageType *m_CursorImage;
+  itk::ModifiedTimeType m_CursorMTime;
+
 };
 
 #ifndef ITK_MANUAL_INSTANTIATION
@@ -38,6 +38,10 @@
 #include "itkImage.h"
 #include "itkVectorImage.h"
 #include "itkVectorImageToImageAdaptor.h"
+#include "itkMultiThreaderBase.h"
+#include <algorithm>
+#include <exception>
+#include <mutex>
 
 //now goes version specialized for RLEImage
 template< typename TPixel, typename CounterType, class TOutputImage, class TPreviewImage>
@@ -64,6 +68,10 @@ IRISSlicer<RLEImage<TPixel, 3, CounterType>, TOutputImage, TPreviewImage>
 
   // Initialize to a zero slice index
   m_SliceIndex = 0;
+
+  // No line cursors yet
+  m_CursorImage = NULL;
+  m_CursorMTime = 0;
 }
 
 template< typename TPixel, typename CounterType, class TOutputImage, class TPreviewImage>
@@ -239,80 +247,133 @@ void IRISSlicer<RLEImage<TPixel, 3, CounterType>, TOutputImage, TPreviewImage>
 
   typename OutputImageType::PixelType *outSlice = &outputPtr->GetPixel(oStartInd);
 
-  if (m_SliceDirectionImageAxis == 2) //slicing along z
+  // Number of input lines along the outer loop, which is divided into bands
+  long nOuter = (m_SliceDirectionImageAxis == 2) ? szVol[1] : szVol[2];
+
+  // When slicing along x, each line is decoded starting from where the
+  // previous slice left it, so that scrolling costs O(1) per line. The
+  // cursors are only valid for the image that they were computed for, and
+  // are discarded when the image is modified or regenerated by its source.
+  if (m_SliceDirectionImageAxis == 0)
     {
-#pragma omp parallel for
-    for (int y = 0; y < szVol[1]; y++)
+    size_t nLines = szVol[1] * szVol[2];
+    itk::ModifiedTimeType stamp = std::max(inputPtr->GetMTime(), inputPtr->GetUpdateMTime());
+    if (m_CursorImage != inputPtr || m_CursorMTime != stamp
+        || m_LineCursors.size() != nLines)
       {
-      typename InputImageType::BufferType::IndexType lineIndex = { { y, (int) m_SliceIndex } };
-      const typename InputImageType::RLLine & line = inputPtr->GetBuffer()->GetPixel(lineIndex);
-      if (m_LineDirectionImageAxis == 1) //y is line coordinate
-        {
-        assert(m_PixelDirectionImageAxis == 0); //x is pixel coordinate
-        uncompressLine(line, outSlice + s_line*y*szVol[0], s_pixel * 1);
-        }
-      else if (m_LineDirectionImageAxis == 0) //x is line coordinate
-        {
-        assert(m_PixelDirectionImageAxis == 1); //y is pixel coordinate
-        uncompressLine(line, outSlice + s_pixel*y, s_line*szVol[1]);
-        }
-      else
-        throw itk::ExceptionObject(__FILE__, __LINE__, "SliceDirectionImageAxis and SliceDirectionImageAxis cannot both have a value of 2!", __FUNCTION__);
+      LineCursor zero = { 0, 0 };
+      m_LineCursors.assign(nLines, zero);
+      m_CursorImage = inputPtr;
+      m_CursorMTime = stamp;
       }
     }
-  else if (m_SliceDirectionImageAxis == 1) //slicing along y
+
+  // Split the outer loop into bands that are processed in parallel
+  itk::MultiThreaderBase *mt = this->GetMultiThreader();
+  mt->SetNumberOfWorkUnits(this->GetNumberOfWorkUnits());
+  long nBands = std::min((long) mt->GetNumberOfWorkUnits(), nOuter);
+  if (nBands < 1)
+    nBands = 1;
+
+  // Exceptions can not leave the worker threads, so the first one is kept
+  // and rethrown once all the bands are done
+  std::mutex errorMutex;
+  std::exception_ptr error;
+
+  mt->ParallelizeArray(0, nBands, [&](itk::SizeValueType band)
     {
-#pragma omp parallel for
-    for (int z = 0; z < szVol[2]; z++)
+    try
+    {
+    long first = (nOuter * band) / nBands, last = (nOuter * (band + 1)) / nBands;
+    if (m_SliceDirectionImageAxis == 2) //slicing along z
       {
-      typename InputImageType::BufferType::IndexType lineIndex = { { (int) m_SliceIndex, z } };
-      const typename InputImageType::RLLine & line = inputPtr->GetBuffer()->GetPixel(lineIndex);
-      if (m_LineDirectionImageAxis == 2) //z is line coordinate
-        {
-        assert(m_PixelDirectionImageAxis == 0); //x is pixel coordinate
-        uncompressLine(line, outSlice + s_line*z*szVol[0], s_pixel * 1);
-        }
-      else if (m_LineDirectionImageAxis == 0) //x is line coordinate
+      for (long y = first; y < last; y++)
         {
-        assert(m_PixelDirectionImageAxis == 2); //z is pixel coordinate
-        uncompressLine(line, outSlice + s_pixel*z, s_line*szVol[2]);
+        typename InputImageType::BufferType::IndexType lineIndex = { { y, (int) m_SliceIndex } };
+        const typename InputImageType::RLLine & line = inputPtr->GetBuffer()->GetPixel(lineIndex);
+        if (m_LineDirectionImageAxis == 1) //y is line coordinate
+          {
+          assert(m_PixelDirectionImageAxis == 0); //x is pixel coordinate
+          uncompressLine(line, outSlice + s_line*y*szVol[0], s_pixel * 1);
+          }
+        else if (m_LineDirectionImageAxis == 0) //x is line coordinate
+          {
+          assert(m_PixelDirectionImageAxis == 1); //y is pixel coordinate
+          uncompressLine(line, outSlice + s_pixel*y, s_line*szVol[1]);
+          }
+        else
+          throw itk::ExceptionObject(__FILE__, __LINE__, "SliceDirectionImageAxis and SliceDirectionImageAxis cannot both have a value of 2!", __FUNCTION__);
         }
-      else
-        throw itk::ExceptionObject(__FILE__, __LINE__, "SliceDirectionImageAxis and SliceDirectionImageAxis cannot both have a value of 1!", __FUNCTION__);
       }
-    }
-  else //slicing along x, the low-preformance case
-    {
-    assert(m_SliceDirectionImageAxis == 0);
-#pragma omp parallel for
-    for (int z = 0; z < szVol[2]; z++)
-      for (int y = 0; y < szVol[1]; y++)
+    else if (m_SliceDirectionImageAxis == 1) //slicing along y
+      {
+      for (long z = first; z < last; z++)
         {
-        typename InputImageType::BufferType::IndexType lineIndex = { { y, z } };
+        typename InputImageType::BufferType::IndexType lineIndex = { { (int) m_SliceIndex, z } };
         const typename InputImageType::RLLine & line = inputPtr->GetBuffer()->GetPixel(lineIndex);
-        int t = 0;
-        for (int x = 0; x < line.size(); x++)
+        if (m_LineDirectionImageAxis == 2) //z is line coordinate
+          {
+          assert(m_PixelDirectionImageAxis == 0); //x is pixel coordinate
+          uncompressLine(line, outSlice + s_line*z*szVol[0], s_pixel * 1);
+          }
+        else if (m_LineDirectionImageAxis == 0) //x is line coordinate
           {
-          t += line[x].first;
-          if (t > m_SliceIndex)
+          assert(m_PixelDirectionImageAxis == 2); //z is pixel coordinate
+          uncompressLine(line, outSlice + s_pixel*z, s_line*szVol[2]);
+          }
+        else
+          throw itk::ExceptionObject(__FILE__, __LINE__, "SliceDirectionImageAxis and SliceDirectionImageAxis cannot both have a value of 1!", __FUNCTION__);
+        }
+      }
+    else //slicing along x, the low-preformance case
+      {
+      assert(m_SliceDirectionImageAxis == 0);
+      long x = m_SliceIndex;
+      for (long z = first; z < last; z++)
+        for (long y = 0; y < szVol[1]; y++)
+          {
+          typename InputImageType::BufferType::IndexType lineIndex = { { y, z } };
+          const typename InputImageType::RLLine & line = inputPtr->GetBuffer()->GetPixel(lineIndex);
+
+          // Move the cursor of this line to the segment containing the slice.
+          // A cursor that does not fit the line is reset to its beginning.
+          LineCursor &c = m_LineCursors[z * szVol[1] + y];
+          if (c.Segment >= line.size() || c.Start < 0)
+            c.Segment = c.Start = 0;
+          while (x < c.Start && c.Segment > 0)
+            c.Start -= line[--c.Segment].first;
+          if (x < c.Start)
+            c.Segment = c.Start = 0;
+          while (c.Segment < line.size() && x >= c.Start + line[c.Segment].first)
+            c.Start += line[c.Segment++].first;
+          if (c.Segment >= line.size())
+            throw itk::ExceptionObject(__FILE__, __LINE__, "Slice index lies outside of the image line", __FUNCTION__);
+
+          if (m_LineDirectionImageAxis == 2) //z is line coordinate
+            {
+            assert(m_PixelDirectionImageAxis == 1); //y is pixel coordinate
+            *(outSlice + s_line*z*szVol[1] + s_pixel *y) = line[c.Segment].second;
+            }
+          else if (m_LineDirectionImageAxis == 1) //y is line coordinate
             {
-            if (m_LineDirectionImageAxis == 2) //z is line coordinate
-              {
-              assert(m_PixelDirectionImageAxis == 1); //y is pixel coordinate
-              *(outSlice + s_line*z*szVol[1] + s_pixel *y) = line[x].second;;
-              }
-            else if (m_LineDirectionImageAxis == 1) //y is line coordinate
-              {
-              assert(m_PixelDirectionImageAxis == 2); //z is pixel coordinate
-              *(outSlice + s_pixel*z + s_line *y*szVol[2]) = line[x].second;
-              }
-            else
-              throw itk::ExceptionObject(__FILE__, __LINE__, "SliceDirectionImageAxis and SliceDirectionImageAxis cannot both have a value of 0!", __FUNCTION__);
-            break;
+            assert(m_PixelDirectionImageAxis == 2); //z is pixel coordinate
+            *(outSlice + s_pixel*z + s_line *y*szVol[2]) = line[c.Segment].second;
             }
+          else
+            throw itk::ExceptionObject(__FILE__, __LINE__, "SliceDirectionImageAxis and SliceDirectionImageAxis cannot both have a value of 0!", __FUNCTION__);
           }
-        }
+      }
+    }
+    catch (...)
+    {
+    std::lock_guard<std::mutex> lock(errorMutex);
+    if (!error)
+      error = std::current_exception();
     }
+    }, nullptr);
+
+  if (error)
+    std::rethrow_exception(error);
 }
 
 //template< typename TPixel, typename CounterType, class TOutputImage, class TPreviewImage>
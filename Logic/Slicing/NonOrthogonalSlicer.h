@@ -48,6 +48,7 @@
 #include "itkDataObjectDecorator.h"
 #include "itkVectorImage.h"
 #include "itkImageAdaptor.h"
+#include <vector>
 
 using itk::DataObjectDecorator;
 using itk::ProcessObject;
@@ -75,6 +76,14 @@ public:
 
   inline void ProcessVoxel(double *cix, bool use_nn, OutputComponentType **out_ptr);
 
+  /**
+   * Process n voxels along a line, starting at cix and advancing by step. This
+   * is equivalent to calling ProcessVoxel n times, but lets the interpolator
+   * evaluate several samples at once.
+   */
+  inline void ProcessLine(double *cix, const double *step, int n, bool use_nn,
+                          OutputComponentType **out_ptr);
+
   inline void SkipVoxels(int n, OutputComponentType **out_ptr);
 
 protected:
@@ -88,6 +97,10 @@ protected:
 
   // Temporary buffer
   double *m_Buffer;
+
+  // Temporary buffers for ProcessLine
+  std::vector<double> m_LineBuffer;
+  std::vector<typename Interpolator::InOut> m_LineStatus;
 };
 
 
@@ -108,6 +121,8 @@ public:
   ~DefaultNonOrthogonalSlicerWorkerTraits();
 
   inline void ProcessVoxel(double *cix, bool use_nn, OutputComponentType **out_ptr);
+  inline void ProcessLine(double *cix, const double *step, int n, bool use_nn,
+                          OutputComponentType **out_ptr);
   inline void SkipVoxels(int n, OutputComponentType **out_ptr);
 
 protected:
@@ -146,6 +161,8 @@ public:
   ~DefaultNonOrthogonalSlicerWorkerTraits();
 
   inline void ProcessVoxel(double *cix, bool use_nn, OutputComponentType **out_ptr);
+  inline void ProcessLine(double *cix, const double *step, int n, bool use_nn,
+                          OutputComponentType **out_ptr);
   inline void SkipVoxels(int n, OutputComponentType **out_ptr);
 
 protected:
@@ -188,6 +205,9 @@ public:
 
   inline void ProcessVoxel(double *cix, bool use_nn, OutputComponentType **out_ptr);
 
+  inline void ProcessLine(double *cix, const double *step, int n, bool use_nn,
+                          OutputComponentType **out_ptr);
+
   inline void SkipVoxels(int n, OutputComponentType **out_ptr);
 
 protected:
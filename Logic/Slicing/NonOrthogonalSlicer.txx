@@ -241,14 +241,8 @@ NonOrthogonalSlicer<TInputImage, TOutputImage, TWorkerTraits>
         }
 
       // Process the voxels that cross the image cube
-      for(int i = kStart; i <= kEnd; i++)
-        {
-        worker.ProcessVoxel(cixSample.GetDataPointer(), use_nn, &outPixelPtr);
-
-        // Update the sample location
-        for(int d = 0; d < InputImageDimension; d++)
-          cixSample[d] += cixStep[d];
-        }
+      worker.ProcessLine(cixSample.GetDataPointer(), cixStep.GetDataPointer(),
+                         kEnd - kStart + 1, use_nn, &outPixelPtr);
 
       // Process the rest
       if(kEnd < line_len - 1)
@@ -303,6 +297,43 @@ DefaultNonOrthogonalSlicerWorkerTraits<TInputImage, TOutputImage>
     }
 }
 
+template <class TInputImage, class TOutputImage>
+void
+DefaultNonOrthogonalSlicerWorkerTraits<TInputImage, TOutputImage>
+::ProcessLine(double *cix, const double *step, int n, bool use_nn, OutputComponentType **out_ptr)
+{
+  // Nearest neighbor sampling gains nothing from batching
+  if(use_nn)
+    {
+    for(int i = 0; i < n; i++)
+      {
+      ProcessVoxel(cix, true, out_ptr);
+      for(unsigned int d = 0; d < TInputImage::ImageDimension; d++)
+        cix[d] += step[d];
+      }
+    return;
+    }
+
+  // Interpolate the whole line into the temporary buffer
+  m_LineBuffer.resize(n * m_NumComponents);
+  m_LineStatus.resize(n);
+  m_Interpolator.InterpolateLine(cix, step, n, m_LineBuffer.data(), m_LineStatus.data());
+
+  const double *p = m_LineBuffer.data();
+  for(int i = 0; i < n; i++, p += m_NumComponents)
+    {
+    if(m_LineStatus[i] == Interpolator::INSIDE || m_LineStatus[i] == Interpolator::BORDER)
+      {
+      for(int k = 0; k < m_NumComponents; k++)
+        *(*out_ptr)++ = static_cast<OutputComponentType>(p[k]);
+      }
+    else
+      {
+      SkipVoxels(1, out_ptr);
+      }
+    }
+}
+
 template <class TInputImage, class TOutputImage>
 void
 DefaultNonOrthogonalSlicerWorkerTraits<TInputImage, TOutputImage>
@@ -363,6 +394,21 @@ DefaultNonOrthogonalSlicerWorkerTraits<
     *(*out_ptr)++ = 0;
 }
 
+template <typename TPixelType, unsigned int Dimension, typename TOutputImage>
+void
+DefaultNonOrthogonalSlicerWorkerTraits<
+  itk::VectorImageToImageAdaptor<TPixelType, Dimension>,
+  TOutputImage>
+::ProcessLine(double *cix, const double *step, int n, bool use_nn, OutputComponentType **out_ptr)
+{
+  for(int i = 0; i < n; i++)
+    {
+    ProcessVoxel(cix, use_nn, out_ptr);
+    for(unsigned int d = 0; d < Dimension; d++)
+      cix[d] += step[d];
+    }
+}
+
 template <typename TPixelType, unsigned int Dimension, typename TOutputImage>
 void
 DefaultNonOrthogonalSlicerWorkerTraits<
@@ -431,6 +477,21 @@ DefaultNonOrthogonalSlicerWorkerTraits<
     }
 }
 
+template <typename TPixelType, unsigned int Dimension, typename TAccessor, typename TOutputImage>
+void
+DefaultNonOrthogonalSlicerWorkerTraits<
+  itk::ImageAdaptor<itk::VectorImage<TPixelType, Dimension>, TAccessor>,
+  TOutputImage>
+::ProcessLine(double *cix, const double *step, int n, bool use_nn, OutputComponentType **out_ptr)
+{
+  for(int i = 0; i < n; i++)
+    {
+    ProcessVoxel(cix, use_nn, out_ptr);
+    for(unsigned int d = 0; d < Dimension; d++)
+      cix[d] += step[d];
+    }
+}
+
 template <typename TPixelType, unsigned int Dimension, typename TAccessor, typename TOutputImage>
 void
 DefaultNonOrthogonalSlicerWorkerTraits<
@@ -480,6 +541,19 @@ DefaultNonOrthogonalSlicerWorkerTraits<RLEImage<TPixel, Dimension, TCounter>, TO
     }
 }
 
+template <typename TPixel, unsigned int Dimension, typename TCounter, typename TOutputImage>
+void
+DefaultNonOrthogonalSlicerWorkerTraits<RLEImage<TPixel, Dimension, TCounter>, TOutputImage>
+::ProcessLine(double *cix, const double *step, int n, bool use_nn, OutputComponentType **out_ptr)
+{
+  for(int i = 0; i < n; i++)
+    {
+    ProcessVoxel(cix, use_nn, out_ptr);
+    for(unsigned int d = 0; d < Dimension; d++)
+      cix[d] += step[d];
+    }
+}
+
 template <typename TPixel, unsigned int Dimension, typename TCounter, typename TOutputImage>
 void
 DefaultNonOrthogonalSlicerWorkerTraits<RLEImage<TPixel, Dimension, TCounter>, TOutputImage>
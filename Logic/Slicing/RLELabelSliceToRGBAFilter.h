@@ -0,0 +1,88 @@
+#ifndef RLELABELSLICETORGBAFILTER_H
+#define RLELABELSLICETORGBAFILTER_H
+
+#include "SNAPCommon.h"
+#include "itkImageSource.h"
+#include "itkRGBAPixel.h"
+#include "ColorLabelTable.h"
+
+/**
+  This filter produces the RGBA display slice of a segmentation directly
+  from the run-length encoded label image. Each run of a line in the slice
+  is looked up in the color label table once, and its color is written to
+  the output as a constant span, so the label slice that the slicer would
+  otherwise decode on every repaint is not computed at all. The lines of
+  the slice are divided into bands that are processed in parallel.
+
+  The filter takes the slicing pipeline of the label image wrapper, and
+  slices the same image in the same orientation as that pipeline. The
+  pipeline is not an input of this filter; instead, its pipeline time is
+  checked in UpdateOutputInformation(). Slices along the x axis of the
+  image (where runs are perpendicular to the slice), oblique slices and
+  slices with a preview image are obtained from the slicing pipeline and
+  mapped to color pixel by pixel.
+  */
+template <class TSlicer>
+class RLELabelSliceToRGBAFilter
+    : public itk::ImageSource<itk::Image<itk::RGBAPixel<unsigned char>, 2> >
+{
+public:
+
+  typedef TSlicer                                                 SlicerType;
+  typedef typename SlicerType::InputImageType                 InputImageType;
+  typedef typename SlicerType::OutputImageType                SliceImageType;
+  typedef typename InputImageType::PixelType                  InputPixelType;
+
+  typedef itk::RGBAPixel<unsigned char>                      OutputPixelType;
+  typedef itk::Image<OutputPixelType, 2>                     OutputImageType;
+
+  typedef RLELabelSliceToRGBAFilter<TSlicer>                            Self;
+  typedef itk::ImageSource<OutputImageType>                       Superclass;
+  typedef SmartPtr<Self>                                             Pointer;
+  typedef SmartPtr<const Self>                                  ConstPointer;
+
+  itkTypeMacro(RLELabelSliceToRGBAFilter, itk::ImageSource)
+
+  itkNewMacro(Self)
+
+  /** Set the slicing pipeline whose slices are rendered */
+  void SetSlicer(SlicerType *slicer);
+
+  /** Set the color table */
+  void SetColorTable(ColorLabelTable *table);
+
+  /** Get the color table */
+  ColorLabelTable *GetColorTable() { return m_ColorTable; }
+
+  /** Check if the slicing pipeline has changed before the pipeline update */
+  virtual void UpdateOutputInformation() ITK_OVERRIDE;
+
+protected:
+
+  RLELabelSliceToRGBAFilter();
+  ~RLELabelSliceToRGBAFilter() {}
+
+  virtual void GenerateOutputInformation() ITK_OVERRIDE;
+  virtual void GenerateData() ITK_OVERRIDE;
+
+  // Color of a label, or of the clear label if the label is hidden
+  OutputPixelType GetLabelColor(InputPixelType label) const;
+
+  // Render the slice straight from the runs of the label image
+  void GenerateDataFromRuns(unsigned int sliceAxis, unsigned int lineAxis,
+                            bool lineForward, bool pixelForward, long sliceIndex);
+
+  // Render the slice produced by the slicing pipeline
+  void GenerateDataFromSlice();
+
+  SmartPtr<SlicerType> m_Slicer;
+  itk::ModifiedTimeType m_SlicerPipelineMTime;
+
+  ColorLabelTable *m_ColorTable;
+};
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "RLELabelSliceToRGBAFilter.txx"
+#endif
+
+#endif // RLELABELSLICETORGBAFILTER_H
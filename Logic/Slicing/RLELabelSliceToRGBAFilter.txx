@@ -0,0 +1,249 @@
+#ifndef RLELabelSliceToRGBAFilter_txx
+#define RLELabelSliceToRGBAFilter_txx
+
+#include "RLELabelSliceToRGBAFilter.h"
+#include "ImageCoordinateTransform.h"
+#include "itkMultiThreaderBase.h"
+#include <algorithm>
+
+template <class TSlicer>
+RLELabelSliceToRGBAFilter<TSlicer>
+::RLELabelSliceToRGBAFilter()
+{
+  m_SlicerPipelineMTime = 0;
+  m_ColorTable = NULL;
+}
+
+template <class TSlicer>
+void
+RLELabelSliceToRGBAFilter<TSlicer>
+::SetSlicer(SlicerType *slicer)
+{
+  if(m_Slicer != slicer)
+    {
+    m_Slicer = slicer;
+    this->Modified();
+    }
+}
+
+template <class TSlicer>
+void
+RLELabelSliceToRGBAFilter<TSlicer>
+::SetColorTable(ColorLabelTable *table)
+{
+  m_ColorTable = table;
+  this->SetNthInput(0, table);
+}
+
+template <class TSlicer>
+void
+RLELabelSliceToRGBAFilter<TSlicer>
+::UpdateOutputInformation()
+{
+  // Bring the slicing pipeline's output information up to date. If the
+  // image, the slice index or the orientation have changed, our output is
+  // out of date as well
+  if(m_Slicer)
+    {
+    m_Slicer->UpdateOutputInformation();
+    itk::ModifiedTimeType t = m_Slicer->GetOutput()->GetPipelineMTime();
+    if(t != m_SlicerPipelineMTime)
+      {
+      m_SlicerPipelineMTime = t;
+      this->Modified();
+      }
+    }
+
+  Superclass::UpdateOutputInformation();
+}
+
+template <class TSlicer>
+void
+RLELabelSliceToRGBAFilter<TSlicer>
+::GenerateOutputInformation()
+{
+  if(m_Slicer)
+    {
+    OutputImageType *output = this->GetOutput();
+    output->CopyInformation(m_Slicer->GetOutput());
+    output->SetRequestedRegionToLargestPossibleRegion();
+    }
+}
+
+template <class TSlicer>
+typename RLELabelSliceToRGBAFilter<TSlicer>::OutputPixelType
+RLELabelSliceToRGBAFilter<TSlicer>
+::GetLabelColor(InputPixelType label) const
+{
+  OutputPixelType pix;
+
+  // Look the label up in place, since a color label carries its description
+  const ColorLabelTable::ValidLabelMap &labels = m_ColorTable->GetValidLabels();
+  ColorLabelTable::ValidLabelConstIterator it = labels.find(label);
+  if(it == labels.end())
+    {
+    // Labels that are not in the table are drawn in their default color
+    ColorLabel cl = ColorLabelTable::GetDefaultColorLabel(label);
+    if(!cl.IsVisible() && label != 0)
+      return this->GetLabelColor(0);
+    cl.GetRGBAVector(pix.GetDataPointer());
+    return pix;
+    }
+
+  // Hidden labels are drawn in the color of the clear label
+  const ColorLabel &cl = it->second;
+  if(!cl.IsVisible() && label != 0)
+    return this->GetLabelColor(0);
+  cl.GetRGBAVector(pix.GetDataPointer());
+  return pix;
+}
+
+template <class TSlicer>
+void
+RLELabelSliceToRGBAFilter<TSlicer>
+::GenerateData()
+{
+  this->AllocateOutputs();
+
+  // Runs can be rendered directly for orthogonal slices that cut across
+  // the lines of the image, i.e., slices along y and z
+  if(m_Slicer->GetUseOrthogonalSlicing() && !m_Slicer->GetPreviewImage())
+    {
+    ImageCoordinateTransform::Pointer tinv = ImageCoordinateTransform::New();
+    m_Slicer->GetOrthogonalTransform()->ComputeInverse(tinv);
+
+    unsigned int sliceAxis = tinv->GetCoordinateIndexZeroBased(2);
+    if(sliceAxis != 0)
+      {
+      // Make sure the image being sliced is current
+      InputImageType *image = const_cast<InputImageType *>(m_Slicer->GetInput());
+      image->SetRequestedRegionToLargestPossibleRegion();
+      image->Update();
+
+      this->GenerateDataFromRuns(
+            sliceAxis,
+            tinv->GetCoordinateIndexZeroBased(1),
+            tinv->GetCoordinateOrientation(1) > 0,
+            tinv->GetCoordinateOrientation(0) > 0,
+            m_Slicer->GetSliceIndex()[sliceAxis]);
+      return;
+      }
+    }
+
+  this->GenerateDataFromSlice();
+}
+
+template <class TSlicer>
+void
+RLELabelSliceToRGBAFilter<TSlicer>
+::GenerateDataFromRuns(unsigned int sliceAxis, unsigned int lineAxis,
+                       bool lineForward, bool pixelForward, long sliceIndex)
+{
+  const InputImageType *image = m_Slicer->GetInput();
+  OutputImageType *output = this->GetOutput();
+
+  long szVol[3];
+  for(int d = 0; d < 3; d++)
+    szVol[d] = image->GetBufferedRegion().GetSize(d);
+
+  long szSlice[2];
+  szSlice[0] = output->GetBufferedRegion().GetSize(0);
+  szSlice[1] = output->GetBufferedRegion().GetSize(1);
+
+  // Like the slicer, start at the output pixel that corresponds to the
+  // first pixel of the first line in the image
+  int s_line = lineForward ? 1 : -1;
+  int s_pixel = pixelForward ? 1 : -1;
+
+  typename OutputImageType::IndexType oStartInd;
+  oStartInd[1] = lineForward ? 0 : szSlice[1] - 1;
+  oStartInd[0] = pixelForward ? 0 : szSlice[0] - 1;
+  OutputPixelType *outSlice = &output->GetPixel(oStartInd);
+
+  // The image lines in the slice map either to the rows of the output or,
+  // if the line direction of the slice is the x axis of the image, to its
+  // columns. These are the output strides between consecutive image lines
+  // and between consecutive pixels in an image line
+  long outerStride = (lineAxis == 0) ? s_pixel : s_line * szSlice[0];
+  long innerStride = (lineAxis == 0) ? s_line * szSlice[0] : s_pixel;
+
+  // Number of image lines in the slice, which are divided into bands
+  long nOuter = (sliceAxis == 2) ? szVol[1] : szVol[2];
+
+  itk::MultiThreaderBase *mt = this->GetMultiThreader();
+  mt->SetNumberOfWorkUnits(this->GetNumberOfWorkUnits());
+  long nBands = std::min((long) mt->GetNumberOfWorkUnits(), nOuter);
+  if(nBands < 1)
+    nBands = 1;
+
+  mt->ParallelizeArray(0, nBands, [&](itk::SizeValueType band)
+    {
+    long first = (nOuter * band) / nBands, last = (nOuter * (band + 1)) / nBands;
+
+    // Segmentations are homogeneous, so consecutive runs often have the same
+    // label and the color lookup can be skipped
+    InputPixelType lastLabel = 0;
+    OutputPixelType color = this->GetLabelColor(0);
+
+    for(long i = first; i < last; i++)
+      {
+      typename InputImageType::BufferType::IndexType lineIndex;
+      lineIndex[0] = (sliceAxis == 2) ? i : sliceIndex;
+      lineIndex[1] = (sliceAxis == 2) ? sliceIndex : i;
+      const typename InputImageType::RLLine &line = image->GetBuffer()->GetPixel(lineIndex);
+
+      OutputPixelType *out = outSlice + i * outerStride;
+      for(size_t s = 0; s < line.size(); s++)
+        {
+        long n = line[s].first;
+        if(line[s].second != lastLabel)
+          {
+          lastLabel = line[s].second;
+          color = this->GetLabelColor(lastLabel);
+          }
+
+        // Fill the span of the run with its color
+        if(innerStride == 1)
+          std::fill(out, out + n, color);
+        else if(innerStride == -1)
+          std::fill(out - n + 1, out + 1, color);
+        else
+          for(long k = 0; k < n; k++)
+            out[k * innerStride] = color;
+
+        out += n * innerStride;
+        }
+      }
+    }, nullptr);
+}
+
+template <class TSlicer>
+void
+RLELabelSliceToRGBAFilter<TSlicer>
+::GenerateDataFromSlice()
+{
+  m_Slicer->Update();
+  const SliceImageType *slice = m_Slicer->GetOutput();
+  OutputImageType *output = this->GetOutput();
+
+  size_t n = output->GetBufferedRegion().GetNumberOfPixels();
+  itkAssertOrThrowMacro(slice->GetBufferedRegion().GetNumberOfPixels() == n,
+                        "Slice does not match the output region");
+
+  InputPixelType lastLabel = 0;
+  OutputPixelType color = this->GetLabelColor(0);
+
+  const InputPixelType *xin = slice->GetBufferPointer(), *xinend = xin + n;
+  OutputPixelType *xout = output->GetBufferPointer();
+  for(; xin < xinend; ++xin, ++xout)
+    {
+    if(*xin != lastLabel)
+      {
+      lastLabel = *xin;
+      color = this->GetLabelColor(lastLabel);
+      }
+    *xout = color;
+    }
+}
+
+#endif // RLELabelSliceToRGBAFilter_txx
@@ -0,0 +1,182 @@
+#include "EMGaussianMixtures.h"
+#include "GaussianMixtureModel.h"
+#include "LogicTestHelpers.h"
+#include <vnl/vnl_math.h>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+typedef Gaussian::VectorType VectorType;
+typedef Gaussian::MatrixType MatrixType;
+
+const int NCLASS = 3, NDIM = 2;
+
+// Samples from three Gaussians, followed by a sample so far from all of them
+// that its density underflows, even once it has pulled one of them towards it
+std::vector<double> makeSamples(int n_per_class)
+{
+  const double means[NCLASS][NDIM] = { {0.0, 0.0}, {5.0, 1.0}, {2.0, 6.0} };
+  const double sigmas[NCLASS][NDIM] = { {1.0, 0.5}, {0.7, 1.2}, {1.5, 1.0} };
+
+  std::vector<double> data;
+  unsigned long seed = 3;
+  for(int c = 0; c < NCLASS; c++)
+    {
+    for(int i = 0; i < n_per_class; i++)
+      {
+      for(int d = 0; d < NDIM; d++)
+        {
+        // Box-Muller with a fixed generator, so that the samples are the same
+        // on every platform
+        double u[2];
+        for(int k = 0; k < 2; k++)
+          {
+          seed = (seed * 1103515245 + 12345) & 0x7fffffff;
+          u[k] = (seed + 1.0) / 2147483649.0;
+          }
+        double z = sqrt(-2.0 * log(u[0])) * cos(2.0 * vnl_math::pi * u[1]);
+        data.push_back(means[c][d] + sigmas[c][d] * z);
+        }
+      }
+    }
+
+  data.push_back(1000.0);
+  data.push_back(-1000.0);
+
+  return data;
+}
+
+void setInitialModel(GaussianMixtureModel *gmm)
+{
+  const double means[NCLASS][NDIM] = { {1.0, 1.0}, {4.0, 0.0}, {1.0, 5.0} };
+  for(int j = 0; j < NCLASS; j++)
+    {
+    MatrixType cov(NDIM, NDIM, 0.0);
+    cov.fill_diagonal(2.0);
+    gmm->SetGaussian(j, VectorType(means[j], NDIM), cov);
+    gmm->SetWeight(j, 1.0 / NCLASS);
+    }
+}
+
+// The EM iterations as they were computed before the E and M steps were
+// split into blocks: one sample at a time, with the latent variables stored
+// by sample
+void referenceEM(double **x, int n, GaussianMixtureModel *gmm, int n_iter)
+{
+  std::vector<double> log_pdf(NCLASS), w(NCLASS), logw(NCLASS), sum(NCLASS);
+  std::vector< std::vector<double> > latent(n, std::vector<double>(NCLASS));
+
+  for(int iter = 0; iter < n_iter; iter++)
+    {
+    for(int j = 0; j < NCLASS; j++)
+      {
+      w[j] = gmm->GetWeight(j);
+      logw[j] = log(w[j]);
+      sum[j] = 0;
+      }
+
+    for(int i = 0; i < n; i++)
+      {
+      for(int j = 0; j < NCLASS; j++)
+        log_pdf[j] = gmm->EvaluateLogPDF(j, x[i]);
+      for(int j = 0; j < NCLASS; j++)
+        {
+        latent[i][j] = EMGaussianMixtures::ComputePosterior(
+              NCLASS, log_pdf.data(), w.data(), logw.data(), j);
+        sum[j] += latent[i][j];
+        }
+      }
+
+    for(int j = 0; j < NCLASS; j++)
+      {
+      VectorType mean(NDIM, 0.0);
+      for(int i = 0; i < n; i++)
+        for(int k = 0; k < NDIM; k++)
+          mean[k] += latent[i][j] * x[i][k];
+      mean /= sum[j];
+      gmm->SetMean(j, mean);
+
+      MatrixType cov(NDIM, NDIM, 0.0);
+      for(int i = 0; i < n; i++)
+        for(int k = 0; k < NDIM; k++)
+          for(int l = 0; l < NDIM; l++)
+            cov(k, l) += (x[i][k] - mean[k]) * (x[i][l] - mean[l]) * latent[i][j];
+      cov /= sum[j];
+      gmm->SetCovariance(j, cov);
+      }
+
+    for(int j = 0; j < NCLASS; j++)
+      gmm->SetWeight(j, sum[j] / n);
+    }
+}
+
+int checkClose(double value, double expected, const std::string &what)
+{
+  if(!(fabs(value - expected) <= 1.0e-8 * std::max(1.0, fabs(expected))))
+    {
+    std::cout << what << ": " << value << ", expected " << expected << std::endl;
+    return 1;
+    }
+  return 0;
+}
+
+int compareModels(GaussianMixtureModel *gmm, GaussianMixtureModel *ref, const std::string &step)
+{
+  int failures = 0;
+  for(int j = 0; j < NCLASS; j++)
+    {
+    std::string cls = step + ", class " + std::to_string(j);
+    failures += checkClose(gmm->GetWeight(j), ref->GetWeight(j), cls + " weight");
+    for(int k = 0; k < NDIM; k++)
+      {
+      failures += checkClose(gmm->GetMean(j)[k], ref->GetMean(j)[k], cls + " mean");
+      for(int l = 0; l < NDIM; l++)
+        failures += checkClose(gmm->GetCovariance(j)(k, l), ref->GetCovariance(j)(k, l),
+                               cls + " covariance");
+      }
+    }
+  return failures;
+}
+
+int main(int argc, char *argv[])
+{
+  int failures = 0;
+
+  // Enough samples for several blocks, the last of them partial
+  std::vector<double> data = makeSamples(5000);
+  int n = data.size() / NDIM;
+  std::vector<double *> x(n);
+  for(int i = 0; i < n; i++)
+    x[i] = &data[i * NDIM];
+
+  const int n_iter = 6;
+  SmartPtr<GaussianMixtureModel> ref = GaussianMixtureModel::New();
+  ref->Initialize(NDIM, NCLASS);
+  setInitialModel(ref);
+  referenceEM(x.data(), n, ref, n_iter);
+
+  // Single steps
+  EMGaussianMixtures em(x.data(), n, NDIM, NCLASS);
+  setInitialModel(em.GetGaussianMixtureModel());
+  for(int iter = 0; iter < n_iter; iter++)
+    em.UpdateOnce();
+  failures += compareModels(em.GetGaussianMixtureModel(), ref, "UpdateOnce");
+
+  // The likelihood stays finite although the density of the outlier
+  // underflows
+  failures += TestCheck(std::isfinite(em.EvaluateLogLikelihood()),
+                        "Log likelihood is not finite");
+
+  // Update runs all of the iterations. With a likelihood of -inf, it would
+  // stop after the second one
+  EMGaussianMixtures em2(x.data(), n, NDIM, NCLASS);
+  setInitialModel(em2.GetGaussianMixtureModel());
+  em2.SetMaxIteration(n_iter);
+  em2.SetPrecision(0.0);
+  em2.Update();
+  failures += compareModels(em2.GetGaussianMixtureModel(), ref, "Update");
+
+  return TestExitStatus(failures);
+}
@@ -0,0 +1,185 @@
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+using namespace std;
+
+#include <itkImage.h>
+#include <itkImageFileReader.h>
+#include <itkTimeProbe.h>
+#include "FastLinearInterpolator.h"
+
+typedef itk::Image<short, 3> Seg3DImageType;
+typedef itk::ImageFileReader<Seg3DImageType> SegReaderType;
+
+Seg3DImageType::Pointer loadImage(const string filename)
+{
+    SegReaderType::Pointer sr = SegReaderType::New();
+    sr->SetFileName(filename);
+    sr->Update();
+    return sr->GetOutput();
+}
+
+//an oblique plane through slice sliceIndex along axis, tilted by angle
+//toward the next axis. Lines of the plane run along the third axis.
+struct ObliquePlane
+{
+    double origin[3], lineStep[3], rowStep[3];
+    int lineLength, nLines;
+};
+
+ObliquePlane makePlane(Seg3DImageType *image, int axis, int sliceIndex, double angle)
+{
+    itk::Size<3> size = image->GetLargestPossibleRegion().GetSize();
+    int a1 = (axis + 1) % 3, a2 = (axis + 2) % 3;
+    const double pi = 3.14159265358979323846;
+    double c = cos(angle * pi / 180.0), s = sin(angle * pi / 180.0);
+
+    ObliquePlane plane;
+    for (int d = 0; d < 3; d++)
+        plane.origin[d] = plane.lineStep[d] = plane.rowStep[d] = 0.0;
+
+    //rows advance along a1, tilted out of the slice plane
+    plane.rowStep[a1] = c;
+    plane.rowStep[axis] = s;
+    plane.lineStep[a2] = 1.0;
+
+    //center the tilted plane on the requested slice
+    plane.origin[axis] = sliceIndex - 0.5 * s * (size[a1] - 1) + 0.25;
+    plane.origin[a1] = 0.3;
+    plane.origin[a2] = -0.7;
+    plane.lineLength = size[a2] + 2;
+    plane.nLines = size[a1];
+    return plane;
+}
+
+//sample the plane one point at a time, returns the elapsed seconds
+template <class TInterpolator>
+double samplePointwise(TInterpolator &interp, const ObliquePlane &plane,
+    vector<typename TInterpolator::OutputComponentType> &out, int nReps)
+{
+    itk::TimeProbe tp;
+    tp.Start();
+    for (int rep = 0; rep < nReps; rep++)
+    {
+        typename TInterpolator::OutputComponentType *p = &out[0];
+        for (int j = 0; j < plane.nLines; j++)
+        {
+            typename TInterpolator::RealType cix[3];
+            for (int d = 0; d < 3; d++)
+                cix[d] = plane.origin[d] + j * plane.rowStep[d];
+            for (int i = 0; i < plane.lineLength; i++, p++)
+            {
+                if (interp.Interpolate(cix, p) == TInterpolator::OUTSIDE)
+                    *p = 0;
+                for (int d = 0; d < 3; d++)
+                    cix[d] += plane.lineStep[d];
+            }
+        }
+    }
+    tp.Stop();
+    return tp.GetTotal();
+}
+
+//sample the plane a line at a time, returns the elapsed seconds
+template <class TInterpolator>
+double sampleLines(TInterpolator &interp, const ObliquePlane &plane,
+    vector<typename TInterpolator::OutputComponentType> &out, int nReps)
+{
+    typedef typename TInterpolator::RealType RealType;
+    vector<typename TInterpolator::InOut> status(plane.lineLength);
+    RealType step[3] = { plane.lineStep[0], plane.lineStep[1], plane.lineStep[2] };
+
+    itk::TimeProbe tp;
+    tp.Start();
+    for (int rep = 0; rep < nReps; rep++)
+    {
+        typename TInterpolator::OutputComponentType *p = &out[0];
+        for (int j = 0; j < plane.nLines; j++, p += plane.lineLength)
+        {
+            RealType cix[3];
+            for (int d = 0; d < 3; d++)
+                cix[d] = plane.origin[d] + j * plane.rowStep[d];
+            interp.InterpolateLine(cix, step, plane.lineLength, p, &status[0]);
+            for (int i = 0; i < plane.lineLength; i++)
+                if (status[i] == TInterpolator::OUTSIDE)
+                    p[i] = 0;
+        }
+    }
+    tp.Stop();
+    return tp.GetTotal();
+}
+
+//compare the pointwise and line sampling, returns false on mismatch
+template <class TFloat>
+bool benchmark(Seg3DImageType *image, const ObliquePlane &plane, int nReps)
+{
+    typedef FastLinearInterpolator<Seg3DImageType, TFloat, 3> InterpolatorType;
+    typedef typename InterpolatorType::OutputComponentType OutputType;
+    InterpolatorType interp(image);
+
+    size_t nSamples = (size_t) plane.nLines * plane.lineLength;
+    vector<OutputType> ref(nSamples), vec(nSamples);
+
+    double tRef = samplePointwise(interp, plane, ref, nReps);
+    double tVec = sampleLines(interp, plane, vec, nReps);
+
+    double maxDiff = 0.0;
+    for (size_t i = 0; i < nSamples; i++)
+        maxDiff = std::max(maxDiff, (double) fabs(ref[i] - vec[i]));
+
+    double total = (double) nSamples * nReps;
+    cout << (sizeof(TFloat) == sizeof(float) ? "float " : "double")
+        << " pointwise: " << total / tRef << " samples/s, "
+        << InterpolatorType::Kernel::GetName() << " lines: " << total / tVec
+        << " samples/s, speedup " << tRef / tVec
+        << ", max difference " << maxDiff << endl;
+
+    return maxDiff <= 1.0e-3;
+}
+
+//sample an oblique slice through the image with the fast linear
+//interpolator, report the number of samples per second
+int main(int argc, char *argv[])
+{
+    if (argc < 4)
+    {
+        cout << "Usage:\n" << argv[0] << " InputImage3D.ext X|Y|Z SliceNumber [AngleDegrees] [Repetitions]" << endl;
+        return 1;
+    }
+
+    int axis;
+    switch (argv[2][0])
+    {
+    case 'X':
+    case 'x': axis = 0; break;
+    case 'Y':
+    case 'y': axis = 1; break;
+    case 'Z':
+    case 'z': axis = 2; break;
+    default: throw std::runtime_error("Axis should be X, Y or Z");
+    }
+
+    int sliceIndex = atoi(argv[3]);
+    double angle = argc > 4 ? atof(argv[4]) : 30.0;
+    int nReps = argc > 5 ? atoi(argv[5]) : 20;
+
+    Seg3DImageType::Pointer image = loadImage(argv[1]);
+    ObliquePlane plane = makePlane(image, axis, sliceIndex, angle);
+
+    cout << "Oblique slice " << argv[2] << " " << sliceIndex << " at " << angle
+        << " degrees, " << plane.nLines << " lines of " << plane.lineLength << endl;
+
+    bool ok = benchmark<double>(image, plane, nReps);
+    ok = benchmark<float>(image, plane, nReps) && ok;
+
+    if (!ok)
+    {
+        cout << "Line and pointwise interpolation differ" << endl;
+        return 1;
+    }
+    return 0;
+}
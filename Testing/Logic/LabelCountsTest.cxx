@@ -0,0 +1,119 @@
+#include "IRISApplication.h"
+#include "DummySystemInfoDelegate.h"
+#include "LogicTestHelpers.h"
+#include "ImageIODelegates.h"
+#include "LabelImageWrapper.h"
+#include "SegmentationStatistics.h"
+#include <iostream>
+#include <map>
+
+// Check the label counts of the wrapper and of the statistics against a scan
+// of the voxels of the current time point
+int checkCounts(IRISApplication *app, const std::string &step)
+{
+  LabelImageWrapper *seg = app->GetSelectedSegmentationLayer();
+
+  std::map<LabelType, size_t> expected;
+  for(LabelImageWrapper::ConstIterator it = seg->GetImageConstIterator(); !it.IsAtEnd(); ++it)
+    expected[it.Get()]++;
+
+  int failures = 0;
+  const SegmentationStatistics::EntryMap &stats = app->GetSegmentationStatistics().GetStats();
+  for(auto &it : expected)
+    {
+    size_t nWrapper = seg->GetNumberOfVoxelsWithLabel(it.first);
+    auto eit = stats.find(it.first);
+    size_t nStats = eit == stats.end() ? 0 : eit->second.count;
+    failures += TestCheck(nWrapper == it.second && nStats == it.second,
+                          step + ": label " + std::to_string(it.first) + " has "
+                          + std::to_string(it.second) + " voxels, wrapper reports "
+                          + std::to_string(nWrapper) + ", statistics report "
+                          + std::to_string(nStats));
+    }
+
+  // Labels that are no longer present are dropped from the statistics
+  for(auto &it : stats)
+    failures += TestCheck(!it.second.count || expected.count(it.first),
+                          step + ": statistics report absent label " + std::to_string(it.first));
+
+  return failures;
+}
+
+// Paint a block of voxels with a label, overlapping the existing labels
+unsigned long paintBlock(IRISApplication *app, long x0, LabelType label)
+{
+  LabelImageWrapper *seg = app->GetSelectedSegmentationLayer();
+  Vector3ui size = seg->GetSize();
+
+  std::vector<itk::Index<3> > voxels;
+  for(long z = size[2] / 4; z < (long) size[2] / 2; z++)
+    for(long y = size[1] / 4; y < (long) size[1] / 2; y++)
+      for(long x = x0; x < x0 + (long) size[0] / 3; x++)
+        voxels.push_back({{ x, y, z }});
+
+  DrawOverFilter draw_over;
+  draw_over.CoverageMode = PAINT_OVER_ALL;
+  draw_over.DrawOverLabel = 0;
+  return seg->PaintVoxels(voxels, label, draw_over, "Paint");
+}
+
+int main(int argc, char *argv[])
+{
+  if(argc < 2)
+    {
+    std::cerr << "Usage: " << argv[0] << " test_data_dir" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  DummySystemInfoDelegate sidel(argv[0]);
+  SystemInterface::SetSystemInfoDelegate(&sidel);
+
+  IRISApplication::Pointer app = IRISApplication::New();
+  std::string dir = argv[1];
+  IRISWarningList wl;
+  app->OpenImage((dir + "/img4d_11f.nii.gz").c_str(), MAIN_ROLE, wl);
+  app->OpenImage((dir + "/seg4d_11f.nii.gz").c_str(), LABEL_ROLE, wl);
+
+  int failures = 0;
+
+  // Compute the counts once, after which they are updated from the deltas
+  failures += checkCounts(app, "load");
+
+  failures += TestCheck(paintBlock(app, 0, 3) != 0, "paint: nothing was painted");
+  failures += checkCounts(app, "paint");
+
+  // A second stroke partly over the first one
+  paintBlock(app, app->GetSelectedSegmentationLayer()->GetSize()[0] / 6, 4);
+  failures += checkCounts(app, "paint over");
+
+  app->Undo();
+  failures += checkCounts(app, "undo");
+
+  app->Undo();
+  failures += checkCounts(app, "undo twice");
+
+  app->Redo();
+  failures += checkCounts(app, "redo");
+
+  // Each time point has its own counts and undo history
+  app->SetCursorTimePoint(5);
+  failures += checkCounts(app, "time point 5");
+
+  paintBlock(app, 2, 1);
+  failures += checkCounts(app, "paint at time point 5");
+
+  app->SetCursorTimePoint(0);
+  failures += checkCounts(app, "back to time point 0");
+
+  app->Undo();
+  failures += checkCounts(app, "undo at time point 0");
+
+  app->SetCursorTimePoint(5);
+  app->Undo();
+  failures += checkCounts(app, "undo at time point 5");
+
+  app->Redo();
+  failures += checkCounts(app, "redo at time point 5");
+
+  return TestExitStatus(failures);
+}
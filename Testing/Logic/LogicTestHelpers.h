@@ -0,0 +1,64 @@
+#ifndef LOGICTESTHELPERS_H
+#define LOGICTESTHELPERS_H
+
+#include "SNAPCommon.h"
+#include "RLERegionOfInterestImageFilter.h"
+#include "itkImage.h"
+#include "itkImageRegionIteratorWithIndex.h"
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+/**
+ * Allocate an image of the given size and set every voxel to f(index). The
+ * logic tests use this to build their input images without reading files.
+ */
+template <class TImage, class TFunction>
+typename TImage::Pointer MakeTestImage(const typename TImage::SizeType &size, TFunction f)
+{
+  typename TImage::RegionType region;
+  region.SetSize(size);
+
+  typename TImage::Pointer img = TImage::New();
+  img->SetRegions(region);
+  img->Allocate();
+  for(itk::ImageRegionIteratorWithIndex<TImage> it(img, region); !it.IsAtEnd(); ++it)
+    it.Set(f(it.GetIndex()));
+  return img;
+}
+
+/**
+ * Convert an image to an RLE image with the same region, disconnected from
+ * the converter so that it can be modified by the test.
+ */
+template <class TRLEImage, class TImage>
+typename TRLEImage::Pointer ConvertToRLE(TImage *img)
+{
+  typedef itk::RegionOfInterestImageFilter<TImage, TRLEImage> ConverterType;
+  typename ConverterType::Pointer conv = ConverterType::New();
+  conv->SetInput(img);
+  conv->SetRegionOfInterest(img->GetLargestPossibleRegion());
+  conv->Update();
+  typename TRLEImage::Pointer out = conv->GetOutput();
+  out->DisconnectPipeline();
+  return out;
+}
+
+/** Print the message and return 1 if a check failed, return 0 otherwise */
+inline int TestCheck(bool ok, const std::string &message)
+{
+  if(ok)
+    return 0;
+  std::cout << message << std::endl;
+  return 1;
+}
+
+/** Print the number of failures and return the exit status of the test */
+inline int TestExitStatus(int failures)
+{
+  if(failures)
+    std::cout << failures << " failures" << std::endl;
+  return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+#endif // LOGICTESTHELPERS_H
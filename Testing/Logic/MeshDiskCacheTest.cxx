@@ -0,0 +1,125 @@
+#include "MeshDiskCache.h"
+#include "MultiLabelMeshPipeline.h"
+#include "MeshOptions.h"
+#include "LogicTestHelpers.h"
+#include "itksys/Directory.hxx"
+#include "itksys/SystemTools.hxx"
+#include "vtkPolyData.h"
+#include <iostream>
+
+using itksys::SystemTools;
+
+typedef MultiLabelMeshPipeline::InputImageType LabelImageType;
+typedef itk::Image<LabelType, 3> PlainImageType;
+
+// A cube of label 1 spanning [10,19] along each axis, with one voxel removed.
+// Cubes with different holes have the same voxel count and bounding box
+SmartPtr<LabelImageType> makeCube(long hole)
+{
+  PlainImageType::Pointer img = MakeTestImage<PlainImageType>(
+        {{30, 30, 30}}, [=](const PlainImageType::IndexType &idx)
+    {
+    bool inside = true, in_hole = true;
+    for(int d = 0; d < 3; d++)
+      {
+      inside = inside && idx[d] >= 10 && idx[d] <= 19;
+      in_hole = in_hole && idx[d] == hole;
+      }
+    return (LabelType) (inside && !in_hole ? 1 : 0);
+    });
+  return ConvertToRLE<LabelImageType>(img.GetPointer());
+}
+
+// Compute the meshes of an image with a fresh pipeline, as after a restart
+vtkSmartPointer<vtkPolyData> computeMesh(LabelImageType *image, MeshOptions *options,
+                                         MeshDiskCache *cache)
+{
+  SmartPtr<MultiLabelMeshPipeline> pipeline = MultiLabelMeshPipeline::New();
+  pipeline->SetImage(image);
+  pipeline->SetMeshOptions(options);
+  pipeline->SetDiskCache(cache);
+  pipeline->UpdateMeshes(nullptr);
+  return pipeline->GetMeshCollection()[1];
+}
+
+// Number of mesh files in the cache directory
+unsigned long countFiles(const std::string &dir)
+{
+  itksys::Directory d;
+  unsigned long n = 0;
+  if(d.Load(dir))
+    for(unsigned long i = 0; i < d.GetNumberOfFiles(); i++)
+      if(SystemTools::GetFilenameLastExtension(d.GetFile(i)) == ".vtk")
+        n++;
+  return n;
+}
+
+int main(int argc, char *argv[])
+{
+  int failures = 0;
+
+  std::string dir = SystemTools::GetCurrentWorkingDirectory() + "/MeshDiskCacheTest.meshcache";
+  SystemTools::RemoveADirectory(dir);
+
+  SmartPtr<MeshOptions> options = MeshOptions::New();
+  SmartPtr<MeshDiskCache> cache = MeshDiskCache::New();
+  cache->SetDirectory(dir);
+
+  // The first computation misses and queues the mesh for writing
+  SmartPtr<LabelImageType> cubeA = makeCube(12);
+  vtkSmartPointer<vtkPolyData> meshA = computeMesh(cubeA, options, cache);
+  if(!meshA || meshA->GetNumberOfPoints() == 0 || cache->GetNumberOfMisses() != 1)
+    {
+    std::cout << "First computation did not produce a mesh" << std::endl;
+    failures++;
+    }
+
+  cache->Flush();
+  if(cache->GetDiskUsage() == 0 || countFiles(dir) != 1)
+    {
+    std::cout << "Mesh was not written to the cache" << std::endl;
+    failures++;
+    }
+
+  // The same voxels in a new image hit the cache
+  vtkSmartPointer<vtkPolyData> meshA2 = computeMesh(makeCube(12), options, cache);
+  if(cache->GetNumberOfHits() != 1
+     || !meshA2 || meshA2->GetNumberOfPoints() != meshA->GetNumberOfPoints())
+    {
+    std::cout << "Identical image did not hit the cache" << std::endl;
+    failures++;
+    }
+
+  // A different shape with the same voxel count and bounding box misses
+  SmartPtr<LabelImageType> cubeB = makeCube(13);
+  computeMesh(cubeB, options, cache);
+  if(cache->GetNumberOfHits() != 1 || cache->GetNumberOfMisses() != 2)
+    {
+    std::cout << "Different shape with the same count and bounding box hit the cache"
+              << std::endl;
+    failures++;
+    }
+
+  // A mesh can be read back before it has been written
+  computeMesh(makeCube(14), options, cache);
+  if(!computeMesh(makeCube(14), options, cache) || cache->GetNumberOfHits() != 2)
+    {
+    std::cout << "Queued mesh was not found" << std::endl;
+    failures++;
+    }
+
+  // With no room, only the most recent file is kept
+  cache->Flush();
+  cache->SetMaximumSize(1);
+  computeMesh(makeCube(15), options, cache);
+  cache->Flush();
+  if(countFiles(dir) != 1)
+    {
+    std::cout << "Expected 1 file after eviction, found " << countFiles(dir) << std::endl;
+    failures++;
+    }
+
+  SystemTools::RemoveADirectory(dir);
+
+  return TestExitStatus(failures);
+}
@@ -0,0 +1,128 @@
+#include "MultiLabelMeshPipeline.h"
+#include "MeshOptions.h"
+#include "LogicTestHelpers.h"
+#include "vtkPolyData.h"
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+typedef MultiLabelMeshPipeline::InputImageType LabelImageType;
+typedef itk::Image<LabelType, 3> PlainImageType;
+
+// A ball of the given label, as an RLE image
+SmartPtr<LabelImageType> makeBall(double radius, LabelType label)
+{
+  PlainImageType::Pointer img = MakeTestImage<PlainImageType>(
+        {{40, 40, 40}}, [=](const PlainImageType::IndexType &idx)
+    {
+    double r2 = 0;
+    for(int d = 0; d < 3; d++)
+      r2 += (idx[d] - 20.0) * (idx[d] - 20.0);
+    return r2 <= radius * radius ? label : (LabelType) 0;
+    });
+  return ConvertToRLE<LabelImageType>(img.GetPointer());
+}
+
+// Number of points in the mesh of a label, or -1 if there is no mesh
+long countPoints(MultiLabelMeshPipeline *pipeline, LabelType label)
+{
+  std::map<LabelType, vtkSmartPointer<vtkPolyData> > meshes = pipeline->GetMeshCollection();
+  if(!meshes.count(label) || !meshes[label])
+    return -1;
+  return meshes[label]->GetNumberOfPoints();
+}
+
+// Visit a time point the way the mesh wrapper does
+MultiLabelMeshPipeline *visit(MultiLabelMeshPipelineTable *table, unsigned int tp,
+                              LabelImageType *image, MeshOptions *options)
+{
+  SmartPtr<MultiLabelMeshPipeline> pipeline = table->GetPipeline(tp);
+  if(!pipeline)
+    {
+    pipeline = MultiLabelMeshPipeline::New();
+    table->SetPipeline(tp, pipeline);
+    }
+  pipeline->SetImage(image);
+  pipeline->SetMeshOptions(options);
+  pipeline->UpdateMeshes(nullptr);
+  table->SetCurrentTimePoint(tp);
+  return pipeline;
+}
+
+int main(int argc, char *argv[])
+{
+  int failures = 0;
+  const unsigned int nt = 6;
+
+  std::vector<SmartPtr<LabelImageType> > images;
+  for(unsigned int tp = 0; tp < nt; tp++)
+    images.push_back(makeBall(8.0 + tp, 1));
+
+  SmartPtr<MeshOptions> options = MeshOptions::New();
+  SmartPtr<MultiLabelMeshPipelineTable> table = MultiLabelMeshPipelineTable::New();
+  table->SetPrefetchCount(2);
+  table->SetPipelineFactory(
+        [&](unsigned int tp)
+    {
+    return MultiLabelMeshPipelineTable::CreateDetachedPipeline(images[tp], options, nullptr);
+    }, nt);
+
+  // Visiting the first frame schedules the next two in the background
+  visit(table, 0, images[0], options);
+  for(int i = 0; i < 6000 && table->GetNumberOfPrefetchedPipelines() < 2; i++)
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  if(table->GetNumberOfPrefetchedPipelines() != 2)
+    {
+    std::cout << "Expected 2 prefetched pipelines, found "
+              << table->GetNumberOfPrefetchedPipelines() << std::endl;
+    failures++;
+    }
+
+  // Edit the live image of a prefetched frame. The background thread worked
+  // on a copy, and the edit must show up when the frame is visited
+  images[2] = makeBall(10.0, 2);
+
+  // The prefetched frame comes with its mesh
+  SmartPtr<MultiLabelMeshPipeline> p1 = table->GetPipeline(1);
+  if(!p1 || countPoints(p1, 1) <= 0)
+    {
+    std::cout << "Prefetched pipeline for time point 1 has no mesh" << std::endl;
+    failures++;
+    }
+
+  MultiLabelMeshPipeline *p2 = visit(table, 1, images[1], options);
+  if(p2 != p1.GetPointer() || countPoints(p2, 1) <= 0)
+    failures++;
+
+  p2 = visit(table, 2, images[2], options);
+  if(countPoints(p2, 1) != -1 || countPoints(p2, 2) <= 0)
+    {
+    std::cout << "Time point 2 does not reflect the edit" << std::endl;
+    failures++;
+    }
+
+  // Without room for meshes, everything but the current frame is evicted
+  unsigned long evictions = table->GetNumberOfEvictions();
+  table->SetMemoryLimit(0);
+  visit(table, 3, images[3], options);
+  if(table->GetNumberOfEvictions() <= evictions)
+    failures++;
+  for(unsigned int tp = 0; tp < nt; tp++)
+    {
+    if(table->Contains(tp) != (tp == 3))
+      {
+      std::cout << "Unexpected table contents at time point " << tp << std::endl;
+      failures++;
+      }
+    }
+
+  // Nothing is prefetched while the table is over its memory limit
+  unsigned long prefetched = table->GetNumberOfPrefetchedPipelines();
+  visit(table, 4, images[4], options);
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  if(table->GetNumberOfPrefetchedPipelines() != prefetched || table->Contains(5))
+    failures++;
+
+  return TestExitStatus(failures);
+}
@@ -0,0 +1,163 @@
+#include "IRISApplication.h"
+#include "DummySystemInfoDelegate.h"
+#include "LogicTestHelpers.h"
+#include "ImageIODelegates.h"
+#include "LabelImageWrapper.h"
+#include "SegmentationUpdateIterator.h"
+#include <algorithm>
+#include <iostream>
+#include <set>
+#include <vector>
+
+typedef itk::Index<3> IndexType;
+typedef std::set<IndexType, itk::Functor::IndexLexicographicCompare<3> > IndexSet;
+
+// The labels of all the voxels of the segmentation
+std::vector<LabelType> snapshot(LabelImageWrapper *seg)
+{
+  std::vector<LabelType> labels;
+  for(LabelImageWrapper::ConstIterator it = seg->GetImageConstIterator(); !it.IsAtEnd(); ++it)
+    labels.push_back(it.Get());
+  return labels;
+}
+
+int checkSnapshot(LabelImageWrapper *seg, const std::vector<LabelType> &expected,
+                  const std::string &step)
+{
+  std::vector<LabelType> labels = snapshot(seg);
+  size_t n_diff = 0;
+  for(size_t i = 0; i < labels.size(); i++)
+    if(labels[i] != expected[i])
+      n_diff++;
+
+  return TestCheck(n_diff == 0, step + ": " + std::to_string(n_diff) + " voxels differ");
+}
+
+// Spray voxels at random over the image and a margin around it, in no
+// particular order and with repeats, as the 3D spray tool does
+std::vector<IndexType> makeSpray(LabelImageWrapper *seg, unsigned long seed)
+{
+  Vector3ui size = seg->GetSize();
+  std::vector<IndexType> voxels;
+  for(int i = 0; i < 5000; i++)
+    {
+    IndexType idx;
+    for(int d = 0; d < 3; d++)
+      {
+      seed = seed * 1103515245 + 12345;
+      idx[d] = (long) ((seed >> 8) % (size[d] + 6)) - 3;
+      }
+    voxels.push_back(idx);
+
+    // Every tenth voxel is sprayed twice, once right away and once later
+    if(i % 10 == 0)
+      voxels.insert(voxels.begin() + i / 2, idx);
+    }
+  return voxels;
+}
+
+// Paint with PaintVoxels and with SegmentationUpdateIterator, and check that
+// the results match and that undo and redo restore them
+int testSpray(IRISApplication *app, unsigned long seed, LabelType label,
+              const DrawOverFilter &draw_over, const std::string &name)
+{
+  int failures = 0;
+  LabelImageWrapper *seg = app->GetSelectedSegmentationLayer();
+  itk::ImageRegion<3> region = seg->GetBufferedRegion();
+
+  std::vector<IndexType> voxels = makeSpray(seg, seed);
+  IndexSet inside;
+  for(const IndexType &idx : voxels)
+    if(region.IsInside(idx))
+      inside.insert(idx);
+
+  std::vector<LabelType> before = snapshot(seg);
+  unsigned long nChanged = seg->PaintVoxels(voxels, label, draw_over, "Spray");
+  std::vector<LabelType> after = snapshot(seg);
+  failures += TestCheck(nChanged != 0, name + ": nothing was painted");
+
+  app->Undo();
+  failures += checkSnapshot(seg, before, name + " undo");
+
+  app->Redo();
+  failures += checkSnapshot(seg, after, name + " redo");
+
+  // The same voxels painted one at a time over their bounding box
+  app->Undo();
+  itk::Index<3> lower = *inside.begin(), upper = *inside.begin();
+  for(const IndexType &idx : inside)
+    for(int d = 0; d < 3; d++)
+      {
+      lower[d] = std::min(lower[d], idx[d]);
+      upper[d] = std::max(upper[d], idx[d]);
+      }
+  itk::ImageRegion<3> bbox;
+  bbox.SetIndex(lower);
+  bbox.SetUpperIndex(upper);
+
+  SegmentationUpdateIterator it(seg, bbox, label, draw_over);
+  for(; !it.IsAtEnd(); ++it)
+    if(inside.count(it.GetIndex()))
+      it.PaintLabel(label);
+  it.Finalize("Iterator");
+
+  failures += checkSnapshot(seg, after, name + " against the iterator");
+  failures += TestCheck(it.GetNumberOfChangedVoxels() == nChanged,
+                        name + ": " + std::to_string(nChanged) + " voxels changed, the iterator changed "
+                        + std::to_string(it.GetNumberOfChangedVoxels()));
+
+  // Undoing the iterator's update restores the original labels as well
+  app->Undo();
+  failures += checkSnapshot(seg, before, name + " undo iterator");
+
+  // Leave the spray applied for the next test
+  seg->PaintVoxels(voxels, label, draw_over, "Spray");
+  return failures;
+}
+
+int main(int argc, char *argv[])
+{
+  if(argc < 2)
+    {
+    std::cerr << "Usage: " << argv[0] << " test_data_dir" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  DummySystemInfoDelegate sidel(argv[0]);
+  SystemInterface::SetSystemInfoDelegate(&sidel);
+
+  IRISApplication::Pointer app = IRISApplication::New();
+  std::string dir = argv[1];
+  IRISWarningList wl;
+  app->OpenImage((dir + "/MRIcrop-orig.gipl.gz").c_str(), MAIN_ROLE, wl);
+  app->OpenImage((dir + "/MRIcrop-seg.gipl.gz").c_str(), LABEL_ROLE, wl);
+
+  int failures = 0;
+
+  DrawOverFilter all;
+  all.CoverageMode = PAINT_OVER_ALL;
+  all.DrawOverLabel = 0;
+  failures += testSpray(app, 1, 5, all, "over all");
+
+  DrawOverFilter visible;
+  visible.CoverageMode = PAINT_OVER_VISIBLE;
+  visible.DrawOverLabel = 0;
+  failures += testSpray(app, 2, 6, visible, "over visible");
+
+  DrawOverFilter one;
+  one.CoverageMode = PAINT_OVER_ONE;
+  one.DrawOverLabel = 0;
+  failures += testSpray(app, 3, 7, one, "over clear");
+
+  // Erasing with the clear label
+  failures += testSpray(app, 4, 0, all, "erase");
+
+  // Voxels that are all outside of the image change nothing
+  LabelImageWrapper *seg = app->GetSelectedSegmentationLayer();
+  std::vector<IndexType> outside = {{{ -1, 0, 0 }}, {{ 0, (long) seg->GetSize()[1], 0 }},
+                                    {{ 0, 0, -5 }}};
+  failures += TestCheck(seg->PaintVoxels(outside, 5, all, "Outside") == 0,
+                        "Voxels outside of the image were painted");
+
+  return TestExitStatus(failures);
+}
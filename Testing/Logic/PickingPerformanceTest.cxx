@@ -0,0 +1,126 @@
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <random>
+
+using namespace std;
+
+#include <itkImage.h>
+#include <itkImageFileReader.h>
+#include <itkTimeProbe.h>
+#include "RLERegionOfInterestImageFilter.h"
+#include "ImageRayIntersectionFinder.h"
+#include "ImageBrickOccupancy.h"
+
+typedef itk::Image<short, 3> Seg3DImageType;
+typedef RLEImage<short> RLEImage3D;
+typedef itk::ImageFileReader<Seg3DImageType> SegReaderType;
+
+Seg3DImageType::Pointer loadImage(const string filename)
+{
+    SegReaderType::Pointer sr = SegReaderType::New();
+    sr->SetFileName(filename);
+    sr->Update();
+    return sr->GetOutput();
+}
+
+//any non-zero label is a hit
+class NonZeroHitTester
+{
+public:
+    int operator()(short label) const { return label != 0 ? 1 : 0; }
+};
+
+typedef ImageRayIntersectionFinder<RLEImage3D, NonZeroHitTester> FinderType;
+
+struct Ray
+{
+    Vector3d start, dir;
+};
+
+//cast all the rays, returns the elapsed seconds
+double castRays(const FinderType &finder, RLEImage3D *image, const vector<Ray> &rays,
+    vector<Vector3i> &hits, vector<int> &results)
+{
+    itk::TimeProbe tp;
+    tp.Start();
+    for (size_t i = 0; i < rays.size(); i++)
+        results[i] = finder.FindIntersection(image, rays[i].start, rays[i].dir, hits[i]);
+    tp.Stop();
+    return tp.GetTotal();
+}
+
+//cast random rays at a segmentation, with and without the brick occupancy
+//grid, and report the number of picks per second
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        cout << "Usage:\n" << argv[0] << " InputSegmentation3D.ext [NumberOfRays]" << endl;
+        return 1;
+    }
+
+    int nRays = argc > 2 ? atoi(argv[2]) : 20000;
+
+    Seg3DImageType::Pointer image = loadImage(argv[1]);
+    typedef itk::RegionOfInterestImageFilter<Seg3DImageType, RLEImage3D> ConverterType;
+    ConverterType::Pointer conv = ConverterType::New();
+    conv->SetInput(image);
+    conv->SetRegionOfInterest(image->GetLargestPossibleRegion());
+    conv->Update();
+    RLEImage3D::Pointer rle = conv->GetOutput();
+
+    itk::TimeProbe tp;
+    tp.Start();
+    ImageBrickOccupancy occupancy;
+    occupancy.Build(rle.GetPointer());
+    tp.Stop();
+    cout << "Building brick occupancy: " << tp.GetTotal() * 1000 << " ms" << endl;
+
+    //rays start on a sphere around the image and aim at random points inside
+    itk::Size<3> size = rle->GetLargestPossibleRegion().GetSize();
+    double radius = 0.0;
+    for (int d = 0; d < 3; d++)
+        radius += size[d] * size[d];
+    radius = sqrt(radius);
+
+    std::mt19937 gen(1234);
+    std::normal_distribution<double> normal;
+    std::uniform_real_distribution<double> unif(0.0, 1.0);
+    vector<Ray> rays(nRays);
+    for (int i = 0; i < nRays; i++)
+    {
+        Vector3d u(normal(gen), normal(gen), normal(gen)), target;
+        u.normalize();
+        for (int d = 0; d < 3; d++)
+        {
+            target[d] = unif(gen) * (size[d] - 1);
+            rays[i].start[d] = 0.5 * (size[d] - 1) + radius * u[d];
+        }
+        rays[i].dir = target - rays[i].start;
+    }
+
+    FinderType finder;
+    vector<Vector3i> hitsRef(nRays), hits(nRays);
+    vector<int> resultsRef(nRays), results(nRays);
+
+    double tRef = castRays(finder, rle, rays, hitsRef, resultsRef);
+    finder.SetBrickOccupancy(&occupancy);
+    double tBrick = castRays(finder, rle, rays, hits, results);
+
+    int nHits = 0, nDiff = 0;
+    for (int i = 0; i < nRays; i++)
+    {
+        if (resultsRef[i] == 1)
+            nHits++;
+        if (results[i] != resultsRef[i] || (results[i] == 1 && hits[i] != hitsRef[i]))
+            nDiff++;
+    }
+
+    cout << nRays << " rays, " << nHits << " hits" << endl;
+    cout << "voxel walk: " << nRays / tRef << " picks/s, brick occupancy: "
+        << nRays / tBrick << " picks/s, speedup " << tRef / tBrick << endl;
+    cout << "Number of rays with different result: " << nDiff << endl;
+
+    return nDiff == 0 ? 0 : 1;
+}
@@ -0,0 +1,110 @@
+#include "RFClassificationEngine.h"
+#include "LogicTestHelpers.h"
+#include <iostream>
+#include <map>
+#include <set>
+
+typedef RFClassificationEngine<GreyType, LabelType, 3> EngineType;
+typedef EngineType::LabelImageType LabelImageType;
+typedef itk::Image<LabelType, 3> PlainImageType;
+
+// A segmentation dominated by label 1, with a few voxels of label 2 and a
+// slab of label 3
+PlainImageType::Pointer makeSegmentation()
+{
+  return MakeTestImage<PlainImageType>(
+        {{100, 100, 100}}, [](const PlainImageType::IndexType &idx)
+    {
+    if(idx[2] == 50 && idx[1] == 50 && idx[0] >= 40 && idx[0] < 60)
+      return (LabelType) 2;
+    else if(idx[2] == 10)
+      return (LabelType) 3;
+    else if(idx[2] < 5)
+      return (LabelType) 0;
+    else
+      return (LabelType) 1;
+    });
+}
+
+// Check that the sampled voxels are distinct, lie in the region and carry
+// their labels, and count them by label
+int checkSample(const std::vector<EngineType::SampleVoxel> &sample, PlainImageType *img,
+                const itk::ImageRegion<3> &region, std::map<LabelType, unsigned long> &counts)
+{
+  std::set<itk::Index<3>, itk::Functor::IndexLexicographicCompare<3> > seen;
+  counts.clear();
+  for(const EngineType::SampleVoxel &v : sample)
+    {
+    if(!region.IsInside(v.first) || img->GetPixel(v.first) != v.second || v.second == 0
+       || !seen.insert(v.first).second)
+      {
+      std::cout << "Bad sample voxel " << v.first << " with label " << v.second << std::endl;
+      return 1;
+      }
+    counts[v.second]++;
+    }
+  return 0;
+}
+
+// A label with a handful of voxels must survive sampling of a large image
+int testUnderRepresentedLabel(PlainImageType *img, LabelImageType *seg)
+{
+  int failures = 0;
+  const unsigned long maxSamples = 10000;
+  itk::ImageRegion<3> region = img->GetLargestPossibleRegion();
+
+  std::map<LabelType, unsigned long> counts;
+  std::vector<EngineType::SampleVoxel> sample =
+      EngineType::SampleLabeledVoxels(seg, region, maxSamples);
+  failures += checkSample(sample, img, region, counts);
+
+  failures += TestCheck(sample.size() <= maxSamples && sample.size() >= maxSamples - 3,
+                        "Unexpected sample size " + std::to_string(sample.size()));
+
+  // All 20 voxels of label 2, and at least a sixth of the sample for label 3
+  failures += TestCheck(counts[2] == 20,
+                        "Label 2 has " + std::to_string(counts[2]) + " samples instead of 20");
+  failures += TestCheck(counts[3] >= maxSamples / 6,
+                        "Label 3 has only " + std::to_string(counts[3]) + " samples");
+  failures += TestCheck(counts[1] >= maxSamples / 2,
+                        "Label 1 has only " + std::to_string(counts[1]) + " samples");
+
+  // Sampling is repeatable
+  failures += TestCheck(EngineType::SampleLabeledVoxels(seg, region, maxSamples) == sample,
+                        "Sampling is not repeatable");
+
+  return failures;
+}
+
+// When there are fewer labeled voxels than samples, all of them are taken
+int testSmallRegion(PlainImageType *img, LabelImageType *seg)
+{
+  int failures = 0;
+  itk::ImageRegion<3> region;
+  region.SetIndex(0, 35); region.SetIndex(1, 45); region.SetIndex(2, 8);
+  region.SetSize(0, 30); region.SetSize(1, 10); region.SetSize(2, 45);
+
+  std::map<LabelType, unsigned long> counts;
+  std::vector<EngineType::SampleVoxel> sample =
+      EngineType::SampleLabeledVoxels(seg, region, 100000);
+  failures += checkSample(sample, img, region, counts);
+
+  failures += TestCheck(sample.size() == region.GetNumberOfPixels()
+                        && counts[2] == 20 && counts[3] == 300,
+                        "Expected every voxel of the region in the sample");
+
+  return failures;
+}
+
+int main(int argc, char *argv[])
+{
+  int failures = 0;
+
+  PlainImageType::Pointer img = makeSegmentation();
+  SmartPtr<LabelImageType> seg = ConvertToRLE<LabelImageType>(img.GetPointer());
+
+  failures += testUnderRepresentedLabel(img, seg);
+  failures += testSmallRegion(img, seg);
+
+  return TestExitStatus(failures);
+}
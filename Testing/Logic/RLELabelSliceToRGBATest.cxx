@@ -0,0 +1,126 @@
+#include "LabelImageWrapper.h"
+#include "RLELabelSliceToRGBAFilter.h"
+#include "ColorLabelTable.h"
+#include "ImageCoordinateTransform.h"
+#include "LogicTestHelpers.h"
+#include "itkImageRegionConstIteratorWithIndex.h"
+#include <iostream>
+
+typedef LabelImageWrapper::SlicerType SlicerType;
+typedef SlicerType::InputImageType LabelImageType;
+typedef SlicerType::OutputImageType SliceType;
+typedef RLELabelSliceToRGBAFilter<SlicerType> FilterType;
+typedef FilterType::OutputImageType RGBASliceType;
+typedef itk::Image<LabelType, 3> PlainImageType;
+
+// A segmentation of odd size with runs of varying lengths, including labels
+// that are hidden and labels that are missing from the color table
+SmartPtr<LabelImageType> makeSegmentation()
+{
+  const LabelType labels[] = { 0, 1, 1, 2, 3, 0, 250, 4 };
+  PlainImageType::Pointer img = MakeTestImage<PlainImageType>(
+        {{17, 11, 7}}, [&](const PlainImageType::IndexType &idx)
+    {
+    long run = idx[0] / (1 + (idx[1] + 2 * idx[2]) % 4);
+    return labels[(run + idx[1] + 3 * idx[2]) % 8];
+    });
+  return ConvertToRLE<LabelImageType>(img.GetPointer());
+}
+
+// The color of a label as the old per-pixel mapping computed it
+RGBASliceType::PixelType referenceColor(ColorLabelTable *table, LabelType label)
+{
+  ColorLabel cl = table->GetColorLabel(label);
+  if(!cl.IsVisible())
+    cl = table->GetColorLabel(0);
+
+  RGBASliceType::PixelType pix;
+  cl.GetRGBAVector(pix.GetDataPointer());
+  return pix;
+}
+
+// Render a slice in the given orientation and compare it to the slice from
+// the slicing pipeline mapped to color pixel by pixel
+int testOrientation(LabelImageType *seg, ColorLabelTable *table,
+                    const Vector3i &map, const itk::Index<3> &cursor)
+{
+  Vector3ui size(seg->GetBufferedRegion().GetSize(0),
+                 seg->GetBufferedRegion().GetSize(1),
+                 seg->GetBufferedRegion().GetSize(2));
+
+  ImageCoordinateTransform::Pointer transform = ImageCoordinateTransform::New();
+  transform->SetTransform(map, size);
+
+  SmartPtr<SlicerType> slicer = SlicerType::New();
+  slicer->SetInput(seg);
+  slicer->SetOrthogonalTransform(transform);
+  slicer->SetUseOrthogonalSlicing(true);
+  slicer->SetSliceIndex(cursor);
+
+  SmartPtr<FilterType> filter = FilterType::New();
+  filter->SetSlicer(slicer);
+  filter->SetColorTable(table);
+  filter->Update();
+  RGBASliceType *rgba = filter->GetOutput();
+
+  slicer->Update();
+  SliceType *slice = slicer->GetOutput();
+
+  if(rgba->GetBufferedRegion() != slice->GetBufferedRegion())
+    {
+    std::cout << "Mapping " << map << ": region " << rgba->GetBufferedRegion()
+              << " does not match the slice" << std::endl;
+    return 1;
+    }
+
+  long n_diff = 0;
+  for(itk::ImageRegionConstIteratorWithIndex<SliceType> it(slice, slice->GetBufferedRegion());
+      !it.IsAtEnd(); ++it)
+    {
+    if(rgba->GetPixel(it.GetIndex()) != referenceColor(table, it.Get()))
+      n_diff++;
+    }
+
+  if(n_diff)
+    {
+    std::cout << "Mapping " << map << ", cursor " << cursor << ": "
+              << n_diff << " pixels differ" << std::endl;
+    return 1;
+    }
+
+  return 0;
+}
+
+int main(int argc, char *argv[])
+{
+  int failures = 0;
+
+  SmartPtr<LabelImageType> seg = makeSegmentation();
+
+  // Label 3 is hidden and label 250 has no entry in the table
+  SmartPtr<ColorLabelTable> table = ColorLabelTable::New();
+  ColorLabel cl = table->GetColorLabel(3);
+  cl.SetVisible(false);
+  table->SetColorLabel(3, cl);
+  table->SetColorLabelValid(250, false);
+
+  // Every assignment of image axes to display axes, in both directions.
+  // Slices along y and z are rendered from the runs, slices along x from the
+  // slicing pipeline
+  const int perms[6][3] = { {1,2,3}, {1,3,2}, {2,1,3}, {2,3,1}, {3,1,2}, {3,2,1} };
+  const itk::Index<3> cursors[] = { {{0, 0, 0}}, {{8, 5, 3}}, {{16, 10, 6}} };
+  for(int p = 0; p < 6; p++)
+    {
+    for(int signs = 0; signs < 8; signs++)
+      {
+      Vector3i map;
+      for(int d = 0; d < 3; d++)
+        map[d] = (signs & (1 << d)) ? -perms[p][d] : perms[p][d];
+
+      for(const itk::Index<3> &cursor : cursors)
+        failures += testOrientation(seg, table, map, cursor);
+      }
+    }
+
+  return TestExitStatus(failures);
+}
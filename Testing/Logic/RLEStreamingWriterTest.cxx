@@ -0,0 +1,154 @@
+#include "RLEImageStreamingWriter.h"
+#include "LogicTestHelpers.h"
+#include "Registry.h"
+#include "itkImageFileReader.h"
+#include "itkImageRegionConstIteratorWithIndex.h"
+#include "itkNiftiImageIO.h"
+#include "itksys/SystemTools.hxx"
+#include "vnl/vnl_math.h"
+#include <cmath>
+#include <iostream>
+
+// Rotation by an angle about an axis, with the last column negated if the
+// direction should not preserve handedness
+template <unsigned int VDim>
+typename itk::ImageBase<VDim>::DirectionType
+makeDirection(double ax, double ay, double az, double angle, bool flip)
+{
+  vnl_vector_fixed<double, 3> u(ax, ay, az);
+  u.normalize();
+  vnl_matrix_fixed<double, 3, 3> K, I;
+  K.fill(0.0);
+  K(0,1) = -u[2]; K(0,2) = u[1];
+  K(1,0) = u[2];  K(1,2) = -u[0];
+  K(2,0) = -u[1]; K(2,1) = u[0];
+  I.set_identity();
+  vnl_matrix_fixed<double, 3, 3> R = I + std::sin(angle) * K + (1 - std::cos(angle)) * K * K;
+
+  typename itk::ImageBase<VDim>::DirectionType dir;
+  dir.SetIdentity();
+  for(unsigned int i = 0; i < 3; i++)
+    for(unsigned int j = 0; j < 3; j++)
+      dir(i,j) = (flip && j == 2) ? -R(i,j) : R(i,j);
+  return dir;
+}
+
+// Write a labeled image with the given direction through the streaming
+// writer, read it back with NiftiImageIO and compare
+template <unsigned int VDim>
+int testRoundTrip(const char *fname, const typename itk::ImageBase<VDim>::DirectionType &dir)
+{
+  typedef itk::Image<LabelType, VDim> PlainImageType;
+  typedef RLEImage<LabelType, VDim> RLEImageType;
+
+  // Runs of varying lengths, with different labels at the line ends
+  typename PlainImageType::SizeType size;
+  for(unsigned int d = 0; d < VDim; d++)
+    size[d] = d == 0 ? 37 : (d < 3 ? 23 - 4 * d : 3);
+
+  typename PlainImageType::Pointer img = MakeTestImage<PlainImageType>(
+        size, [](const typename PlainImageType::IndexType &idx)
+    {
+    long sum = 0;
+    for(unsigned int d = 1; d < VDim; d++)
+      sum += (d + 1) * idx[d];
+    return (LabelType) (((idx[0] / (1 + sum % 5)) + sum) % 7);
+    });
+  typename PlainImageType::RegionType region = img->GetLargestPossibleRegion();
+
+  typename PlainImageType::SpacingType spacing;
+  typename PlainImageType::PointType origin;
+  for(unsigned int d = 0; d < VDim; d++)
+    {
+    spacing[d] = 0.5 + 0.35 * d;
+    origin[d] = -12.5 + 7.25 * d;
+    }
+
+  typename RLEImageType::Pointer rle = ConvertToRLE<RLEImageType>(img.GetPointer());
+  rle->SetSpacing(spacing);
+  rle->SetOrigin(origin);
+  rle->SetDirection(dir);
+
+  std::string fn = itksys::SystemTools::GetCurrentWorkingDirectory() + "/" + fname;
+  Registry hints;
+  if(!RLEImageStreamingWriter<RLEImageType>::Write(rle, fn.c_str(), hints))
+    {
+    std::cout << fname << ": the streaming writer declined the image" << std::endl;
+    return 1;
+    }
+
+  typedef itk::ImageFileReader<PlainImageType> ReaderType;
+  typename ReaderType::Pointer reader = ReaderType::New();
+  reader->SetImageIO(itk::NiftiImageIO::New());
+  reader->SetFileName(fn);
+  reader->Update();
+  PlainImageType *result = reader->GetOutput();
+
+  int failures = 0;
+  if(result->GetLargestPossibleRegion().GetSize() != region.GetSize())
+    {
+    std::cout << fname << ": size " << result->GetLargestPossibleRegion().GetSize() << std::endl;
+    failures++;
+    }
+  else
+    {
+    long n_diff = 0;
+    for(itk::ImageRegionConstIteratorWithIndex<PlainImageType> it(img, region); !it.IsAtEnd(); ++it)
+      if(result->GetPixel(it.GetIndex()) != it.Get())
+        n_diff++;
+    if(n_diff)
+      {
+      std::cout << fname << ": " << n_diff << " voxels differ" << std::endl;
+      failures++;
+      }
+    }
+
+  // The header is stored in single precision
+  for(unsigned int i = 0; i < VDim; i++)
+    {
+    if(std::fabs(result->GetSpacing()[i] - spacing[i]) > 1e-5
+       || (i < 3 && std::fabs(result->GetOrigin()[i] - origin[i]) > 1e-4))
+      {
+      std::cout << fname << ": spacing " << result->GetSpacing()
+                << " origin " << result->GetOrigin() << std::endl;
+      failures++;
+      break;
+      }
+    }
+
+  for(unsigned int i = 0; i < 3; i++)
+    {
+    for(unsigned int j = 0; j < 3; j++)
+      {
+      if(std::fabs(result->GetDirection()(i,j) - dir(i,j)) > 1e-5)
+        {
+        std::cout << fname << ": direction " << std::endl << result->GetDirection()
+                  << " expected " << std::endl << dir << std::endl;
+        failures++;
+        i = j = 3;
+        }
+      }
+    }
+
+  itksys::SystemTools::RemoveFile(fn);
+  return failures;
+}
+
+int main(int argc, char *argv[])
+{
+  int failures = 0;
+
+  itk::ImageBase<3>::DirectionType identity;
+  identity.SetIdentity();
+
+  // Oblique rotations, with and without a change of handedness, and
+  // rotations by half a turn, where the quaternion has a zero real part
+  failures += testRoundTrip<3>("rle_identity.nii", identity);
+  failures += testRoundTrip<3>("rle_oblique.nii.gz", makeDirection<3>(1, 2, 3, 0.6, false));
+  failures += testRoundTrip<3>("rle_oblique_flip.nii", makeDirection<3>(-2, 1, 0.5, 1.1, true));
+  failures += testRoundTrip<3>("rle_half_turn.nii.gz", makeDirection<3>(0, 1, 1, vnl_math::pi, false));
+  failures += testRoundTrip<3>("rle_half_turn_flip.nii", makeDirection<3>(1, 0, 0, vnl_math::pi, true));
+  failures += testRoundTrip<4>("rle_oblique_4d.nii.gz", makeDirection<4>(3, -1, 2, 0.4, true));
+
+  return TestExitStatus(failures);
+}
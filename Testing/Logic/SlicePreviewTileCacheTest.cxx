@@ -0,0 +1,210 @@
+#include "PreprocessingFilterConfigTraits.h"
+#include "SlicePreviewTileCache.h"
+#include "SmoothBinaryThresholdImageFilter.h"
+#include "GMMClassifyImageFilter.h"
+#include "ThresholdSettings.h"
+#include "LogicTestHelpers.h"
+#include "itkImageRegionConstIterator.h"
+#include <iostream>
+#include <vector>
+
+typedef SmoothBinaryThresholdFilterConfigTraits ThresholdTraits;
+typedef GMMPreprocessingFilterConfigTraits GMMTraits;
+typedef ThresholdTraits::GreyType GreyImageType;
+typedef ThresholdTraits::SpeedType SpeedImageType;
+typedef std::vector<SpeedImageType::PixelType> SliceData;
+
+// A greyscale image with a gradient along x and stripes along z
+GreyImageType::Pointer makeImage()
+{
+  return MakeTestImage<GreyImageType>(
+        {{40, 30, 20}}, [](const GreyImageType::IndexType &idx)
+    {
+    return (GreyType) (10 * idx[0] + 7 * idx[1] + 50 * (idx[2] % 3));
+    });
+}
+
+// Request the axial slice z from a cache, as the slicer does, and return it
+template <class TCache>
+SliceData getSlice(TCache *cache, long z)
+{
+  cache->UpdateOutputInformation();
+  SpeedImageType::RegionType region = cache->GetOutput()->GetLargestPossibleRegion();
+  region.SetIndex(2, z);
+  region.SetSize(2, 1);
+  cache->GetOutput()->SetRequestedRegion(region);
+  cache->Update();
+
+  SliceData data;
+  for(itk::ImageRegionConstIterator<SpeedImageType> it(cache->GetOutput(), region); !it.IsAtEnd(); ++it)
+    data.push_back(it.Get());
+  return data;
+}
+
+// Check the number of hits and misses of a cache
+template <class TCache>
+int checkHits(TCache *cache, unsigned long hits, unsigned long misses, const char *step)
+{
+  return TestCheck(
+        cache->GetNumberOfHits() == hits && cache->GetNumberOfMisses() == misses,
+        std::string(step) + ": " + std::to_string(cache->GetNumberOfHits()) + " hits, "
+        + std::to_string(cache->GetNumberOfMisses()) + " misses, expected "
+        + std::to_string(hits) + " and " + std::to_string(misses));
+}
+
+// Dragging a threshold back to a previous value hits the cache
+int testThreshold(GreyImageType *img)
+{
+  int failures = 0;
+
+  SmartPtr<ThresholdSettings> ts = ThresholdSettings::New();
+  ts->SetThresholdMode(ThresholdSettings::TWO_SIDED);
+  ts->SetLowerThreshold(100);
+  ts->SetUpperThreshold(300);
+  ts->SetSmoothness(3);
+
+  typedef ThresholdTraits::FilterType FilterType;
+  SmartPtr<FilterType> filter = FilterType::New();
+  filter->SetInput(img);
+  filter->SetInputImageMinimum(0);
+  filter->SetInputImageMaximum(700);
+  filter->SetParameters(ts);
+
+  typedef SlicePreviewTileCache<ThresholdTraits> CacheType;
+  SmartPtr<CacheType> cache = CacheType::New();
+  cache->SetFilter(filter);
+
+  SliceData s100 = getSlice(cache.GetPointer(), 5);
+  failures += checkHits(cache.GetPointer(), 0, 1, "first slice");
+
+  // Dragging the slider computes new slices
+  ts->SetLowerThreshold(120);
+  SliceData s120 = getSlice(cache.GetPointer(), 5);
+  ts->SetLowerThreshold(140);
+  getSlice(cache.GetPointer(), 5);
+  failures += checkHits(cache.GetPointer(), 0, 3, "drag");
+  if(s120 == s100)
+    {
+    std::cout << "Threshold change did not change the slice" << std::endl;
+    failures++;
+    }
+
+  // Dragging it back finds them in the cache
+  ts->SetLowerThreshold(120);
+  if(getSlice(cache.GetPointer(), 5) != s120)
+    failures++;
+  ts->SetLowerThreshold(100);
+  if(getSlice(cache.GetPointer(), 5) != s100)
+    failures++;
+  failures += checkHits(cache.GetPointer(), 2, 3, "drag back");
+
+  // Another slice with the same thresholds is computed
+  getSlice(cache.GetPointer(), 6);
+  failures += checkHits(cache.GetPointer(), 2, 4, "other slice");
+
+  return failures;
+}
+
+// Retraining the mixture model misses the cache
+int testRetrainedGMM(GreyImageType *img)
+{
+  int failures = 0;
+
+  SmartPtr<GaussianMixtureModel> gmm = GaussianMixtureModel::New();
+  gmm->Initialize(1, 2);
+  gmm->SetGaussian(0, vnl_vector<double>(1, 150.0), vnl_matrix<double>(1, 1, 2500.0));
+  gmm->SetGaussian(1, vnl_vector<double>(1, 450.0), vnl_matrix<double>(1, 1, 2500.0));
+  gmm->SetWeight(0, 0.5);
+  gmm->SetWeight(1, 0.5);
+
+  typedef GMMTraits::FilterType FilterType;
+  SmartPtr<FilterType> filter = FilterType::New();
+  filter->AddScalarImage(img);
+  filter->SetMixtureModel(gmm);
+
+  typedef SlicePreviewTileCache<GMMTraits> CacheType;
+  SmartPtr<CacheType> cache = CacheType::New();
+  cache->SetFilter(filter);
+
+  SliceData s1 = getSlice(cache.GetPointer(), 5);
+  if(getSlice(cache.GetPointer(), 5) != s1)
+    failures++;
+  failures += checkHits(cache.GetPointer(), 1, 1, "same model");
+
+  // A retrained model is the same object with new parameters, which is
+  // passed to the filter again
+  gmm->SetMean(0, vnl_vector<double>(1, 250.0));
+  GMMTraits::SetParameters(gmm, filter, 1);
+  SliceData s2 = getSlice(cache.GetPointer(), 5);
+  failures += checkHits(cache.GetPointer(), 1, 2, "retrained model");
+  if(s2 == s1)
+    {
+    std::cout << "Retrained model did not change the slice" << std::endl;
+    failures++;
+    }
+
+  return failures;
+}
+
+// Caches that share a budget evict each other's least recently used slices
+int testSharedBudget(GreyImageType *img)
+{
+  int failures = 0;
+
+  SmartPtr<ThresholdSettings> ts = ThresholdSettings::New();
+  ts->SetThresholdMode(ThresholdSettings::LOWER);
+  ts->SetLowerThreshold(200);
+  ts->SetSmoothness(3);
+
+  typedef ThresholdTraits::FilterType FilterType;
+  typedef SlicePreviewTileCache<ThresholdTraits> CacheType;
+  SmartPtr<SlicePreviewTileCacheBudget> budget = SlicePreviewTileCacheBudget::New();
+  SmartPtr<CacheType> cache[2];
+  for(int i = 0; i < 2; i++)
+    {
+    SmartPtr<FilterType> filter = FilterType::New();
+    filter->SetInput(img);
+    filter->SetInputImageMaximum(700);
+    filter->SetParameters(ts);
+    cache[i] = CacheType::New();
+    cache[i]->SetFilter(filter);
+    cache[i]->SetBudget(budget);
+    }
+
+  // Room for two and a half slices
+  unsigned long sliceBytes = 40 * 30 * sizeof(SpeedImageType::PixelType);
+  budget->SetMaximumMemory(5 * sliceBytes / 2);
+
+  getSlice(cache[0].GetPointer(), 1);
+  getSlice(cache[0].GetPointer(), 2);
+  getSlice(cache[1].GetPointer(), 1);
+  if(cache[0]->GetMemoryUsed() != sliceBytes || cache[1]->GetMemoryUsed() != sliceBytes
+     || budget->GetMemoryUsed() != 2 * sliceBytes)
+    {
+    std::cout << "Oldest slice of the other cache was not evicted" << std::endl;
+    failures++;
+    }
+
+  // The slice that was kept is the more recent one
+  getSlice(cache[0].GetPointer(), 2);
+  failures += checkHits(cache[0].GetPointer(), 1, 2, "shared budget");
+
+  // Clearing a cache returns its memory to the budget
+  cache[0]->ClearCache();
+  if(budget->GetMemoryUsed() != sliceBytes)
+    failures++;
+
+  return failures;
+}
+
+int main(int argc, char *argv[])
+{
+  int failures = 0;
+
+  GreyImageType::Pointer img = makeImage();
+  failures += testThreshold(img);
+  failures += testRetrainedGMM(img);
+  failures += testSharedBudget(img);
+
+  return TestExitStatus(failures);
+}
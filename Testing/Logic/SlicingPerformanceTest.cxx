@@ -18,6 +18,9 @@ using namespace std;
 #include "IRISSlicer.h"
 #include "RLERegionOfInterestImageFilter.h"
 #include <itkTimeProbe.h>
+#include <itkMultiThreaderBase.h>
+#include <itkImageRegionConstIterator.h>
+#include <algorithm>
 
 typedef itk::Image<short, 3> Seg3DImageType;
 typedef itk::Image<short, 2> Seg2DImageType;
@@ -160,10 +163,12 @@ Seg2DImageType::Pointer cropIRIS(Seg3DImageType::Pointer image)
     return roi->GetOutput();
 }
 
-Seg2DImageType::Pointer cropRLEiris(RLEImage3D::Pointer image)
+Seg2DImageType::Pointer cropRLEiris(RLEImage3D::Pointer image, unsigned int nThreads = 0)
 {
     typedef IRISSlicer<RLEImage3D, Seg2DImageType, RLEImage3D> roiType;
     roiType::Pointer roi = roiType::New();
+    if (nThreads > 0)
+        roi->SetNumberOfWorkUnits(nThreads);
     roi->SetInput(image);
     roi->SetSliceIndex(sliceIndex);
     roi->SetSliceDirectionImageAxis(axis);
@@ -202,12 +207,49 @@ Seg3DImageType::Pointer cropRLE(Label3DType::Pointer image)
     return lm2li->GetOutput();
 }
 
+//slice the RLE image with an increasing number of threads, measure time taken
+//returns false if any thread count produces a slice different from the reference
+bool threadSweepRLEiris(RLEImage3D::Pointer image, Seg2DImageType::Pointer reference)
+{
+    bool identical = true;
+    unsigned int maxThreads = itk::MultiThreaderBase::GetGlobalDefaultNumberOfThreads();
+    for (unsigned int nThreads = 1; ; nThreads = std::min(2 * nThreads, maxThreads))
+    {
+        itk::TimeProbe tp;
+        Seg2DImageType::Pointer slice;
+        for (int rep = 0; rep < 10; rep++)
+        {
+            tp.Start();
+            slice = cropRLEiris(image, nThreads);
+            tp.Stop();
+        }
+        cout << "irisRLE slicing with " << nThreads << " threads took: "
+            << tp.GetMean() * 1000 << " ms " << endl;
+
+        itk::ImageRegionConstIterator<Seg2DImageType>
+            it(slice, slice->GetLargestPossibleRegion()),
+            rit(reference, reference->GetLargestPossibleRegion());
+        for (; !it.IsAtEnd(); ++it, ++rit)
+            if (it.Get() != rit.Get())
+            {
+                cout << "Slice differs from reference at " << it.GetIndex()
+                    << " with " << nThreads << " threads" << endl;
+                identical = false;
+                break;
+            }
+
+        if (nThreads == maxThreads)
+            break;
+    }
+    return identical;
+}
+
 //do some slicing operations, measure time taken
 int main(int argc, char *argv[])
 {
     if (argc < 5)
     {
-        cout << "Usage:\n" << argv[0] << " InputImage3D.ext OutputSlice2D.ext X|Y|Z SliceNumber [RLE|RLI|IRIS|Normal]" << endl;
+        cout << "Usage:\n" << argv[0] << " InputImage3D.ext OutputSlice2D.ext X|Y|Z SliceNumber [RLE|RLI|IRIS|Normal] [MEM|SWEEP]" << endl;
         return 1;
     }
 
@@ -243,6 +285,10 @@ int main(int argc, char *argv[])
     if (argc>6)
         if (strcmp(argv[6], "MEM") == 0 || strcmp(argv[6], "mem") == 0)
             memCheck = true;
+    bool threadSweep = false;
+    if (argc>6)
+        if (strcmp(argv[6], "SWEEP") == 0 || strcmp(argv[6], "sweep") == 0)
+            threadSweep = true;
 
     Seg3DImageType::Pointer cropped, inImage = loadImage(argv[1]);
     Label3DType::Pointer inLabelMap;
@@ -307,6 +353,10 @@ int main(int argc, char *argv[])
 
     cout << " slicing took: " << tp.GetMean() * 1000 << " ms " << endl;
 
+    if (irisRLE && threadSweep)
+        if (!threadSweepRLEiris(rleImage, cropped2D))
+            return 1;
+
 
     if (!iris && !rli && !irisRLE)
     {
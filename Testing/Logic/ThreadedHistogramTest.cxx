@@ -0,0 +1,241 @@
+#include "ThreadedHistogramImageFilter.h"
+#include "ScalarImageHistogram.h"
+#include "LogicTestHelpers.h"
+#include "itkImageRegionConstIterator.h"
+#include "itkMinimumMaximumImageFilter.h"
+#include <iostream>
+#include <string>
+
+typedef itk::Image<short, 4> ShortImageType;
+typedef itk::Image<float, 4> FloatImageType;
+
+// A 4D image of odd size with a skewed distribution of values, including
+// the given extreme values
+template <class TImage>
+typename TImage::Pointer makeImage(typename TImage::PixelType vmin,
+                                   typename TImage::PixelType vmax)
+{
+  unsigned long seed = 7;
+  typename TImage::Pointer img = MakeTestImage<TImage>(
+        {{37, 23, 11, 2}}, [&](const typename TImage::IndexType &)
+    {
+    seed = seed * 1103515245 + 12345;
+    double u = ((seed >> 8) % 10007) / 10007.0;
+    return (typename TImage::PixelType) (vmin + u * u * (vmax - vmin));
+    });
+
+  img->GetPixel({{0, 0, 0, 0}}) = vmin;
+  img->GetPixel({{36, 22, 10, 1}}) = vmax;
+  return img;
+}
+
+// The histogram as the filter computed it before it was threaded: every
+// voxel is added to a single histogram, which is then transformed
+template <class TImage>
+SmartPtr<ScalarImageHistogram> referenceHistogram(
+    TImage *img, double vmin, double vmax, size_t nBins, double scale, double shift)
+{
+  SmartPtr<ScalarImageHistogram> hist = ScalarImageHistogram::New();
+  hist->Initialize(vmin, vmax, nBins);
+  for(itk::ImageRegionConstIterator<TImage> it(img, img->GetBufferedRegion()); !it.IsAtEnd(); ++it)
+    hist->AddSample(it.Get());
+  hist->ApplyIntensityTransform(scale, shift);
+  return hist;
+}
+
+int compareHistograms(const ScalarImageHistogram *hist, const ScalarImageHistogram *ref,
+                      const std::string &step)
+{
+  if(TestCheck(hist->GetSize() == ref->GetSize(),
+               step + ": " + std::to_string(hist->GetSize()) + " bins, expected "
+               + std::to_string(ref->GetSize())))
+    return 1;
+
+  size_t n_diff = 0;
+  for(size_t i = 0; i < ref->GetSize(); i++)
+    if(hist->GetFrequency(i) != ref->GetFrequency(i)
+       || hist->GetBinMin(i) != ref->GetBinMin(i)
+       || hist->GetBinMax(i) != ref->GetBinMax(i))
+      n_diff++;
+
+  return TestCheck(n_diff == 0 && hist->GetTotalSamples() == ref->GetTotalSamples()
+                   && hist->GetMaxFrequency() == ref->GetMaxFrequency(),
+                   step + ": " + std::to_string(n_diff) + " bins differ");
+}
+
+// Rebinning the histogram and changing its transform neither modify the
+// range outputs nor bring their pipeline time forward, so that the pipelines
+// that use the range, such as the display mapping, are not updated
+template <class TFilter, class TImage>
+int checkRangeNotModified(TFilter *filter, TImage *img, double vmin, double vmax,
+                          const std::string &name)
+{
+  typename TFilter::PixelObjectType *range[] =
+    { filter->GetMinimumOutput(), filter->GetMaximumOutput() };
+
+  itk::ModifiedTimeType mtime[2], ptime[2];
+  for(int i = 0; i < 2; i++)
+    {
+    range[i]->Update();
+    range[i]->UpdateOutputInformation();
+    mtime[i] = range[i]->GetMTime();
+    ptime[i] = range[i]->GetPipelineMTime();
+    }
+
+  int failures = 0;
+  filter->SetNumberOfBins(64);
+  filter->SetIntensityTransform(2.0, 1.0);
+  filter->Update();
+  failures += compareHistograms(
+        filter->GetHistogramOutput(),
+        referenceHistogram(img, vmin, vmax, 64, 2.0, 1.0),
+        name + " rebinned");
+
+  // The histogram is also brought up to date through the histogram output
+  filter->SetNumberOfBins(32);
+  filter->GetHistogramOutput()->Update();
+  failures += compareHistograms(
+        filter->GetHistogramOutput(),
+        referenceHistogram(img, vmin, vmax, 32, 2.0, 1.0),
+        name + " rebinned through the output");
+
+  for(int i = 0; i < 2; i++)
+    {
+    range[i]->UpdateOutputInformation();
+    if(range[i]->GetMTime() != mtime[i] || range[i]->GetPipelineMTime() != ptime[i])
+      {
+      std::cout << name << ": rebinning modified the range" << std::endl;
+      failures++;
+      }
+    }
+
+  return failures;
+}
+
+// Compare the filter to the old computation, with the range computed by the
+// filter and with the range supplied by a min/max filter
+template <class TImage>
+int testImage(TImage *img, const std::string &name)
+{
+  int failures = 0;
+  typedef ThreadedHistogramImageFilter<TImage> HistogramFilterType;
+  typedef itk::MinimumMaximumImageFilter<TImage> MinMaxFilterType;
+
+  typename MinMaxFilterType::Pointer minmax = MinMaxFilterType::New();
+  minmax->SetInput(img);
+  minmax->Update();
+  double vmin = minmax->GetMinimum(), vmax = minmax->GetMaximum();
+
+  // Range computed by the filter
+  typename HistogramFilterType::Pointer filter = HistogramFilterType::New();
+  filter->SetInput(img);
+  const size_t bins[] = { 1, 2, 40, 256, 1000 };
+  for(size_t nBins : bins)
+    {
+    filter->SetNumberOfBins(nBins);
+    filter->SetIntensityTransform(1.0, 0.0);
+    filter->Update();
+    failures += compareHistograms(
+          filter->GetHistogramOutput(),
+          referenceHistogram(img, vmin, vmax, nBins, 1.0, 0.0),
+          name + " " + std::to_string(nBins) + " bins");
+
+    if(filter->GetMinimum() != minmax->GetMinimum()
+       || filter->GetMaximum() != minmax->GetMaximum())
+      {
+      std::cout << name << ": range " << filter->GetMinimum() << " to "
+                << filter->GetMaximum() << ", expected " << vmin << " to " << vmax << std::endl;
+      failures++;
+      }
+    }
+
+  // An intensity transform
+  filter->SetNumberOfBins(100);
+  filter->SetIntensityTransform(0.5, -20.0);
+  filter->Update();
+  failures += compareHistograms(
+        filter->GetHistogramOutput(),
+        referenceHistogram(img, vmin, vmax, 100, 0.5, -20.0),
+        name + " transform");
+
+  // Range from a min/max filter, as the vector image wrapper does it
+  typename HistogramFilterType::Pointer ranged = HistogramFilterType::New();
+  ranged->SetInput(img);
+  ranged->SetRangeInputs(minmax->GetMinimumOutput(), minmax->GetMaximumOutput());
+  ranged->SetNumberOfBins(128);
+  ranged->Update();
+  failures += compareHistograms(
+        ranged->GetHistogramOutput(),
+        referenceHistogram(img, vmin, vmax, 128, 1.0, 0.0),
+        name + " range inputs");
+
+  failures += checkRangeNotModified(filter.GetPointer(), img, vmin, vmax, name);
+
+  // A range narrower than the data, whose extreme values go to the end bins
+  typedef typename HistogramFilterType::PixelObjectType PixelObjectType;
+  typename PixelObjectType::Pointer inMin = PixelObjectType::New();
+  typename PixelObjectType::Pointer inMax = PixelObjectType::New();
+  inMin->Set((typename TImage::PixelType) (vmin + 0.25 * (vmax - vmin)));
+  inMax->Set((typename TImage::PixelType) (vmin + 0.5 * (vmax - vmin)));
+  ranged->SetRangeInputs(inMin, inMax);
+  ranged->SetNumberOfBins(50);
+  ranged->Update();
+  failures += compareHistograms(
+        ranged->GetHistogramOutput(),
+        referenceHistogram(img, inMin->Get(), inMax->Get(), 50, 1.0, 0.0),
+        name + " narrow range");
+
+  // The histogram follows changes to the image, and the range outputs are
+  // only modified if the range changes
+  itk::ModifiedTimeType tMin = filter->GetMinimumOutput()->GetMTime();
+  itk::ModifiedTimeType tMax = filter->GetMaximumOutput()->GetMTime();
+  img->GetPixel({{5, 5, 5, 0}}) = (typename TImage::PixelType) vmax;
+  img->Modified();
+  filter->SetNumberOfBins(40);
+  filter->SetIntensityTransform(1.0, 0.0);
+  filter->Update();
+  failures += compareHistograms(
+        filter->GetHistogramOutput(),
+        referenceHistogram(img, vmin, vmax, 40, 1.0, 0.0),
+        name + " modified image");
+  if(filter->GetMinimumOutput()->GetMTime() != tMin
+     || filter->GetMaximumOutput()->GetMTime() != tMax)
+    {
+    std::cout << name << ": the same range was modified" << std::endl;
+    failures++;
+    }
+
+  img->GetPixel({{6, 5, 5, 0}}) = (typename TImage::PixelType) (vmax + 1);
+  img->Modified();
+  filter->Update();
+  failures += compareHistograms(
+        filter->GetHistogramOutput(),
+        referenceHistogram(img, vmin, vmax + 1, 40, 1.0, 0.0),
+        name + " extended range");
+  if(filter->GetMinimumOutput()->GetMTime() != tMin
+     || filter->GetMaximumOutput()->GetMTime() == tMax
+     || filter->GetMaximum() != (typename TImage::PixelType) (vmax + 1))
+    {
+    std::cout << name << ": the new maximum was not output" << std::endl;
+    failures++;
+    }
+
+  return failures;
+}
+
+int main(int argc, char *argv[])
+{
+  int failures = 0;
+
+  // Short images are counted value by value, float images are binned
+  ShortImageType::Pointer shortImg = makeImage<ShortImageType>(-1024, 3071);
+  failures += testImage<ShortImageType>(shortImg, "short");
+
+  ShortImageType::Pointer narrowImg = makeImage<ShortImageType>(12, 20);
+  failures += testImage<ShortImageType>(narrowImg, "short with few values");
+
+  FloatImageType::Pointer floatImg = makeImage<FloatImageType>(-0.5f, 1.75f);
+  failures += testImage<FloatImageType>(floatImg, "float");
+
+  return TestExitStatus(failures);
+}
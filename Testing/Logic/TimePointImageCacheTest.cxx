@@ -0,0 +1,206 @@
+#include "TimePointImageCache.h"
+#include "LogicTestHelpers.h"
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+
+typedef itk::Image<short, 3> ImageType;
+typedef TimePointImageCache<ImageType> CacheType;
+
+// Number of times the loader has been called
+static std::atomic<int> n_loads(0);
+
+// A loader that makes a small image filled with the time point
+SmartPtr<CacheType> makeCache(unsigned int nt)
+{
+  SmartPtr<CacheType> cache = CacheType::New();
+  cache->SetLoader([](unsigned int tp)
+    {
+    if(tp == 7)
+      throw std::runtime_error("Time point 7 can't be read");
+
+    ImageType::Pointer image = ImageType::New();
+    ImageType::RegionType region;
+    region.SetSize(0, 10); region.SetSize(1, 10); region.SetSize(2, 10);
+    image->SetRegions(region);
+    image->Allocate();
+    image->FillBuffer((short) tp);
+    n_loads++;
+    return image;
+    }, nt);
+  cache->SetPrefetchRadius(0);
+  return cache;
+}
+
+static const unsigned long FRAME_BYTES = 1000 * sizeof(short);
+
+// Check the frames held by the cache, given as a bit mask of time points
+int checkFrames(CacheType *cache, unsigned int mask, const char *step)
+{
+  for(unsigned int tp = 0; tp < cache->GetNumberOfTimePoints(); tp++)
+    {
+    if(TestCheck(cache->Contains(tp) == ((mask & (1u << tp)) != 0),
+                 std::string(step) + ": unexpected contents at time point " + std::to_string(tp)))
+      return 1;
+    }
+  return 0;
+}
+
+// The least recently used frames are evicted when there are too many
+int testEvictByCount()
+{
+  int failures = 0;
+  SmartPtr<CacheType> cache = makeCache(10);
+  cache->SetMaximumNumberOfFrames(3);
+
+  for(unsigned int tp = 0; tp < 3; tp++)
+    cache->GetTimePoint(tp);
+  failures += checkFrames(cache, 0x7, "fill");
+
+  // Using frame 0 makes frame 1 the oldest
+  if(cache->GetTimePoint(0)->GetPixel({{0, 0, 0}}) != 0)
+    failures++;
+  cache->GetTimePoint(3);
+  failures += checkFrames(cache, 0xd, "evict by count");
+
+  if(cache->GetNumberOfHits() != 1 || cache->GetNumberOfMisses() != 4
+     || cache->GetNumberOfCachedFrames() != 3)
+    {
+    std::cout << "Unexpected hits and misses: " << cache->GetNumberOfHits()
+              << ", " << cache->GetNumberOfMisses() << std::endl;
+    failures++;
+    }
+
+  // Lowering the limit evicts right away
+  cache->SetMaximumNumberOfFrames(1);
+  failures += checkFrames(cache, 0x8, "lower limit");
+
+  return failures;
+}
+
+// The least recently used frames are evicted when they take too much memory
+int testEvictByBytes()
+{
+  int failures = 0;
+  SmartPtr<CacheType> cache = makeCache(10);
+  cache->SetMemoryBudget(2 * FRAME_BYTES);
+
+  for(unsigned int tp = 0; tp < 4; tp++)
+    cache->GetTimePoint(tp);
+  failures += checkFrames(cache, 0xc, "evict by bytes");
+  if(cache->GetCachedBytes() != 2 * FRAME_BYTES)
+    failures++;
+
+  // The frame requested last is kept even if it alone exceeds the budget
+  cache->SetMemoryBudget(1);
+  failures += checkFrames(cache, 0x8, "tiny budget");
+  if(cache->GetCachedBytes() != FRAME_BYTES)
+    failures++;
+
+  return failures;
+}
+
+// Pinned frames are never evicted, and replace the frames read from disk
+int testPinning()
+{
+  int failures = 0;
+  SmartPtr<CacheType> cache = makeCache(10);
+  cache->SetMaximumNumberOfFrames(2);
+
+  // Edit time point 1 and pin it
+  ImageType::Pointer edited = cache->GetTimePoint(1);
+  edited->FillBuffer(99);
+  cache->Pin(1, edited);
+
+  // Pin an edited copy of a frame that is not in the cache
+  ImageType::Pointer other = ImageType::New();
+  other->SetRegions(edited->GetBufferedRegion());
+  other->Allocate();
+  other->FillBuffer(55);
+  cache->Pin(5, other);
+
+  for(unsigned int tp = 2; tp < 5; tp++)
+    cache->GetTimePoint(tp);
+  failures += checkFrames(cache, 0x32, "pinned");
+  if(!cache->HasPinnedTimePoints())
+    failures++;
+
+  int loads = n_loads;
+  if(cache->GetTimePoint(1)->GetPixel({{0, 0, 0}}) != 99
+     || cache->GetTimePoint(5)->GetPixel({{0, 0, 0}}) != 55 || n_loads != loads)
+    {
+    std::cout << "Pinned frames were not returned" << std::endl;
+    failures++;
+    }
+
+  cache->Clear();
+  if(cache->HasPinnedTimePoints() || cache->GetNumberOfCachedFrames() != 0)
+    failures++;
+
+  return failures;
+}
+
+// The neighbors of a time point are read in the background
+int testPrefetch()
+{
+  int failures = 0;
+  SmartPtr<CacheType> cache = makeCache(10);
+  cache->SetPrefetchRadius(2);
+
+  cache->GetTimePoint(4);
+  cache->Prefetch(4);
+  for(int i = 0; i < 500 && cache->GetNumberOfPrefetchedFrames() < 4; i++)
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  failures += checkFrames(cache, 0x7c, "prefetch");
+
+  // Stepping to a neighbor does not read from disk
+  int loads = n_loads;
+  cache->GetTimePoint(5);
+  if(n_loads != loads || cache->GetNumberOfHits() != 1)
+    {
+    std::cout << "Prefetched frame was read again" << std::endl;
+    failures++;
+    }
+
+  // No more neighbors are prefetched than fit in the cache, and prefetching
+  // does not evict the frames around the current time point
+  cache->SetMaximumNumberOfFrames(3);
+  cache->Prefetch(5);
+  for(int i = 0; i < 500 && !cache->Contains(4); i++)
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  if(cache->GetNumberOfCachedFrames() > 3 || !cache->Contains(5)
+     || !cache->Contains(4) || !cache->Contains(6))
+    {
+    std::cout << "Prefetch window was not kept" << std::endl;
+    failures++;
+    }
+
+  // Read errors in the background are ignored, and reported when the frame
+  // is requested
+  cache->Prefetch(8);
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  try
+    {
+    cache->GetTimePoint(7);
+    std::cout << "Read error was not reported" << std::endl;
+    failures++;
+    }
+  catch(std::exception &)
+    {
+    }
+
+  return failures;
+}
+
+int main(int argc, char *argv[])
+{
+  int failures = 0;
+  failures += testEvictByCount();
+  failures += testEvictByBytes();
+  failures += testPinning();
+  failures += testPrefetch();
+
+  return TestExitStatus(failures);
+}
@@ -0,0 +1,204 @@
+#include "SNAPCommon.h"
+#include "UndoDataManager.h"
+#include <iostream>
+#include <random>
+#include <vector>
+
+typedef UndoDataManager<LabelType> UndoManagerType;
+typedef UndoManagerType::Delta DeltaType;
+typedef std::vector<std::pair<size_t, LabelType> > RunList;
+
+// Runs of a commit as they are expected to be read back
+struct ExpectedCommit
+{
+  std::vector<RunList> deltas;
+};
+
+// Create a delta with random runs, recording the runs it should decode to
+DeltaType *makeDelta(std::mt19937 &rng, RunList &runs)
+{
+  std::uniform_int_distribution<size_t> len(1, 40);
+  std::uniform_int_distribution<int> val(0, 20);
+
+  DeltaType *delta = new DeltaType();
+  runs.clear();
+  for(int i = 0; i < 2000; i++)
+    {
+    size_t n = len(rng);
+    LabelType v = (LabelType) val(rng);
+    if(i % 2)
+      delta->EncodeRun(v, n);
+    else
+      for(size_t k = 0; k < n; k++)
+        delta->Encode(v);
+
+    // Adjacent runs with the same value are merged by the encoder
+    if(runs.size() && runs.back().second == v)
+      runs.back().first += n;
+    else
+      runs.push_back(std::make_pair(n, v));
+    }
+  delta->FinishEncoding();
+  return delta;
+}
+
+// Commit two random deltas
+void makeCommit(std::mt19937 &rng, UndoManagerType *um, std::vector<ExpectedCommit> &expected)
+{
+  ExpectedCommit ec;
+  ec.deltas.resize(2);
+  for(int d = 0; d < 2; d++)
+    um->AddDeltaToStaging(makeDelta(rng, ec.deltas[d]));
+  um->CommitStaging("test");
+  expected.push_back(ec);
+}
+
+// Check that the deltas of a commit read back as expected
+int checkCommit(const UndoManagerType::Commit &commit, const ExpectedCommit &ec)
+{
+  if(commit.GetDeltas().size() != ec.deltas.size())
+    return 1;
+
+  int d = 0;
+  for(auto dit = commit.GetDeltas().begin(); dit != commit.GetDeltas().end(); ++dit, ++d)
+    {
+    if((*dit)->IsSpilled())
+      return 1;
+
+    const RunList &runs = ec.deltas[d];
+    size_t i = 0;
+    for(DeltaType::RLEReader r(*dit); !r.IsAtEnd(); ++r, ++i)
+      {
+      if(i >= runs.size() || r.GetLength() != runs[i].first || r.GetValue() != runs[i].second)
+        return 1;
+      }
+    if(i != runs.size())
+      return 1;
+    }
+
+  return 0;
+}
+
+// The memory budget may only be exceeded by the commit that is in use
+int checkBudget(UndoManagerType *um, const UndoManagerType::Commit &commit, size_t budget)
+{
+  if(um->GetTotalSize() > std::max(budget, commit.GetMemorySize()))
+    {
+    std::cout << "Memory budget exceeded: " << um->GetTotalSize() << std::endl;
+    return 1;
+    }
+  return 0;
+}
+
+// Spill commits to disk, then undo and redo across the spilled commits
+int testSpillUndoRedo()
+{
+  std::mt19937 rng(1234);
+  const size_t budget = 32768, n_commits = 24;
+  UndoManagerType *um = new UndoManagerType(4, budget, 1024 * 1024);
+  std::vector<ExpectedCommit> expected;
+
+  int failures = 0;
+  for(size_t i = 0; i < n_commits; i++)
+    makeCommit(rng, um, expected);
+
+  if(um->GetNumberOfCommits() != n_commits)
+    {
+    std::cout << "Commits were dropped instead of spilled" << std::endl;
+    failures++;
+    }
+  if(um->GetNumberOfSpilledCommits() == 0 || um->GetDiskSize() == 0)
+    {
+    std::cout << "No commits were spilled" << std::endl;
+    failures++;
+    }
+  if(um->GetTotalSize() > budget)
+    {
+    std::cout << "Memory budget exceeded after commits" << std::endl;
+    failures++;
+    }
+
+  // Walk back and forth through the history several times. Every restore
+  // leaves dead space in the spill file, which has to be compacted.
+  for(int pass = 0; pass < 6; pass++)
+    {
+    for(size_t i = n_commits; i > 0; i--)
+      {
+      const UndoManagerType::Commit &commit = um->GetCommitForUndo();
+      failures += checkCommit(commit, expected[i - 1]);
+      failures += checkBudget(um, commit, budget);
+      }
+    if(um->IsUndoPossible())
+      failures++;
+
+    for(size_t i = 0; i < n_commits; i++)
+      {
+      const UndoManagerType::Commit &commit = um->GetCommitForRedo();
+      failures += checkCommit(commit, expected[i]);
+      failures += checkBudget(um, commit, budget);
+      }
+    if(um->IsRedoPossible())
+      failures++;
+
+    if(um->GetSpillFileSize() > 2 * um->GetDiskSize() + budget)
+      {
+      std::cout << "Spill file was not compacted: " << um->GetSpillFileSize()
+                << " bytes for " << um->GetDiskSize() << " bytes of data" << std::endl;
+      failures++;
+      }
+    }
+
+  // Undo halfway and commit, which discards the redo history
+  for(size_t i = 0; i < n_commits / 2; i++)
+    um->GetCommitForUndo();
+  expected.resize(n_commits / 2);
+  makeCommit(rng, um, expected);
+  if(um->GetNumberOfCommits() != expected.size() || um->IsRedoPossible())
+    failures++;
+
+  for(size_t i = expected.size(); i > 0; i--)
+    failures += checkCommit(um->GetCommitForUndo(), expected[i - 1]);
+
+  // Deleting the manager also closes the spill file
+  delete um;
+  return failures;
+}
+
+// Without room on disk, old commits are dropped down to the minimum count
+int testDropWithoutDisk()
+{
+  std::mt19937 rng(5678);
+  UndoManagerType *um = new UndoManagerType(4, 1024, 0);
+  std::vector<ExpectedCommit> expected;
+
+  int failures = 0;
+  for(size_t i = 0; i < 16; i++)
+    makeCommit(rng, um, expected);
+
+  if(um->GetNumberOfSpilledCommits() != 0 || um->GetDiskSize() != 0)
+    failures++;
+  // The minimum number of commits is kept in addition to the newest one
+  if(um->GetNumberOfCommits() != 5)
+    {
+    std::cout << "Expected 5 commits, found " << um->GetNumberOfCommits() << std::endl;
+    failures++;
+    }
+
+  // The newest commits are the ones that are kept
+  for(size_t i = 0; i < 5; i++)
+    failures += checkCommit(um->GetCommitForUndo(), expected[expected.size() - 1 - i]);
+
+  delete um;
+  return failures;
+}
+
+int main(int argc, char *argv[])
+{
+  int failures = 0;
+  failures += testSpillUndoRedo();
+  failures += testDropWithoutDisk();
+
+  if(failures)
+    std::cout << failures << " failures" << std::endl;
+  return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -2,9 +2,13 @@
 #include "RLERegionOfInterestImageFilter.h"
 #include <iostream>
 #include <string>
+#include <vector>
+#include <random>
+#include <algorithm>
 #include <itkImageFileReader.h>
 #include <itkImageFileWriter.h>
 #include <itkTimeProbe.h>
+#include <itkImageRegionIteratorWithIndex.h>
 #include "IRISSlicer.h"
 #include "itkTestingComparisonImageFilter.h"
 
@@ -58,7 +62,7 @@ inline char axisToLetter(unsigned axis)
 }
 
 //invokes IRISSlicer<itk> and IRISSlicer<rle> and compares results
-void testIRISSlicer(shortRLEImage::Pointer rleImage, Seg3DImageType::Pointer itkImage,
+unsigned long testIRISSlicer(shortRLEImage::Pointer rleImage, Seg3DImageType::Pointer itkImage,
     unsigned sliceIndex, unsigned sliceAxis, unsigned lineAxis, unsigned pixelAxis,
     bool lineForward, bool pixelForward)
 {
@@ -104,20 +108,243 @@ void testIRISSlicer(shortRLEImage::Pointer rleImage, Seg3DImageType::Pointer itk
     diff->UpdateLargestPossibleRegion();
     std::cout << "Number of pixels with difference: " << 
         diff->GetNumberOfPixelsWithDifferences() << std::endl << std::endl;
+    return diff->GetNumberOfPixelsWithDifferences();
 }
 
 //test all 4 combinations of bool parameters (lineForward and pixelForward)
-void test4bools(shortRLEImage::Pointer rleImage, Seg3DImageType::Pointer itkImage,
+unsigned long test4bools(shortRLEImage::Pointer rleImage, Seg3DImageType::Pointer itkImage,
     unsigned sliceIndex, unsigned sliceAxis, unsigned lineAxis, unsigned pixelAxis)
 {
-    testIRISSlicer(rleImage, itkImage, sliceIndex, sliceAxis, lineAxis, pixelAxis, true, true);
-    testIRISSlicer(rleImage, itkImage, sliceIndex, sliceAxis, lineAxis, pixelAxis, true, false);
-    testIRISSlicer(rleImage, itkImage, sliceIndex, sliceAxis, lineAxis, pixelAxis, false, true);
-    testIRISSlicer(rleImage, itkImage, sliceIndex, sliceAxis, lineAxis, pixelAxis, false, false);
+    unsigned long nDiff = 0;
+    nDiff += testIRISSlicer(rleImage, itkImage, sliceIndex, sliceAxis, lineAxis, pixelAxis, true, true);
+    nDiff += testIRISSlicer(rleImage, itkImage, sliceIndex, sliceAxis, lineAxis, pixelAxis, true, false);
+    nDiff += testIRISSlicer(rleImage, itkImage, sliceIndex, sliceAxis, lineAxis, pixelAxis, false, true);
+    nDiff += testIRISSlicer(rleImage, itkImage, sliceIndex, sliceAxis, lineAxis, pixelAxis, false, false);
+    return nDiff;
+}
+
+//slices along x with the same pair of slicers while the image is edited,
+//so that the per-line cursors of the RLE slicer are reused and invalidated
+unsigned long testSlicerCursorsAcrossEdits(shortRLEImage::Pointer rleImage, Seg3DImageType::Pointer itkImage)
+{
+    typedef IRISSlicer<shortRLEImage, Seg2DImageType, shortRLEImage> slicerTypeRLE;
+    typedef IRISSlicer<Seg3DImageType, Seg2DImageType, Seg3DImageType> slicerTypeITK;
+    slicerTypeRLE::Pointer roiRLE = slicerTypeRLE::New();
+    slicerTypeITK::Pointer roiITK = slicerTypeITK::New();
+    roiRLE->SetInput(rleImage);
+    roiITK->SetInput(itkImage);
+    roiRLE->SetSliceDirectionImageAxis(0);
+    roiITK->SetSliceDirectionImageAxis(0);
+    roiRLE->SetLineDirectionImageAxis(2);
+    roiITK->SetLineDirectionImageAxis(2);
+    roiRLE->SetPixelDirectionImageAxis(1);
+    roiITK->SetPixelDirectionImageAxis(1);
+
+    shortRLEImage::RegionType reg = rleImage->GetLargestPossibleRegion();
+    long nx = reg.GetSize(0);
+    std::mt19937 gen(4321);
+
+    unsigned long nDiff = 0;
+    auto sweep = [&](long step)
+    {
+        for (long i = 0; i < nx; i += step)
+        {
+            long x = (step > 0) ? i : nx - 1 - i;
+            roiRLE->SetSliceIndex(x);
+            roiITK->SetSliceIndex(x);
+            roiRLE->Update();
+            roiITK->Update();
+
+            typedef itk::Testing::ComparisonImageFilter< Seg2DImageType, Seg2DImageType > DiffType;
+            DiffType::Pointer diff = DiffType::New();
+            diff->SetValidInput(roiITK->GetOutput());
+            diff->SetTestInput(roiRLE->GetOutput());
+            diff->UpdateLargestPossibleRegion();
+            nDiff += diff->GetNumberOfPixelsWithDifferences();
+        }
+    };
+
+    for (int pass = 0; pass < 4; pass++)
+    {
+        sweep(1);
+        sweep(-3);
+
+        //scatter single voxels, which split runs, and fill whole lines,
+        //which leave a single run that existing cursors point past
+        for (int k = 0; k < 2000; k++)
+        {
+            shortRLEImage::IndexType idx;
+            for (unsigned d = 0; d < 3; d++)
+            {
+                std::uniform_int_distribution<long> dist(0, reg.GetSize(d) - 1);
+                idx[d] = reg.GetIndex(d) + dist(gen);
+            }
+            short value = short(k % 5);
+            if (k % 10 == 0)
+            {
+                for (long x = 0; x < nx; x++)
+                {
+                    idx[0] = reg.GetIndex(0) + x;
+                    rleImage->SetPixel(idx, value);
+                    itkImage->SetPixel(idx, value);
+                }
+            }
+            else
+            {
+                rleImage->SetPixel(idx, value);
+                itkImage->SetPixel(idx, value);
+            }
+        }
+        rleImage->Modified();
+        itkImage->Modified();
+    }
+
+    std::cout << "Number of pixels with difference slicing along x across edits: "
+        << nDiff << std::endl << std::endl;
+    return nDiff;
+}
+
+//measures random GetPixel throughput with and without the segment index,
+//returns the number of samples that differ from the itk image
+unsigned long benchmarkGetPixel(shortRLEImage::Pointer rleImage, Seg3DImageType::Pointer itkImage,
+    unsigned nSamples)
+{
+    itk::TimeProbe tp;
+    std::cout << "Random GetPixel benchmark, " << nSamples << " samples" << std::endl;
+
+    //fixed seed, so that runs are comparable
+    std::mt19937 gen(1234);
+    shortRLEImage::RegionType reg = rleImage->GetLargestPossibleRegion();
+    std::vector<shortRLEImage::IndexType> samples(nSamples);
+    for (unsigned i = 0; i < nSamples; i++)
+        for (unsigned d = 0; d < 3; d++)
+        {
+            std::uniform_int_distribution<long> dist(0, reg.GetSize(d) - 1);
+            samples[i][d] = reg.GetIndex(d) + dist(gen);
+        }
+
+    unsigned long nTotalDiff = 0;
+    for (int useIndex = 0; useIndex < 2; useIndex++)
+    {
+        rleImage->SetUseSegmentIndex(useIndex != 0);
+        if (useIndex)
+        {
+            std::cout << "Building segment index: "; tp.Start();
+            rleImage->GetPixel(samples[0]);
+            tp.Stop(); std::cout << tp.GetMean() * 1000 << " ms " << std::endl; tp.Reset();
+        }
+
+        std::cout << "GetPixel " << (useIndex ? "with" : "without") << " index: "; tp.Start();
+        long sum = 0;
+        for (unsigned i = 0; i < nSamples; i++)
+            sum += rleImage->GetPixel(samples[i]);
+        tp.Stop();
+        std::cout << tp.GetMean() * 1000 << " ms, "
+            << nSamples / tp.GetMean() << " samples/s (checksum " << sum << ")" << std::endl;
+        tp.Reset();
+
+        unsigned nDiff = 0;
+        for (unsigned i = 0; i < nSamples; i++)
+            if (rleImage->GetPixel(samples[i]) != itkImage->GetPixel(samples[i]))
+                nDiff++;
+        std::cout << "Number of samples with difference: " << nDiff << std::endl;
+        nTotalDiff += nDiff;
+    }
+
+    //lines modified through SetPixel must still read back correctly
+    for (unsigned i = 0; i < nSamples; i += 97)
+    {
+        short value = short(i % 7);
+        rleImage->SetPixel(samples[i], value);
+        itkImage->SetPixel(samples[i], value);
+    }
+    unsigned nDiff = 0;
+    for (unsigned i = 0; i < nSamples; i++)
+        if (rleImage->GetPixel(samples[i]) != itkImage->GetPixel(samples[i]))
+            nDiff++;
+    std::cout << "Number of samples with difference after SetPixel: " << nDiff
+        << std::endl;
+    nTotalDiff += nDiff;
+
+    //lines modified through an iterator, without Modified(), must also read
+    //back correctly once the index has been built
+    rleImage->GetPixel(samples[0]);
+    shortRLEImage::RegionType sub = reg;
+    for (unsigned d = 0; d < 3; d++)
+    {
+        sub.SetIndex(d, reg.GetIndex(d) + reg.GetSize(d) / 4);
+        sub.SetSize(d, std::max(reg.GetSize(d) / 2, (itk::SizeValueType) 1));
+    }
+    itk::ImageRegionIterator<shortRLEImage> wit(rleImage, sub);
+    for (long k = 0; !wit.IsAtEnd(); ++wit, ++k)
+        if (k % 5 == 0)
+            wit.Set(short(k % 3));
+    itk::ImageRegionIteratorWithIndex<Seg3DImageType> iwit(itkImage, sub);
+    for (long k = 0; !iwit.IsAtEnd(); ++iwit, ++k)
+        if (k % 5 == 0)
+            iwit.Set(short(k % 3));
+    nDiff = 0;
+    for (unsigned i = 0; i < nSamples; i++)
+        if (rleImage->GetPixel(samples[i]) != itkImage->GetPixel(samples[i]))
+            nDiff++;
+    std::cout << "Number of samples with difference after iterator writes: " << nDiff
+        << std::endl;
+    nTotalDiff += nDiff;
+
+    //after Modified() the index is rebuilt from the changed lines
+    rleImage->Modified();
+    nDiff = 0;
+    for (unsigned i = 0; i < nSamples; i++)
+        if (rleImage->GetPixel(samples[i]) != itkImage->GetPixel(samples[i]))
+            nDiff++;
+    std::cout << "Number of samples with difference after rebuilding the index: " << nDiff
+        << std::endl << std::endl;
+    nTotalDiff += nDiff;
+
+    rleImage->SetUseSegmentIndex(false);
+    return nTotalDiff;
+}
+
+//relabels the nonzero pixels in the second half of each line,
+//returns the number of pixels that differ from the itk image
+unsigned long testTransformLineInterval(shortRLEImage::Pointer rleImage, Seg3DImageType::Pointer itkImage)
+{
+    itk::TimeProbe tp;
+    shortRLEImage::RegionType reg = rleImage->GetLargestPossibleRegion();
+    long nx = reg.GetSize(0);
+    auto relabel = [](short value) { return short(value ? value + 1 : 0); };
+
+    std::cout << "TransformLineInterval: "; tp.Start();
+    itk::ImageRegionIterator<shortRLEImage::BufferType> it(rleImage->GetBuffer(),
+        rleImage->GetBuffer()->GetBufferedRegion());
+    for (; !it.IsAtEnd(); ++it)
+        rleImage->TransformLineInterval(it.Value(), nx / 2, nx,
+            [&](short value, long) { return relabel(value); });
+    tp.Stop(); std::cout << tp.GetMean() * 1000 << " ms " << std::endl; tp.Reset();
+
+    for (itk::ImageRegionIteratorWithIndex<Seg3DImageType> iit(itkImage, reg); !iit.IsAtEnd(); ++iit)
+        if (iit.GetIndex()[0] - reg.GetIndex(0) >= nx / 2)
+            iit.Set(relabel(iit.Get()));
+
+    unsigned nDiff = 0;
+    itk::ImageRegionConstIterator<shortRLEImage> rit(rleImage, reg);
+    itk::ImageRegionConstIterator<Seg3DImageType> iit(itkImage, reg);
+    for (; !rit.IsAtEnd(); ++rit, ++iit)
+        if (rit.Get() != iit.Get())
+            nDiff++;
+    std::cout << "Number of pixels with difference after TransformLineInterval: " << nDiff
+        << std::endl << std::endl;
+    return nDiff;
 }
 
 int main(int argc, char* argv[])
 {
+    if (argc < 2)
+    {
+        std::cout << "Usage:\n" << argv[0] << " InputSegmentation3D.ext" << std::endl;
+        return 1;
+    }
+
     itk::TimeProbe tp;
     std::cout << "Loading image: "; tp.Start();
     Seg3DImageType::Pointer inImage = loadImage(argv[1]);
@@ -134,12 +361,18 @@ int main(int argc, char* argv[])
     tp.Stop(); std::cout << tp.GetMean() * 1000 << " ms " << std::endl; tp.Reset();
 
     //Test all 6 permutations of axes
-    test4bools(test, inImage, inImage->GetBufferedRegion().GetSize(2) / 2, 2, 1, 0);
-    test4bools(test, inImage, inImage->GetBufferedRegion().GetSize(2) / 2, 2, 0, 1);
-    test4bools(test, inImage, inImage->GetBufferedRegion().GetSize(1) / 2, 1, 2, 0);
-    test4bools(test, inImage, inImage->GetBufferedRegion().GetSize(1) / 2, 1, 0, 2);
-    test4bools(test, inImage, inImage->GetBufferedRegion().GetSize(0) / 2, 0, 2, 1);
-    test4bools(test, inImage, inImage->GetBufferedRegion().GetSize(0) / 2, 0, 1, 2);
-    std::cout << "All tests finished!";
-    getchar();
+    unsigned long nDiff = 0;
+    nDiff += test4bools(test, inImage, inImage->GetBufferedRegion().GetSize(2) / 2, 2, 1, 0);
+    nDiff += test4bools(test, inImage, inImage->GetBufferedRegion().GetSize(2) / 2, 2, 0, 1);
+    nDiff += test4bools(test, inImage, inImage->GetBufferedRegion().GetSize(1) / 2, 1, 2, 0);
+    nDiff += test4bools(test, inImage, inImage->GetBufferedRegion().GetSize(1) / 2, 1, 0, 2);
+    nDiff += test4bools(test, inImage, inImage->GetBufferedRegion().GetSize(0) / 2, 0, 2, 1);
+    nDiff += test4bools(test, inImage, inImage->GetBufferedRegion().GetSize(0) / 2, 0, 1, 2);
+
+    nDiff += testSlicerCursorsAcrossEdits(test, inImage);
+    nDiff += testTransformLineInterval(test, inImage);
+    nDiff += benchmarkGetPixel(test, inImage, 1000000);
+
+    std::cout << "All tests finished, " << nDiff << " differences" << std::endl;
+    return nDiff == 0 ? 0 : 1;
 }